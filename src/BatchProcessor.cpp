@@ -0,0 +1,228 @@
+#include "BatchProcessor.h"
+
+BatchProcessor::BatchProcessor(std::shared_ptr<WebModel> modelToUse,
+                               const juce::Array<juce::File>& inputFiles,
+                               const Options& batchOptions)
+    : model(modelToUse), options(batchOptions)
+{
+    ctrlValuesResult = model->getCtrlValues(ctrlValues);
+
+    for (const auto& file : inputFiles)
+    {
+        Item item;
+        item.input = file;
+        item.output = options.outputDirectory.getChildFile(file.getFileNameWithoutExtension()
+                                                           + options.outputSuffix
+                                                           + file.getFileExtension());
+        items.push_back(item);
+    }
+}
+
+juce::Array<juce::File> BatchProcessor::findInputFiles(const juce::File& directory,
+                                                       const juce::StringArray& extensions)
+{
+    juce::Array<juce::File> files;
+
+    for (const auto& file : directory.findChildFiles(juce::File::findFiles, false))
+    {
+        if (extensions.contains(file.getFileExtension(), true))
+            files.add(file);
+    }
+
+    // Process them in a predictable order
+    files.sort();
+    return files;
+}
+
+BatchProcessor::Item BatchProcessor::getItem(int index) const
+{
+    std::lock_guard<std::mutex> lock(itemsMutex);
+    return items[(size_t) index];
+}
+
+void BatchProcessor::notifyItemChanged(int index)
+{
+    if (itemCallback)
+        itemCallback(index, getItem(index));
+}
+
+BatchProcessor::Report BatchProcessor::run(const ItemCallback& onItemChanged)
+{
+    itemCallback = onItemChanged;
+    nextItem = 0;
+
+    double startMs = juce::Time::getMillisecondCounterHiRes();
+
+    if (! options.outputDirectory.createDirectory())
+    {
+        LogAndDBG("BatchProcessor: could not create "
+                  + options.outputDirectory.getFullPathName());
+    }
+
+    if (ctrlValuesResult.failed())
+    {
+        // None of the files can be processed
+        std::lock_guard<std::mutex> lock(itemsMutex);
+        for (auto& item : items)
+        {
+            item.result = ctrlValuesResult;
+            item.status = ModelStatus::ERROR;
+        }
+    }
+    else
+    {
+        // Every job that finishes submits the next file,
+        // so at most maxConcurrentJobs jobs are in flight at any time
+        int numJobs =
+            juce::jlimit(1, juce::jmax(1, (int) items.size()), options.maxConcurrentJobs);
+        for (int i = 0; i < numJobs; ++i)
+            startNextItem();
+    }
+
+    {
+        std::unique_lock<std::mutex> lock(itemsMutex);
+        allJobsFinished.wait(lock, [this] { return numJobsInFlight == 0; });
+    }
+
+    Report report;
+    report.numFiles = (int) items.size();
+    report.elapsedMs = juce::Time::getMillisecondCounterHiRes() - startMs;
+
+    std::lock_guard<std::mutex> lock(itemsMutex);
+    for (auto& item : items)
+    {
+        if (item.status == ModelStatus::FINISHED)
+        {
+            report.numSucceeded++;
+            report.bytesProcessed += item.inputBytes;
+        }
+        else if (item.status == ModelStatus::ERROR)
+        {
+            report.numFailed++;
+        }
+        else
+        {
+            // Skipped or aborted because the batch was stopped
+            item.status = ModelStatus::CANCELLED;
+        }
+    }
+
+    LogAndDBG(report.toString());
+    return report;
+}
+
+void BatchProcessor::startNextItem()
+{
+    int index = nextItem++;
+    if (index >= (int) items.size() || shouldStop)
+        return;
+
+    double startMs = juce::Time::getMillisecondCounterHiRes();
+
+    juce::File input, output;
+    {
+        std::lock_guard<std::mutex> lock(itemsMutex);
+        Item& item = items[(size_t) index];
+        item.status = ModelStatus::STARTING;
+        item.inputBytes = item.input.getSize();
+        input = item.input;
+        output = item.output;
+        numJobsInFlight++;
+    }
+    notifyItemChanged(index);
+
+    auto context = std::make_shared<ProcessContext>();
+    ProcessContext* contextPtr = context.get();
+    context->cancellation = cancellation;
+    context->ctrlValues = ctrlValues;
+    context->onChange = [this, index, contextPtr]
+    {
+        {
+            std::lock_guard<std::mutex> lock(itemsMutex);
+            items[(size_t) index].status = contextPtr->status.load();
+            items[(size_t) index].progress = contextPtr->progress.load();
+        }
+        notifyItemChanged(index);
+    };
+
+    // WebModel processes the file it's given in place, so we give it a copy
+    auto copyInput = [input, output]
+    {
+        if (input.copyFileTo(output))
+            return OpResult::ok();
+
+        Error error;
+        error.type = ErrorType::FileUploadError;
+        error.devMessage =
+            "Failed to copy " + input.getFullPathName() + " to " + output.getFullPathName();
+        return OpResult::fail(error);
+    };
+
+    std::vector<JobScheduler::Stage> stages;
+    stages.push_back({ "copy", copyInput });
+    for (auto& stage : model->makeProcessStages(output, context))
+        stages.push_back(std::move(stage));
+
+    auto job = JobScheduler::getInstance()->submit(model->getGradioClient().getSpaceInfo().gradio,
+                                                   JobScheduler::Priority::Batch,
+                                                   std::move(stages),
+                                                   cancellation);
+
+    job.then(
+        [this, index, context, startMs](const OpResult& result)
+        {
+            // Keep the pipeline full before this job is counted as finished,
+            // since run() (and this object) can be gone right after that
+            startNextItem();
+            finishItem(index, *context, result, startMs);
+        });
+}
+
+void BatchProcessor::finishItem(int index,
+                                ProcessContext& context,
+                                const OpResult& result,
+                                double startMs)
+{
+    juce::File input, output;
+    {
+        std::lock_guard<std::mutex> lock(itemsMutex);
+        input = items[(size_t) index].input;
+        output = items[(size_t) index].output;
+    }
+
+    juce::File labelsFile;
+    if (result.wasOk() && context.labelsJson.isNotEmpty())
+    {
+        labelsFile = output.withFileExtension(".labels.json");
+        labelsFile.replaceWithText(context.labelsJson);
+    }
+
+    if (result.failed())
+    {
+        output.deleteFile();
+        LogAndDBG("BatchProcessor: " + input.getFileName() + " failed: "
+                      + result.getError().devMessage,
+                  HarpLogger::Level::Error);
+        context.trace.setError(result.getError().devMessage);
+    }
+    context.trace.write();
+
+    {
+        std::lock_guard<std::mutex> lock(itemsMutex);
+        Item& item = items[(size_t) index];
+        item.result = result;
+        item.labelsFile = labelsFile;
+        if (result.wasOk())
+            item.status = ModelStatus::FINISHED;
+        else if (CancellationToken::isCancellation(result))
+            item.status = ModelStatus::CANCELLED;
+        else
+            item.status = ModelStatus::ERROR;
+        item.elapsedMs = juce::Time::getMillisecondCounterHiRes() - startMs;
+    }
+    notifyItemChanged(index);
+
+    std::lock_guard<std::mutex> lock(itemsMutex);
+    numJobsInFlight--;
+    allJobsFinished.notify_all();
+}
@@ -0,0 +1,137 @@
+/**
+ * @file
+ * @brief Processes many files through one loaded WebModel, with a bounded
+ * number of concurrent jobs, per-file status and a throughput report
+ */
+
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "JobScheduler.h"
+#include "WebModel.h"
+#include "juce_core/juce_core.h"
+
+class BatchProcessor
+{
+public:
+    struct Options
+    {
+        // Number of files that are uploaded/processed/downloaded at the same time.
+        // Their stages run on the JobScheduler, behind any interactive job
+        int maxConcurrentJobs = 4;
+        // Where the outputs are written. The inputs are never modified
+        juce::File outputDirectory;
+        // Appended to the name of each input file, e.g song.wav -> song_harp.wav
+        juce::String outputSuffix = "_harp";
+    };
+
+    struct Item
+    {
+        juce::File input;
+        juce::File output;
+        // Only written if the app returned labels
+        juce::File labelsFile;
+        ModelStatus status = ModelStatus::INITIALIZED;
+        float progress = -1.0f;
+        OpResult result = OpResult::ok();
+        juce::int64 inputBytes = 0;
+        double elapsedMs = 0.0;
+
+        bool isDone() const
+        {
+            return status == ModelStatus::FINISHED || status == ModelStatus::ERROR
+                   || status == ModelStatus::CANCELLED;
+        }
+    };
+
+    struct Report
+    {
+        int numFiles = 0;
+        int numSucceeded = 0;
+        int numFailed = 0;
+        // Total size of the inputs that were processed successfully
+        juce::int64 bytesProcessed = 0;
+        double elapsedMs = 0.0;
+
+        double getFilesPerMinute() const
+        {
+            return elapsedMs > 0.0 ? numSucceeded / (elapsedMs / 60000.0) : 0.0;
+        }
+
+        double getBytesPerSecond() const
+        {
+            return elapsedMs > 0.0 ? bytesProcessed / (elapsedMs / 1000.0) : 0.0;
+        }
+
+        juce::String toString() const
+        {
+            return "Batch: " + juce::String(numSucceeded) + "/" + juce::String(numFiles)
+                   + " files processed, " + juce::String(numFailed) + " failed, in "
+                   + juce::String(elapsedMs / 1000.0, 1) + " s ("
+                   + juce::String(getFilesPerMinute(), 1) + " files/min, "
+                   + juce::String(getBytesPerSecond() / 1024.0, 1) + " KB/s)";
+        }
+    };
+
+    // Called from the JobScheduler's threads whenever the status of an item changes
+    using ItemCallback = std::function<void(int index, const Item& item)>;
+
+    // Takes the values of the model's controls, which all the files are processed
+    // with. Construct it on the thread that edits the controls
+    BatchProcessor(std::shared_ptr<WebModel> model,
+                   const juce::Array<juce::File>& inputFiles,
+                   const Options& options);
+
+    // All the files of directory (not recursive) with one of the given extensions (e.g ".wav")
+    static juce::Array<juce::File> findInputFiles(const juce::File& directory,
+                                                  const juce::StringArray& extensions);
+
+    /*
+    * Processes all the files and blocks until they are done.
+    * A failing file doesn't stop the others, its error is kept in its Item.
+    */
+    Report run(const ItemCallback& onItemChanged = nullptr);
+
+    /*
+    * Files that haven't started yet are skipped, and the requests of the
+    * running jobs are aborted. A stopped BatchProcessor can't be run again.
+    */
+    void stop()
+    {
+        shouldStop = true;
+        cancellation->cancel();
+    }
+
+    int getNumItems() const { return (int) items.size(); }
+    Item getItem(int index) const;
+
+private:
+    // Submits the next file to the JobScheduler, unless there are none left
+    void startNextItem();
+    void finishItem(int index, ProcessContext& context, const OpResult& result, double startMs);
+    void notifyItemChanged(int index);
+
+    std::shared_ptr<WebModel> model;
+    Options options;
+    // See ProcessContext::ctrlValues
+    juce::var ctrlValues;
+    OpResult ctrlValuesResult = OpResult::ok();
+
+    mutable std::mutex itemsMutex;
+    std::vector<Item> items;
+
+    std::atomic<int> nextItem { 0 };
+    std::atomic<bool> shouldStop { false };
+    // Jobs submitted and not finished yet, guarded by itemsMutex
+    int numJobsInFlight = 0;
+    std::condition_variable allJobsFinished;
+    // Shared by the contexts of all the jobs
+    const std::shared_ptr<CancellationToken> cancellation { std::make_shared<CancellationToken>() };
+    ItemCallback itemCallback;
+};
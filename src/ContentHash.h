@@ -0,0 +1,212 @@
+/**
+ * @file
+ * @brief Fast content hashing (XXH64) used to key the upload, result and media caches
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+
+#include "juce_core/juce_core.h"
+
+/*
+* A streaming implementation of the 64-bit xxHash algorithm.
+* It is not a cryptographic hash, but it is fast enough to hash
+* hour-long multichannel audio files before every upload,
+* and collisions are practically impossible for our use.
+*/
+class ContentHash
+{
+public:
+    explicit ContentHash(uint64_t seedToUse = 0) { reset(seedToUse); }
+
+    void reset(uint64_t seedToUse = 0)
+    {
+        seed = seedToUse;
+        acc[0] = seed + prime1 + prime2;
+        acc[1] = seed + prime2;
+        acc[2] = seed;
+        acc[3] = seed - prime1;
+        totalLength = 0;
+        bufferSize = 0;
+    }
+
+    void update(const void* data, size_t numBytes)
+    {
+        auto* p = static_cast<const uint8_t*>(data);
+        const uint8_t* end = p + numBytes;
+        totalLength += numBytes;
+
+        // Not enough for a full stripe yet, keep it for later
+        if (bufferSize + numBytes < stripeSize)
+        {
+            std::memcpy(buffer + bufferSize, p, numBytes);
+            bufferSize += numBytes;
+            return;
+        }
+
+        if (bufferSize > 0)
+        {
+            size_t numToFill = stripeSize - bufferSize;
+            std::memcpy(buffer + bufferSize, p, numToFill);
+            processStripe(buffer);
+            p += numToFill;
+            bufferSize = 0;
+        }
+
+        while (p + stripeSize <= end)
+        {
+            processStripe(p);
+            p += stripeSize;
+        }
+
+        bufferSize = (size_t) (end - p);
+        std::memcpy(buffer, p, bufferSize);
+    }
+
+    void update(const juce::String& text)
+    {
+        update(text.toRawUTF8(), text.getNumBytesAsUTF8());
+    }
+
+    uint64_t digest() const
+    {
+        uint64_t h;
+
+        if (totalLength >= stripeSize)
+        {
+            h = rotl(acc[0], 1) + rotl(acc[1], 7) + rotl(acc[2], 12) + rotl(acc[3], 18);
+            for (auto a : acc)
+                h = mergeRound(h, a);
+        }
+        else
+        {
+            h = seed + prime5;
+        }
+
+        h += totalLength;
+
+        const uint8_t* p = buffer;
+        const uint8_t* end = buffer + bufferSize;
+
+        while (p + 8 <= end)
+        {
+            h ^= round(0, read64(p));
+            h = rotl(h, 27) * prime1 + prime4;
+            p += 8;
+        }
+
+        if (p + 4 <= end)
+        {
+            h ^= (uint64_t) read32(p) * prime1;
+            h = rotl(h, 23) * prime2 + prime3;
+            p += 4;
+        }
+
+        while (p < end)
+        {
+            h ^= (uint64_t) (*p) * prime5;
+            h = rotl(h, 11) * prime1;
+            ++p;
+        }
+
+        h ^= h >> 33;
+        h *= prime2;
+        h ^= h >> 29;
+        h *= prime3;
+        h ^= h >> 32;
+        return h;
+    }
+
+    juce::String toString() const { return toString(digest()); }
+
+    static juce::String toString(uint64_t hash)
+    {
+        return juce::String::toHexString((juce::int64) hash).paddedLeft('0', 16);
+    }
+
+    static uint64_t hashString(const juce::String& text)
+    {
+        ContentHash hasher;
+        hasher.update(text);
+        return hasher.digest();
+    }
+
+    /*
+    * Hashes the contents of a file. The file is memory-mapped when possible,
+    * so that the OS can page it in as we go.
+    * Returns false if the file couldn't be read.
+    */
+    static bool hashFile(const juce::File& file, uint64_t& hash)
+    {
+        ContentHash hasher;
+        juce::MemoryMappedFile mappedFile(file, juce::MemoryMappedFile::readOnly);
+
+        if (mappedFile.getData() != nullptr)
+        {
+            hasher.update(mappedFile.getData(), mappedFile.getSize());
+        }
+        else
+        {
+            // Empty or unmappable file
+            juce::FileInputStream input(file);
+            if (! input.openedOk())
+                return false;
+
+            juce::HeapBlock<char> chunk(1 << 16);
+            for (;;)
+            {
+                int numRead = input.read(chunk.getData(), 1 << 16);
+                if (numRead <= 0)
+                    break;
+                hasher.update(chunk.getData(), (size_t) numRead);
+            }
+        }
+
+        hash = hasher.digest();
+        return true;
+    }
+
+private:
+    static constexpr uint64_t prime1 = 0x9E3779B185EBCA87ULL;
+    static constexpr uint64_t prime2 = 0xC2B2AE3D27D4EB4FULL;
+    static constexpr uint64_t prime3 = 0x165667B19E3779F9ULL;
+    static constexpr uint64_t prime4 = 0x85EBCA77C2B2AE63ULL;
+    static constexpr uint64_t prime5 = 0x27D4EB2F165667C5ULL;
+    static constexpr size_t stripeSize = 32;
+
+    static uint64_t rotl(uint64_t x, int r) { return (x << r) | (x >> (64 - r)); }
+
+    static uint64_t read64(const uint8_t* p)
+    {
+        return (uint64_t) juce::ByteOrder::littleEndianInt64(p);
+    }
+
+    static uint32_t read32(const uint8_t* p) { return juce::ByteOrder::littleEndianInt(p); }
+
+    static uint64_t round(uint64_t accumulator, uint64_t input)
+    {
+        accumulator += input * prime2;
+        accumulator = rotl(accumulator, 31);
+        return accumulator * prime1;
+    }
+
+    static uint64_t mergeRound(uint64_t h, uint64_t value)
+    {
+        h ^= round(0, value);
+        return h * prime1 + prime4;
+    }
+
+    void processStripe(const uint8_t* p)
+    {
+        for (int i = 0; i < 4; ++i)
+            acc[i] = round(acc[i], read64(p + 8 * i));
+    }
+
+    uint64_t seed = 0;
+    uint64_t acc[4];
+    uint64_t totalLength = 0;
+    uint8_t buffer[stripeSize];
+    size_t bufferSize = 0;
+};
@@ -2,26 +2,318 @@
 
 JUCE_IMPLEMENT_SINGLETON(HarpLogger)
 
+namespace
+{
+// A power of two
+const size_t queueCapacity = 8192;
+
+// How often the writer wakes up when nobody asks it to
+const int writeIntervalMs = 200;
+} // namespace
+
+/*
+* A bounded multi producer, single consumer queue (Vyukov's). Every slot has a
+* sequence number that tells whether it is free for the producer at a given
+* position, or holds a record for the consumer, so pushing only takes a
+* compare and swap on the tail and never waits for other producers.
+*/
+class HarpLogger::RecordQueue
+{
+public:
+    explicit RecordQueue(size_t capacity)
+        : slots(new Slot[capacity]), mask(capacity - 1)
+    {
+        jassert(juce::isPowerOfTwo(capacity));
+        for (size_t i = 0; i < capacity; ++i)
+            slots[i].sequence.store(i, std::memory_order_relaxed);
+    }
+
+    // False if the queue is full
+    bool push(juce::String&& record)
+    {
+        size_t position = tail.load(std::memory_order_relaxed);
+        Slot* slot = nullptr;
+        for (;;)
+        {
+            slot = &slots[position & mask];
+            size_t sequence = slot->sequence.load(std::memory_order_acquire);
+            auto diff = (std::ptrdiff_t) sequence - (std::ptrdiff_t) position;
+            if (diff == 0)
+            {
+                if (tail.compare_exchange_weak(position, position + 1, std::memory_order_relaxed))
+                    break;
+            }
+            else if (diff < 0)
+            {
+                return false;
+            }
+            else
+            {
+                position = tail.load(std::memory_order_relaxed);
+            }
+        }
+
+        slot->record = std::move(record);
+        slot->sequence.store(position + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Only called by the writer thread
+    bool pop(juce::String& record)
+    {
+        Slot& slot = slots[head & mask];
+        if (slot.sequence.load(std::memory_order_acquire) != head + 1)
+            return false;
+
+        record = std::move(slot.record);
+        slot.sequence.store(head + mask + 1, std::memory_order_release);
+        head++;
+        return true;
+    }
+
+    size_t getApproximateSize() const
+    {
+        return tail.load(std::memory_order_relaxed) - headSnapshot.load(std::memory_order_relaxed);
+    }
+
+    void publishHead() { headSnapshot.store(head, std::memory_order_relaxed); }
+
+    size_t getCapacity() const { return mask + 1; }
+
+private:
+    struct Slot
+    {
+        std::atomic<size_t> sequence { 0 };
+        juce::String record;
+    };
+
+    std::unique_ptr<Slot[]> slots;
+    const size_t mask;
+
+    alignas(64) std::atomic<size_t> tail { 0 };
+    alignas(64) size_t head = 0;
+    std::atomic<size_t> headSnapshot { 0 };
+};
+
+class HarpLogger::Writer : public juce::Thread
+{
+public:
+    explicit Writer(HarpLogger& ownerToUse) : juce::Thread("HARP logger"), owner(ownerToUse) {}
+
+    void run() override
+    {
+        while (! threadShouldExit())
+        {
+            wait(writeIntervalMs);
+            owner.writeQueuedRecords();
+        }
+        // Whatever was logged while we were asked to stop
+        owner.writeQueuedRecords();
+    }
+
+private:
+    HarpLogger& owner;
+};
+
+HarpLogger::HarpLogger() : queue(std::make_unique<RecordQueue>(queueCapacity)) {}
+
 HarpLogger::~HarpLogger()
 {
-    logger.reset(); // Explicitly reset the unique pointer to release the FileLogger
+    started = false;
+    if (writer != nullptr)
+    {
+        writer->signalThreadShouldExit();
+        writer->notify();
+        writer->stopThread(2000);
+    }
     clearSingletonInstance();
 }
 
+const char* HarpLogger::getLevelName(Level level)
+{
+    switch (level)
+    {
+        case Level::Debug:
+            return "DEBUG";
+        case Level::Warning:
+            return "WARN ";
+        case Level::Error:
+            return "ERROR";
+        case Level::Info:
+        default:
+            return "INFO ";
+    }
+}
+
+bool HarpLogger::passesRateLimit(Level level)
+{
+    if (level == Level::Error)
+        return true;
+
+    // One second windows. Racing threads may let a few extra messages through
+    juce::uint32 second = juce::Time::getMillisecondCounter() / 1000;
+    juce::uint32 window = rateWindow.load(std::memory_order_relaxed);
+    if (window != second && rateWindow.compare_exchange_strong(window, second))
+        numInRateWindow.store(0, std::memory_order_relaxed);
+
+    if (numInRateWindow.fetch_add(1, std::memory_order_relaxed) < rateLimit.load())
+        return true;
+
+    numRateLimited++;
+    return false;
+}
+
 // Log a message
-void HarpLogger::LogAndDBG(const juce::String& message) const
+void HarpLogger::LogAndDBG(const juce::String& message, Level level)
 {
-    if (logger)
+    if (! started.load(std::memory_order_acquire) || level < minimumLevel.load())
+        return;
+
+    DBG(message);
+
+    if (! passesRateLimit(level))
+        return;
+
+    juce::String record =
+        juce::Time::getCurrentTime().toISO8601(true) + " " + getLevelName(level) + " " + message;
+
+    if (! queue->push(std::move(record)))
     {
-        DBG(message);
-        logger->logMessage(message);
+        numDropped++;
+        return;
     }
+    numQueued++;
+
+    // Errors should reach the file even if we crash soon after, and a filling
+    // queue should be emptied before it overflows. Anything else waits for the
+    // writer's next round, so that logging stays free of locks
+    if (level == Level::Error || queue->getApproximateSize() > queue->getCapacity() / 2)
+        writer->notify();
 }
 
 // Initialize the logger
 void HarpLogger::initializeLogger()
 {
-    logger.reset(juce::FileLogger::createDefaultAppLogger("HARP", "harp.log", "hello, harp!"));
+    if (started)
+        return;
+
+    // The same file juce::FileLogger::createDefaultAppLogger used
+    logFile = juce::FileLogger::getSystemLogFileFolder()
+                  .getChildFile("HARP")
+                  .getChildFile("harp.log");
+    logFile.getParentDirectory().createDirectory();
+
+    writer = std::make_unique<Writer>(*this);
+    writer->startThread();
+    started.store(true, std::memory_order_release);
+
+    LogAndDBG("hello, harp!");
+}
+
+void HarpLogger::setRotation(juce::int64 maxBytes, int maxFiles)
+{
+    jassert(! started);
+    maxFileBytes = maxBytes;
+    maxRotatedFiles = maxFiles;
+}
+
+void HarpLogger::flush(int timeoutMs)
+{
+    if (writer == nullptr)
+        return;
+
+    juce::uint64 target = numQueued;
+    writer->notify();
+
+    double deadline = juce::Time::getMillisecondCounterHiRes() + timeoutMs;
+    for (;;)
+    {
+        // Reset before checking, so that a batch written in between still wakes us up
+        batchWritten.reset();
+        if (numWritten >= target)
+            return;
+
+        int remainingMs = (int) (deadline - juce::Time::getMillisecondCounterHiRes());
+        if (remainingMs <= 0 || ! writer->isThreadRunning())
+            return;
+        batchWritten.wait(remainingMs);
+    }
+}
+
+void HarpLogger::writeQueuedRecords()
+{
+    juce::MemoryOutputStream batch;
+    juce::uint64 numInBatch = 0;
+
+    juce::String record;
+    while (queue->pop(record))
+    {
+        batch << record << juce::newLine;
+        numInBatch++;
+    }
+    queue->publishHead();
+
+    juce::uint64 dropped = numDropped;
+    if (dropped != numDroppedReported)
+    {
+        batch << juce::Time::getCurrentTime().toISO8601(true) << " WARN  HarpLogger: dropped "
+              << juce::String(dropped - numDroppedReported)
+              << " messages, the log queue was full" << juce::newLine;
+        numDroppedReported = dropped;
+    }
+
+    juce::uint64 rateLimited = numRateLimited;
+    if (rateLimited != numRateLimitedReported)
+    {
+        batch << juce::Time::getCurrentTime().toISO8601(true) << " WARN  HarpLogger: skipped "
+              << juce::String(rateLimited - numRateLimitedReported)
+              << " messages over the rate limit" << juce::newLine;
+        numRateLimitedReported = rateLimited;
+    }
+
+    if (batch.getDataSize() > 0)
+    {
+        rotateIfNeeded(batch.getDataSize());
+
+        // One write and one flush per batch, however many messages it holds
+        juce::FileOutputStream out(logFile);
+        if (out.openedOk())
+        {
+            out.write(batch.getData(), batch.getDataSize());
+            out.flush();
+        }
+    }
+
+    numWritten += numInBatch;
+    batchWritten.signal();
+}
+
+void HarpLogger::rotateIfNeeded(size_t bytesToWrite)
+{
+    if (logFile.getSize() + (juce::int64) bytesToWrite <= maxFileBytes)
+        return;
+
+    // harp.log -> harp.1.log -> harp.2.log ..., the oldest one is deleted
+    auto getRotatedFile = [this](int index)
+    {
+        return logFile.getSiblingFile(logFile.getFileNameWithoutExtension() + "."
+                                      + juce::String(index) + logFile.getFileExtension());
+    };
+
+    if (maxRotatedFiles <= 0)
+    {
+        logFile.deleteFile();
+        return;
+    }
+
+    getRotatedFile(maxRotatedFiles).deleteFile();
+    for (int i = maxRotatedFiles - 1; i >= 1; --i)
+    {
+        juce::File rotated = getRotatedFile(i);
+        if (rotated.existsAsFile())
+            rotated.moveFileTo(getRotatedFile(i + 1));
+    }
+    logFile.moveFileTo(getRotatedFile(1));
 }
 
-juce::File HarpLogger::getLogFile() const { return logger->getLogFile(); }
\ No newline at end of file
+juce::File HarpLogger::getLogFile() const { return logFile; }
@@ -1,5 +1,15 @@
+/**
+ * @file
+ * @brief The HARP log (harp.log). Logging only formats the message and pushes
+ * it into a lock-free queue; a background thread writes the queued messages
+ * to the file in batches and rotates it when it gets too big
+ */
+
 #pragma once
 
+#include <atomic>
+#include <memory>
+
 #include <juce_core/juce_core.h>
 #include <juce_events/juce_events.h>
 
@@ -19,22 +29,92 @@ public:
     HarpLogger(const HarpLogger&) = delete;
     HarpLogger& operator=(const HarpLogger&) = delete;
 
-    void LogAndDBG(const juce::String& message) const;
+    enum class Level
+    {
+        Debug,
+        Info,
+        Warning,
+        Error,
+    };
 
+    /*
+    * Never blocks and never touches the disk, so it can be called from any
+    * thread. Messages below the minimum level are ignored, and messages below
+    * Error are dropped when more than the rate limit arrive in a second.
+    * If the queue is full the message is dropped and counted, see getNumDropped.
+    * Messages logged before initializeLogger are ignored.
+    */
+    void LogAndDBG(const juce::String& message, Level level = Level::Info);
+
+    // Starts the writer thread. Does nothing if the logger is already running
     void initializeLogger();
 
+    // Blocks until everything logged so far is in the file, or timeoutMs has passed
+    void flush(int timeoutMs = 1000);
+
+    void setMinimumLevel(Level level) { minimumLevel = level; }
+    Level getMinimumLevel() const { return minimumLevel; }
+
+    // Messages per second, not counting errors
+    void setRateLimit(int maxMessagesPerSecond) { rateLimit = maxMessagesPerSecond; }
+
+    // Not thread safe, call before initializeLogger
+    void setRotation(juce::int64 maxFileBytes, int maxRotatedFiles);
+
+    // Messages lost because the queue was full
+    juce::uint64 getNumDropped() const { return numDropped; }
+    juce::uint64 getNumRateLimited() const { return numRateLimited; }
+
     juce::File getLogFile() const;
 
 private:
     // Private constructor to prevent instantiation from outside
-    HarpLogger() = default;
+    HarpLogger();
+
+    class RecordQueue;
+    class Writer;
+
+    bool passesRateLimit(Level level);
+
+    // Called on the writer thread
+    void writeQueuedRecords();
+    void rotateIfNeeded(size_t bytesToWrite);
+
+    static const char* getLevelName(Level level);
+
+    std::unique_ptr<RecordQueue> queue;
+    std::unique_ptr<Writer> writer;
+    std::atomic<bool> started { false };
+
+    juce::File logFile;
+    juce::int64 maxFileBytes = 5 * 1024 * 1024;
+    int maxRotatedFiles = 3;
+
+#if JUCE_DEBUG
+    std::atomic<Level> minimumLevel { Level::Debug };
+#else
+    std::atomic<Level> minimumLevel { Level::Info };
+#endif
+
+    std::atomic<int> rateLimit { 200 };
+    std::atomic<juce::uint32> rateWindow { 0 };
+    std::atomic<int> numInRateWindow { 0 };
 
-    std::unique_ptr<juce::FileLogger> logger { nullptr };
+    std::atomic<juce::uint64> numQueued { 0 };
+    std::atomic<juce::uint64> numWritten { 0 };
+    std::atomic<juce::uint64> numDropped { 0 };
+    std::atomic<juce::uint64> numRateLimited { 0 };
+    // Signalled by the writer thread after every batch, see flush
+    juce::WaitableEvent batchWritten { true };
+    // Only touched by the writer thread
+    juce::uint64 numDroppedReported = 0;
+    juce::uint64 numRateLimitedReported = 0;
 };
 
 // Function for easier access to logging
 // without having to write HarpLogger::getInstance()->LogAndDBG(message) every time
-inline void LogAndDBG(const juce::String& message)
+inline void LogAndDBG(const juce::String& message,
+                      HarpLogger::Level level = HarpLogger::Level::Info)
 {
-    HarpLogger::getInstance()->LogAndDBG(message);
-}
\ No newline at end of file
+    HarpLogger::getInstance()->LogAndDBG(message, level);
+}
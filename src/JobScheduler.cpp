@@ -0,0 +1,357 @@
+#include "JobScheduler.h"
+
+JUCE_IMPLEMENT_SINGLETON(JobScheduler)
+
+struct JobScheduler::Job
+{
+    JobId id = 0;
+    juce::String space;
+    Priority priority = Priority::Interactive;
+    std::vector<Stage> stages;
+    // Only touched by the thread that runs the job's current stage
+    size_t nextStage = 0;
+    std::shared_ptr<CancellationToken> cancellation;
+
+    std::mutex mutex;
+    JobStatus status = JobStatus::Queued;
+    std::promise<OpResult> promise;
+    std::shared_future<OpResult> future { promise.get_future().share() };
+    std::vector<Continuation> continuations;
+
+    bool isDone() const
+    {
+        return status == JobStatus::Finished || status == JobStatus::Failed
+               || status == JobStatus::Cancelled;
+    }
+};
+
+JobScheduler::JobId JobScheduler::JobHandle::getId() const { return job != nullptr ? job->id : 0; }
+
+JobScheduler::JobStatus JobScheduler::JobHandle::getStatus() const
+{
+    jassert(job != nullptr);
+    std::lock_guard<std::mutex> lock(job->mutex);
+    return job->status;
+}
+
+bool JobScheduler::JobHandle::isDone() const
+{
+    jassert(job != nullptr);
+    std::lock_guard<std::mutex> lock(job->mutex);
+    return job->isDone();
+}
+
+OpResult JobScheduler::JobHandle::wait() const
+{
+    jassert(job != nullptr);
+    return job->future.get();
+}
+
+std::shared_future<OpResult> JobScheduler::JobHandle::getFuture() const
+{
+    jassert(job != nullptr);
+    return job->future;
+}
+
+void JobScheduler::JobHandle::then(Continuation continuation) const
+{
+    jassert(job != nullptr);
+    {
+        std::lock_guard<std::mutex> lock(job->mutex);
+        if (! job->isDone())
+        {
+            job->continuations.push_back(std::move(continuation));
+            return;
+        }
+    }
+    continuation(job->future.get());
+}
+
+juce::String JobScheduler::Stats::toString() const
+{
+    return "JobScheduler: " + juce::String(numSubmitted) + " jobs submitted, "
+           + juce::String(numFinished) + " finished, " + juce::String(numFailed) + " failed, "
+           + juce::String(numCancelled) + " cancelled | queue depth " + juce::String(queueDepth)
+           + " (max " + juce::String(maxQueueDepth) + "), " + juce::String(numRunningTasks)
+           + " running | queue wait avg " + juce::String(getAverageQueueWaitMs(), 1)
+           + " ms / max " + juce::String(maxQueueWaitMs, 1) + " ms";
+}
+
+JobScheduler::JobScheduler()
+{
+    // Most stages spend their time waiting on the network, not on the cpu
+    int numThreads = juce::jmax(8, juce::SystemStats::getNumCpus());
+    for (int i = 0; i < numThreads; ++i)
+        workers.emplace_back([this] { workerLoop(); });
+}
+
+JobScheduler::~JobScheduler()
+{
+    std::vector<std::shared_ptr<Job>> jobsToCancel;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        shuttingDown = true;
+        for (auto& [id, job] : activeJobs)
+            jobsToCancel.push_back(job);
+    }
+
+    // Abort the running stages, so that joining doesn't wait on the network
+    for (auto& job : jobsToCancel)
+        job->cancellation->cancel();
+
+    taskAvailable.notify_all();
+    for (auto& worker : workers)
+        worker.join();
+
+    // Whatever didn't get to run is cancelled
+    std::vector<Task> leftovers;
+    for (auto& queue : queues)
+    {
+        leftovers.insert(leftovers.end(), queue.begin(), queue.end());
+        queue.clear();
+    }
+    for (auto& task : leftovers)
+        finishJob(task.job, OpResult::fail(CancellationToken::makeError("Job")));
+
+    clearSingletonInstance();
+}
+
+JobScheduler::JobHandle JobScheduler::submit(const juce::String& space,
+                                             Priority priority,
+                                             std::vector<Stage> stages,
+                                             std::shared_ptr<CancellationToken> cancellation)
+{
+    auto job = std::make_shared<Job>();
+    job->space = space;
+    job->priority = priority;
+    job->stages = std::move(stages);
+    // Every job gets a token, so that cancel() and the destructor can abort it
+    job->cancellation =
+        cancellation != nullptr ? std::move(cancellation) : std::make_shared<CancellationToken>();
+
+    bool rejected = false;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        job->id = nextJobId++;
+        stats.numSubmitted++;
+
+        if (shuttingDown)
+        {
+            rejected = true;
+        }
+        else if (! job->stages.empty())
+        {
+            activeJobs[job->id] = job;
+            pushTask(job, false);
+        }
+    }
+
+    if (rejected)
+        finishJob(job, OpResult::fail(CancellationToken::makeError("Job")));
+    else if (job->stages.empty())
+        finishJob(job, OpResult::ok());
+    else
+        taskAvailable.notify_one();
+
+    return JobHandle(job);
+}
+
+bool JobScheduler::cancel(JobId id)
+{
+    std::shared_ptr<Job> job;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto it = activeJobs.find(id);
+        if (it == activeJobs.end())
+            return false;
+        job = it->second;
+    }
+
+    job->cancellation->cancel();
+
+    // A queued stage of the job no longer has to wait for a slot of its space
+    taskAvailable.notify_all();
+    return true;
+}
+
+int JobScheduler::getQueueDepth() const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return stats.queueDepth;
+}
+
+JobScheduler::Stats JobScheduler::getStats() const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return stats;
+}
+
+void JobScheduler::setMaxTasksPerSpace(int maxTasks)
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        maxTasksPerSpace = juce::jmax(1, maxTasks);
+    }
+    taskAvailable.notify_all();
+}
+
+int JobScheduler::getMaxTasksPerSpace() const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return maxTasksPerSpace;
+}
+
+void JobScheduler::pushTask(const std::shared_ptr<Job>& job, bool atFront)
+{
+    Task task;
+    task.job = job;
+    task.queuedMs = juce::Time::getMillisecondCounterHiRes();
+
+    auto& queue = queues[(size_t) job->priority];
+    if (atFront)
+        queue.push_front(task);
+    else
+        queue.push_back(task);
+
+    stats.queueDepth++;
+    stats.maxQueueDepth = juce::jmax(stats.maxQueueDepth, stats.queueDepth);
+}
+
+bool JobScheduler::popRunnableTask(Task& task)
+{
+    // Interactive tasks first, then batch tasks, each in queue order,
+    // skipping the ones whose space is already busy enough
+    for (auto& queue : queues)
+    {
+        for (auto it = queue.begin(); it != queue.end(); ++it)
+        {
+            const auto& job = it->job;
+
+            // Cancelled jobs only need a thread to be wrapped up, not a slot of their space
+            if (! job->cancellation->isCancelled()
+                && runningTasksPerSpace[job->space] >= maxTasksPerSpace)
+                continue;
+
+            task = *it;
+            queue.erase(it);
+            runningTasksPerSpace[task.job->space]++;
+            stats.queueDepth--;
+            stats.numRunningTasks++;
+            return true;
+        }
+    }
+    return false;
+}
+
+void JobScheduler::workerLoop()
+{
+    for (;;)
+    {
+        Task task;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            taskAvailable.wait(lock, [&] { return shuttingDown || popRunnableTask(task); });
+
+            // The destructor wraps up whatever is still queued
+            if (task.job == nullptr)
+                return;
+        }
+        runTask(task);
+    }
+}
+
+void JobScheduler::runTask(Task& task)
+{
+    auto& job = task.job;
+    double queueWaitMs = juce::Time::getMillisecondCounterHiRes() - task.queuedMs;
+
+    {
+        std::lock_guard<std::mutex> lock(job->mutex);
+        job->status = JobStatus::Running;
+    }
+
+    OpResult result = OpResult::ok();
+    const Stage& stage = job->stages[job->nextStage];
+
+    if (job->cancellation->isCancelled())
+    {
+        result = OpResult::fail(CancellationToken::makeError("Job " + juce::String(job->id)));
+    }
+    else
+    {
+        try
+        {
+            result = stage.run();
+        }
+        catch (...)
+        {
+            // One bad job shouldn't take a worker down
+            Error error;
+            error.type = ErrorType::UnknownError;
+            error.devMessage = "Unexpected exception in the " + stage.name + " stage of job "
+                               + juce::String(job->id);
+            result = OpResult::fail(error);
+        }
+    }
+    job->nextStage++;
+
+    bool isDone = result.failed() || job->nextStage >= job->stages.size();
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        runningTasksPerSpace[job->space]--;
+        stats.numRunningTasks--;
+        stats.numTasksRun++;
+        stats.totalQueueWaitMs += queueWaitMs;
+        stats.maxQueueWaitMs = juce::jmax(stats.maxQueueWaitMs, queueWaitMs);
+
+        if (! isDone && shuttingDown)
+        {
+            result = OpResult::fail(CancellationToken::makeError("Job " + juce::String(job->id)));
+            isDone = true;
+        }
+        else if (! isDone)
+        {
+            // The next stage goes to the front of the queue,
+            // so that the jobs that are under way finish first
+            pushTask(job, true);
+        }
+    }
+
+    // A slot of the space was freed, and maybe another stage was queued
+    taskAvailable.notify_all();
+
+    if (isDone)
+        finishJob(job, result);
+}
+
+void JobScheduler::finishJob(const std::shared_ptr<Job>& job, const OpResult& result)
+{
+    JobStatus status = JobStatus::Finished;
+    if (CancellationToken::isCancellation(result)
+        || (result.failed() && job->cancellation->isCancelled()))
+        status = JobStatus::Cancelled;
+    else if (result.failed())
+        status = JobStatus::Failed;
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        activeJobs.erase(job->id);
+        if (status == JobStatus::Finished)
+            stats.numFinished++;
+        else if (status == JobStatus::Failed)
+            stats.numFailed++;
+        else
+            stats.numCancelled++;
+    }
+
+    std::vector<Continuation> continuations;
+    {
+        std::lock_guard<std::mutex> lock(job->mutex);
+        job->status = status;
+        job->promise.set_value(result);
+        continuations.swap(job->continuations);
+    }
+
+    for (auto& continuation : continuations)
+        continuation(result);
+}
@@ -0,0 +1,170 @@
+/**
+ * @file
+ * @brief Runs processing jobs on a shared pool of threads. A job is a chain of
+ * stages (e.g upload, call, poll, download), and every stage is scheduled as its
+ * own task, so that the network waits of different jobs overlap
+ */
+
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <juce_core/juce_core.h>
+#include <juce_events/juce_events.h>
+
+#include "errors.h"
+#include "gradio/CancellationToken.h"
+
+class JobScheduler : private juce::DeletedAtShutdown
+{
+private:
+    struct Job;
+
+public:
+    JUCE_DECLARE_SINGLETON(JobScheduler, false)
+
+    using JobId = juce::int64;
+
+    enum class Priority
+    {
+        // Started from the GUI. Runs ahead of any queued batch work
+        Interactive,
+        Batch,
+    };
+
+    enum class JobStatus
+    {
+        Queued,
+        Running,
+        Finished,
+        Failed,
+        Cancelled,
+    };
+
+    // One step of a job. The stages of a job run in order, and a failing stage ends the job
+    struct Stage
+    {
+        juce::String name;
+        std::function<OpResult()> run;
+    };
+
+    using Continuation = std::function<void(const OpResult& result)>;
+
+    // A handle to a submitted job. Cheap to copy
+    class JobHandle
+    {
+    public:
+        JobHandle() = default;
+
+        bool isValid() const { return job != nullptr; }
+
+        JobId getId() const;
+        JobStatus getStatus() const;
+        bool isDone() const;
+
+        // Blocks until the job is done
+        OpResult wait() const;
+
+        std::shared_future<OpResult> getFuture() const;
+
+        /*
+        * Runs continuation once the job is done, on the thread that finished it.
+        * Continuations run in the order they were added. If the job is already
+        * done, continuation runs straight away on the calling thread.
+        */
+        void then(Continuation continuation) const;
+
+    private:
+        friend class JobScheduler;
+
+        explicit JobHandle(std::shared_ptr<Job> jobToHandle) : job(std::move(jobToHandle)) {}
+
+        std::shared_ptr<Job> job;
+    };
+
+    struct Stats
+    {
+        int numSubmitted = 0;
+        int numFinished = 0;
+        int numFailed = 0;
+        int numCancelled = 0;
+        // Stages waiting for a thread, or for a slot of their space
+        int queueDepth = 0;
+        int maxQueueDepth = 0;
+        int numRunningTasks = 0;
+        int numTasksRun = 0;
+        // Time the tasks spent in the queue
+        double totalQueueWaitMs = 0.0;
+        double maxQueueWaitMs = 0.0;
+
+        double getAverageQueueWaitMs() const
+        {
+            return numTasksRun > 0 ? totalQueueWaitMs / numTasksRun : 0.0;
+        }
+
+        juce::String toString() const;
+    };
+
+    ~JobScheduler() override;
+
+    JobScheduler(const JobScheduler&) = delete;
+    JobScheduler& operator=(const JobScheduler&) = delete;
+
+    /*
+    * Queues a job. space (e.g the gradio url) is only used to limit the
+    * number of stages that run against the same space at once.
+    * Cancelling the token aborts the running stage (if it passes the token
+    * on to its requests) and skips the rest; the job then ends up Cancelled.
+    */
+    JobHandle submit(const juce::String& space,
+                     Priority priority,
+                     std::vector<Stage> stages,
+                     std::shared_ptr<CancellationToken> cancellation = nullptr);
+
+    // Cancels a job that isn't done yet. Returns false if there is no such job
+    bool cancel(JobId id);
+
+    // Stages of all jobs that are waiting to run
+    int getQueueDepth() const;
+
+    Stats getStats() const;
+
+    void setMaxTasksPerSpace(int maxTasks);
+    int getMaxTasksPerSpace() const;
+
+private:
+    JobScheduler();
+
+    struct Task
+    {
+        std::shared_ptr<Job> job;
+        double queuedMs = 0.0;
+    };
+
+    void workerLoop();
+    // Called with the lock held
+    bool popRunnableTask(Task& task);
+    void pushTask(const std::shared_ptr<Job>& job, bool atFront);
+    void runTask(Task& task);
+    void finishJob(const std::shared_ptr<Job>& job, const OpResult& result);
+
+    mutable std::mutex mutex;
+    std::condition_variable taskAvailable;
+    // One queue per Priority
+    std::deque<Task> queues[2];
+    std::map<juce::String, int> runningTasksPerSpace;
+    std::map<JobId, std::shared_ptr<Job>> activeJobs;
+    std::vector<std::thread> workers;
+    bool shuttingDown = false;
+    int maxTasksPerSpace = 4;
+    JobId nextJobId = 1;
+    Stats stats;
+};
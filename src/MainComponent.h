@@ -12,12 +12,15 @@
 #include <juce_gui_basics/juce_gui_basics.h>
 #include <juce_gui_extra/juce_gui_extra.h>
 
+#include "BatchProcessor.h"
+#include "PipelineRunner.h"
 #include "CtrlComponent.h"
-#include "ThreadPoolJob.h"
+#include "SpaceProber.h"
 #include "WebModel.h"
 
 #include "gui/CustomPathDialog.h"
 #include "gui/HoverHandler.h"
+#include "gui/ModelPathLookAndFeel.h"
 #include "gui/MultiButton.h"
 #include "gui/StatusComponent.h"
 #include "gui/TitledTextBox.h"
@@ -25,10 +28,12 @@
 #include "gradio/GradioClient.h"
 
 #include "HarpLogger.h"
+#include "Metrics.h"
 #include "external/magic_enum.hpp"
 #include "media/AudioDisplayComponent.h"
 #include "media/MediaDisplayComponent.h"
 #include "media/MidiDisplayComponent.h"
+#include "media/VersionStore.h"
 using namespace juce;
 
 // this only calls the callback ONCE
@@ -102,7 +107,9 @@ public:
         saveAs = 0x2002,
         about = 0x2003,
         undo = 0x2005,
-        redo = 0x2006
+        redo = 0x2006,
+        batchProcess = 0x2007,
+        processChain = 0x2008
         // settings = 0x2004,
     };
 
@@ -129,6 +136,9 @@ public:
             menu.addCommandItem(&commandManager, CommandIDs::undo);
             menu.addCommandItem(&commandManager, CommandIDs::redo);
             menu.addSeparator();
+            menu.addCommandItem(&commandManager, CommandIDs::batchProcess);
+            menu.addCommandItem(&commandManager, CommandIDs::processChain);
+            menu.addSeparator();
             // menu.addCommandItem (&commandManager, CommandIDs::settings);
             // menu.addSeparator();
             menu.addCommandItem(&commandManager, CommandIDs::about);
@@ -147,8 +157,8 @@ public:
     void getAllCommands(Array<CommandID>& commands) override
     {
         const CommandID ids[] = {
-            CommandIDs::open, CommandIDs::save, CommandIDs::saveAs,
-            CommandIDs::undo, CommandIDs::redo, CommandIDs::about,
+            CommandIDs::open, CommandIDs::save,  CommandIDs::saveAs,       CommandIDs::undo,
+            CommandIDs::redo, CommandIDs::about, CommandIDs::batchProcess, CommandIDs::processChain,
         };
         commands.addArray(ids, numElementsInArray(ids));
     }
@@ -186,6 +196,18 @@ public:
             case CommandIDs::about:
                 result.setInfo("About HARP", "Shows information about the application", "About", 0);
                 break;
+            case CommandIDs::batchProcess:
+                result.setInfo("Batch Process Folder...",
+                               "Processes every file of a folder with the loaded model",
+                               "File",
+                               0);
+                break;
+            case CommandIDs::processChain:
+                result.setInfo("Process Through Chain...",
+                               "Processes the file with several models, one after the other",
+                               "File",
+                               0);
+                break;
         }
     }
 
@@ -218,6 +240,14 @@ public:
                 DBG("About command invoked");
                 showAboutDialog();
                 break;
+            case CommandIDs::batchProcess:
+                DBG("Batch process command invoked");
+                batchProcessCallback();
+                break;
+            case CommandIDs::processChain:
+                DBG("Process chain command invoked");
+                chainProcessCallback();
+                break;
             default:
                 return false;
         }
@@ -529,6 +559,8 @@ public:
                                     modelPathComboBox.setSelectedId(new_id);
                                     lastSelectedItemIndex = new_id - 1;
                                     lastLoadedModelItemIndex = new_id - 1;
+                                    // Keep it warm from now on, like the other saved models
+                                    SpaceProber::getInstance()->addSpace(customPath);
                                 }
                             }
                             else
@@ -541,7 +573,8 @@ public:
                 catch (Error& loadingError)
                 {
                     Error::fillUserMessage(loadingError);
-                    LogAndDBG("Error in Model Loading:\n" + loadingError.devMessage);
+                    LogAndDBG("Error in Model Loading:\n" + loadingError.devMessage,
+                              HarpLogger::Level::Error);
                     auto msgOpts =
                         MessageBoxOptions()
                             .withTitle("Loading Error")
@@ -583,6 +616,7 @@ public:
 
                         if (chosen == "Open HARP Logs")
                         {
+                            HarpLogger::getInstance()->flush();
                             HarpLogger::getInstance()->getLogFile().revealToUser();
                         }
                         else if (chosen == "Open Space URL")
@@ -703,6 +737,39 @@ public:
             modelPathComboBox.addItem(options[i], static_cast<int>(i) + 1);
         }
         lastSelectedItemIndex = -1;
+        updateModelPathReadiness();
+    }
+
+    // Shows the readiness and latency of every saved model in the drop-down menu,
+    // see SpaceProber
+    void updateModelPathReadiness()
+    {
+        std::map<String, String> modelPathReadiness;
+        // Item 0 is "custom path..."
+        for (int i = 1; i < modelPathComboBox.getNumItems(); ++i)
+        {
+            String path = modelPathComboBox.getItemText(i);
+            String readiness = SpaceProber::getInstance()->getState(path).toString();
+            if (readiness.isNotEmpty())
+                modelPathReadiness[path] = readiness;
+        }
+        modelPathLookAndFeel.setReadiness(std::move(modelPathReadiness));
+
+        if (modelPathComboBox.isMouseOver(true))
+            showModelPathInstructions();
+    }
+
+    void showModelPathInstructions()
+    {
+        String message = "A drop-down menu with some available models. Any new model you add "
+                         "will automatically be added to the list";
+
+        String path = modelPathComboBox.getText();
+        String readiness = modelPathLookAndFeel.getReadiness(path);
+        if (readiness.isNotEmpty())
+            message += " (" + path + ": " + readiness + ")";
+
+        setInstructions(message);
     }
 
     void focusCallback()
@@ -747,13 +814,32 @@ public:
     }
 
     explicit MainComponent(const URL& initialFilePath = URL())
-        : jobsFinished(0),
-          totalJobs(0),
-          jobProcessorThread(customJobs, jobsFinished, totalJobs, processBroadcaster)
     {
         // logger.reset(juce::FileLogger::createDefaultAppLogger("HARP", "harp.log", "hello, harp!"));
         HarpLogger::getInstance()->initializeLogger();
 
+        // Scraped by fleet monitoring, see Metrics
+        Metrics::getInstance()->startExporting(Metrics::getDefaultExportFile());
+        int metricsPort = juce::SystemStats::getEnvironmentVariable("HARP_METRICS_PORT", {})
+                              .getIntValue();
+        if (metricsPort > 0 && ! Metrics::getInstance()->startServer(metricsPort))
+            LogAndDBG("Could not serve the metrics on port " + juce::String(metricsPort),
+                      HarpLogger::Level::Warning);
+
+        // The disk space the undo history may take, 2 GB by default
+        int versionsBudgetMB =
+            juce::SystemStats::getEnvironmentVariable("HARP_VERSIONS_BUDGET_MB", {}).getIntValue();
+        juce::int64 versionsBudget = (juce::int64) versionsBudgetMB * 1024 * 1024;
+        if (versionsBudget > 0)
+            VersionStore::getInstance()->setByteBudget(versionsBudget);
+
+        // The disk space of the cached processing results, 2 GB by default
+        int resultsBudgetMB =
+            juce::SystemStats::getEnvironmentVariable("HARP_RESULT_CACHE_MB", {}).getIntValue();
+        juce::int64 resultsBudget = (juce::int64) resultsBudgetMB * 1024 * 1024;
+        if (resultsBudget > 0)
+            ResultCache::getInstance()->setByteBudget(resultsBudget);
+
         addAndMakeVisible(chooseFileButton);
         chooseFileButton.onClick = [this] { openFileChooser(); };
         chooseFileButtonHandler.onMouseEnter = [this]()
@@ -844,7 +930,6 @@ public:
             clearInstructions();
         };
 
-        processBroadcaster.addChangeListener(this);
         saveEnabled = false;
 
         loadModelButton.addMode(loadButtonInfo);
@@ -864,7 +949,8 @@ public:
             processCancelButton.setMode(processButtonInfo.label);
         }
         else if (currentStatus == ModelStatus::PROCESSING || currentStatus == ModelStatus::STARTING
-                 || currentStatus == ModelStatus::SENDING)
+                 || currentStatus == ModelStatus::SENDING
+                 || currentStatus == ModelStatus::DOWNLOADING)
         {
             processCancelButton.setEnabled(true);
             processCancelButton.setMode(cancelButtonInfo.label);
@@ -872,10 +958,12 @@ public:
 
         setStatus(currentStatus);
 
-        // add a status timer to update the status label periodically
-        mModelStatusTimer = std::make_unique<ModelStatusTimer>(model);
-        mModelStatusTimer->addChangeListener(this);
-        mModelStatusTimer->startTimer(50); // 100 ms interval
+        // Updates the status label whenever the status of the model changes
+        mModelStatusWatcher = std::make_unique<ModelStatusWatcher>(model);
+        mModelStatusWatcher->onStatusEvents =
+            [this](const std::vector<StatusChannel::Event>& events,
+                   ModelStatus status,
+                   float progress) { statusChanged(events, status, progress); };
 
         // model path textbox
         std::vector<std::string> modelPaths = {
@@ -910,11 +998,17 @@ public:
         {
             modelPathComboBox.addItem(modelPaths[i], static_cast<int>(i) + 1);
         }
-        modelPathComboBoxHandler.onMouseEnter = [this]()
-        {
-            setInstructions(
-                "A drop-down menu with some available models. Any new model you add will automatically be added to the list");
-        };
+
+        // Wake up the saved models in the background, so that switching to one
+        // doesn't have to wait for a cold start
+        StringArray spacesToProbe;
+        for (auto i = 1u; i < modelPaths.size(); ++i)
+            spacesToProbe.add(modelPaths[i]);
+        SpaceProber::getInstance()->addChangeListener(this);
+        SpaceProber::getInstance()->setSpaces(spacesToProbe);
+        SpaceProber::getInstance()->startProbing();
+        modelPathComboBox.setLookAndFeel(&modelPathLookAndFeel);
+        modelPathComboBoxHandler.onMouseEnter = [this]() { showModelPathInstructions(); };
         modelPathComboBoxHandler.onMouseExit = [this]() { clearInstructions(); };
         modelPathComboBoxHandler.attach();
 
@@ -965,6 +1059,19 @@ public:
         addAndMakeVisible(ctrlComponent);
         ctrlComponent.populateGui();
 
+        // load() shows the cached controls of a space straight away,
+        // and tells us if the space turns out to have different ones
+        Component::SafePointer<MainComponent> safeThis(this);
+        model->onSchemaChanged = [safeThis]
+        {
+            MessageManager::callAsync(
+                [safeThis]
+                {
+                    if (safeThis != nullptr)
+                        safeThis->updateSchemaIfIdle();
+                });
+        };
+
         addAndMakeVisible(nameLabel);
         addAndMakeVisible(authorLabel);
         addAndMakeVisible(descriptionLabel);
@@ -978,8 +1085,6 @@ public:
         auto& card = model->card();
         setModelCard(card);
 
-        jobProcessorThread.startThread();
-
         // ARA requires that plugin editors are resizable to support tight integration
         // into the host UI
         setOpaque(true);
@@ -992,16 +1097,16 @@ public:
         mediaDisplay->removeChangeListener(this);
 
         // remove listeners
-        mModelStatusTimer->removeChangeListener(this);
+        mModelStatusWatcher.reset();
         loadBroadcaster.removeChangeListener(this);
-        processBroadcaster.removeChangeListener(this);
+        SpaceProber::getInstance()->removeChangeListener(this);
+        modelPathComboBox.setLookAndFeel(nullptr);
 
-        jobProcessorThread.signalThreadShouldExit();
-        // This will not actually run any processing task
-        // It'll just make sure that the thread is not waiting
-        // and it'll allow it to check for the threadShouldExit flag
-        jobProcessorThread.signalTask();
-        jobProcessorThread.waitForThreadToExit(-1);
+        // Abort the batch, if one is running
+        if (batchProcessor != nullptr)
+            batchProcessor->stop();
+        if (chainRunner != nullptr)
+            chainRunner->stop();
 
 #if JUCE_MAC
         MenuBarModel::setMacMainMenu(nullptr);
@@ -1012,6 +1117,42 @@ public:
     void cancelCallback()
     {
         DBG("HARPProcessorEditor::buttonClicked cancel button listener activated");
+        if (waitingForTempFile)
+        {
+            // Processing didn't start yet, so there is nothing to cancel
+            waitingForTempFile = false;
+            processCancelButton.setEnabled(false);
+            if (chainRunner != nullptr)
+            {
+                // Stops the apps that are still loading
+                chainRunner->stop();
+                chainRunner.reset();
+                loadModelButton.setEnabled(true);
+            }
+
+            // The new version is still being copied in the background, so it
+            // is only removed once the copy is done with it
+            Component::SafePointer<MainComponent> safeThis(this);
+            mediaDisplay->whenTempFileReady(
+                [safeThis](bool)
+                {
+                    if (safeThis == nullptr)
+                        return;
+                    safeThis->mediaDisplay->iteratePreviousTempFile();
+                    safeThis->mediaDisplay->clearFutureTempFiles();
+                    safeThis->resetProcessingButtons();
+                });
+            return;
+        }
+
+        if (chainRunner != nullptr)
+        {
+            // chainFinished rolls back the temp file once the running step stops
+            chainRunner->stop();
+            processCancelButton.setEnabled(false);
+            return;
+        }
+
         OpResult cancelResult = model->cancel();
         if (cancelResult.failed())
         {
@@ -1088,41 +1229,451 @@ public:
         }
 
         mediaDisplay->addNewTempFile();
+        lastTraceSummary.clear();
 
-        // print how many jobs are currently in the threadpool
-        LogAndDBG("threadPool.getNumJobs: " + std::to_string(threadPool.getNumJobs()));
+        LogAndDBG(JobScheduler::getInstance()->getStats().toString());
 
-        // empty customJobs
-        customJobs.clear();
+        // The temp file is copied in the background, so processing starts
+        // once it's complete
+        waitingForTempFile = true;
+        Component::SafePointer<MainComponent> safeThis(this);
+        mediaDisplay->whenTempFileReady(
+            [safeThis](bool copied)
+            {
+                if (safeThis != nullptr && safeThis->waitingForTempFile)
+                    safeThis->startProcessing(copied);
+            });
+    }
+
+    void startProcessing(bool tempFileCopied)
+    {
+        waitingForTempFile = false;
+
+        if (! tempFileCopied)
+        {
+            // MediaDisplayComponent already told the user
+            mediaDisplay->iteratePreviousTempFile();
+            mediaDisplay->clearFutureTempFiles();
+            resetProcessingButtons();
+            return;
+        }
+
+        // The stages of the job run on the JobScheduler. We pick up
+        // the result on the message thread once the last one is done
+        Component::SafePointer<MainComponent> safeThis(this);
+        model->processAsync(mediaDisplay->getTempFilePath().getLocalFile())
+            .then(
+                [safeThis](const OpResult& result)
+                {
+                    MessageManager::callAsync(
+                        [safeThis, result]
+                        {
+                            if (safeThis != nullptr)
+                                safeThis->processingFinished(result);
+                        });
+                });
+    }
+
+    void processingFinished(OpResult processingResult)
+    {
+        if (CancellationToken::isCancellation(processingResult))
+        {
+            // cancelCallback already rolled back the temp file
+            LogAndDBG(processingResult.getError().devMessage);
+            model->getLastTrace().write();
+            resetProcessingButtons();
+            return;
+        }
 
-        customJobs.push_back(new CustomThreadPoolJob([this] { // &jobsFinished, totalJobs
-            // Individual job code for each iteration
-            // copy the audio file, with the same filename except for an added _harp to the stem
-            OpResult processingResult =
-                model->process(mediaDisplay->getTempFilePath().getLocalFile());
-            if (processingResult.failed())
+        if (processingResult.failed())
+        {
+            Error processingError = processingResult.getError();
+            Error::fillUserMessage(processingError);
+            LogAndDBG("Error in Processing:\n" + processingError.devMessage,
+                      HarpLogger::Level::Error);
+            model->getLastTrace().write();
+            AlertWindow::showMessageBoxAsync(AlertWindow::WarningIcon,
+                                             "Processing Error",
+                                             "An error occurred while processing the audio file: \n"
+                                                 + processingError.userMessage);
+            resetProcessingButtons();
+            return;
+        }
+
+        // The processed file goes into the version store before it's shown,
+        // as that moves it
+        double reloadStartMs = Time::getMillisecondCounterHiRes();
+        mediaDisplay->commitTempFile();
+
+        Component::SafePointer<MainComponent> safeThis(this);
+        mediaDisplay->whenTempFileReady(
+            [safeThis, reloadStartMs](bool)
+            {
+                // If it couldn't be stored, the version stays where it was processed
+                if (safeThis != nullptr)
+                    safeThis->showProcessedFile(reloadStartMs);
+            });
+    }
+
+    void showProcessedFile(double reloadStartMs)
+    {
+        // refresh the display for the new updated file
+        URL tempFilePath = mediaDisplay->getTempFilePath();
+        mediaDisplay->updateDisplay(tempFilePath);
+
+        // extract generated labels from the model
+        LabelList& labels = model->getLabels();
+
+        // add the labels to the display component
+        mediaDisplay->addLabels(labels);
+
+        // The display loads in the background, so the reload only ends once
+        // the new version is completely drawn
+        Component::SafePointer<MainComponent> safeThis(this);
+        PipelineTrace trace = model->getLastTrace();
+        mediaDisplay->whenMediaDrawn(
+            [safeThis, trace, reloadStartMs]() mutable
             {
-                Error processingError = processingResult.getError();
-                Error::fillUserMessage(processingError);
-                LogAndDBG("Error in Processing:\n" + processingError.devMessage.toStdString());
-                AlertWindow::showMessageBoxAsync(
-                    AlertWindow::WarningIcon,
-                    "Processing Error",
-                    "An error occurred while processing the audio file: \n"
-                        + processingError.userMessage);
-                // cb: I commented this out, and it doesn't seem to change anything
-                // it was also causing a crash. If we need it, it needs to run on
-                // the message thread using MessageManager::callAsync
-                // resetProcessingButtons();
-                return;
+                trace.add("reload", Time::getMillisecondCounterHiRes() - reloadStartMs);
+                trace.write();
+
+                if (safeThis != nullptr && safeThis->model->getStatus() == ModelStatus::FINISHED)
+                {
+                    safeThis->lastTraceSummary = trace.getSummary();
+                    safeThis->setStatus(ModelStatus::FINISHED);
+                }
+            });
+        setStatus(ModelStatus::FINISHED);
+
+        // now, we can enable the process button
+        resetProcessingButtons();
+    }
+
+    void batchProcessCallback()
+    {
+        ModelStatus currentStatus = model->getStatus();
+        if (currentStatus != ModelStatus::LOADED && currentStatus != ModelStatus::FINISHED)
+        {
+            AlertWindow::showMessageBoxAsync(
+                AlertWindow::WarningIcon,
+                "Error",
+                "Model is not loaded or is busy. Please load a model first.");
+            return;
+        }
+
+        if (batchProcessor != nullptr)
+        {
+            AlertWindow::showMessageBoxAsync(
+                AlertWindow::InfoIcon, "Batch Processing", "A batch is already running.");
+            return;
+        }
+
+        batchFolderBrowser = std::make_unique<FileChooser>("Select a folder to process...");
+        batchFolderBrowser->launchAsync(
+            FileBrowserComponent::openMode | FileBrowserComponent::canSelectDirectories,
+            [this](const FileChooser& browser)
+            {
+                File folder = browser.getResult();
+                if (folder == File {})
+                    return;
+                startBatch(folder);
+            });
+    }
+
+    // Processes every supported file of folder into folder/harp_output,
+    // on the loading thread pool so that the model can't be swapped mid-batch
+    void startBatch(const File& folder)
+    {
+        StringArray extensions = model->card().midi_in ? midiExtensions : audioExtensions;
+        Array<File> inputFiles = BatchProcessor::findInputFiles(folder, extensions);
+
+        if (inputFiles.isEmpty())
+        {
+            AlertWindow::showMessageBoxAsync(AlertWindow::WarningIcon,
+                                             "Batch Processing",
+                                             "No supported files found in "
+                                                 + folder.getFullPathName());
+            return;
+        }
+
+        BatchProcessor::Options options;
+        options.outputDirectory = folder.getChildFile("harp_output");
+        batchProcessor = std::make_shared<BatchProcessor>(model, inputFiles, options);
+
+        loadModelButton.setEnabled(false);
+        setStatus("Batch: starting " + String(inputFiles.size()) + " files");
+
+        Component::SafePointer<MainComponent> safeThis(this);
+        auto batch = batchProcessor;
+        threadPool.addJob(
+            [safeThis, batch]
+            {
+                std::atomic<int> numDone { 0 };
+                auto onItemChanged = [safeThis, batch, &numDone](int,
+                                                                 const BatchProcessor::Item& item)
+                {
+                    if (! item.isDone())
+                        return;
+                    String message = "Batch: " + String(++numDone) + "/"
+                                     + String(batch->getNumItems()) + " done ("
+                                     + item.input.getFileName() + ")";
+                    MessageManager::callAsync(
+                        [safeThis, message]
+                        {
+                            if (safeThis != nullptr)
+                                safeThis->setStatus(message);
+                        });
+                };
+
+                BatchProcessor::Report report = batch->run(onItemChanged);
+
+                MessageManager::callAsync(
+                    [safeThis, report]
+                    {
+                        if (safeThis == nullptr)
+                            return;
+                        safeThis->batchProcessor.reset();
+                        safeThis->loadModelButton.setEnabled(true);
+                        safeThis->updateSchemaIfIdle();
+                        safeThis->setStatus(report.toString());
+                        if (report.numFailed > 0)
+                        {
+                            AlertWindow::showMessageBoxAsync(
+                                AlertWindow::WarningIcon,
+                                "Batch Processing",
+                                String(report.numFailed)
+                                    + " file(s) failed to process. See the log for details.");
+                        }
+                    });
+            });
+    }
+
+    void chainProcessCallback()
+    {
+        if (! mediaDisplay->isFileLoaded())
+        {
+            AlertWindow::showMessageBoxAsync(
+                AlertWindow::WarningIcon,
+                "Error",
+                "Audio file is not loaded. Please load an audio file first.");
+            return;
+        }
+
+        ModelStatus currentStatus = model->getStatus();
+        if (isProcessing || batchProcessor != nullptr
+            || (currentStatus != ModelStatus::LOADED && currentStatus != ModelStatus::FINISHED))
+        {
+            AlertWindow::showMessageBoxAsync(
+                AlertWindow::WarningIcon,
+                "Error",
+                "Model is not loaded or is busy. Please load a model first.");
+            return;
+        }
+
+        auto* chainWindow = new AlertWindow(
+            "Process Through Chain",
+            "The file is processed by each model in turn, the output of one being the input of "
+            "the next. Enter one model per line, optionally followed by control values:\n"
+            "hugggof/harmonic_percussive; Pitch Shift=3",
+            AlertWindow::NoIcon);
+
+        // Starts with the loaded model, but its controls have to be given like the others
+        chainWindow->addTextEditor("steps", model->getGradioClient().getSpaceInfo().userInput);
+        if (auto* stepsEditor = chainWindow->getTextEditor("steps"))
+        {
+            stepsEditor->setMultiLine(true);
+            stepsEditor->setReturnKeyStartsNewLine(true);
+            stepsEditor->setSize(400, 120);
+        }
+        chainWindow->addButton("Process", 1);
+        chainWindow->addButton("Cancel", 0, KeyPress(KeyPress::escapeKey));
+
+        Component::SafePointer<MainComponent> safeThis(this);
+        chainWindow->enterModalState(
+            true,
+            new CustomPathAlertCallback(
+                [safeThis, chainWindow](int result)
+                {
+                    String text = chainWindow->getTextEditorContents("steps");
+                    delete chainWindow;
+
+                    if (result == 1 && safeThis != nullptr)
+                        safeThis->startChain(parseChainSteps(text));
+                }),
+            false);
+    }
+
+    // One step per line: the model, then its control values as "label=value", separated by ';'
+    static std::vector<PipelineRunner::Step> parseChainSteps(const String& text)
+    {
+        std::vector<PipelineRunner::Step> steps;
+        StringArray lines;
+        lines.addLines(text);
+
+        for (const auto& line : lines)
+        {
+            StringArray parts;
+            parts.addTokens(line, ";", "\"");
+            parts.trim();
+            parts.removeEmptyStrings();
+            if (parts.isEmpty())
+                continue;
+
+            PipelineRunner::Step step;
+            step.space = parts[0];
+            for (int i = 1; i < parts.size(); ++i)
+            {
+                step.ctrlValues.push_back(
+                    { parts[i].upToFirstOccurrenceOf("=", false, false).trim(),
+                      parts[i].fromFirstOccurrenceOf("=", false, false).trim().unquoted() });
             }
-            // load the audio file again
-            processBroadcaster.sendChangeMessage();
+            steps.push_back(step);
+        }
+        return steps;
+    }
+
+    // Like processCallback, with a PipelineRunner of the steps instead of the loaded model
+    void startChain(const std::vector<PipelineRunner::Step>& steps)
+    {
+        if (steps.empty())
+            return;
+
+        processCancelButton.setEnabled(true);
+        processCancelButton.setMode(cancelButtonInfo.label);
+        loadModelButton.setEnabled(false);
+        saveEnabled = false;
+        isProcessing = true;
+
+        // The models load (and wake up) while the temp file is copied
+        chainRunner = std::make_shared<PipelineRunner>(steps);
+        chainRunner->startLoading();
+
+        mediaDisplay->addNewTempFile();
+        lastTraceSummary.clear();
+        setStatus("Chain: loading " + String((int) steps.size()) + " models");
+
+        waitingForTempFile = true;
+        Component::SafePointer<MainComponent> safeThis(this);
+        auto runner = chainRunner;
+        mediaDisplay->whenTempFileReady(
+            [safeThis, runner](bool copied)
+            {
+                if (safeThis != nullptr && safeThis->waitingForTempFile
+                    && safeThis->chainRunner == runner)
+                    safeThis->runChain(copied);
+            });
+    }
+
+    // Runs the chain on the loading thread pool, so that the model can't be swapped meanwhile
+    void runChain(bool tempFileCopied)
+    {
+        waitingForTempFile = false;
+
+        if (! tempFileCopied)
+        {
+            // MediaDisplayComponent already told the user
+            mediaDisplay->iteratePreviousTempFile();
+            mediaDisplay->clearFutureTempFiles();
+            chainRunner.reset();
+            loadModelButton.setEnabled(true);
+            resetProcessingButtons();
+            return;
+        }
+
+        // The working file may share its data with a stored version, so the
+        // chain writes a file of its own, which then replaces it
+        File workingFile = mediaDisplay->getTempFilePath().getLocalFile();
+        File chainOutput = VersionStore::getInstance()->createWorkingFile(
+            workingFile.getFileNameWithoutExtension(), workingFile.getFileExtension());
+
+        Component::SafePointer<MainComponent> safeThis(this);
+        auto runner = chainRunner;
+        threadPool.addJob(
+            [safeThis, runner, workingFile, chainOutput]
+            {
+                auto onStepChanged = [safeThis, runner](int index,
+                                                        const PipelineRunner::StepResult& step)
+                {
+                    String message = "Chain: step " + String(index + 1) + "/"
+                                     + String(runner->getNumSteps()) + " (" + step.space + ") "
+                                     + String(std::string(magic_enum::enum_name(step.status)));
+                    if (step.progress >= 0.0f)
+                        message += " (" + String(roundToInt(step.progress * 100.0f)) + "%)";
+                    MessageManager::callAsync(
+                        [safeThis, message]
+                        {
+                            if (safeThis != nullptr && safeThis->chainRunner != nullptr)
+                                safeThis->setStatus(message);
+                        });
+                };
+
+                PipelineRunner::Report report =
+                    runner->run(workingFile, chainOutput, onStepChanged);
+                if (report.result.wasOk() && ! chainOutput.moveFileTo(workingFile))
+                {
+                    Error error;
+                    error.type = ErrorType::FileDownloadError;
+                    error.devMessage = "Failed to move " + chainOutput.getFullPathName() + " to "
+                                       + workingFile.getFullPathName();
+                    report.result = OpResult::fail(error);
+                }
+                chainOutput.deleteFile();
 
-        }));
+                MessageManager::callAsync(
+                    [safeThis, report]
+                    {
+                        if (safeThis != nullptr)
+                            safeThis->chainFinished(report);
+                    });
+            });
+    }
+
+    void chainFinished(const PipelineRunner::Report& report)
+    {
+        chainRunner.reset();
+        loadModelButton.setEnabled(true);
+        LogAndDBG(report.toString());
 
-        // Now the customJobs are ready to be added to be run in the threadPool
-        jobProcessorThread.signalTask();
+        if (report.result.failed())
+        {
+            mediaDisplay->iteratePreviousTempFile();
+            mediaDisplay->clearFutureTempFiles();
+        }
+
+        if (CancellationToken::isCancellation(report.result))
+        {
+            setStatus("Chain cancelled");
+            resetProcessingButtons();
+            return;
+        }
+
+        if (report.result.failed())
+        {
+            Error chainError = report.result.getError();
+            Error::fillUserMessage(chainError);
+            LogAndDBG("Error in Chain:\n" + chainError.devMessage, HarpLogger::Level::Error);
+            AlertWindow::showMessageBoxAsync(AlertWindow::WarningIcon,
+                                             "Processing Error",
+                                             "An error occurred while processing the audio file: \n"
+                                                 + chainError.userMessage);
+            setStatus(report.toString());
+            resetProcessingButtons();
+            return;
+        }
+
+        mediaDisplay->commitTempFile();
+
+        Component::SafePointer<MainComponent> safeThis(this);
+        String summary = report.toString();
+        mediaDisplay->whenTempFileReady(
+            [safeThis, summary](bool)
+            {
+                if (safeThis == nullptr)
+                    return;
+                safeThis->mediaDisplay->updateDisplay(safeThis->mediaDisplay->getTempFilePath());
+                safeThis->setStatus(summary);
+                safeThis->resetProcessingButtons();
+            });
     }
 
     void initializeMediaDisplay(int mediaType = 0)
@@ -1357,14 +1908,42 @@ public:
         }
     }
 
-    void setStatus(const ModelStatus& status)
+    void setStatus(const ModelStatus& status, float progress = -1.0f)
     {
         juce::String statusName = std::string(magic_enum::enum_name(status)).c_str();
-        statusArea.setStatusMessage("ModelStatus::" + statusName);
+        juce::String message = "ModelStatus::" + statusName;
+        if ((status == ModelStatus::PROCESSING || status == ModelStatus::DOWNLOADING)
+            && progress >= 0.0f)
+        {
+            message += " (" + juce::String(juce::roundToInt(progress * 100.0f)) + "%)";
+        }
+        if (status == ModelStatus::FINISHED && lastTraceSummary.isNotEmpty())
+        {
+            message += ", " + lastTraceSummary;
+        }
+        statusArea.setStatusMessage(message);
     }
 
     void setStatus(const juce::String& message) { statusArea.setStatusMessage(message); }
 
+    // Called by mModelStatusWatcher with the status changes since its last call
+    void statusChanged(const std::vector<StatusChannel::Event>& events,
+                       ModelStatus status,
+                       float progress)
+    {
+        for (const auto& event : events)
+        {
+            LogAndDBG("ModelStatus::"
+                          + juce::String(std::string(magic_enum::enum_name(event.status)))
+                          + " after " + juce::String(juce::roundToInt(event.previousStatusMs))
+                          + " ms in ModelStatus::"
+                          + juce::String(std::string(magic_enum::enum_name(event.previousStatus))),
+                      HarpLogger::Level::Debug);
+        }
+
+        setStatus(status, progress);
+    }
+
     void clearStatus() { statusArea.clearStatusMessage(); }
 
     void setInstructions(const juce::String& message)
@@ -1376,8 +1955,10 @@ public:
 
 private:
     // HARP UI
-    std::unique_ptr<ModelStatusTimer> mModelStatusTimer { nullptr };
+    std::unique_ptr<ModelStatusWatcher> mModelStatusWatcher { nullptr };
 
+    // Declared before modelPathComboBox, which uses it
+    ModelPathLookAndFeel modelPathLookAndFeel;
     ComboBox modelPathComboBox;
     // Two usefull variables to keep track of the selected item in the modelPathComboBox
     // and the item index of the last loaded model
@@ -1424,6 +2005,8 @@ private:
     // A flag that indicates if the audio file can be saved
     bool saveEnabled = true;
     bool isProcessing = false;
+    // Processing was requested, but the temp file is still being copied
+    bool waitingForTempFile = false;
 
     std::string customPath;
     CtrlComponent ctrlComponent;
@@ -1440,11 +2023,20 @@ private:
 
     Time lastLoadTime;
 
+    // Where the time of the last process call went, shown next to FINISHED
+    juce::String lastTraceSummary;
+
     // the model itself
     std::shared_ptr<WebModel> model { new WebModel() };
 
     std::unique_ptr<FileChooser> openFileBrowser;
     std::unique_ptr<FileChooser> saveFileBrowser;
+    std::unique_ptr<FileChooser> batchFolderBrowser;
+
+    // The batch that is currently running, if any
+    std::shared_ptr<BatchProcessor> batchProcessor;
+    // The chain that is currently running, if any
+    std::shared_ptr<PipelineRunner> chainRunner;
 
     std::unique_ptr<MediaDisplayComponent> mediaDisplay;
 
@@ -1453,17 +2045,11 @@ private:
     StringArray audioExtensions = AudioDisplayComponent::getSupportedExtensions();
     StringArray midiExtensions = MidiDisplayComponent::getSupportedExtensions();
 
-    /// CustomThreadPoolJob
     // This one is used for Loading the models
-    // The thread pull for Processing lives inside the JobProcessorThread
+    // Processing jobs run on the JobScheduler
     ThreadPool threadPool { 1 };
-    int jobsFinished;
-    int totalJobs;
-    JobProcessorThread jobProcessorThread;
-    std::vector<CustomThreadPoolJob*> customJobs;
 
     ChangeBroadcaster loadBroadcaster;
-    ChangeBroadcaster processBroadcaster;
 
     ApplicationCommandManager commandManager;
     // MenuBar
@@ -1493,6 +2079,29 @@ private:
         processCancelButton.setEnabled(true);
         saveEnabled = true;
         isProcessing = false;
+        updateSchemaIfIdle();
+        repaint();
+    }
+
+    // Switches to the controls found by the model's schema revalidation.
+    // Running jobs read the controls, so it waits until they are done
+    void updateSchemaIfIdle()
+    {
+        if (isProcessing || batchProcessor != nullptr || chainRunner != nullptr
+            || ! model->hasUpdatedSchema())
+            return;
+
+        OpResult result = model->applyUpdatedSchema();
+        if (result.failed())
+        {
+            LogAndDBG("Could not apply the updated controls: " + result.getError().devMessage);
+            return;
+        }
+
+        LogAndDBG("The controls of the model changed, updating them");
+        setModelCard(model->card());
+        ctrlComponent.populateGui();
+        resized();
         repaint();
     }
 
@@ -1539,29 +2148,11 @@ private:
 
         // else if (source == &loadBroadcaster)
 
-        // The processBroadcaster should be also replaced in a similar way
-        // as the loadBroadcaster
-        else if (source == &processBroadcaster)
-        {
-            // refresh the display for the new updated file
-            URL tempFilePath = mediaDisplay->getTempFilePath();
-            mediaDisplay->updateDisplay(tempFilePath);
-
-            // extract generated labels from the model
-            LabelList& labels = model->getLabels();
-
-            // add the labels to the display component
-            mediaDisplay->addLabels(labels);
-
-            // now, we can enable the process button
-            resetProcessingButtons();
-        }
-        else if (source == mModelStatusTimer.get())
+        // The processBroadcaster was replaced in a similar way,
+        // see processingFinished
+        else if (source == SpaceProber::getInstance())
         {
-            // update the status label
-            DBG("HARPProcessorEditor::changeListenerCallback: updating status label");
-            // statusLabel.setText(model->getStatus(), dontSendNotification);
-            setStatus(model->getStatus());
+            updateModelPathReadiness();
         }
         else
         {
@@ -1575,7 +2166,7 @@ private:
         {
             setModelCard(model->card());
             ctrlComponent.setModel(model);
-            mModelStatusTimer->setModel(model);
+            mModelStatusWatcher->setModel(model);
             ctrlComponent.populateGui();
             SpaceInfo spaceInfo = model->getGradioClient().getSpaceInfo();
             if (spaceInfo.status == SpaceInfo::Status::LOCALHOST)
@@ -0,0 +1,377 @@
+#include "Metrics.h"
+
+#include <algorithm>
+
+#include "external/magic_enum.hpp"
+
+JUCE_IMPLEMENT_SINGLETON(Metrics)
+
+namespace
+{
+juce::String escapeLabelValue(const juce::String& value)
+{
+    return value.replace("\\", "\\\\").replace("\"", "\\\"").replace("\n", "\\n");
+}
+
+// Adds a label to the formatted labels of a series, e.g le="250" to {stage="upload"}
+juce::String addLabel(const juce::String& labels, const juce::String& label)
+{
+    if (labels.isEmpty())
+        return "{" + label + "}";
+    return labels.dropLastCharacters(1) + "," + label + "}";
+}
+
+juce::var labelsToVar(const Metrics::Labels& labels)
+{
+    juce::DynamicObject::Ptr obj = new juce::DynamicObject();
+    for (const auto& [name, value] : labels)
+        obj->setProperty(name, value);
+    return juce::var(obj.get());
+}
+
+juce::String formatBound(double bound) { return juce::String(bound, bound < 10.0 ? 1 : 0); }
+} // namespace
+
+class Metrics::Exporter : public juce::Thread
+{
+public:
+    Exporter(const Metrics& ownerToUse, int intervalMsToUse)
+        : juce::Thread("HARP metrics exporter"), owner(ownerToUse), intervalMs(intervalMsToUse)
+    {
+    }
+
+    void run() override
+    {
+        while (! threadShouldExit())
+        {
+            wait(intervalMs);
+            owner.writeExportFile();
+        }
+    }
+
+private:
+    const Metrics& owner;
+    const int intervalMs;
+};
+
+class Metrics::Server : public juce::Thread
+{
+public:
+    explicit Server(const Metrics& ownerToUse)
+        : juce::Thread("HARP metrics server"), owner(ownerToUse)
+    {
+    }
+
+    ~Server() override { stop(); }
+
+    bool start(int port)
+    {
+        // Only reachable from this machine
+        if (! listener.createListener(port, "127.0.0.1"))
+            return false;
+        startThread();
+        return true;
+    }
+
+    void stop()
+    {
+        signalThreadShouldExit();
+        // Makes a blocked waitForNextConnection return
+        listener.close();
+        stopThread(2000);
+    }
+
+    void run() override
+    {
+        while (! threadShouldExit())
+        {
+            std::unique_ptr<juce::StreamingSocket> client(listener.waitForNextConnection());
+            if (client == nullptr || threadShouldExit())
+                continue;
+            respond(*client);
+        }
+    }
+
+private:
+    void respond(juce::StreamingSocket& client)
+    {
+        char buffer[2048] = {};
+        if (client.waitUntilReady(true, 1000) != 1)
+            return;
+        int numRead = client.read(buffer, (int) sizeof(buffer) - 1, false);
+        if (numRead <= 0)
+            return;
+
+        // e.g "GET /metrics HTTP/1.1"
+        juce::StringArray requestLine;
+        requestLine.addTokens(juce::String(buffer, (size_t) numRead).upToFirstOccurrenceOf(
+                                  "\r\n", false, false),
+                              " ",
+                              "");
+        juce::String path = requestLine[1].upToFirstOccurrenceOf("?", false, false);
+
+        juce::String status = "200 OK";
+        juce::String contentType = "text/plain; version=0.0.4";
+        juce::String body;
+        if (requestLine[0] != "GET")
+        {
+            status = "405 Method Not Allowed";
+        }
+        else if (path == "/metrics.json")
+        {
+            contentType = "application/json";
+            body = owner.toJson();
+        }
+        else if (path == "/metrics" || path == "/")
+        {
+            body = owner.toPrometheus();
+        }
+        else
+        {
+            status = "404 Not Found";
+        }
+
+        juce::MemoryBlock bodyData(body.toRawUTF8(), body.getNumBytesAsUTF8());
+        juce::String header = "HTTP/1.1 " + status + "\r\nContent-Type: " + contentType
+                              + "\r\nContent-Length: " + juce::String(bodyData.getSize())
+                              + "\r\nConnection: close\r\n\r\n";
+        client.write(header.toRawUTF8(), (int) header.getNumBytesAsUTF8());
+        client.write(bodyData.getData(), (int) bodyData.getSize());
+    }
+
+    const Metrics& owner;
+    juce::StreamingSocket listener;
+};
+
+const std::vector<double>& Metrics::Histogram::getBucketBounds()
+{
+    static const std::vector<double> bounds { 1,   2.5,  5,    10,   25,    50,    100,   250,
+                                              500, 1000, 2500, 5000, 10000, 30000, 60000, 120000 };
+    return bounds;
+}
+
+void Metrics::Histogram::observe(double valueMs)
+{
+    const auto& bounds = getBucketBounds();
+    size_t bucket = (size_t) (std::lower_bound(bounds.begin(), bounds.end(), valueMs)
+                              - bounds.begin());
+    buckets[bucket]++;
+    count++;
+
+    double currentSum = sum.load();
+    while (! sum.compare_exchange_weak(currentSum, currentSum + valueMs))
+    {
+    }
+}
+
+std::vector<juce::int64> Metrics::Histogram::getCumulativeCounts() const
+{
+    std::vector<juce::int64> cumulative;
+    juce::int64 total = 0;
+    for (const auto& bucket : buckets)
+    {
+        total += bucket.load();
+        cumulative.push_back(total);
+    }
+    return cumulative;
+}
+
+Metrics::Metrics() {}
+
+Metrics::~Metrics()
+{
+    stop();
+    clearSingletonInstance();
+}
+
+juce::String Metrics::formatLabels(const Labels& labels)
+{
+    if (labels.empty())
+        return {};
+
+    juce::StringArray parts;
+    for (const auto& [name, value] : labels)
+        parts.add(name + "=\"" + escapeLabelValue(value) + "\"");
+    return "{" + parts.joinIntoString(",") + "}";
+}
+
+Metrics::Counter& Metrics::counter(const juce::String& name, const Labels& labels)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    auto& entry = counters[name][formatLabels(labels)];
+    if (entry.series == nullptr)
+    {
+        entry.labels = labels;
+        entry.series = std::make_unique<Counter>();
+    }
+    return *entry.series;
+}
+
+Metrics::Histogram& Metrics::histogram(const juce::String& name, const Labels& labels)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    auto& entry = histograms[name][formatLabels(labels)];
+    if (entry.series == nullptr)
+    {
+        entry.labels = labels;
+        entry.series = std::make_unique<Histogram>();
+    }
+    return *entry.series;
+}
+
+void Metrics::countError(const Error& error, const juce::String& operation)
+{
+    juce::String type = std::string(magic_enum::enum_name(error.type)).c_str();
+    counter("harp_errors_total", { { "type", type }, { "operation", operation } }).increment();
+}
+
+void Metrics::countCacheLookup(const juce::String& cache, bool hit)
+{
+    counter("harp_cache_requests_total", { { "cache", cache }, { "result", hit ? "hit" : "miss" } })
+        .increment();
+}
+
+juce::String Metrics::toPrometheus() const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    juce::MemoryOutputStream out;
+
+    for (const auto& [name, family] : counters)
+    {
+        out << "# TYPE " << name << " counter\n";
+        for (const auto& [labels, entry] : family)
+            out << name << labels << " " << juce::String(entry.series->get()) << "\n";
+    }
+
+    const auto& bounds = Histogram::getBucketBounds();
+    for (const auto& [name, family] : histograms)
+    {
+        out << "# TYPE " << name << " histogram\n";
+        for (const auto& [labels, entry] : family)
+        {
+            const Histogram& series = *entry.series;
+            auto cumulative = series.getCumulativeCounts();
+            for (size_t i = 0; i < cumulative.size(); ++i)
+            {
+                juce::String le = i < bounds.size() ? formatBound(bounds[i]) : "+Inf";
+                out << name << "_bucket" << addLabel(labels, "le=\"" + le + "\"") << " "
+                    << juce::String(cumulative[i]) << "\n";
+            }
+            out << name << "_sum" << labels << " " << juce::String(series.getSum(), 3) << "\n";
+            out << name << "_count" << labels << " " << juce::String(series.getCount()) << "\n";
+        }
+    }
+    return out.toString();
+}
+
+juce::String Metrics::toJson() const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+
+    juce::Array<juce::var> counterArray;
+    for (const auto& [name, family] : counters)
+    {
+        for (const auto& [key, entry] : family)
+        {
+            juce::DynamicObject::Ptr obj = new juce::DynamicObject();
+            obj->setProperty("name", name);
+            obj->setProperty("labels", labelsToVar(entry.labels));
+            obj->setProperty("value", entry.series->get());
+            counterArray.add(juce::var(obj.get()));
+        }
+    }
+
+    const auto& bounds = Histogram::getBucketBounds();
+    juce::Array<juce::var> histogramArray;
+    for (const auto& [name, family] : histograms)
+    {
+        for (const auto& [key, entry] : family)
+        {
+            const Histogram& series = *entry.series;
+            juce::Array<juce::var> bucketArray;
+            auto cumulative = series.getCumulativeCounts();
+            for (size_t i = 0; i < cumulative.size(); ++i)
+            {
+                juce::DynamicObject::Ptr bucket = new juce::DynamicObject();
+                bucket->setProperty("le", i < bounds.size() ? juce::var(bounds[i]) : "+Inf");
+                bucket->setProperty("count", cumulative[i]);
+                bucketArray.add(juce::var(bucket.get()));
+            }
+
+            juce::DynamicObject::Ptr obj = new juce::DynamicObject();
+            obj->setProperty("name", name);
+            obj->setProperty("labels", labelsToVar(entry.labels));
+            obj->setProperty("count", series.getCount());
+            obj->setProperty("sum", series.getSum());
+            obj->setProperty("buckets", bucketArray);
+            histogramArray.add(juce::var(obj.get()));
+        }
+    }
+
+    juce::DynamicObject::Ptr json = new juce::DynamicObject();
+    json->setProperty("time", juce::Time::getCurrentTime().toISO8601(true));
+    json->setProperty("counters", counterArray);
+    json->setProperty("histograms", histogramArray);
+    return juce::JSON::toString(juce::var(json.get()));
+}
+
+void Metrics::startExporting(const juce::File& file, int intervalMs)
+{
+    if (exporter != nullptr)
+    {
+        // The exporter sleeps for a whole interval between exports
+        exporter->signalThreadShouldExit();
+        exporter->notify();
+        exporter->stopThread(2000);
+        exporter.reset();
+    }
+
+    exportFile = file;
+    exportFile.getParentDirectory().createDirectory();
+    exporter = std::make_unique<Exporter>(*this, intervalMs);
+    exporter->startThread(juce::Thread::Priority::low);
+}
+
+bool Metrics::startServer(int port)
+{
+    server.reset();
+    auto newServer = std::make_unique<Server>(*this);
+    if (! newServer->start(port))
+        return false;
+    server = std::move(newServer);
+    return true;
+}
+
+void Metrics::stop()
+{
+    server.reset();
+    if (exporter != nullptr)
+    {
+        exporter->signalThreadShouldExit();
+        exporter->notify();
+        exporter->stopThread(2000);
+        exporter.reset();
+        // The counts of the last interval
+        writeExportFile();
+    }
+}
+
+void Metrics::writeExportFile() const
+{
+    if (exportFile == juce::File())
+        return;
+
+    juce::String text = exportFile.hasFileExtension("json") ? toJson() : toPrometheus();
+
+    // Scrapers never see a half written file
+    juce::TemporaryFile tempFile(exportFile);
+    if (tempFile.getFile().replaceWithText(text))
+        tempFile.overwriteTargetFileWithTemporary();
+}
+
+juce::File Metrics::getDefaultExportFile()
+{
+    // The same folder as harp.log
+    return juce::FileLogger::getSystemLogFileFolder().getChildFile("HARP").getChildFile(
+        "metrics.prom");
+}
@@ -0,0 +1,124 @@
+/**
+ * @file
+ * @brief A registry of counters and latency histograms (requests, errors,
+ * stage durations, bytes, cache hits, UI paint times), exported periodically
+ * to a Prometheus text or JSON file and optionally served on localhost
+ */
+
+#pragma once
+
+#include <atomic>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+#include <juce_core/juce_core.h>
+#include <juce_events/juce_events.h>
+
+#include "errors.h"
+
+class Metrics : private juce::DeletedAtShutdown
+{
+public:
+    JUCE_DECLARE_SINGLETON(Metrics, false)
+
+    ~Metrics();
+
+    Metrics(const Metrics&) = delete;
+    Metrics& operator=(const Metrics&) = delete;
+
+    // Label names and values, e.g { { "cache", "result" }, { "result", "hit" } }
+    using Labels = std::vector<std::pair<juce::String, juce::String>>;
+
+    class Counter
+    {
+    public:
+        void increment(juce::int64 amount = 1) { value += amount; }
+        juce::int64 get() const { return value; }
+
+    private:
+        std::atomic<juce::int64> value { 0 };
+    };
+
+    // Fixed buckets in milliseconds, from 1 ms to 2 minutes
+    class Histogram
+    {
+    public:
+        static const std::vector<double>& getBucketBounds();
+
+        void observe(double valueMs);
+
+        // Observations <= the bound of each bucket, the last one is +Inf
+        std::vector<juce::int64> getCumulativeCounts() const;
+        juce::int64 getCount() const { return count; }
+        double getSum() const { return sum; }
+
+    private:
+        // One more than the bounds, for +Inf
+        std::atomic<juce::int64> buckets[17] {};
+        std::atomic<juce::int64> count { 0 };
+        std::atomic<double> sum { 0.0 };
+    };
+
+    /*
+    * The series with this name and labels, created on first use. The returned
+    * references stay valid until shutdown, so hot paths can keep them.
+    */
+    Counter& counter(const juce::String& name, const Labels& labels = {});
+    Histogram& histogram(const juce::String& name, const Labels& labels = {});
+
+    // harp_errors_total{type, operation}
+    void countError(const Error& error, const juce::String& operation);
+
+    // harp_cache_requests_total{cache, result}
+    void countCacheLookup(const juce::String& cache, bool hit);
+
+    juce::String toPrometheus() const;
+    juce::String toJson() const;
+
+    /*
+    * Writes all the metrics to file every intervalMs, and once more when
+    * stopped. Files ending in .json get toJson(), anything else toPrometheus().
+    */
+    void startExporting(const juce::File& file, int intervalMs = 15000);
+
+    // Serves GET /metrics (Prometheus text) and /metrics.json on 127.0.0.1:port
+    bool startServer(int port);
+
+    void stop();
+
+    // metrics.prom next to harp.log
+    static juce::File getDefaultExportFile();
+
+private:
+    Metrics();
+
+    class Exporter;
+    class Server;
+
+    // Writes the export file. Called on the exporter thread
+    void writeExportFile() const;
+
+    template <typename Series>
+    struct Entry
+    {
+        Labels labels;
+        std::unique_ptr<Series> series;
+    };
+
+    // Keyed by the formatted labels
+    template <typename Series>
+    using Family = std::map<juce::String, Entry<Series>>;
+
+    static juce::String formatLabels(const Labels& labels);
+
+    mutable std::mutex mutex;
+    std::map<juce::String, Family<Counter>> counters;
+    std::map<juce::String, Family<Histogram>> histograms;
+
+    juce::File exportFile;
+    std::unique_ptr<Exporter> exporter;
+    std::unique_ptr<Server> server;
+};
@@ -70,5 +70,4 @@ public:
 protected:
     ModelCard m_card;
     bool m_loaded { false };
-    ModelStatus status2;
 };
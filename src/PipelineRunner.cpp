@@ -0,0 +1,278 @@
+#include "PipelineRunner.h"
+
+juce::String PipelineRunner::Report::toString() const
+{
+    juce::StringArray parts;
+    for (const auto& step : steps)
+    {
+        juce::String part = step.space + " " + juce::String(step.elapsedMs / 1000.0, 1) + " s";
+        if (step.loadWaitMs >= 1.0)
+            part += " (+" + juce::String(step.loadWaitMs / 1000.0, 1) + " s waiting to load)";
+        parts.add(part);
+    }
+
+    juce::String outcome = result.wasOk() ? "finished" : "failed";
+    return "Pipeline: " + juce::String((int) steps.size()) + " steps " + outcome + " in "
+           + juce::String(elapsedMs / 1000.0, 1) + " s: " + parts.joinIntoString(" -> ");
+}
+
+PipelineRunner::PipelineRunner(std::vector<Step> stepsToRun) : steps(std::move(stepsToRun))
+{
+    for (const auto& step : steps)
+    {
+        spaceKeys.push_back(GradioClient::getSchedulerKey(step.space));
+        models.push_back(std::make_shared<WebModel>());
+    }
+}
+
+PipelineRunner::~PipelineRunner()
+{
+    stop();
+
+    // The continuations of a running pipeline point back to this object
+    std::unique_lock<std::mutex> lock(mutex);
+    runFinished.wait(lock, [this] { return ! running; });
+}
+
+void PipelineRunner::startLoading()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    if (loadsStarted)
+        return;
+    loadsStarted = true;
+
+    for (size_t i = 0; i < steps.size(); ++i)
+    {
+        // Only the model and the step are captured, so a load
+        // can outlive the PipelineRunner that started it
+        auto model = models[i];
+        Step step = steps[i];
+        auto load = [model, step]
+        {
+            std::map<std::string, std::any> params = { { "url", step.space.toStdString() } };
+            OpResult result = model->load(params);
+            if (result.failed())
+                return result;
+
+            for (const auto& [label, value] : step.ctrlValues)
+            {
+                result = model->setCtrlValue(label, value);
+                if (result.failed())
+                    return result;
+            }
+            return OpResult::ok();
+        };
+
+        loadJobs.push_back(JobScheduler::getInstance()->submit(spaceKeys[i],
+                                                               JobScheduler::Priority::Interactive,
+                                                               { { "load", load } },
+                                                               cancellation));
+    }
+}
+
+OpResult PipelineRunner::waitUntilLoaded()
+{
+    startLoading();
+
+    for (const auto& job : loadJobs)
+    {
+        OpResult result = job.wait();
+        if (result.failed())
+            return result;
+    }
+    return OpResult::ok();
+}
+
+PipelineRunner::Report PipelineRunner::run(const juce::File& input,
+                                           const juce::File& output,
+                                           const StepCallback& onStepChanged)
+{
+    startLoading();
+
+    double startMs = juce::Time::getMillisecondCounterHiRes();
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        jassert(! running);
+        running = true;
+        workFile = output;
+        runResult = OpResult::ok();
+        stepCallback = onStepChanged;
+
+        stepResults.clear();
+        for (const auto& step : steps)
+        {
+            StepResult stepResult;
+            stepResult.space = step.space;
+            stepResults.push_back(stepResult);
+        }
+    }
+
+    // Every step processes the same file in place, so the output
+    // of a step is uploaded as is by the next one
+    if (input.copyFileTo(output))
+    {
+        startStep(0);
+    }
+    else
+    {
+        Error error;
+        error.type = ErrorType::FileUploadError;
+        error.devMessage =
+            "Failed to copy " + input.getFullPathName() + " to " + output.getFullPathName();
+        finishRun(OpResult::fail(error));
+    }
+
+    std::unique_lock<std::mutex> lock(mutex);
+    runFinished.wait(lock, [this] { return ! running; });
+
+    Report report;
+    report.result = runResult;
+    report.steps = stepResults;
+    report.elapsedMs = juce::Time::getMillisecondCounterHiRes() - startMs;
+    return report;
+}
+
+void PipelineRunner::notifyStepChanged(int index)
+{
+    StepCallback callback;
+    StepResult step;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        callback = stepCallback;
+        step = stepResults[(size_t) index];
+    }
+    if (callback)
+        callback(index, step);
+}
+
+void PipelineRunner::startStep(int index)
+{
+    if (index >= (int) steps.size())
+    {
+        finishRun(OpResult::ok());
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stepResults[(size_t) index].status = ModelStatus::LOADING;
+    }
+    notifyStepChanged(index);
+
+    // Runs straight away if the app is already loaded
+    double waitStartMs = juce::Time::getMillisecondCounterHiRes();
+    loadJobs[(size_t) index].then(
+        [this, index, waitStartMs](const OpResult& loadResult)
+        {
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                stepResults[(size_t) index].loadWaitMs =
+                    juce::Time::getMillisecondCounterHiRes() - waitStartMs;
+            }
+
+            if (loadResult.failed())
+            {
+                {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    StepResult& step = stepResults[(size_t) index];
+                    step.result = loadResult;
+                    step.status = CancellationToken::isCancellation(loadResult)
+                                      ? ModelStatus::CANCELLED
+                                      : ModelStatus::ERROR;
+                }
+                notifyStepChanged(index);
+                finishRun(loadResult);
+                return;
+            }
+
+            runStep(index);
+        });
+}
+
+void PipelineRunner::runStep(int index)
+{
+    auto context = std::make_shared<ProcessContext>();
+    ProcessContext* contextPtr = context.get();
+    context->cancellation = cancellation;
+    context->onChange = [this, index, contextPtr]
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stepResults[(size_t) index].status = contextPtr->status.load();
+            stepResults[(size_t) index].progress = contextPtr->progress.load();
+        }
+        notifyStepChanged(index);
+    };
+
+    juce::File file;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        file = workFile;
+        stepStartMs = juce::Time::getMillisecondCounterHiRes();
+    }
+
+    const auto& model = models[(size_t) index];
+    auto job = JobScheduler::getInstance()->submit(spaceKeys[(size_t) index],
+                                                   JobScheduler::Priority::Interactive,
+                                                   model->makeProcessStages(file, context),
+                                                   cancellation);
+
+    job.then(
+        [this, index, context](const OpResult& result)
+        {
+            finishStep(index, *context, result);
+
+            // finishRun has to be the last thing we do, since run()
+            // (and this object) can be gone right after it
+            if (result.wasOk())
+                startStep(index + 1);
+            else
+                finishRun(result);
+        });
+}
+
+void PipelineRunner::finishStep(int index, ProcessContext& context, const OpResult& result)
+{
+    if (result.failed())
+    {
+        LogAndDBG("PipelineRunner: step " + juce::String(index + 1) + " ("
+                  + steps[(size_t) index].space + ") failed: " + result.getError().devMessage);
+        context.trace.setError(result.getError().devMessage);
+    }
+    context.trace.write();
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        StepResult& step = stepResults[(size_t) index];
+        step.result = result;
+        step.labelsJson = context.labelsJson;
+        if (result.wasOk())
+            step.status = ModelStatus::FINISHED;
+        else if (CancellationToken::isCancellation(result))
+            step.status = ModelStatus::CANCELLED;
+        else
+            step.status = ModelStatus::ERROR;
+        step.elapsedMs = juce::Time::getMillisecondCounterHiRes() - stepStartMs;
+    }
+    notifyStepChanged(index);
+}
+
+void PipelineRunner::finishRun(const OpResult& result)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+
+    if (result.failed())
+        workFile.deleteFile();
+
+    // The steps that never started
+    for (auto& step : stepResults)
+    {
+        if (! step.isDone())
+            step.status = ModelStatus::CANCELLED;
+    }
+
+    runResult = result;
+    running = false;
+    runFinished.notify_all();
+}
@@ -0,0 +1,129 @@
+/**
+ * @file
+ * @brief Chains several gradio apps, e.g source separation followed by
+ * transcription. The output of each step is the input of the next one, and
+ * all the apps are loaded up front, so that loading (and waking up) the later
+ * apps overlaps with the processing of the earlier ones
+ */
+
+#pragma once
+
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "JobScheduler.h"
+#include "WebModel.h"
+#include "juce_core/juce_core.h"
+
+class PipelineRunner
+{
+public:
+    struct Step
+    {
+        // The gradio app of the step (e.g hugggof/harmonic_percussive)
+        juce::String space;
+        // Control values of the step, as (label, value) pairs. See WebModel::setCtrlValue
+        std::vector<std::pair<juce::String, juce::String>> ctrlValues;
+    };
+
+    struct StepResult
+    {
+        juce::String space;
+        ModelStatus status = ModelStatus::INITIALIZED;
+        float progress = -1.0f;
+        OpResult result = OpResult::ok();
+        // Only set if the app returned labels
+        juce::String labelsJson;
+        // Time the step spent waiting for its app to finish loading,
+        // after the previous step was done
+        double loadWaitMs = 0.0;
+        double elapsedMs = 0.0;
+
+        bool isDone() const
+        {
+            return status == ModelStatus::FINISHED || status == ModelStatus::ERROR
+                   || status == ModelStatus::CANCELLED;
+        }
+    };
+
+    struct Report
+    {
+        OpResult result = OpResult::ok();
+        std::vector<StepResult> steps;
+        double elapsedMs = 0.0;
+
+        juce::String toString() const;
+    };
+
+    // Called from the JobScheduler's threads whenever the status of a step changes
+    using StepCallback = std::function<void(int index, const StepResult& step)>;
+
+    explicit PipelineRunner(std::vector<Step> steps);
+
+    // Stops the pipeline and waits for its jobs to finish
+    ~PipelineRunner();
+
+    PipelineRunner(const PipelineRunner&) = delete;
+    PipelineRunner& operator=(const PipelineRunner&) = delete;
+
+    /*
+    * Starts loading the apps of all the steps on the JobScheduler, at
+    * the same time. Called by run() if it wasn't called before, but
+    * calling it early hides the loading time behind whatever comes next.
+    */
+    void startLoading();
+
+    // Blocks until all the apps are loaded. Fails with the error of the first step that didn't
+    OpResult waitUntilLoaded();
+
+    /*
+    * Runs input through all the steps and writes the result to output.
+    * The input is never modified. Step N+1 starts as soon as step N is done
+    * and the app of step N+1 is loaded. Blocks until the pipeline is done;
+    * a failing step ends it, and output is deleted.
+    * Can be called again (e.g for the next file) once it has returned.
+    */
+    Report run(const juce::File& input,
+               const juce::File& output,
+               const StepCallback& onStepChanged = nullptr);
+
+    /*
+    * The running pipeline (and any loads that haven't started) are cancelled.
+    * A stopped PipelineRunner can't be run again.
+    */
+    void stop() { cancellation->cancel(); }
+
+    int getNumSteps() const { return (int) steps.size(); }
+    std::shared_ptr<WebModel> getModel(int index) const { return models[(size_t) index]; }
+
+private:
+    // Submits step index of the current run, once its app is loaded
+    void startStep(int index);
+    void runStep(int index);
+    void finishStep(int index, ProcessContext& context, const OpResult& result);
+    void finishRun(const OpResult& result);
+    void notifyStepChanged(int index);
+
+    const std::vector<Step> steps;
+    // The JobScheduler key of the space of each step, for its load and process jobs alike
+    std::vector<juce::String> spaceKeys;
+    std::vector<std::shared_ptr<WebModel>> models;
+    std::vector<JobScheduler::JobHandle> loadJobs;
+
+    // Shared by the loads and the contexts of all the steps
+    const std::shared_ptr<CancellationToken> cancellation { std::make_shared<CancellationToken>() };
+
+    // The state of the current run, guarded by mutex
+    mutable std::mutex mutex;
+    std::condition_variable runFinished;
+    bool running = false;
+    bool loadsStarted = false;
+    juce::File workFile;
+    std::vector<StepResult> stepResults;
+    OpResult runResult = OpResult::ok();
+    double stepStartMs = 0.0;
+    StepCallback stepCallback;
+};
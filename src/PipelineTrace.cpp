@@ -0,0 +1,169 @@
+#include "PipelineTrace.h"
+
+#include <mutex>
+
+void PipelineTrace::reset(const juce::String& spaceToTrace, const juce::String& fileToTrace)
+{
+    space = spaceToTrace;
+    file = fileToTrace;
+    error.clear();
+    wallClockStart = juce::Time::getCurrentTime();
+    startMs = juce::Time::getMillisecondCounterHiRes();
+    stages.clear();
+    stageOpen = false;
+}
+
+double PipelineTrace::getElapsedMs() const
+{
+    return juce::Time::getMillisecondCounterHiRes() - startMs;
+}
+
+void PipelineTrace::begin(const juce::String& stageName)
+{
+    end();
+
+    Stage stage;
+    stage.name = stageName;
+    stage.startMs = getElapsedMs();
+    stages.push_back(stage);
+    stageOpen = true;
+}
+
+void PipelineTrace::end(juce::int64 bytes)
+{
+    if (! stageOpen)
+        return;
+
+    Stage& stage = stages.back();
+    stage.durationMs = getElapsedMs() - stage.startMs;
+    stage.bytes = bytes;
+    stageOpen = false;
+}
+
+void PipelineTrace::add(const juce::String& stageName, double durationMs, juce::int64 bytes)
+{
+    end();
+
+    Stage stage;
+    stage.name = stageName;
+    stage.startMs = stages.empty() ? 0.0 : stages.back().startMs + stages.back().durationMs;
+    stage.durationMs = durationMs;
+    stage.bytes = bytes;
+    stages.push_back(stage);
+}
+
+void PipelineTrace::addRetries(int numRetries, double waitMs)
+{
+    if (stages.empty() || numRetries <= 0)
+        return;
+
+    Stage& stage = stages.back();
+    stage.retries += numRetries;
+    stage.retryWaitMs += waitMs;
+}
+
+double PipelineTrace::getTotalMs() const
+{
+    if (stages.empty())
+        return 0.0;
+
+    const Stage& last = stages.back();
+    return last.startMs + last.durationMs;
+}
+
+const PipelineTrace::Stage* PipelineTrace::getDominantStage() const
+{
+    const Stage* dominant = nullptr;
+    for (const auto& stage : stages)
+    {
+        if (dominant == nullptr || stage.durationMs > dominant->durationMs)
+            dominant = &stage;
+    }
+    return dominant;
+}
+
+juce::String PipelineTrace::toJson() const
+{
+    juce::Array<juce::var> stageArray;
+    for (const auto& stage : stages)
+    {
+        juce::DynamicObject::Ptr obj = new juce::DynamicObject();
+        obj->setProperty("name", stage.name);
+        obj->setProperty("start_ms", stage.startMs);
+        obj->setProperty("ms", stage.durationMs);
+        if (stage.bytes >= 0)
+            obj->setProperty("bytes", stage.bytes);
+        if (stage.retries > 0)
+        {
+            obj->setProperty("retries", stage.retries);
+            obj->setProperty("retry_wait_ms", stage.retryWaitMs);
+        }
+        stageArray.add(juce::var(obj.get()));
+    }
+
+    juce::DynamicObject::Ptr trace = new juce::DynamicObject();
+    trace->setProperty("time", wallClockStart.toISO8601(true));
+    trace->setProperty("space", space);
+    trace->setProperty("file", file);
+    trace->setProperty("total_ms", getTotalMs());
+    if (error.isNotEmpty())
+        trace->setProperty("error", error);
+    trace->setProperty("stages", stageArray);
+
+    // All on one line, so that the file stays one trace per line
+    return juce::JSON::toString(juce::var(trace.get()), true);
+}
+
+juce::String PipelineTrace::getSummary() const
+{
+    double total = getTotalMs();
+    if (stages.empty() || total <= 0.0)
+        return {};
+
+    const Stage* dominant = getDominantStage();
+    juce::String summary = "took " + juce::String(total / 1000.0, 2) + " s, mostly "
+                           + dominant->name + " ("
+                           + juce::String(juce::roundToInt(100.0 * dominant->durationMs / total))
+                           + "%)";
+
+    juce::StringArray parts;
+    for (const auto& stage : stages)
+    {
+        juce::String part =
+            stage.name + " " + juce::String(juce::roundToInt(stage.durationMs)) + " ms";
+        if (stage.retries > 0)
+            part += " (" + juce::String(stage.retries) + " retries)";
+        parts.add(part);
+    }
+
+    return summary + ": " + parts.joinIntoString(", ");
+}
+
+juce::File PipelineTrace::getTraceFile()
+{
+    // The same folder as harp.log (see FileLogger::createDefaultAppLogger)
+    return juce::FileLogger::getSystemLogFileFolder()
+        .getChildFile("HARP")
+        .getChildFile("pipeline_traces.jsonl");
+}
+
+void PipelineTrace::write() const
+{
+    // Traces of concurrent jobs are written from different threads
+    static std::mutex writeMutex;
+    std::lock_guard<std::mutex> lock(writeMutex);
+
+    juce::File traceFile = getTraceFile();
+    traceFile.getParentDirectory().createDirectory();
+
+    juce::String line = toJson() + "\n";
+    if (traceFile.getSize() + (juce::int64) line.getNumBytesAsUTF8() > maxTraceFileBytes)
+    {
+        juce::File previous = traceFile.getSiblingFile(traceFile.getFileNameWithoutExtension()
+                                                       + ".1" + traceFile.getFileExtension());
+        previous.deleteFile();
+        traceFile.moveFileTo(previous);
+    }
+
+    traceFile.appendText(line, false, false);
+}
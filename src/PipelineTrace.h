@@ -0,0 +1,84 @@
+/**
+ * @file
+ * @brief Per-stage timings of a single process call (upload, queue, inference,
+ * download, parsing, display reload), written as JSON lines next to the HARP log
+ */
+
+#pragma once
+
+#include <vector>
+
+#include "juce_core/juce_core.h"
+
+class PipelineTrace
+{
+public:
+    struct Stage
+    {
+        juce::String name;
+        // Relative to the start of the trace
+        double startMs = 0.0;
+        double durationMs = 0.0;
+        // Bytes moved during the stage, or -1 if it doesn't move any
+        juce::int64 bytes = -1;
+        // Retries of the requests made during the stage, see RetryPolicy
+        int retries = 0;
+        double retryWaitMs = 0.0;
+    };
+
+    PipelineTrace() { reset(); }
+
+    // Starts a new trace. The space and the file are only used to label it
+    void reset(const juce::String& spaceToTrace = {}, const juce::String& fileToTrace = {});
+
+    // Starts timing a stage, ending the previous one if it's still open
+    void begin(const juce::String& stageName);
+
+    // Ends the open stage, if any
+    void end(juce::int64 bytes = -1);
+
+    // Adds a stage that was timed elsewhere, e.g inside GradioClient.
+    // It is placed right after the previous stage
+    void add(const juce::String& stageName, double durationMs, juce::int64 bytes = -1);
+
+    // Records the retries of the last stage. Their waits are part of its duration
+    void addRetries(int numRetries, double waitMs);
+
+    // Marks the traced call as failed
+    void setError(const juce::String& message) { error = message; }
+
+    const std::vector<Stage>& getStages() const { return stages; }
+    double getTotalMs() const;
+
+    // The stage that took the longest
+    const Stage* getDominantStage() const;
+
+    // The whole trace as a single line of JSON
+    juce::String toJson() const;
+
+    // A short human readable summary, e.g for the status area
+    juce::String getSummary() const;
+
+    /*
+    * Appends toJson() to pipeline_traces.jsonl in the HARP log folder. Once
+    * the file grows over maxTraceFileBytes it's moved to pipeline_traces.1.jsonl,
+    * replacing the previous one, so the traces take at most twice that
+    */
+    void write() const;
+
+    static juce::File getTraceFile();
+
+    static constexpr juce::int64 maxTraceFileBytes = 5 * 1024 * 1024;
+
+private:
+    double getElapsedMs() const;
+
+    juce::String space;
+    juce::String file;
+    juce::String error;
+    juce::Time wallClockStart;
+    double startMs = 0.0;
+
+    std::vector<Stage> stages;
+    bool stageOpen = false;
+};
@@ -0,0 +1,188 @@
+#include "ResultCache.h"
+
+#include <algorithm>
+#include <vector>
+
+#include "ContentHash.h"
+
+JUCE_IMPLEMENT_SINGLETON(ResultCache)
+
+namespace
+{
+const juce::String outputFilePrefix = "output";
+const juce::String labelsFileName = "labels.json";
+// Its modification time is used as the last access time of the entry
+const juce::String stampFileName = "entry.stamp";
+} // namespace
+
+ResultCache::ResultCache()
+{
+    cacheDirectory = juce::File::getSpecialLocation(juce::File::userApplicationDataDirectory)
+                         .getChildFile("HARP")
+                         .getChildFile("cache")
+                         .getChildFile("results");
+}
+
+ResultCache::~ResultCache() { clearSingletonInstance(); }
+
+juce::String ResultCache::makeKey(const juce::String& space,
+                                 uint64_t inputHash,
+                                 const juce::String& ctrlJson)
+{
+    ContentHash hasher;
+    hasher.update(space);
+    hasher.update(ContentHash::toString(inputHash));
+    hasher.update(ctrlJson);
+    return hasher.toString();
+}
+
+void ResultCache::setDirectory(const juce::File& directory)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    cacheDirectory = directory;
+}
+
+juce::File ResultCache::getDirectory() const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return cacheDirectory;
+}
+
+bool ResultCache::lookup(const juce::String& key, Entry& entry)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    juce::File entryDir = cacheDirectory.getChildFile(key);
+    juce::File stampFile = entryDir.getChildFile(stampFileName);
+
+    // The stamp is written last, so an entry without it is incomplete
+    if (! stampFile.existsAsFile())
+    {
+        numMisses++;
+        return false;
+    }
+
+    auto outputs = entryDir.findChildFiles(juce::File::findFiles, false, outputFilePrefix + ".*");
+    entry.outputFile = outputs.isEmpty() ? juce::File() : outputs.getFirst();
+
+    juce::File labelsFile = entryDir.getChildFile(labelsFileName);
+    entry.labelsJson = labelsFile.existsAsFile() ? labelsFile.loadFileAsString() : juce::String();
+
+    stampFile.setLastModificationTime(juce::Time::getCurrentTime());
+    numHits++;
+    return true;
+}
+
+void ResultCache::store(const juce::String& key,
+                        const juce::File& outputFile,
+                        const juce::String& labelsJson)
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        juce::File entryDir = cacheDirectory.getChildFile(key);
+
+        entryDir.deleteRecursively();
+        if (! entryDir.createDirectory())
+        {
+            DBG("ResultCache::store: Failed to create " << entryDir.getFullPathName());
+            return;
+        }
+
+        bool ok = true;
+        if (outputFile.existsAsFile())
+        {
+            ok = outputFile.copyFileTo(
+                entryDir.getChildFile(outputFilePrefix + outputFile.getFileExtension()));
+        }
+        if (ok && labelsJson.isNotEmpty())
+        {
+            ok = entryDir.getChildFile(labelsFileName).replaceWithText(labelsJson);
+        }
+
+        if (! ok)
+        {
+            entryDir.deleteRecursively();
+            return;
+        }
+
+        entryDir.getChildFile(stampFileName).create();
+    }
+
+    evictIfNeeded();
+}
+
+void ResultCache::clear()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    cacheDirectory.deleteRecursively();
+}
+
+void ResultCache::setByteBudget(juce::int64 numBytes)
+{
+    byteBudget = numBytes;
+    evictIfNeeded();
+}
+
+juce::int64 ResultCache::getEntrySize(const juce::File& entryDir)
+{
+    juce::int64 size = 0;
+    for (const auto& file : entryDir.findChildFiles(juce::File::findFiles, false))
+        size += file.getSize();
+    return size;
+}
+
+juce::int64 ResultCache::getTotalBytes()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    juce::int64 total = 0;
+    for (const auto& entryDir : cacheDirectory.findChildFiles(juce::File::findDirectories, false))
+        total += getEntrySize(entryDir);
+    return total;
+}
+
+void ResultCache::evictIfNeeded()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+
+    struct EntryInfo
+    {
+        juce::File dir;
+        juce::Time lastUsed;
+        juce::int64 size;
+    };
+
+    std::vector<EntryInfo> entries;
+    juce::int64 total = 0;
+
+    for (const auto& entryDir : cacheDirectory.findChildFiles(juce::File::findDirectories, false))
+    {
+        juce::int64 size = getEntrySize(entryDir);
+        entries.push_back(
+            { entryDir, entryDir.getChildFile(stampFileName).getLastModificationTime(), size });
+        total += size;
+    }
+
+    if (total <= byteBudget)
+        return;
+
+    // Least recently used first
+    std::sort(entries.begin(),
+              entries.end(),
+              [](const EntryInfo& a, const EntryInfo& b) { return a.lastUsed < b.lastUsed; });
+
+    for (const auto& entry : entries)
+    {
+        if (total <= byteBudget)
+            break;
+
+        DBG("ResultCache: evicting " << entry.dir.getFileName());
+        entry.dir.deleteRecursively();
+        total -= entry.size;
+    }
+}
+
+juce::String ResultCache::statsToString()
+{
+    return "ResultCache: " + juce::String(numHits) + " hits, " + juce::String(numMisses)
+           + " misses, " + juce::String(getTotalBytes()) + " of " + juce::String(byteBudget.load())
+           + " bytes used";
+}
@@ -0,0 +1,71 @@
+/**
+ * @file
+ * @brief A size-bounded on-disk cache of processing results, so that identical
+ * requests (same space, input and control values) don't hit the network again
+ */
+
+#pragma once
+
+#include <atomic>
+#include <mutex>
+
+#include <juce_core/juce_core.h>
+#include <juce_events/juce_events.h>
+
+using namespace juce;
+
+class ResultCache : private DeletedAtShutdown
+{
+public:
+    JUCE_DECLARE_SINGLETON(ResultCache, false)
+
+    ~ResultCache();
+
+    ResultCache(const ResultCache&) = delete;
+    ResultCache& operator=(const ResultCache&) = delete;
+
+    struct Entry
+    {
+        // The processed file. Doesn't exist for models that only output labels
+        juce::File outputFile;
+        // The pyharp.LabelList object of the response, or empty if there was none
+        juce::String labelsJson;
+    };
+
+    static juce::String
+        makeKey(const juce::String& space, uint64_t inputHash, const juce::String& ctrlJson);
+
+    bool lookup(const juce::String& key, Entry& entry);
+
+    void store(const juce::String& key,
+               const juce::File& outputFile,
+               const juce::String& labelsJson);
+
+    void clear();
+
+    // Least recently used entries are evicted once the cache grows over this size
+    void setByteBudget(juce::int64 numBytes);
+    juce::int64 getByteBudget() const { return byteBudget; }
+
+    void setDirectory(const juce::File& directory);
+    juce::File getDirectory() const;
+
+    juce::int64 getTotalBytes();
+    int getNumHits() const { return numHits; }
+    int getNumMisses() const { return numMisses; }
+
+    juce::String statsToString();
+
+private:
+    ResultCache();
+
+    void evictIfNeeded();
+
+    static juce::int64 getEntrySize(const juce::File& entryDir);
+
+    mutable std::mutex mutex;
+    juce::File cacheDirectory;
+    std::atomic<juce::int64> byteBudget { (juce::int64) 2 * 1024 * 1024 * 1024 };
+    std::atomic<int> numHits { 0 };
+    std::atomic<int> numMisses { 0 };
+};
@@ -0,0 +1,108 @@
+#include "SchemaCache.h"
+
+#include "ContentHash.h"
+
+JUCE_IMPLEMENT_SINGLETON(SchemaCache)
+
+SchemaCache::SchemaCache()
+{
+    cacheDirectory = juce::File::getSpecialLocation(juce::File::userApplicationDataDirectory)
+                         .getChildFile("HARP")
+                         .getChildFile("cache")
+                         .getChildFile("schemas");
+}
+
+SchemaCache::~SchemaCache() { clearSingletonInstance(); }
+
+void SchemaCache::setDirectory(const juce::File& directory)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    cacheDirectory = directory;
+}
+
+juce::File SchemaCache::getDirectory() const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return cacheDirectory;
+}
+
+juce::File SchemaCache::getEntryFile(const juce::String& space) const
+{
+    return cacheDirectory.getChildFile(ContentHash::toString(ContentHash::hashString(space))
+                                       + ".json");
+}
+
+juce::String SchemaCache::hashSchema(const juce::Array<juce::var>& ctrlList,
+                                     const juce::var& card)
+{
+    ContentHash hasher;
+    hasher.update(juce::JSON::toString(juce::var(ctrlList), true));
+    hasher.update(juce::JSON::toString(card, true));
+    return hasher.toString();
+}
+
+bool SchemaCache::lookup(const juce::String& space, Entry& entry)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    juce::File entryFile = getEntryFile(space);
+    if (! entryFile.existsAsFile())
+        return false;
+
+    juce::var json = juce::JSON::parse(entryFile);
+    juce::Array<juce::var>* ctrlList = json.getProperty("controls", {}).getArray();
+    juce::var card = json.getProperty("card", {});
+
+    // Written by another version of HARP, or damaged
+    if (json.getProperty("space", {}).toString() != space || ctrlList == nullptr
+        || ! card.isObject())
+    {
+        DBG("SchemaCache::lookup: Ignoring " << entryFile.getFullPathName());
+        return false;
+    }
+
+    entry.space = space;
+    entry.serverVersion = json.getProperty("server_version", {}).toString();
+    entry.ctrlList = *ctrlList;
+    entry.card = card;
+    entry.fetchTime = juce::Time::fromISO8601(json.getProperty("fetch_time", {}).toString());
+    entry.schemaHash = json.getProperty("schema_hash", {}).toString();
+    return true;
+}
+
+void SchemaCache::store(Entry entry)
+{
+    entry.schemaHash = hashSchema(entry.ctrlList, entry.card);
+
+    juce::DynamicObject::Ptr json = new juce::DynamicObject();
+    json->setProperty("space", entry.space);
+    json->setProperty("server_version", entry.serverVersion);
+    json->setProperty("fetch_time", entry.fetchTime.toISO8601(true));
+    json->setProperty("schema_hash", entry.schemaHash);
+    json->setProperty("controls", entry.ctrlList);
+    json->setProperty("card", entry.card);
+
+    std::lock_guard<std::mutex> lock(mutex);
+    juce::File entryFile = getEntryFile(entry.space);
+    if (! entryFile.getParentDirectory().createDirectory())
+    {
+        DBG("SchemaCache::store: Failed to create " << cacheDirectory.getFullPathName());
+        return;
+    }
+
+    // Readers never see a half written entry
+    juce::TemporaryFile tempFile(entryFile);
+    if (tempFile.getFile().replaceWithText(juce::JSON::toString(juce::var(json.get()))))
+        tempFile.overwriteTargetFileWithTemporary();
+}
+
+void SchemaCache::remove(const juce::String& space)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    getEntryFile(space).deleteFile();
+}
+
+void SchemaCache::clear()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    cacheDirectory.deleteRecursively();
+}
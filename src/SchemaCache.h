@@ -0,0 +1,60 @@
+/**
+ * @file
+ * @brief An on-disk cache of the controls response (model card and controls)
+ * of every space that was loaded, so that loading it again doesn't have to
+ * wait for the network
+ */
+
+#pragma once
+
+#include <mutex>
+
+#include <juce_core/juce_core.h>
+#include <juce_events/juce_events.h>
+
+class SchemaCache : private juce::DeletedAtShutdown
+{
+public:
+    JUCE_DECLARE_SINGLETON(SchemaCache, false)
+
+    ~SchemaCache();
+
+    SchemaCache(const SchemaCache&) = delete;
+    SchemaCache& operator=(const SchemaCache&) = delete;
+
+    struct Entry
+    {
+        // As typed by the user (e.g hugggof/harmonic_percussive)
+        juce::String space;
+        // See GradioClient::getServerVersion. Empty if it isn't known, then
+        // the controls are fetched again on every revalidation
+        juce::String serverVersion;
+        juce::Array<juce::var> ctrlList;
+        juce::var card;
+        juce::Time fetchTime;
+        // Tells whether a refetched schema differs from this one. Filled in by store()
+        juce::String schemaHash;
+    };
+
+    static juce::String hashSchema(const juce::Array<juce::var>& ctrlList,
+                                   const juce::var& card);
+
+    bool lookup(const juce::String& space, Entry& entry);
+
+    void store(Entry entry);
+
+    void remove(const juce::String& space);
+
+    void clear();
+
+    void setDirectory(const juce::File& directory);
+    juce::File getDirectory() const;
+
+private:
+    SchemaCache();
+
+    juce::File getEntryFile(const juce::String& space) const;
+
+    mutable std::mutex mutex;
+    juce::File cacheDirectory;
+};
@@ -0,0 +1,276 @@
+#include "SpaceProber.h"
+
+#include "HarpLogger.h"
+#include "SchemaCache.h"
+#include "gradio/GradioClient.h"
+
+JUCE_IMPLEMENT_SINGLETON(SpaceProber)
+
+namespace
+{
+// How often the timer looks for spaces that are due for a probe
+const int timerIntervalMs = 5000;
+
+void copyProperties(const juce::DynamicObject& source, juce::DynamicObject& destination)
+{
+    destination.clear();
+    for (const auto& property : source.getProperties())
+        destination.setProperty(property.name, property.value);
+}
+
+juce::var copyCard(const juce::DynamicObject& cardDict)
+{
+    juce::DynamicObject::Ptr card = new juce::DynamicObject();
+    copyProperties(cardDict, *card);
+    return juce::var(card.get());
+}
+} // namespace
+
+juce::String SpaceProber::SpaceState::toString() const
+{
+    switch (readiness)
+    {
+        case Readiness::Probing:
+            return "probing...";
+        case Readiness::Ready:
+            return "ready, " + juce::String(juce::roundToInt(latencyMs)) + " ms";
+        case Readiness::Unreachable:
+            return "asleep or down";
+        case Readiness::Unknown:
+        default:
+            return {};
+    }
+}
+
+SpaceProber::SpaceProber() {}
+
+SpaceProber::~SpaceProber()
+{
+    stopTimer();
+
+    // The probes point back to this object
+    cancellation->cancel();
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        allProbesFinished.wait(lock, [this] { return numProbesInFlight == 0; });
+    }
+
+    clearSingletonInstance();
+}
+
+void SpaceProber::setSpaces(const juce::StringArray& spacesToProbe)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    spaces = spacesToProbe;
+}
+
+void SpaceProber::addSpace(const juce::String& space)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    spaces.addIfNotAlreadyThere(space);
+}
+
+void SpaceProber::startProbing(int intervalMs, int retryIntervalMs)
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        probeInterval = juce::RelativeTime::milliseconds(intervalMs);
+        retryInterval = juce::RelativeTime::milliseconds(retryIntervalMs);
+    }
+    probeAll();
+    startTimer(timerIntervalMs);
+}
+
+void SpaceProber::stopProbing() { stopTimer(); }
+
+void SpaceProber::setControlsMaxAge(juce::RelativeTime maxAge)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    controlsMaxAge = maxAge;
+}
+
+void SpaceProber::probeAll()
+{
+    juce::StringArray spacesToProbe;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        spacesToProbe = spaces;
+    }
+
+    // The pool runs maxConcurrentProbes of them at a time, the rest wait in its queue
+    for (const auto& space : spacesToProbe)
+        probe(space);
+}
+
+void SpaceProber::timerCallback()
+{
+    juce::StringArray dueSpaces;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        juce::Time now = juce::Time::getCurrentTime();
+        for (const auto& space : spaces)
+        {
+            const SpaceState& state = states[space];
+            if (state.readiness == Readiness::Probing)
+                continue;
+
+            juce::RelativeTime interval = state.readiness == Readiness::Unreachable
+                                              ? getRetryDelay(state)
+                                              : probeInterval;
+            if (now - state.lastProbeTime >= interval)
+                dueSpaces.add(space);
+        }
+    }
+
+    for (const auto& space : dueSpaces)
+        probe(space);
+}
+
+juce::RelativeTime SpaceProber::getRetryDelay(const SpaceState& state) const
+{
+    // retryInterval, 2 * retryInterval, 4 * retryInterval, ... up to probeInterval
+    int doublings = juce::jlimit(0, 16, state.numFailures - 1);
+    double delaySeconds = retryInterval.inSeconds() * (double) (1 << doublings);
+    return juce::RelativeTime::seconds(juce::jmin(delaySeconds, probeInterval.inSeconds()));
+}
+
+void SpaceProber::probe(const juce::String& space)
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        SpaceState& state = states[space];
+        if (state.readiness == Readiness::Probing || cancellation->isCancelled())
+            return;
+
+        state.readiness = Readiness::Probing;
+        numProbesInFlight++;
+    }
+    sendChangeMessage();
+
+    struct Probe
+    {
+        juce::Array<juce::var> ctrlList;
+        juce::DynamicObject cardDict;
+        double latencyMs = 0.0;
+    };
+    auto probeResult = std::make_shared<Probe>();
+
+    // The controls request is the same one WebModel::load makes,
+    // so it wakes the space up and tells us what loading it will return
+    auto probeSpace = [space, probeResult, token = cancellation]
+    {
+        // Probes still queued when the prober shuts down
+        if (token->isCancelled())
+            return OpResult::fail(CancellationToken::makeError("Probe of " + space));
+
+        GradioClient client;
+        OpResult result = client.setSpaceInfo(space);
+        if (result.failed())
+            return result;
+
+        double startMs = juce::Time::getMillisecondCounterHiRes();
+        result = client.getControls(probeResult->ctrlList, probeResult->cardDict, token.get());
+        probeResult->latencyMs = juce::Time::getMillisecondCounterHiRes() - startMs;
+        return result;
+    };
+
+    probePool.addJob(
+        [this, space, probeResult, probeSpace]
+        {
+            OpResult result = probeSpace();
+            finishProbe(space,
+                        result,
+                        probeResult->latencyMs,
+                        probeResult->ctrlList,
+                        probeResult->cardDict);
+        });
+}
+
+void SpaceProber::finishProbe(const juce::String& space,
+                              const OpResult& result,
+                              double latencyMs,
+                              const juce::Array<juce::var>& ctrlList,
+                              const juce::DynamicObject& cardDict)
+{
+    if (result.wasOk())
+        storeControls(space, ctrlList, cardDict);
+    else if (! CancellationToken::isCancellation(result))
+        LogAndDBG("SpaceProber: " + space + " is unreachable: " + result.getError().devMessage,
+                  HarpLogger::Level::Warning);
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        SpaceState& state = states[space];
+        state.lastProbeTime = juce::Time::getCurrentTime();
+        if (result.wasOk())
+        {
+            state.readiness = Readiness::Ready;
+            state.latencyMs = latencyMs;
+            state.error.clear();
+            state.numFailures = 0;
+        }
+        else if (CancellationToken::isCancellation(result))
+        {
+            state.readiness = Readiness::Unknown;
+        }
+        else
+        {
+            state.readiness = Readiness::Unreachable;
+            state.error = result.getError().devMessage;
+            state.numFailures++;
+        }
+    }
+    sendChangeMessage();
+
+    // Has to be the last thing we do, since the destructor waits for it
+    std::lock_guard<std::mutex> lock(mutex);
+    numProbesInFlight--;
+    allProbesFinished.notify_all();
+}
+
+SpaceProber::SpaceState SpaceProber::getState(const juce::String& space) const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = states.find(space);
+    return it != states.end() ? it->second : SpaceState();
+}
+
+bool SpaceProber::getCachedControls(const juce::String& space,
+                                    juce::Array<juce::var>& ctrlList,
+                                    juce::DynamicObject& cardDict) const
+{
+    juce::RelativeTime maxAge;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        maxAge = controlsMaxAge;
+    }
+
+    SchemaCache::Entry entry;
+    if (! SchemaCache::getInstance()->lookup(space, entry)
+        || juce::Time::getCurrentTime() - entry.fetchTime > maxAge)
+        return false;
+
+    ctrlList = entry.ctrlList;
+    copyProperties(*entry.card.getDynamicObject(), cardDict);
+    return true;
+}
+
+void SpaceProber::storeControls(const juce::String& space,
+                                const juce::Array<juce::var>& ctrlList,
+                                const juce::DynamicObject& cardDict)
+{
+    SchemaCache::Entry entry;
+    entry.space = space;
+    entry.ctrlList = ctrlList;
+    entry.card = copyCard(cardDict);
+    entry.fetchTime = juce::Time::getCurrentTime();
+
+    // A probe doesn't ask for the server version. The one stored with the
+    // same controls still holds, see WebModel::revalidateSchema
+    SchemaCache::Entry stored;
+    if (SchemaCache::getInstance()->lookup(space, stored)
+        && stored.schemaHash == SchemaCache::hashSchema(entry.ctrlList, entry.card))
+        entry.serverVersion = stored.serverVersion;
+
+    SchemaCache::getInstance()->store(entry);
+}
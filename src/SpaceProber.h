@@ -0,0 +1,119 @@
+/**
+ * @file
+ * @brief Probes a list of gradio apps in the background, a couple at a time and
+ * on a schedule, so that sleeping spaces get woken up before they are needed. The
+ * controls response of every successful probe goes to the SchemaCache, so that
+ * loading a probed app doesn't have to wait for it again
+ */
+
+#pragma once
+
+#include <condition_variable>
+#include <map>
+#include <memory>
+#include <mutex>
+
+#include <juce_core/juce_core.h>
+#include <juce_events/juce_events.h>
+
+#include "errors.h"
+#include "gradio/CancellationToken.h"
+
+class SpaceProber : private juce::DeletedAtShutdown,
+                    public juce::ChangeBroadcaster,
+                    private juce::Timer
+{
+public:
+    JUCE_DECLARE_SINGLETON(SpaceProber, false)
+
+    enum class Readiness
+    {
+        Unknown,
+        Probing,
+        Ready,
+        // Asleep, building or down. Probing it again is what wakes it up
+        Unreachable,
+    };
+
+    struct SpaceState
+    {
+        Readiness readiness = Readiness::Unknown;
+        // Round trip of the last successful probe (the controls request)
+        double latencyMs = 0.0;
+        juce::Time lastProbeTime;
+        juce::String error;
+        // Failed probes since the last successful one, see getRetryDelay
+        int numFailures = 0;
+
+        // A short description, e.g for the model list
+        juce::String toString() const;
+    };
+
+    ~SpaceProber() override;
+
+    SpaceProber(const SpaceProber&) = delete;
+    SpaceProber& operator=(const SpaceProber&) = delete;
+
+    // The spaces to probe, as typed by the user (e.g hugggof/harmonic_percussive)
+    void setSpaces(const juce::StringArray& spacesToProbe);
+    void addSpace(const juce::String& space);
+
+    /*
+    * Probes all the spaces now, and then every intervalMs. Unreachable
+    * spaces are probed again after retryIntervalMs, doubling the wait after
+    * every failure (up to intervalMs) until they wake up.
+    * Must be called from the message thread.
+    */
+    void startProbing(int intervalMs = 5 * 60 * 1000, int retryIntervalMs = 30 * 1000);
+    void stopProbing();
+
+    // Probes space on the prober's own pool, unless a probe of it is already running
+    void probe(const juce::String& space);
+    void probeAll();
+
+    SpaceState getState(const juce::String& space) const;
+
+    /*
+    * The controls of space in the SchemaCache, whether a probe or a load put
+    * them there, if they are recent enough. Returns false otherwise.
+    */
+    bool getCachedControls(const juce::String& space,
+                           juce::Array<juce::var>& ctrlList,
+                           juce::DynamicObject& cardDict) const;
+
+    // How long cached controls are trusted without revalidating them
+    void setControlsMaxAge(juce::RelativeTime maxAge);
+
+private:
+    SpaceProber();
+
+    void timerCallback() override;
+    // How long to wait before probing an unreachable space again. Guarded by mutex
+    juce::RelativeTime getRetryDelay(const SpaceState& state) const;
+    void finishProbe(const juce::String& space,
+                     const OpResult& result,
+                     double latencyMs,
+                     const juce::Array<juce::var>& ctrlList,
+                     const juce::DynamicObject& cardDict);
+    void storeControls(const juce::String& space,
+                       const juce::Array<juce::var>& ctrlList,
+                       const juce::DynamicObject& cardDict);
+
+    mutable std::mutex mutex;
+    juce::StringArray spaces;
+    std::map<juce::String, SpaceState> states;
+    juce::RelativeTime controlsMaxAge { juce::RelativeTime::minutes(10) };
+    juce::RelativeTime probeInterval { juce::RelativeTime::minutes(5) };
+    juce::RelativeTime retryInterval { juce::RelativeTime::seconds(30) };
+
+    // Probes that haven't finished yet, guarded by mutex
+    int numProbesInFlight = 0;
+    std::condition_variable allProbesFinished;
+    const std::shared_ptr<CancellationToken> cancellation { std::make_shared<CancellationToken>() };
+
+    // A probe blocks its thread until the space answers, which can take minutes
+    // for a cold start. The probes get their own small pool, so that they can't
+    // take the JobScheduler's threads away from the user's jobs
+    static constexpr int maxConcurrentProbes = 2;
+    juce::ThreadPool probePool { maxConcurrentProbes };
+};
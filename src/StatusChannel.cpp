@@ -0,0 +1,132 @@
+#include "StatusChannel.h"
+
+StatusChannel::StatusChannel() : statusStartMs(juce::Time::getMillisecondCounterHiRes()) {}
+
+void StatusChannel::publish(ModelStatus status)
+{
+    {
+        juce::SpinLock::ScopedLockType lock(publishLock);
+
+        ModelStatus previousStatus = latestStatus.load();
+        if (previousStatus == status)
+            return;
+
+        double nowMs = juce::Time::getMillisecondCounterHiRes();
+        double previousStatusMs = nowMs - statusStartMs;
+        statusStartMs = nowMs;
+        latestStatus = status;
+
+        juce::uint64 sequence = nextSequence.fetch_add(1) + 1;
+        Slot& slot = slots[sequence % numSlots];
+
+        slot.stamp.store(2 * sequence - 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        slot.status.store(status, std::memory_order_relaxed);
+        slot.previousStatus.store(previousStatus, std::memory_order_relaxed);
+        slot.timeMs.store(nowMs, std::memory_order_relaxed);
+        slot.previousStatusMs.store(previousStatusMs, std::memory_order_relaxed);
+        slot.stamp.store(2 * sequence, std::memory_order_release);
+    }
+
+    notifyListener();
+}
+
+void StatusChannel::publishProgress(float progress)
+{
+    if (latestProgress.exchange(progress) != progress)
+        notifyListener();
+}
+
+std::vector<StatusChannel::Event> StatusChannel::getEventsSince(juce::uint64 afterSequence,
+                                                                int* numMissed) const
+{
+    std::vector<Event> events;
+    if (numMissed != nullptr)
+        *numMissed = 0;
+
+    juce::uint64 latest = nextSequence;
+    // Anything older than the ring is gone
+    if (latest > numSlots && afterSequence < latest - numSlots)
+    {
+        if (numMissed != nullptr)
+            *numMissed += (int) (latest - numSlots - afterSequence);
+        afterSequence = latest - numSlots;
+    }
+
+    for (juce::uint64 sequence = afterSequence + 1; sequence <= latest; ++sequence)
+    {
+        const Slot& slot = slots[sequence % numSlots];
+        juce::uint64 stamp = slot.stamp.load(std::memory_order_acquire);
+
+        // Its publisher hasn't finished writing it yet, and will wake us up again
+        if (stamp < 2 * sequence)
+            break;
+
+        Event event;
+        event.sequence = sequence;
+        event.status = slot.status.load(std::memory_order_relaxed);
+        event.previousStatus = slot.previousStatus.load(std::memory_order_relaxed);
+        event.timeMs = slot.timeMs.load(std::memory_order_relaxed);
+        event.previousStatusMs = slot.previousStatusMs.load(std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_acquire);
+
+        // Overwritten by a newer event, before or while we read it
+        if (stamp != 2 * sequence
+            || slot.stamp.load(std::memory_order_relaxed) != 2 * sequence)
+        {
+            if (numMissed != nullptr)
+                (*numMissed)++;
+            continue;
+        }
+        events.push_back(event);
+    }
+    return events;
+}
+
+void StatusChannel::setListener(std::function<void()> onEvents)
+{
+    JUCE_ASSERT_MESSAGE_THREAD
+
+    std::shared_ptr<Subscription> newSubscription;
+    if (onEvents != nullptr)
+    {
+        newSubscription = std::make_shared<Subscription>();
+        newSubscription->callback = std::move(onEvents);
+    }
+
+    std::shared_ptr<Subscription> oldSubscription;
+    {
+        juce::SpinLock::ScopedLockType lock(subscriptionLock);
+        oldSubscription = std::move(subscription);
+        subscription = newSubscription;
+    }
+
+    // Deliveries run on the message thread too, so none of them can call it after this
+    if (oldSubscription != nullptr)
+        oldSubscription->callback = nullptr;
+}
+
+void StatusChannel::notifyListener()
+{
+    std::shared_ptr<Subscription> listener;
+    {
+        juce::SpinLock::ScopedLockType lock(subscriptionLock);
+        listener = subscription;
+    }
+
+    // One wake up for any number of events published before the listener runs
+    if (listener == nullptr || listener->pending.exchange(true))
+        return;
+
+    std::weak_ptr<Subscription> weakListener = listener;
+    juce::MessageManager::callAsync(
+        [weakListener]
+        {
+            auto subscribed = weakListener.lock();
+            if (subscribed == nullptr)
+                return;
+            subscribed->pending = false;
+            if (subscribed->callback != nullptr)
+                subscribed->callback();
+        });
+}
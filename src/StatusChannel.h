@@ -0,0 +1,112 @@
+/**
+ * @file
+ * @brief Publishes the status changes and progress of a model from any thread,
+ * and wakes the message thread only when there is something new to show
+ */
+
+#pragma once
+
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <vector>
+
+#include <juce_core/juce_core.h>
+#include <juce_events/juce_events.h>
+
+#include "utils.h"
+
+/*
+* Every status change gets the next sequence number and is written into a ring
+* of recent transitions, so a listener that wakes up late still sees every state
+* the model went through, in order, with the time it entered each one.
+* Progress updates (one per downloaded chunk or progress event) aren't events:
+* only the latest one matters, so it's kept in a single value that the listener
+* reads when it wakes up, and it can't push transitions out of the ring.
+* Readers take no locks: each slot of the ring is a seqlock. Publishers of
+* transitions take a spin lock, so that the status, the time it was entered and
+* the sequence numbers change together.
+*/
+class StatusChannel
+{
+public:
+    struct Event
+    {
+        // Starts at 1
+        juce::uint64 sequence = 0;
+        ModelStatus status = ModelStatus::INITIALIZED;
+        ModelStatus previousStatus = ModelStatus::INITIALIZED;
+        // juce::Time::getMillisecondCounterHiRes() when it was published
+        double timeMs = 0.0;
+        // How long the model was in previousStatus
+        double previousStatusMs = 0.0;
+    };
+
+    StatusChannel();
+
+    StatusChannel(const StatusChannel&) = delete;
+    StatusChannel& operator=(const StatusChannel&) = delete;
+
+    // Any thread. Does nothing if the status didn't change
+    void publish(ModelStatus status);
+
+    // Any thread. Wakes the listener if the progress changed, at most once per wake up
+    void publishProgress(float progress);
+
+    ModelStatus getStatus() const { return latestStatus; }
+    float getProgress() const { return latestProgress; }
+
+    // The sequence number of the last event, 0 if there was none
+    juce::uint64 getLatestSequence() const { return nextSequence; }
+
+    /*
+    * The events after afterSequence, oldest first. Events that were
+    * overwritten by newer ones before they could be read are skipped and
+    * counted in numMissed, if given.
+    */
+    std::vector<Event> getEventsSince(juce::uint64 afterSequence,
+                                      int* numMissed = nullptr) const;
+
+    /*
+    * Message thread only. onEvents is called on the message thread after one
+    * or more events or progress updates were published, once for all of those
+    * since its last call. Pass nullptr to stop listening, which has to happen
+    * before the channel is destroyed.
+    */
+    void setListener(std::function<void()> onEvents);
+
+private:
+    struct Slot
+    {
+        // 2 * sequence once the event is written, odd while it is being written
+        std::atomic<juce::uint64> stamp { 0 };
+        std::atomic<ModelStatus> status { ModelStatus::INITIALIZED };
+        std::atomic<ModelStatus> previousStatus { ModelStatus::INITIALIZED };
+        std::atomic<double> timeMs { 0.0 };
+        std::atomic<double> previousStatusMs { 0.0 };
+    };
+
+    struct Subscription
+    {
+        // A wake up is already on its way to the message thread
+        std::atomic<bool> pending { false };
+        std::function<void()> callback;
+    };
+
+    void notifyListener();
+
+    static constexpr size_t numSlots = 64;
+    Slot slots[numSlots];
+
+    std::atomic<juce::uint64> nextSequence { 0 };
+    std::atomic<ModelStatus> latestStatus { ModelStatus::INITIALIZED };
+    std::atomic<float> latestProgress { -1.0f };
+
+    // Held by publish() only
+    juce::SpinLock publishLock;
+    double statusStartMs = 0.0;
+
+    // Only guards swapping the subscription, never held while calling it
+    juce::SpinLock subscriptionLock;
+    std::shared_ptr<Subscription> subscription;
+};
@@ -8,25 +8,174 @@
 
 #pragma once
 
+#include "ContentHash.h"
 #include "HarpLogger.h"
+#include "JobScheduler.h"
+#include "Metrics.h"
 #include "Model.h"
+#include "PipelineTrace.h"
+#include "ResultCache.h"
+#include "SchemaCache.h"
+#include "SpaceProber.h"
+#include "StatusChannel.h"
+#include "external/magic_enum.hpp"
 #include "gradio/GradioClient.h"
 #include "juce_core/juce_core.h"
 #include "utils.h"
+#include <atomic>
+#include <functional>
 #include <fstream>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <vector>
 
-class WebModel : public Model
+// The state of a single WebModel::process call
+struct ProcessContext
+{
+    std::atomic<ModelStatus> status { ModelStatus::STARTING };
+    // Progress (0-1) of the current stage, or -1 if the app doesn't report any
+    std::atomic<float> progress { -1.0f };
+
+    // The labels returned by the app, and the pyharp.LabelList they came from
+    LabelList labels;
+    juce::String labelsJson;
+
+    // How long each stage of the call took
+    PipelineTrace trace;
+
+    // Passed from one stage of the call to the next
+    juce::File file;
+    // Empty if the input couldn't be read, then nothing is looked up in the caches
+    std::optional<uint64_t> inputHash;
+    juce::String resultKey;
+    // The result came from the result cache, so the later stages have nothing to do
+    bool servedFromCache = false;
+    juce::String uploadedFilePath;
+    juce::String eventId;
+    juce::String response;
+
+    // The values of the model's controls when the call was submitted, see
+    // WebModel::getCtrlValues. Editing the controls (or switching to an updated
+    // schema) while the call runs doesn't change what it sends
+    juce::var ctrlValues;
+
+    // Called from the processing thread whenever the status or the progress change
+    std::function<void()> onChange;
+
+    // Cancelling it aborts the request the call is waiting on. Contexts can share
+    // a token, e.g all the jobs of a batch
+    std::shared_ptr<CancellationToken> cancellation { std::make_shared<CancellationToken>() };
+
+    bool isCancelled() const { return cancellation != nullptr && cancellation->isCancelled(); }
+
+    void setStatus(ModelStatus newStatus)
+    {
+        ModelStatus oldStatus = status.exchange(newStatus);
+        if (oldStatus != newStatus)
+        {
+            // How long the call spent in the old status
+            double nowMs = juce::Time::getMillisecondCounterHiRes();
+            juce::String from = std::string(magic_enum::enum_name(oldStatus)).c_str();
+            juce::String to = std::string(magic_enum::enum_name(newStatus)).c_str();
+            Metrics::getInstance()
+                ->histogram("harp_status_duration_ms", { { "from", from }, { "to", to } })
+                .observe(nowMs - statusChangeMs);
+            statusChangeMs = nowMs;
+        }
+        if (onChange)
+            onChange();
+    }
+
+    void setProgress(float newProgress)
+    {
+        progress = newProgress;
+        if (onChange)
+            onChange();
+    }
+
+    double statusChangeMs = juce::Time::getMillisecondCounterHiRes();
+
+    // ERROR, or CANCELLED if the call failed because it was cancelled
+    void setFailed() { setStatus(isCancelled() ? ModelStatus::CANCELLED : ModelStatus::ERROR); }
+};
+
+class WebModel : public Model, public std::enable_shared_from_this<WebModel>
 {
 public:
-    WebModel() { status2 = ModelStatus::INITIALIZED; }
+    WebModel() { setStatus(ModelStatus::INITIALIZED); }
 
     ~WebModel() {}
 
-    bool ready() const override { return status2 == ModelStatus::LOADED; }
+    bool ready() const override { return statusChannel.getStatus() == ModelStatus::LOADED; }
 
     CtrlList& controls() { return m_ctrls; }
 
+    /*
+    * The current value of each control, in order, for ProcessContext::ctrlValues.
+    * Media inputs are left void, to be filled in with the path of the uploaded
+    * file. Call it from the thread that edits the controls.
+    */
+    OpResult getCtrlValues(juce::var& ctrlValues) const
+    {
+        juce::Array<juce::var> values;
+
+        // Iterate through each control in m_ctrls
+        for (const auto& ctrlPair : m_ctrls)
+        {
+            auto ctrl = ctrlPair.second;
+            // Check the type of ctrl and extract its value
+            if (auto sliderCtrl = dynamic_cast<SliderCtrl*>(ctrl.get()))
+            {
+                values.add(juce::var(sliderCtrl->value));
+            }
+            else if (auto textBoxCtrl = dynamic_cast<TextBoxCtrl*>(ctrl.get()))
+            {
+                values.add(juce::var(textBoxCtrl->value));
+            }
+            else if (auto numberBoxCtrl = dynamic_cast<NumberBoxCtrl*>(ctrl.get()))
+            {
+                values.add(juce::var(numberBoxCtrl->value));
+            }
+            else if (auto toggleCtrl = dynamic_cast<ToggleCtrl*>(ctrl.get()))
+            {
+                values.add(juce::var(toggleCtrl->value));
+            }
+            else if (auto comboBoxCtrl = dynamic_cast<ComboBoxCtrl*>(ctrl.get()))
+            {
+                values.add(juce::var(comboBoxCtrl->value));
+            }
+            else if (dynamic_cast<AudioInCtrl*>(ctrl.get()) != nullptr
+                     || dynamic_cast<MidiInCtrl*>(ctrl.get()) != nullptr)
+            {
+                // The path of the uploaded file, see ctrlsToJson
+                values.add(juce::var());
+            }
+            else
+            {
+                Error error;
+                error.type = ErrorType::UnsupportedControlType;
+                // Unsupported control type or missing implementation
+                error.devMessage =
+                    "Unsupported control type or missing implementation for control with ID: "
+                    + ctrl->id.toString();
+                return OpResult::fail(error);
+            }
+        }
+
+        ctrlValues = values;
+        return OpResult::ok();
+    }
+
     OpResult load(const map<string, any>& params) override
+    {
+        OpResult result = loadSpace(params);
+        if (result.failed())
+            Metrics::getInstance()->countError(result.getError(), "load");
+        return result;
+    }
+
+    OpResult loadSpace(const map<string, any>& params)
     {
         // Create an Error object in case we need it
         // and a successful result
@@ -35,7 +184,7 @@ public:
         OpResult result = OpResult::ok();
 
         m_ctrls.clear();
-        status2 = ModelStatus::LOADING;
+        setStatus(ModelStatus::LOADING);
 
         // get the name of the huggingface repo we're going to use
         // if (! modelparams::contains(params, "url"))
@@ -51,7 +200,7 @@ public:
         // if (gradioClient.getSpaceInfo().status == SpaceInfo::Status::ERROR)
         if (result.failed())
         {
-            status2 = ModelStatus::ERROR;
+            setStatus(ModelStatus::ERROR);
             return result;
         }
 
@@ -59,47 +208,401 @@ public:
 
         juce::Array<juce::var> ctrlList;
         juce::DynamicObject cardDict;
-        status2 = ModelStatus::GETTING_CONTROLS;
-        result = gradioClient.getControls(ctrlList, cardDict);
+        setStatus(ModelStatus::GETTING_CONTROLS);
+        {
+            // A schema found by the revalidation of a previous load is of no use anymore
+            std::lock_guard<std::mutex> lock(schemaMutex);
+            schemaGeneration++;
+            hasPendingSchema = false;
+        }
+
+        // The schema of the last time the space was loaded, if any. It is only
+        // used if someone can pick up a changed schema, see onSchemaChanged
+        SchemaCache::Entry schema;
+        bool usedCachedSchema = onSchemaChanged != nullptr
+                                && SchemaCache::getInstance()->lookup(userSpaceAddress, schema);
+
+        if (onSchemaChanged != nullptr)
+            Metrics::getInstance()->countCacheLookup("schema", usedCachedSchema);
+
+        if (usedCachedSchema)
+        {
+            LogAndDBG("Using the cached controls of " + juce::String(userSpaceAddress));
+            ctrlList = schema.ctrlList;
+            for (const auto& property : schema.card.getDynamicObject()->getProperties())
+                cardDict.setProperty(property.name, property.value);
+        }
+        // Without revalidation, only controls that a probe or a load fetched
+        // recently are used, see SpaceProber
+        else if (onSchemaChanged == nullptr
+                 && SpaceProber::getInstance()->getCachedControls(
+                     userSpaceAddress, ctrlList, cardDict))
+        {
+            LogAndDBG("Using the recently fetched controls of " + juce::String(userSpaceAddress));
+            Metrics::getInstance()->countCacheLookup("probe", true);
+        }
+        else
+        {
+            if (onSchemaChanged == nullptr)
+                Metrics::getInstance()->countCacheLookup("probe", false);
+            result = gradioClient.getControls(ctrlList, cardDict);
+            if (result.failed())
+            {
+                setStatus(ModelStatus::ERROR);
+                return result;
+            }
+            // revalidateSchema stores them in the SchemaCache, along with the server version
+        }
+
+        ModelCard card;
+        CtrlList ctrls;
+        result = buildSchema(ctrlList, cardDict, card, ctrls);
         if (result.failed())
         {
-            status2 = ModelStatus::ERROR;
+            setStatus(ModelStatus::ERROR);
             return result;
         }
+        m_card = card;
+        m_ctrls = ctrls;
+
+        if (! usedCachedSchema)
+        {
+            schema.space = userSpaceAddress;
+            schema.ctrlList = ctrlList;
+            schema.card = juce::var(copySchemaCard(cardDict).get());
+            schema.fetchTime = juce::Time::getCurrentTime();
+        }
+        revalidateSchemaAsync(schema, usedCachedSchema);
+
+        setStatus(ModelStatus::LOADED);
+        return OpResult::ok();
+    }
+
+    /*
+    * Called from a JobScheduler thread when the controls of the loaded space
+    * turn out to differ from the cached ones that load() used. Call
+    * applyUpdatedSchema() from the thread that owns the controls to switch
+    * to the new ones. load() only uses cached schemas if this is set.
+    */
+    std::function<void()> onSchemaChanged;
+
+    bool hasUpdatedSchema()
+    {
+        std::lock_guard<std::mutex> lock(schemaMutex);
+        return hasPendingSchema;
+    }
+
+    // Switches to the schema found by the background revalidation, if any
+    OpResult applyUpdatedSchema()
+    {
+        SchemaCache::Entry schema;
+        {
+            std::lock_guard<std::mutex> lock(schemaMutex);
+            if (! hasPendingSchema)
+                return OpResult::ok();
+            schema = pendingSchema;
+            hasPendingSchema = false;
+        }
+
+        ModelCard card;
+        CtrlList ctrls;
+        OpResult result =
+            buildSchema(schema.ctrlList, *schema.card.getDynamicObject(), card, ctrls);
+        if (result.failed())
+            return result;
+
+        m_card = card;
+        m_ctrls = ctrls;
+        return OpResult::ok();
+    }
+
+    /*
+    * Schedules the processing of filetoProcess on the JobScheduler, one task
+    * per stage (see makeProcessStages). The model's own status, progress,
+    * labels and trace follow the job, and cancel() aborts it.
+    * The model has to be owned by a shared_ptr.
+    */
+    JobScheduler::JobHandle
+        processAsync(juce::File filetoProcess,
+                     JobScheduler::Priority priority = JobScheduler::Priority::Interactive)
+    {
+        // The GUI follows the model's own status, progress and labels
+        auto context = std::make_shared<ProcessContext>();
+        ProcessContext* contextPtr = context.get();
+        context->onChange = [this, contextPtr]
+        {
+            statusChannel.publish(contextPtr->status.load());
+            statusChannel.publishProgress(contextPtr->progress.load());
+        };
+
+        // cancel() aborts this job
+        {
+            std::lock_guard<std::mutex> lock(cancellationMutex);
+            currentCancellation = context->cancellation;
+        }
+
+        auto job = JobScheduler::getInstance()->submit(gradioClient.getSpaceInfo().gradio,
+                                                       priority,
+                                                       makeProcessStages(filetoProcess, context),
+                                                       context->cancellation);
+
+        auto self = shared_from_this();
+        job.then([self, context](const OpResult& result)
+                 { self->finishProcessAsync(*context, result); });
+        return job;
+    }
+
+    /*
+    * Processes filetoProcess in place, reporting the status, progress and
+    * labels of this call through context instead of the model's own state.
+    * Safe to call concurrently for different files. Runs the same stages
+    * as makeProcessStages, one after the other on the calling thread.
+    */
+    OpResult process(juce::File filetoProcess, ProcessContext& context)
+    {
+        context.file = filetoProcess;
+        if (context.ctrlValues.isVoid())
+        {
+            OpResult result = getCtrlValues(context.ctrlValues);
+            if (result.failed())
+                return result;
+        }
+        for (const auto& stage : getProcessStages())
+        {
+            OpResult result = runStage(stage, context);
+            if (result.failed())
+                return result;
+        }
+        return OpResult::ok();
+    }
+
+    /*
+    * The stages of process(file, context) as JobScheduler tasks:
+    * prepare (result cache lookup), upload, call, poll and download.
+    * Each task keeps the model and the context alive. The values of the
+    * controls are taken now, unless the context already has them.
+    * The model has to be owned by a shared_ptr.
+    */
+    std::vector<JobScheduler::Stage> makeProcessStages(juce::File filetoProcess,
+                                                       std::shared_ptr<ProcessContext> context)
+    {
+        context->file = filetoProcess;
+        auto self = shared_from_this();
+
+        std::vector<JobScheduler::Stage> stages;
+        if (context->ctrlValues.isVoid())
+        {
+            OpResult result = getCtrlValues(context->ctrlValues);
+            if (result.failed())
+            {
+                stages.push_back({ "prepare", [result] { return result; } });
+                return stages;
+            }
+        }
+        for (const auto& stage : getProcessStages())
+        {
+            stages.push_back(
+                { stage.name, [self, context, stage] { return self->runStage(stage, *context); } });
+        }
+        return stages;
+    }
+
+    OpResult cancel()
+    {
+        // Abort the request the current process(file) call is blocked on,
+        // so that its thread is freed straight away. Then ask the app
+        // to stop working on the job as well
+        bool abortedLocally = false;
+        {
+            std::lock_guard<std::mutex> lock(cancellationMutex);
+            if (currentCancellation != nullptr)
+            {
+                currentCancellation->cancel();
+                abortedLocally = true;
+            }
+        }
+
+        // Create a successful result.
+        // we'll update it to a failure result if something goes wrong
+        OpResult result = OpResult::ok();
+
+        juce::String eventId;
+        juce::String endpoint = "cancel";
+
+        // Perform a POST request to the cancel endpoint to get the event ID
+        juce::String jsonBody = R"({"data": []})"; // The body is empty in this case
+
+        setStatus(ModelStatus::CANCELLING);
+        result = gradioClient.makePostRequestForEventID(endpoint, eventId, jsonBody);
+        if (result.wasOk())
+        {
+            // Use the event ID to make a GET request for the cancel response
+            juce::String response;
+            result = gradioClient.getResponseFromEventID(endpoint, eventId, response);
+        }
+
+        if (result.failed() && ! abortedLocally)
+        {
+            setStatus(ModelStatus::ERROR);
+            return result;
+        }
+        if (result.failed())
+        {
+            // Our side of the job is gone either way
+            LogAndDBG("The app did not acknowledge the cancellation: "
+                      + result.getError().devMessage);
+        }
+        setStatus(ModelStatus::CANCELLED);
+        return OpResult::ok();
+    }
+
+    ModelStatus getStatus() const { return statusChannel.getStatus(); }
+
+    // The trace of the last process(file) call
+    PipelineTrace getLastTrace() const { return lastTrace; }
+
+    // Safe to call from any thread, see StatusChannel
+    void setStatus(ModelStatus status) { statusChannel.publish(status); }
+
+    // Progress (0-1) of the current processing job, or -1 if the app doesn't report any
+    float getProgress() const { return statusChannel.getProgress(); }
+
+    // Every status and progress change, for the GUI
+    StatusChannel& getStatusChannel() { return statusChannel; }
+
+    ModelStatus getLastStatus() { return lastStatus; }
+    void setLastStatus(ModelStatus status) { lastStatus = status; }
+
+    CtrlList::iterator findCtrlByUuid(const juce::Uuid& uuid)
+    {
+        return std::find_if(m_ctrls.begin(),
+                            m_ctrls.end(),
+                            [&uuid](const CtrlList::value_type& pair)
+                            { return pair.first == uuid; });
+    }
+
+    // Sets the control whose label matches label (case insensitive) to value,
+    // e.g from the command line or a pipeline definition
+    OpResult setCtrlValue(const juce::String& label, const juce::String& value)
+    {
+        Error error;
+        error.type = ErrorType::UnsupportedControlType;
+
+        for (auto& ctrlPair : m_ctrls)
+        {
+            Ctrl* ctrl = ctrlPair.second.get();
+            if (! label.equalsIgnoreCase(juce::String(ctrl->label)))
+                continue;
+
+            if (auto slider = dynamic_cast<SliderCtrl*>(ctrl))
+                slider->value =
+                    juce::jlimit(slider->minimum, slider->maximum, value.getDoubleValue());
+            else if (auto numberBox = dynamic_cast<NumberBoxCtrl*>(ctrl))
+                numberBox->value =
+                    juce::jlimit(numberBox->min, numberBox->max, value.getDoubleValue());
+            else if (auto toggle = dynamic_cast<ToggleCtrl*>(ctrl))
+                toggle->value = value.equalsIgnoreCase("true") || value == "1"
+                                || value.equalsIgnoreCase("yes");
+            else if (auto textBox = dynamic_cast<TextBoxCtrl*>(ctrl))
+                textBox->value = value.toStdString();
+            else if (auto comboBox = dynamic_cast<ComboBoxCtrl*>(ctrl))
+            {
+                if (std::find(comboBox->options.begin(),
+                              comboBox->options.end(),
+                              value.toStdString())
+                    == comboBox->options.end())
+                {
+                    error.devMessage = "\"" + value + "\" is not one of the options of " + label;
+                    return OpResult::fail(error);
+                }
+                comboBox->value = value.toStdString();
+            }
+            else
+            {
+                error.devMessage = "The control " + label + " can't be set by value.";
+                return OpResult::fail(error);
+            }
+            return OpResult::ok();
+        }
+
+        error.devMessage = "The app has no control named " + label;
+        return OpResult::fail(error);
+    }
+
+    GradioClient& getGradioClient() { return gradioClient; }
+
+    LabelList& getLabels() { return labels; }
+
+private:
+    using StageMethod = OpResult (WebModel::*)(ProcessContext&);
+
+    struct StageInfo
+    {
+        const char* name;
+        StageMethod method;
+    };
+
+    static const std::vector<StageInfo>& getProcessStages()
+    {
+        static const std::vector<StageInfo> stages = {
+            { "prepare", &WebModel::prepareStage },
+            { "upload", &WebModel::uploadStage },
+            { "call", &WebModel::callStage },
+            { "poll", &WebModel::pollStage },
+            { "download", &WebModel::downloadStage },
+        };
+        return stages;
+    }
+
+    // Runs one stage of a call, counting its failures
+    OpResult runStage(const StageInfo& stage, ProcessContext& context)
+    {
+        OpResult result = (this->*stage.method)(context);
+        if (result.failed())
+            Metrics::getInstance()->countError(result.getError(), stage.name);
+        return result;
+    }
+
+    // Builds the model card and the controls from a controls response,
+    // see GradioClient::getControls
+    static OpResult buildSchema(const juce::Array<juce::var>& ctrlList,
+                                const juce::DynamicObject& cardDict,
+                                ModelCard& card,
+                                CtrlList& ctrls)
+    {
+        Error error;
+        error.type = ErrorType::JsonParseError;
 
         // TODO: probably need to check if these properties exist and if they're the right types.
-        m_card = ModelCard();
-        m_card.name = cardDict.getProperty("name").toString().toStdString();
-        m_card.description = cardDict.getProperty("description").toString().toStdString();
-        m_card.author = cardDict.getProperty("author").toString().toStdString();
-        m_card.midi_in = (bool) cardDict.getProperty("midi_in");
-        m_card.midi_out = (bool) cardDict.getProperty("midi_out");
+        card = ModelCard();
+        card.name = cardDict.getProperty("name").toString().toStdString();
+        card.description = cardDict.getProperty("description").toString().toStdString();
+        card.author = cardDict.getProperty("author").toString().toStdString();
+        card.midi_in = (bool) cardDict.getProperty("midi_in");
+        card.midi_out = (bool) cardDict.getProperty("midi_out");
 
         // tags is a list of str
         juce::Array<juce::var>* tags = cardDict.getProperty("tags").getArray();
         if (tags == nullptr)
         {
-            status2 = ModelStatus::ERROR;
             error.devMessage = "Failed to load the tags array from JSON. tags is null.";
             return OpResult::fail(error);
         }
 
         for (int i = 0; i < tags->size(); i++)
         {
-            m_card.tags.push_back(tags->getReference(i).toString().toStdString());
+            card.tags.push_back(tags->getReference(i).toString().toStdString());
         }
 
-        // clear the m_ctrls vector
-        m_ctrls.clear();
+        ctrls.clear();
 
         // iterate through the list of controls
-        // and add them to the m_ctrls vector
+        // and add them to the ctrls vector
         for (int i = 0; i < ctrlList.size(); i++)
         {
             juce::var ctrl = ctrlList.getReference(i);
             if (! ctrl.isObject())
             {
-                status2 = ModelStatus::ERROR;
                 error.devMessage = "Failed to load controls from JSON. ctrl is not an object.";
                 return OpResult::fail(error);
             }
@@ -116,16 +619,18 @@ public:
                     auto audio_in = std::make_shared<AudioInCtrl>();
                     audio_in->label = ctrl["label"].toString().toStdString();
 
-                    m_ctrls.push_back({ audio_in->id, audio_in });
-                    LogAndDBG("Audio In: " + audio_in->label + " added");
+                    ctrls.push_back({ audio_in->id, audio_in });
+                    LogAndDBG("Audio In: " + audio_in->label + " added",
+                              HarpLogger::Level::Debug);
                 }
                 else if (ctrl_type == "midi_in")
                 {
                     auto midi_in = std::make_shared<MidiInCtrl>();
                     midi_in->label = ctrl["label"].toString().toStdString();
 
-                    m_ctrls.push_back({ midi_in->id, midi_in });
-                    LogAndDBG("MIDI In: " + midi_in->label + " added");
+                    ctrls.push_back({ midi_in->id, midi_in });
+                    LogAndDBG("MIDI In: " + midi_in->label + " added",
+                              HarpLogger::Level::Debug);
                 }
                 // The rest are the actual controls that map to hyperparameters
                 // of the model
@@ -139,8 +644,9 @@ public:
                     slider->step = ctrl["step"].toString().getFloatValue();
                     slider->value = ctrl["value"].toString().getFloatValue();
 
-                    m_ctrls.push_back({ slider->id, slider });
-                    LogAndDBG("Slider: " + slider->label + " added");
+                    ctrls.push_back({ slider->id, slider });
+                    LogAndDBG("Slider: " + slider->label + " added",
+                              HarpLogger::Level::Debug);
                 }
                 else if (ctrl_type == "text")
                 {
@@ -149,8 +655,9 @@ public:
                     text->label = ctrl["label"].toString().toStdString();
                     text->value = ctrl["value"].toString().toStdString();
 
-                    m_ctrls.push_back({ text->id, text });
-                    LogAndDBG("Text: " + text->label + " added");
+                    ctrls.push_back({ text->id, text });
+                    LogAndDBG("Text: " + text->label + " added",
+                              HarpLogger::Level::Debug);
                 }
                 else if (ctrl_type == "number_box")
                 {
@@ -160,49 +667,221 @@ public:
                     number_box->max = ctrl["max"].toString().getFloatValue();
                     number_box->value = ctrl["value"].toString().getFloatValue();
 
-                    m_ctrls.push_back({ number_box->id, number_box });
-                    LogAndDBG("Number Box: " + number_box->label + " added");
+                    ctrls.push_back({ number_box->id, number_box });
+                    LogAndDBG("Number Box: " + number_box->label + " added",
+                              HarpLogger::Level::Debug);
                 }
                 else
-                    LogAndDBG("failed to parse control with unknown type: " + ctrl_type);
+                    LogAndDBG("failed to parse control with unknown type: " + ctrl_type,
+                              HarpLogger::Level::Warning);
             }
             catch (const char* e)
             {
-                status2 = ModelStatus::ERROR;
                 error.devMessage = "Failed to load controls from JSON. " + std::string(e);
                 return OpResult::fail(error);
             }
         }
-        status2 = ModelStatus::LOADED;
         return OpResult::ok();
     }
 
-    OpResult process(juce::File filetoProcess)
+    static juce::DynamicObject::Ptr copySchemaCard(const juce::DynamicObject& cardDict)
     {
-        status2 = ModelStatus::STARTING;
-        // Create an Error object in case we need it
-        // and a successful result
-        Error error;
-        error.type = ErrorType::JsonParseError;
-        OpResult result = OpResult::ok();
+        juce::DynamicObject::Ptr card = new juce::DynamicObject();
+        for (const auto& property : cardDict.getProperties())
+            card->setProperty(property.name, property.value);
+        return card;
+    }
+
+    /*
+    * Brings the schema cache up to date with the space, on the JobScheduler.
+    * A cached schema is fetched again unless the server version (the config's
+    * ETag) is known and unchanged, and if it differs, it is handed to onSchemaChanged.
+    */
+    void revalidateSchemaAsync(SchemaCache::Entry schema, bool fromCache)
+    {
+        int generation = 0;
+        {
+            std::lock_guard<std::mutex> lock(schemaMutex);
+            generation = schemaGeneration;
+        }
+
+        auto self = shared_from_this();
+        auto revalidate = [self, schema, fromCache, generation]
+        { return self->revalidateSchema(schema, fromCache, generation); };
+
+        // Behind any processing, it isn't needed for anything the user is waiting on
+        JobScheduler::getInstance()->submit(gradioClient.getSpaceInfo().gradio,
+                                            JobScheduler::Priority::Batch,
+                                            { { "revalidate_schema", revalidate } });
+    }
+
+    OpResult revalidateSchema(SchemaCache::Entry schema, bool fromCache, int generation)
+    {
+        // Our own client, since load() may switch gradioClient to another space meanwhile
+        GradioClient client;
+        OpResult result = client.setSpaceInfo(schema.space);
+        if (result.failed())
+            return result;
+
+        // Only a matching ETag vouches for the controls. Without one (or if the
+        // config can't be fetched), the controls are fetched and compared again
+        juce::String version;
+        bool versionKnown = client.getServerVersion(version).wasOk() && version.isNotEmpty();
+        if (fromCache && versionKnown && version == schema.serverVersion)
+            return OpResult::ok();
+
+        bool changed = false;
+        if (fromCache)
+        {
+            juce::Array<juce::var> ctrlList;
+            juce::DynamicObject cardDict;
+            result = client.getControls(ctrlList, cardDict);
+            if (result.failed())
+            {
+                LogAndDBG("Could not revalidate the controls of " + schema.space + ": "
+                          + result.getError().devMessage);
+                return result;
+            }
+
+            juce::var card(copySchemaCard(cardDict).get());
+            changed = SchemaCache::hashSchema(ctrlList, card) != schema.schemaHash;
+            schema.ctrlList = ctrlList;
+            schema.card = card;
+            schema.fetchTime = juce::Time::getCurrentTime();
+        }
+        schema.serverVersion = versionKnown ? version : juce::String();
+        SchemaCache::getInstance()->store(schema);
+
+        if (! changed)
+            return OpResult::ok();
+
+        {
+            std::lock_guard<std::mutex> lock(schemaMutex);
+            // Another space was loaded since
+            if (generation != schemaGeneration)
+                return OpResult::ok();
+            pendingSchema = schema;
+            hasPendingSchema = true;
+        }
+        LogAndDBG("The controls of " + schema.space + " changed since they were cached");
+        if (onSchemaChanged)
+            onSchemaChanged();
+        return OpResult::ok();
+    }
+
+    // Publishes the outcome of a processAsync job as the model's own state
+    void finishProcessAsync(ProcessContext& context, const OpResult& result)
+    {
+        {
+            std::lock_guard<std::mutex> lock(cancellationMutex);
+            if (currentCancellation == context.cancellation)
+                currentCancellation.reset();
+        }
 
-        status2 = ModelStatus::SENDING;
-        juce::String uploadedFilePath;
-        result = gradioClient.uploadFileRequest(filetoProcess, uploadedFilePath);
         if (result.failed())
         {
-            status2 = ModelStatus::ERROR;
+            // Also covers jobs that were cancelled before their first stage ran
+            context.setFailed();
+            context.trace.setError(result.getError().devMessage);
+        }
+        if (context.labelsJson.isNotEmpty())
+        {
+            labels = std::move(context.labels);
+        }
+        // The GUI adds the display reload time before writing it
+        lastTrace = context.trace;
+    }
+
+    // Hashes the input and looks for an identical request in the result cache
+    OpResult prepareStage(ProcessContext& context)
+    {
+        context.setStatus(ModelStatus::STARTING);
+        context.setProgress(-1.0f);
+        context.trace.reset(gradioClient.getSpaceInfo().gradio, context.file.getFileName());
+        context.servedFromCache = false;
+
+        // Identical requests (same space, input and control values) are served
+        // from the result cache without touching the network
+        context.trace.begin("cache_lookup");
+        uint64_t inputHash = 0;
+        context.inputHash.reset();
+        if (ContentHash::hashFile(context.file, inputHash))
+            context.inputHash = inputHash;
+        if (context.inputHash.has_value())
+        {
+            juce::String ctrlKeyJson;
+            OpResult result = ctrlsToJson(ctrlKeyJson, context.ctrlValues, "");
+            if (result.failed())
+            {
+                context.setFailed();
+                return result;
+            }
+            context.resultKey = ResultCache::makeKey(
+                gradioClient.getSpaceInfo().gradio, *context.inputHash, ctrlKeyJson);
+
+            if (loadCachedResult(context.resultKey, context.file, context).wasOk())
+            {
+                LogAndDBG("Using the cached result of " + context.file.getFileName());
+                context.servedFromCache = true;
+            }
+            Metrics::getInstance()->countCacheLookup("result", context.servedFromCache);
+        }
+        context.trace.end();
+
+        if (context.servedFromCache)
+            context.setStatus(ModelStatus::FINISHED);
+        return OpResult::ok();
+    }
+
+    OpResult uploadStage(ProcessContext& context)
+    {
+        if (context.servedFromCache)
+            return OpResult::ok();
+
+        context.setStatus(ModelStatus::SENDING);
+        context.trace.begin("upload");
+        bool uploadWasCached = false;
+        RetryPolicy::Stats retryStats;
+        OpResult result = gradioClient.uploadFileCached(context.file,
+                                                        context.inputHash,
+                                                        context.uploadedFilePath,
+                                                        &uploadWasCached,
+                                                        10000,
+                                                        context.cancellation.get(),
+                                                        &retryStats);
+        context.trace.end(uploadWasCached ? 0 : context.file.getSize());
+        context.trace.addRetries(retryStats.numRetries, retryStats.waitMs);
+        if (result.failed())
+        {
+            context.setFailed();
             return result;
         }
 
-        juce::String eventId;
+        if (context.inputHash.has_value())
+            Metrics::getInstance()->countCacheLookup("upload", uploadWasCached);
+        if (! uploadWasCached)
+        {
+            Metrics::getInstance()
+                ->counter("harp_bytes_total", { { "direction", "up" } })
+                .increment(context.file.getSize());
+        }
+        return result;
+    }
+
+    // Starts the job on the app
+    OpResult callStage(ProcessContext& context)
+    {
+        if (context.servedFromCache)
+            return OpResult::ok();
+
         juce::String endpoint = "process";
         // the  jsonBody is created by ctrlsToJson
         juce::String ctrlJson;
-        result = ctrlsToJson(ctrlJson, uploadedFilePath.toStdString());
+        OpResult result =
+            ctrlsToJson(ctrlJson, context.ctrlValues, context.uploadedFilePath.toStdString());
         if (result.failed())
         {
-            status2 = ModelStatus::ERROR;
+            context.setFailed();
             return result;
         }
         // TODO: The jsonBody should be created using DynamicObject and var
@@ -215,29 +894,72 @@ public:
             }
             )";
 
-        status2 = ModelStatus::PROCESSING;
-        result = gradioClient.makePostRequestForEventID(endpoint, eventId, jsonBody);
+        context.setStatus(ModelStatus::PROCESSING);
+        context.trace.begin("submit");
+        RetryPolicy::Stats retryStats;
+        result = gradioClient.makePostRequestForEventID(
+            endpoint, context.eventId, jsonBody, 10000, context.cancellation.get(), &retryStats);
+        context.trace.end();
+        context.trace.addRetries(retryStats.numRetries, retryStats.waitMs);
         if (result.failed())
         {
-            status2 = ModelStatus::ERROR;
-            return result;
+            context.setFailed();
         }
+        return result;
+    }
+
+    // Waits for the app to finish the job
+    OpResult pollStage(ProcessContext& context)
+    {
+        if (context.servedFromCache)
+            return OpResult::ok();
 
-        juce::String response;
-        result =
-            gradioClient.getResponseFromEventID(endpoint, eventId, response, 14000);
+        // Update the progress as the events of the job arrive
+        auto onEvent = [&context](const SSEEvent& event)
+        {
+            float eventProgress = event.getProgress();
+            if (eventProgress >= 0.0f)
+                context.setProgress(eventProgress);
+        };
+
+        // queue: until the event stream is opened
+        // first_byte: until the app sends its first event
+        // inference: until the app sends its result
+        GradioClient::EventStreamTimings streamTimings;
+        OpResult result = gradioClient.getResponseFromEventID("process",
+                                                              context.eventId,
+                                                              context.response,
+                                                              14000,
+                                                              onEvent,
+                                                              &streamTimings,
+                                                              context.cancellation.get());
+        context.trace.add("queue", streamTimings.connectMs);
+        context.trace.add("first_byte", streamTimings.firstByteMs);
+        context.trace.add("inference", streamTimings.streamMs, streamTimings.bytes);
         if (result.failed())
         {
-            status2 = ModelStatus::ERROR;
-            return result;
+            context.setFailed();
         }
+        return result;
+    }
+
+    // Parses the response and downloads the outputs into context.file
+    OpResult downloadStage(ProcessContext& context)
+    {
+        if (context.servedFromCache)
+            return OpResult::ok();
 
+        Error error;
+        error.type = ErrorType::JsonParseError;
+
+        context.trace.begin("parse");
         juce::String responseData;
         juce::String key = "data: ";
-        result = gradioClient.extractKeyFromResponse(response, responseData, key);
+        OpResult result =
+            gradioClient.extractKeyFromResponse(context.response, responseData, key);
         if (result.failed())
         {
-            status2 = ModelStatus::ERROR;
+            context.setFailed();
             return result;
         }
 
@@ -246,30 +968,35 @@ public:
         if (! parsedData.isObject())
         {
             error.devMessage = "Failed to parse the 'data' key of the received JSON.";
-            status2 = ModelStatus::ERROR;
+            context.setFailed();
             return OpResult::fail(error);
         }
         if (! parsedData.isArray())
         {
             error.devMessage = "Parsed data field should be an array.";
-            status2 = ModelStatus::ERROR;
+            context.setFailed();
             return OpResult::fail(error);
         }
         juce::Array<juce::var>* dataArray = parsedData.getArray();
         if (dataArray == nullptr)
         {
             error.devMessage = "The data array is empty.";
-            status2 = ModelStatus::ERROR;
+            context.setFailed();
             return OpResult::fail(error);
         }
 
+        context.trace.end();
+
+        // Whether we received a file, so that we can store it in the result cache
+        bool producedOutputFile = false;
+
         // Iterate through the array elements
         for (int i = 0; i < dataArray->size(); i++)
         {
             juce::var procObj = dataArray->getReference(i);
             if (! procObj.isObject())
             {
-                status2 = ModelStatus::ERROR;
+                context.setFailed();
                 error.devMessage =
                     "The " + juce::String(i)
                     + "th element of the array of processed outputs we received from the gradio app is not an object.";
@@ -282,7 +1009,7 @@ public:
             // meta should be an object
             if (! meta.isObject())
             {
-                status2 = ModelStatus::ERROR;
+                context.setFailed();
                 error.type = ErrorType::MissingJsonKey;
                 error.devMessage =
                     "The " + juce::String(i)
@@ -310,151 +1037,53 @@ public:
                 }
                 else
                 {
-                    status2 = ModelStatus::ERROR;
+                    context.setFailed();
                     error.type = ErrorType::FileDownloadError;
                     error.devMessage =
                         "The url does not contain the expected substring '/c/file='. Check if https://github.com/gradio-app/gradio/issues/9049 has been fixed";
                     return OpResult::fail(error);
                 }
-                result = gradioClient.downloadFileFromURL(url, outputFilePath);
+                context.setStatus(ModelStatus::DOWNLOADING);
+                context.setProgress(-1.0f);
+                auto onProgress = [&context](juce::int64 downloaded, juce::int64 total)
+                {
+                    if (total > 0)
+                        context.setProgress((float) downloaded / (float) total);
+                };
+                context.trace.begin("download");
+                SegmentedDownload::Stats downloadStats;
+                result = gradioClient.downloadFileFromURL(url,
+                                                          outputFilePath,
+                                                          10000,
+                                                          onProgress,
+                                                          &downloadStats,
+                                                          context.cancellation.get());
+                context.trace.end(downloadStats.bytes);
                 if (result.failed())
                 {
-                    status2 = ModelStatus::ERROR;
+                    context.setFailed();
                     return result;
                 }
+                Metrics::getInstance()
+                    ->counter("harp_bytes_total", { { "direction", "down" } })
+                    .increment(downloadStats.bytes);
                 // Make a juce::File from the path
                 juce::File processedFile(outputFilePath);
                 // Replace the input file with the processed file
-                processedFile.moveFileTo(filetoProcess);
+                processedFile.moveFileTo(context.file);
+                producedOutputFile = true;
             }
             else if (procObjType == "pyharp.LabelList")
             {
-                juce::Array<juce::var>* labelsPyharp =
-                    procObj.getDynamicObject()->getProperty("labels").getArray();
-                labels.clear();
-                for (int j = 0; j < labelsPyharp->size(); j++)
+                context.trace.begin("labels");
+                result = parseLabels(procObj, context.labels);
+                context.trace.end();
+                if (result.failed())
                 {
-                    juce::DynamicObject* labelPyharp =
-                        labelsPyharp->getReference(j).getDynamicObject();
-                    juce::String labelType = labelPyharp->getProperty("label_type").toString();
-                    std::unique_ptr<OutputLabel> label;
-
-                    if (labelType == "AudioLabel")
-                    {
-                        auto audioLabel = std::make_unique<AudioLabel>();
-                        if (labelPyharp->hasProperty("amplitude"))
-                        {
-                            if (labelPyharp->getProperty("amplitude").isDouble()
-                                || labelPyharp->getProperty("amplitude").isInt())
-                            {
-                                audioLabel->amplitude =
-                                    static_cast<float>(labelPyharp->getProperty("amplitude"));
-                            }
-                        }
-                        label = std::move(audioLabel);
-                    }
-                    else if (labelType == "SpectrogramLabel")
-                    {
-                        auto spectrogramLabel = std::make_unique<SpectrogramLabel>();
-                        if (labelPyharp->hasProperty("frequency"))
-                        {
-                            if (labelPyharp->getProperty("frequency").isDouble()
-                                || labelPyharp->getProperty("frequency").isInt())
-                            {
-                                spectrogramLabel->frequency =
-                                    static_cast<float>(labelPyharp->getProperty("frequency"));
-                            }
-                        }
-                        label = std::move(spectrogramLabel);
-                    }
-                    else if (labelType == "MidiLabel")
-                    {
-                        auto midiLabel = std::make_unique<MidiLabel>();
-                        if (labelPyharp->hasProperty("pitch"))
-                        {
-                            if (labelPyharp->getProperty("pitch").isDouble()
-                                || labelPyharp->getProperty("pitch").isInt())
-                            {
-                                midiLabel->pitch =
-                                    static_cast<float>(labelPyharp->getProperty("pitch"));
-                            }
-                        }
-                        label = std::move(midiLabel);
-                    }
-                    else
-                    {
-                        error.type = ErrorType::UnknownLabelType;
-                        error.devMessage = "Unknown label type: " + labelType;
-                        return OpResult::fail(error);
-                    }
-                    // All the labels, no matter theyr type, have some common properties
-                    // t: float
-                    // label: str
-                    // duration: float = 0.0
-                    // description: str = None
-                    // color: int = 0
-                    // first we'll check which of those exist and are not void or null
-                    // for those that exist, we fill the struct properties
-                    // the rest will be ignored
-                    if (labelPyharp->hasProperty("t"))
-                    {
-                        // now check if it's a float
-                        if (labelPyharp->getProperty("t").isDouble()
-                            || labelPyharp->getProperty("t").isInt())
-                        {
-                            label->t = static_cast<float>(labelPyharp->getProperty("t"));
-                        }
-                    }
-                    if (labelPyharp->hasProperty("label"))
-                    {
-                        // now check if it's a string
-                        if (labelPyharp->getProperty("label").isString())
-                        {
-                            label->label = labelPyharp->getProperty("label").toString();
-                        }
-                    }
-                    if (labelPyharp->hasProperty("duration"))
-                    {
-                        // now check if it's a float
-                        if (labelPyharp->getProperty("duration").isDouble()
-                            || labelPyharp->getProperty("duration").isInt())
-                        {
-                            label->duration =
-                                static_cast<float>(labelPyharp->getProperty("duration"));
-                        }
-                    }
-                    if (labelPyharp->hasProperty("description"))
-                    {
-                        // now check if it's a string
-                        if (labelPyharp->getProperty("description").isString())
-                        {
-                            label->description = labelPyharp->getProperty("description").toString();
-                        }
-                    }
-                    if (labelPyharp->hasProperty("color"))
-                    {
-                        // now check if it's an int
-                        if ((labelPyharp->getProperty("color").isInt64()
-                             || labelPyharp->getProperty("color").isInt()))
-                        {
-                            int color_val = static_cast<int>(labelPyharp->getProperty("color"));
-
-                            if (color_val != 0)
-                            {
-                                label->color = color_val;
-                            }
-                        }
-                    }
-                    if (labelPyharp->hasProperty("link"))
-                    {
-                        // now check if it's a string
-                        if (labelPyharp->getProperty("link").isString())
-                        {
-                            label->link = labelPyharp->getProperty("link").toString();
-                        }
-                    }
-                    labels.push_back(std::move(label));
+                    context.setFailed();
+                    return result;
                 }
+                context.labelsJson = juce::JSON::toString(procObj, true);
             }
             else
             {
@@ -462,130 +1091,228 @@ public:
                           + " object, that we don't yet support in HARP.");
             }
         }
-        status2 = ModelStatus::FINISHED;
-        return result;
+        if (context.resultKey.isNotEmpty())
+        {
+            context.trace.begin("cache_store");
+            ResultCache::getInstance()->store(context.resultKey,
+                                              producedOutputFile ? context.file : juce::File(),
+                                              context.labelsJson);
+            context.trace.end();
+        }
+
+        LogAndDBG(ConnectionPool::getInstance()->statsToString());
+        context.setStatus(ModelStatus::FINISHED);
+        return OpResult::ok();
     }
 
-    OpResult cancel()
+    // Restores a result from the result cache into filetoProcess and context.
+    // Fails if there is no usable entry for key
+    OpResult loadCachedResult(const juce::String& key,
+                              juce::File filetoProcess,
+                              ProcessContext& context)
     {
-        // Create a successful result.
-        // we'll update it to a failure result if something goes wrong
-        OpResult result = OpResult::ok();
-
-        juce::String eventId;
-        juce::String endpoint = "cancel";
+        Error error;
+        error.type = ErrorType::MissingJsonKey;
+        error.devMessage = "No cached result for " + key;
 
-        // Perform a POST request to the cancel endpoint to get the event ID
-        juce::String jsonBody = R"({"data": []})"; // The body is empty in this case
+        ResultCache::Entry entry;
+        if (! ResultCache::getInstance()->lookup(key, entry))
+            return OpResult::fail(error);
 
-        status2 = ModelStatus::CANCELLING;
-        result = gradioClient.makePostRequestForEventID(endpoint, eventId, jsonBody);
-        if (result.failed())
+        if (entry.labelsJson.isNotEmpty())
         {
-            status2 = ModelStatus::ERROR;
-            return result;
+            juce::var procObj = juce::JSON::parse(entry.labelsJson);
+            if (! procObj.isObject())
+                return OpResult::fail(error);
+
+            OpResult result = parseLabels(procObj, context.labels);
+            if (result.failed())
+                return result;
+            context.labelsJson = entry.labelsJson;
         }
 
-        // Use the event ID to make a GET request for the cancel response
-        juce::String response;
-        result = gradioClient.getResponseFromEventID(endpoint, eventId, response);
-        if (result.failed())
+        if (entry.outputFile.existsAsFile() && ! entry.outputFile.copyFileTo(filetoProcess))
         {
-            status2 = ModelStatus::ERROR;
-            return result;
+            error.type = ErrorType::FileDownloadError;
+            error.devMessage =
+                "Failed to copy the cached result " + entry.outputFile.getFullPathName();
+            return OpResult::fail(error);
         }
-        status2 = ModelStatus::CANCELLED;
-        return result;
-    }
-
-    ModelStatus getStatus() { return status2; }
-
-    void setStatus(ModelStatus status) { status2 = status; }
-
-    ModelStatus getLastStatus() { return lastStatus; }
-    void setLastStatus(ModelStatus status) { lastStatus = status; }
 
-    CtrlList::iterator findCtrlByUuid(const juce::Uuid& uuid)
-    {
-        return std::find_if(m_ctrls.begin(),
-                            m_ctrls.end(),
-                            [&uuid](const CtrlList::value_type& pair)
-                            { return pair.first == uuid; });
+        return OpResult::ok();
     }
 
-    GradioClient& getGradioClient() { return gradioClient; }
-
-    LabelList& getLabels() { return labels; }
-
-private:
-    OpResult ctrlsToJson(juce::String& ctrlJson, std::string mediaInputPath) const
+    // Fills labels from a "pyharp.LabelList" object of the process response
+    OpResult parseLabels(const juce::var& procObj, LabelList& parsedLabels) const
     {
-        // Create a JSON array to hold each control's value
-        juce::Array<juce::var> jsonCtrlsArray;
-
-        // Iterate through each control in m_ctrls
-        for (const auto& ctrlPair : m_ctrls)
+        Error error;
+        juce::Array<juce::var>* labelsPyharp =
+            procObj.getDynamicObject()->getProperty("labels").getArray();
+        if (labelsPyharp == nullptr)
         {
-            auto ctrl = ctrlPair.second;
-            // Check the type of ctrl and extract its value
-            if (auto sliderCtrl = dynamic_cast<SliderCtrl*>(ctrl.get()))
+            error.type = ErrorType::MissingJsonKey;
+            error.devMessage = "The pyharp.LabelList object does not have a labels array.";
+            return OpResult::fail(error);
+        }
+        parsedLabels.clear();
+        for (int j = 0; j < labelsPyharp->size(); j++)
+        {
+            juce::DynamicObject* labelPyharp =
+                labelsPyharp->getReference(j).getDynamicObject();
+            juce::String labelType = labelPyharp->getProperty("label_type").toString();
+            std::unique_ptr<OutputLabel> label;
+
+            if (labelType == "AudioLabel")
             {
-                // Slider control, use sliderCtrl->value
-                jsonCtrlsArray.add(juce::var(sliderCtrl->value));
+                auto audioLabel = std::make_unique<AudioLabel>();
+                if (labelPyharp->hasProperty("amplitude"))
+                {
+                    if (labelPyharp->getProperty("amplitude").isDouble()
+                        || labelPyharp->getProperty("amplitude").isInt())
+                    {
+                        audioLabel->amplitude =
+                            static_cast<float>(labelPyharp->getProperty("amplitude"));
+                    }
+                }
+                label = std::move(audioLabel);
             }
-            else if (auto textBoxCtrl = dynamic_cast<TextBoxCtrl*>(ctrl.get()))
+            else if (labelType == "SpectrogramLabel")
             {
-                // Text box control, use textBoxCtrl->value
-                jsonCtrlsArray.add(juce::var(textBoxCtrl->value));
+                auto spectrogramLabel = std::make_unique<SpectrogramLabel>();
+                if (labelPyharp->hasProperty("frequency"))
+                {
+                    if (labelPyharp->getProperty("frequency").isDouble()
+                        || labelPyharp->getProperty("frequency").isInt())
+                    {
+                        spectrogramLabel->frequency =
+                            static_cast<float>(labelPyharp->getProperty("frequency"));
+                    }
+                }
+                label = std::move(spectrogramLabel);
             }
-            else if (auto numberBoxCtrl = dynamic_cast<NumberBoxCtrl*>(ctrl.get()))
+            else if (labelType == "MidiLabel")
             {
-                // Number box control, use numberBoxCtrl->value
-                jsonCtrlsArray.add(juce::var(numberBoxCtrl->value));
+                auto midiLabel = std::make_unique<MidiLabel>();
+                if (labelPyharp->hasProperty("pitch"))
+                {
+                    if (labelPyharp->getProperty("pitch").isDouble()
+                        || labelPyharp->getProperty("pitch").isInt())
+                    {
+                        midiLabel->pitch =
+                            static_cast<float>(labelPyharp->getProperty("pitch"));
+                    }
+                }
+                label = std::move(midiLabel);
             }
-            else if (auto toggleCtrl = dynamic_cast<ToggleCtrl*>(ctrl.get()))
+            else
             {
-                // Toggle control, use toggleCtrl->value
-                jsonCtrlsArray.add(juce::var(toggleCtrl->value));
+                error.type = ErrorType::UnknownLabelType;
+                error.devMessage = "Unknown label type: " + labelType;
+                return OpResult::fail(error);
             }
-            else if (auto comboBoxCtrl = dynamic_cast<ComboBoxCtrl*>(ctrl.get()))
+            // All the labels, no matter theyr type, have some common properties
+            // t: float
+            // label: str
+            // duration: float = 0.0
+            // description: str = None
+            // color: int = 0
+            // first we'll check which of those exist and are not void or null
+            // for those that exist, we fill the struct properties
+            // the rest will be ignored
+            if (labelPyharp->hasProperty("t"))
             {
-                // Combo box control, use comboBoxCtrl->value
-                jsonCtrlsArray.add(juce::var(comboBoxCtrl->value));
+                // now check if it's a float
+                if (labelPyharp->getProperty("t").isDouble()
+                    || labelPyharp->getProperty("t").isInt())
+                {
+                    label->t = static_cast<float>(labelPyharp->getProperty("t"));
+                }
             }
-            else if (auto audioInCtrl = dynamic_cast<AudioInCtrl*>(ctrl.get()))
+            if (labelPyharp->hasProperty("label"))
             {
-                // Audio in control, use audioInCtrl->value
-                audioInCtrl->value = mediaInputPath;
-                // Due to the way gradio http api works, we need to add the mediaInputPath
-                // into another object first, like this:
-                // {
-                //     "path": "path/to/audio/file"
-                // }
-                // juce::DynamicObject obj;
-                juce::DynamicObject::Ptr obj = new juce::DynamicObject();
-                obj->setProperty("path", juce::var(audioInCtrl->value));
-                // Then we add the object to the array
-                jsonCtrlsArray.add(juce::var(obj));
+                // now check if it's a string
+                if (labelPyharp->getProperty("label").isString())
+                {
+                    label->label = labelPyharp->getProperty("label").toString();
+                }
             }
-            else if (auto midiInCtrl = dynamic_cast<MidiInCtrl*>(ctrl.get()))
+            if (labelPyharp->hasProperty("duration"))
             {
-                midiInCtrl->value = mediaInputPath;
-                // same as audioInCtrl
-                juce::DynamicObject::Ptr obj = new juce::DynamicObject();
-                obj->setProperty("path", juce::var(midiInCtrl->value));
-                jsonCtrlsArray.add(juce::var(obj));
+                // now check if it's a float
+                if (labelPyharp->getProperty("duration").isDouble()
+                    || labelPyharp->getProperty("duration").isInt())
+                {
+                    label->duration =
+                        static_cast<float>(labelPyharp->getProperty("duration"));
+                }
             }
-            else
+            if (labelPyharp->hasProperty("description"))
             {
-                Error error;
-                error.type = ErrorType::UnsupportedControlType;
-                // Unsupported control type or missing implementation
-                error.devMessage =
-                    "Unsupported control type or missing implementation for control with ID: "
-                    + ctrl->id.toString();
-                return OpResult::fail(error);
+                // now check if it's a string
+                if (labelPyharp->getProperty("description").isString())
+                {
+                    label->description = labelPyharp->getProperty("description").toString();
+                }
+            }
+            if (labelPyharp->hasProperty("color"))
+            {
+                // now check if it's an int
+                if ((labelPyharp->getProperty("color").isInt64()
+                     || labelPyharp->getProperty("color").isInt()))
+                {
+                    int color_val = static_cast<int>(labelPyharp->getProperty("color"));
+
+                    if (color_val != 0)
+                    {
+                        label->color = color_val;
+                    }
+                }
+            }
+            if (labelPyharp->hasProperty("link"))
+            {
+                // now check if it's a string
+                if (labelPyharp->getProperty("link").isString())
+                {
+                    label->link = labelPyharp->getProperty("link").toString();
+                }
+            }
+            parsedLabels.push_back(std::move(label));
+        }
+        return OpResult::ok();
+    }
+
+    // Fills in the media inputs of ctrlValues (see getCtrlValues) with mediaInputPath
+    static OpResult ctrlsToJson(juce::String& ctrlJson,
+                                const juce::var& ctrlValues,
+                                std::string mediaInputPath)
+    {
+        if (! ctrlValues.isArray())
+        {
+            Error error;
+            error.type = ErrorType::UnknownError;
+            error.devMessage = "The values of the controls were not taken before processing";
+            return OpResult::fail(error);
+        }
+
+        // Create a JSON array to hold each control's value
+        juce::Array<juce::var> jsonCtrlsArray;
+
+        for (const auto& value : *ctrlValues.getArray())
+        {
+            if (! value.isVoid())
+            {
+                jsonCtrlsArray.add(value);
+                continue;
             }
+            // Due to the way gradio http api works, we need to add the mediaInputPath
+            // into another object first, like this:
+            // {
+            //     "path": "path/to/audio/file"
+            // }
+            juce::DynamicObject::Ptr obj = new juce::DynamicObject();
+            obj->setProperty("path", juce::var(mediaInputPath));
+            // Then we add the object to the array
+            jsonCtrlsArray.add(juce::var(obj));
         }
 
         // Convert the array to a JSON string
@@ -603,38 +1330,92 @@ private:
 
     // A variable to store the latest labelList received during processing
     LabelList labels;
+
+    // The status and progress of the model, and of its running process(file) call
+    StatusChannel statusChannel;
+
+    PipelineTrace lastTrace;
+
+    // The schema found by revalidateSchema, until applyUpdatedSchema picks it up
+    std::mutex schemaMutex;
+    SchemaCache::Entry pendingSchema;
+    bool hasPendingSchema = false;
+    // Incremented by every load(), so that stale revalidations are ignored
+    int schemaGeneration = 0;
+
+    // The token of the running process(file) call, if any
+    std::mutex cancellationMutex;
+    std::shared_ptr<CancellationToken> currentCancellation;
 };
 
-// a timer that checks the status of the model and broadcasts a change if if there is one
-class ModelStatusTimer : public juce::Timer, public juce::ChangeBroadcaster
+/*
+* Passes every status change of a model to onStatusEvents, on the message
+* thread, along with its latest status and progress. Nothing runs while
+* neither of them changes.
+*/
+class ModelStatusWatcher
 {
 public:
-    ModelStatusTimer(std::shared_ptr<WebModel> model) : m_model(model) {}
+    explicit ModelStatusWatcher(std::shared_ptr<WebModel> model) { setModel(model); }
 
-    void timerCallback() override
+    ~ModelStatusWatcher()
     {
-        // get the status of the model
-        ModelStatus status = m_model->getStatus();
-        // DBG("ModelStatusTimer::timerCallback status: " + std::to_string(status)
-        //     + " lastStatus: " + std::to_string(lastStatus));
-
-        // if the status has changed, broadcast a change
-        if (status != lastStatus)
-        {
-            lastStatus = status;
-            sendChangeMessage();
-        }
+        if (m_model != nullptr)
+            m_model->getStatusChannel().setListener(nullptr);
     }
 
+    ModelStatusWatcher(const ModelStatusWatcher&) = delete;
+    ModelStatusWatcher& operator=(const ModelStatusWatcher&) = delete;
+
+    // Starts with the current status of model
     void setModel(std::shared_ptr<WebModel> model)
     {
-        // stopTimer();
+        if (m_model != nullptr)
+            m_model->getStatusChannel().setListener(nullptr);
+
         m_model = model;
-        // lastStatus = ModelStatus::INITIALIZED;
-        // startTimer(50);
+        StatusChannel& channel = m_model->getStatusChannel();
+        juce::uint64 latest = channel.getLatestSequence();
+        lastSequence = latest > 0 ? latest - 1 : 0;
+        channel.setListener([this] { deliverEvents(false); });
+        deliverEvents(true);
     }
 
+    std::function<void(const std::vector<StatusChannel::Event>& events,
+                       ModelStatus status,
+                       float progress)>
+        onStatusEvents;
+
 private:
+    void deliverEvents(bool always)
+    {
+        StatusChannel& channel = m_model->getStatusChannel();
+        // Read before the events, so that a transition published in between
+        // is delivered with this call or the next one, never left behind
+        ModelStatus status = channel.getStatus();
+        float progress = channel.getProgress();
+
+        int numMissed = 0;
+        auto events = channel.getEventsSince(lastSequence, &numMissed);
+        if (numMissed > 0)
+        {
+            LogAndDBG("ModelStatusWatcher: missed " + juce::String(numMissed) + " status events",
+                      HarpLogger::Level::Warning);
+        }
+        if (events.empty() && progress == lastProgress && ! always)
+            return;
+
+        if (! events.empty())
+        {
+            lastSequence = events.back().sequence;
+            status = events.back().status;
+        }
+        lastProgress = progress;
+        if (onStatusEvents)
+            onStatusEvents(events, status, progress);
+    }
+
     std::shared_ptr<WebModel> m_model;
-    ModelStatus lastStatus;
+    juce::uint64 lastSequence = 0;
+    float lastProgress = -1.0f;
 };
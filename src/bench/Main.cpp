@@ -0,0 +1,267 @@
+/**
+ * @file
+ * @brief harp-bench, end-to-end latency and throughput benchmarks of WebModel::load
+ * and WebModel::process against a local MockGradioServer. Runs without network access
+ */
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <numeric>
+#include <vector>
+
+#include "../BatchProcessor.h"
+#include "../ResultCache.h"
+#include "../WebModel.h"
+#include "MockGradioServer.h"
+#include "juce_core/juce_core.h"
+#include "juce_events/juce_events.h"
+
+namespace
+{
+struct Options
+{
+    int iterations = 20;
+    juce::int64 payloadBytes = 1024 * 1024;
+    int batchFiles = 16;
+    int jobs = 4;
+    MockGradioServer::Config server;
+};
+
+void printUsage()
+{
+    std::cout << "Usage: harp-bench [options]\n"
+                 "\n"
+                 "Options:\n"
+                 "  --iterations <n>      Sequential load/process calls to time (default: 20)\n"
+                 "  --payload <bytes>     Size of the input files (default: 1048576)\n"
+                 "  --output-bytes <n>    Size of the processed files (default: same as input)\n"
+                 "  --latency <ms>        Latency added to every request (default: 0)\n"
+                 "  --processing <ms>     Time the mock app spends processing (default: 200)\n"
+                 "  --failure-rate <p>    Probability that a request fails (default: 0)\n"
+                 "  --drop-rate <p>       Probability that a download is cut off (default: 0)\n"
+                 "  --batch-files <n>     Files in the throughput run (default: 16)\n"
+                 "  --jobs <n>            Concurrent jobs in the throughput run (default: 4)\n"
+                 "  --midi                Pretend to be a midi app\n";
+}
+
+// Nearest-rank percentile of an already sorted list
+double percentile(const std::vector<double>& sorted, double p)
+{
+    if (sorted.empty())
+        return 0.0;
+
+    size_t rank = (size_t) std::ceil(p / 100.0 * (double) sorted.size());
+    return sorted[juce::jlimit((size_t) 0, sorted.size() - 1, rank == 0 ? 0 : rank - 1)];
+}
+
+void printLatencies(const juce::String& name,
+                    std::vector<double> latencies,
+                    int numFailed,
+                    double totalMs)
+{
+    std::sort(latencies.begin(), latencies.end());
+    double mean = latencies.empty()
+                      ? 0.0
+                      : std::accumulate(latencies.begin(), latencies.end(), 0.0)
+                            / (double) latencies.size();
+    double perSecond = totalMs > 0.0 ? latencies.size() / (totalMs / 1000.0) : 0.0;
+
+    std::cout << name << ": " << latencies.size() << " ok, " << numFailed << " failed | p50 "
+              << juce::String(percentile(latencies, 50.0), 1) << " ms, p99 "
+              << juce::String(percentile(latencies, 99.0), 1) << " ms, mean "
+              << juce::String(mean, 1) << " ms | " << juce::String(perSecond, 2) << " calls/s"
+              << std::endl;
+}
+
+// A 16 bit mono wav file of numBytes bytes, filled with noise so that every file is unique
+void writeTestFile(const juce::File& file, juce::int64 numBytes, bool midi, juce::Random& random)
+{
+    juce::FileOutputStream output(file);
+    output.setPosition(0);
+    output.truncate();
+
+    juce::int64 dataBytes = juce::jmax((juce::int64) 2, numBytes - 44) & ~(juce::int64) 1;
+
+    if (midi)
+    {
+        // Not a valid midi file, but the mock app doesn't care
+        output.write("MThd", 4);
+        dataBytes = juce::jmax((juce::int64) 0, numBytes - 4);
+    }
+    else
+    {
+        output.write("RIFF", 4);
+        output.writeInt((int) (36 + dataBytes));
+        output.write("WAVEfmt ", 8);
+        output.writeInt(16);
+        output.writeShort(1); // PCM
+        output.writeShort(1); // mono
+        output.writeInt(44100);
+        output.writeInt(44100 * 2);
+        output.writeShort(2);
+        output.writeShort(16);
+        output.write("data", 4);
+        output.writeInt((int) dataBytes);
+    }
+
+    juce::HeapBlock<char> chunk(65536);
+    while (dataBytes > 0)
+    {
+        int numToWrite = (int) juce::jmin((juce::int64) 65536, dataBytes);
+        random.fillBitsRandomly(chunk.getData(), (size_t) numToWrite);
+        output.write(chunk.getData(), (size_t) numToWrite);
+        dataBytes -= numToWrite;
+    }
+}
+} // namespace
+
+int main(int argc, char* argv[])
+{
+    juce::ScopedJuceInitialiser_GUI juceInitialiser;
+
+    Options options;
+
+    for (int i = 1; i < argc; ++i)
+    {
+        juce::String arg = argv[i];
+        juce::String value = i + 1 < argc ? juce::String(argv[i + 1]) : juce::String();
+
+        if (arg == "--help" || arg == "-h")
+        {
+            printUsage();
+            return 0;
+        }
+        else if (arg == "--midi")
+            options.server.midi = true;
+        else if (value.isEmpty())
+        {
+            printUsage();
+            return 2;
+        }
+        else
+        {
+            ++i;
+            if (arg == "--iterations")
+                options.iterations = juce::jmax(1, value.getIntValue());
+            else if (arg == "--payload")
+                options.payloadBytes = juce::jmax((juce::int64) 64, value.getLargeIntValue());
+            else if (arg == "--output-bytes")
+                options.server.outputBytes = value.getLargeIntValue();
+            else if (arg == "--latency")
+                options.server.latencyMs = value.getIntValue();
+            else if (arg == "--processing")
+                options.server.processingMs = value.getIntValue();
+            else if (arg == "--failure-rate")
+                options.server.failureRate = value.getDoubleValue();
+            else if (arg == "--drop-rate")
+                options.server.dropRate = value.getDoubleValue();
+            else if (arg == "--batch-files")
+                options.batchFiles = juce::jmax(1, value.getIntValue());
+            else if (arg == "--jobs")
+                options.jobs = juce::jmax(1, value.getIntValue());
+            else
+            {
+                printUsage();
+                return 2;
+            }
+        }
+    }
+
+    MockGradioServer server(options.server);
+    if (! server.start())
+    {
+        std::cerr << "Could not start the mock gradio server." << std::endl;
+        return 1;
+    }
+    std::cout << "Mock gradio app listening on " << server.getURL() << std::endl;
+
+    juce::File workDir = juce::File::getSpecialLocation(juce::File::tempDirectory)
+                             .getChildFile("harp-bench")
+                             .getNonexistentSibling();
+    workDir.createDirectory();
+
+    // Every process call should go to the (mock) network
+    ResultCache::getInstance()->setDirectory(workDir.getChildFile("results"));
+
+    std::map<std::string, std::any> params = { { "url", server.getURL().toStdString() } };
+    juce::String extension = options.server.midi ? ".mid" : ".wav";
+    juce::Random random(1234);
+
+    // load
+    std::vector<double> loadLatencies;
+    int numLoadFailures = 0;
+    double loadStartMs = juce::Time::getMillisecondCounterHiRes();
+
+    for (int i = 0; i < options.iterations; ++i)
+    {
+        WebModel model;
+        double startMs = juce::Time::getMillisecondCounterHiRes();
+        if (model.load(params).wasOk())
+            loadLatencies.push_back(juce::Time::getMillisecondCounterHiRes() - startMs);
+        else
+            numLoadFailures++;
+    }
+    printLatencies("load   ",
+                   loadLatencies,
+                   numLoadFailures,
+                   juce::Time::getMillisecondCounterHiRes() - loadStartMs);
+
+    auto model = std::make_shared<WebModel>();
+    if (model->load(params).failed())
+    {
+        std::cerr << "Could not load the mock app, giving up." << std::endl;
+        workDir.deleteRecursively();
+        return 1;
+    }
+
+    // process, one call at a time
+    std::vector<double> processLatencies;
+    int numProcessFailures = 0;
+    double processStartMs = juce::Time::getMillisecondCounterHiRes();
+
+    for (int i = 0; i < options.iterations; ++i)
+    {
+        juce::File input = workDir.getChildFile("sequential" + juce::String(i) + extension);
+        writeTestFile(input, options.payloadBytes, options.server.midi, random);
+        ResultCache::getInstance()->clear();
+
+        ProcessContext context;
+        double startMs = juce::Time::getMillisecondCounterHiRes();
+        if (model->process(input, context).wasOk())
+            processLatencies.push_back(juce::Time::getMillisecondCounterHiRes() - startMs);
+        else
+            numProcessFailures++;
+    }
+    printLatencies("process",
+                   processLatencies,
+                   numProcessFailures,
+                   juce::Time::getMillisecondCounterHiRes() - processStartMs);
+
+    // process, many files at once
+    juce::File batchDir = workDir.getChildFile("batch");
+    batchDir.createDirectory();
+    juce::Array<juce::File> batchFiles;
+    for (int i = 0; i < options.batchFiles; ++i)
+    {
+        juce::File input = batchDir.getChildFile("batch" + juce::String(i) + extension);
+        writeTestFile(input, options.payloadBytes, options.server.midi, random);
+        batchFiles.add(input);
+    }
+    ResultCache::getInstance()->clear();
+
+    BatchProcessor::Options batchOptions;
+    batchOptions.maxConcurrentJobs = options.jobs;
+    batchOptions.outputDirectory = workDir.getChildFile("batch_output");
+    BatchProcessor batch(model, batchFiles, batchOptions);
+    BatchProcessor::Report report = batch.run();
+
+    std::cout << "batch  : " << options.jobs << " jobs | " << report.toString() << std::endl;
+    std::cout << "server : " << server.getNumRequests() << " requests, "
+              << server.getNumInjectedFailures() << " injected failures" << std::endl;
+    std::cout << ConnectionPool::getInstance()->statsToString() << std::endl;
+
+    server.stop();
+    workDir.deleteRecursively();
+    return 0;
+}
@@ -0,0 +1,537 @@
+#include "MockGradioServer.h"
+
+#include <algorithm>
+#include <cstring>
+
+namespace
+{
+// Position of pattern in block at or after start, or -1
+juce::int64 findBytes(const juce::MemoryBlock& block, const juce::String& pattern, size_t start)
+{
+    auto* begin = static_cast<const char*>(block.getData());
+    auto* end = begin + block.getSize();
+    const char* needle = pattern.toRawUTF8();
+    size_t needleSize = pattern.getNumBytesAsUTF8();
+
+    if (start >= block.getSize())
+        return -1;
+
+    auto* found = std::search(begin + start, end, needle, needle + needleSize);
+    return found == end ? -1 : (juce::int64) (found - begin);
+}
+
+juce::String getStatusText(int statusCode)
+{
+    switch (statusCode)
+    {
+        case 200:
+            return "OK";
+        case 206:
+            return "Partial Content";
+        case 404:
+            return "Not Found";
+        case 416:
+            return "Range Not Satisfiable";
+        default:
+            return "Internal Server Error";
+    }
+}
+} // namespace
+
+MockGradioServer::MockGradioServer(const Config& serverConfig)
+    : juce::Thread("MockGradioServer"), config(serverConfig)
+{
+}
+
+MockGradioServer::~MockGradioServer() { stop(); }
+
+bool MockGradioServer::start()
+{
+    if (! listener.createListener(config.port, "127.0.0.1"))
+        return false;
+
+    port = listener.getBoundPort();
+    startThread();
+    return true;
+}
+
+void MockGradioServer::stop()
+{
+    signalThreadShouldExit();
+    // Unblocks waitForNextConnection
+    listener.close();
+    stopThread(2000);
+
+    std::vector<std::thread> threads;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        for (auto* socket : openSockets)
+            socket->close();
+        threads.swap(connectionThreads);
+    }
+
+    for (auto& thread : threads)
+        thread.join();
+}
+
+void MockGradioServer::run()
+{
+    while (! threadShouldExit())
+    {
+        juce::StreamingSocket* socket = listener.waitForNextConnection();
+        if (socket == nullptr)
+            break;
+
+        std::lock_guard<std::mutex> lock(mutex);
+        openSockets.push_back(socket);
+        connectionThreads.emplace_back([this, socket] { serveConnection(socket); });
+    }
+}
+
+void MockGradioServer::serveConnection(juce::StreamingSocket* socket)
+{
+    Request request;
+    while (! threadShouldExit() && readRequest(*socket, request))
+    {
+        numRequests++;
+
+        if (config.latencyMs > 0)
+            juce::Thread::sleep(config.latencyMs);
+
+        handleRequest(*socket, request);
+
+        // Event streams are terminated by closing the connection
+        bool wasEventStream = request.method == "GET" && request.target.startsWith("/call/");
+        if (! request.keepAlive || wasEventStream)
+            break;
+
+        request = Request();
+    }
+
+    std::lock_guard<std::mutex> lock(mutex);
+    openSockets.erase(std::remove(openSockets.begin(), openSockets.end(), socket),
+                      openSockets.end());
+    socket->close();
+    delete socket;
+}
+
+bool MockGradioServer::readRequest(juce::StreamingSocket& socket, Request& request)
+{
+    juce::MemoryBlock received;
+    char buffer[8192];
+    juce::int64 headerEnd = -1;
+
+    while (headerEnd < 0)
+    {
+        if (socket.waitUntilReady(true, 30000) != 1)
+            return false;
+
+        int numRead = socket.read(buffer, (int) sizeof(buffer), false);
+        if (numRead <= 0)
+            return false;
+
+        received.append(buffer, (size_t) numRead);
+        headerEnd = findBytes(received, "\r\n\r\n", 0);
+    }
+
+    juce::StringArray lines;
+    lines.addLines(juce::String::fromUTF8(static_cast<const char*>(received.getData()),
+                                          (int) headerEnd));
+
+    // e.g "POST /upload HTTP/1.1"
+    juce::StringArray requestLine = juce::StringArray::fromTokens(lines[0], " ", "");
+    request.method = requestLine[0];
+    request.target = juce::URL::removeEscapeChars(requestLine[1]);
+
+    for (int i = 1; i < lines.size(); ++i)
+    {
+        juce::String name = lines[i].upToFirstOccurrenceOf(":", false, false).trim();
+        juce::String value = lines[i].fromFirstOccurrenceOf(":", false, false).trim();
+        if (name.isNotEmpty())
+            request.headers.set(name.toLowerCase(), value);
+    }
+
+    request.keepAlive = ! request.headers["connection"].equalsIgnoreCase("close");
+
+    // curl asks for permission before sending big bodies
+    if (request.headers["expect"].equalsIgnoreCase("100-continue"))
+    {
+        const char* continueResponse = "HTTP/1.1 100 Continue\r\n\r\n";
+        writeAll(socket, continueResponse, strlen(continueResponse));
+    }
+
+    juce::int64 contentLength = request.headers["content-length"].getLargeIntValue();
+    size_t bodyStart = (size_t) headerEnd + 4;
+    request.body.append(static_cast<const char*>(received.getData()) + bodyStart,
+                        received.getSize() - bodyStart);
+
+    while ((juce::int64) request.body.getSize() < contentLength)
+    {
+        if (socket.waitUntilReady(true, 30000) != 1)
+            return false;
+
+        int numToRead = (int) juce::jmin((juce::int64) sizeof(buffer),
+                                         contentLength - (juce::int64) request.body.getSize());
+        int numRead = socket.read(buffer, numToRead, false);
+        if (numRead <= 0)
+            return false;
+
+        request.body.append(buffer, (size_t) numRead);
+    }
+
+    return true;
+}
+
+void MockGradioServer::handleRequest(juce::StreamingSocket& socket, const Request& request)
+{
+    if (request.method == "POST" && request.target.startsWith("/call/"))
+        handleCall(socket, request);
+    else if (request.method == "GET" && request.target.startsWith("/call/"))
+        handleEventStream(socket, request);
+    else if (request.method == "POST" && request.target.startsWith("/upload"))
+        handleUpload(socket, request);
+    else if (request.method == "GET" && request.target.startsWith("/file="))
+        handleFile(socket, request);
+    else
+        sendJson(socket, 404, R"({"detail": "Not Found"})");
+}
+
+void MockGradioServer::handleCall(juce::StreamingSocket& socket, const Request& request)
+{
+    if (shouldFail(config.failureRate))
+    {
+        sendJson(socket, 500, R"({"detail": "Injected failure"})");
+        return;
+    }
+
+    // e.g /call/process
+    PendingCall call;
+    call.endpoint = request.target.fromFirstOccurrenceOf("/call/", false, false);
+
+    // The input file is the first {"path": ...} object of the data array
+    juce::var body = juce::JSON::parse(request.body.toString());
+    if (auto* data = body["data"].getArray())
+    {
+        for (const auto& value : *data)
+        {
+            if (value.hasProperty("path"))
+            {
+                call.inputPath = value["path"].toString();
+                break;
+            }
+        }
+    }
+
+    juce::String eventId;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        eventId = "mock" + juce::String(nextId++);
+        pendingCalls[eventId] = call;
+    }
+
+    sendJson(socket, 200, R"({"event_id": ")" + eventId + R"("})");
+}
+
+void MockGradioServer::handleEventStream(juce::StreamingSocket& socket, const Request& request)
+{
+    // e.g /call/process/mock12
+    juce::String eventId = request.target.fromLastOccurrenceOf("/", false, false);
+
+    PendingCall call;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto it = pendingCalls.find(eventId);
+        if (it == pendingCalls.end())
+        {
+            sendJson(socket, 404, R"({"detail": "Unknown event id"})");
+            return;
+        }
+        call = it->second;
+        pendingCalls.erase(it);
+    }
+
+    // No Content-Length, the stream ends when we close the connection
+    juce::String header = "HTTP/1.1 200 OK\r\nContent-Type: text/event-stream\r\n"
+                          "Cache-Control: no-cache\r\nConnection: close\r\n\r\n";
+    writeAll(socket, header.toRawUTF8(), header.getNumBytesAsUTF8());
+
+    auto sendEvent = [&socket](const juce::String& name, const juce::String& data)
+    {
+        juce::String event = "event: " + name + "\ndata: " + data + "\n\n";
+        return writeAll(socket, event.toRawUTF8(), event.getNumBytesAsUTF8());
+    };
+
+    juce::String data;
+
+    if (call.endpoint == "controls")
+    {
+        data = getControlsJson();
+    }
+    else if (call.endpoint == "process")
+    {
+        sendEvent("heartbeat", "null");
+
+        int numSteps = juce::jmax(1, config.numProgressEvents);
+        for (int i = 0; i < numSteps; ++i)
+        {
+            juce::Thread::sleep(config.processingMs / numSteps);
+            juce::String progress = R"({"progress_data": [{"index": )" + juce::String(i + 1)
+                                    + R"(, "length": )" + juce::String(numSteps) + "}]}";
+            if (! sendEvent("progress", progress))
+                return;
+        }
+
+        std::shared_ptr<juce::MemoryBlock> input;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            auto it = files.find(call.inputPath);
+            if (it != files.end())
+                input = it->second;
+        }
+
+        if (input == nullptr)
+        {
+            sendEvent("error", R"("The input file )" + call.inputPath + R"( was not uploaded")");
+            return;
+        }
+
+        auto output = std::make_shared<juce::MemoryBlock>();
+        juce::String outputPath;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (config.outputBytes < 0)
+            {
+                *output = *input;
+            }
+            else
+            {
+                output->setSize((size_t) config.outputBytes);
+                random.fillBitsRandomly(output->getData(), output->getSize());
+            }
+
+            outputPath = "/tmp/gradio/mock/out" + juce::String(nextId++) + "/"
+                         + call.inputPath.fromLastOccurrenceOf("/", false, false);
+            files[outputPath] = output;
+        }
+
+        data = getProcessResultJson(outputPath);
+    }
+    else
+    {
+        // e.g cancel
+        data = "[]";
+    }
+
+    if (shouldFail(config.failureRate))
+        sendEvent("error", R"("Injected failure")");
+    else
+        sendEvent("complete", data);
+}
+
+void MockGradioServer::handleUpload(juce::StreamingSocket& socket, const Request& request)
+{
+    if (shouldFail(config.failureRate))
+    {
+        sendJson(socket, 500, R"({"detail": "Injected failure"})");
+        return;
+    }
+
+    juce::String contentType = request.headers["content-type"];
+    juce::String boundary =
+        contentType.fromFirstOccurrenceOf("boundary=", false, false).unquoted().trim();
+
+    // --boundary\r\n<part headers>\r\n\r\n<file contents>\r\n--boundary--
+    juce::int64 partHeaderEnd = findBytes(request.body, "\r\n\r\n", 0);
+    juce::int64 contentEnd = partHeaderEnd < 0 ? -1
+                                               : findBytes(request.body,
+                                                           "\r\n--" + boundary,
+                                                           (size_t) partHeaderEnd);
+
+    if (boundary.isEmpty() || partHeaderEnd < 0 || contentEnd < 0)
+    {
+        sendJson(socket, 500, R"({"detail": "Malformed multipart body"})");
+        return;
+    }
+
+    juce::String partHeader = juce::String::fromUTF8(
+        static_cast<const char*>(request.body.getData()), (int) partHeaderEnd);
+    juce::String fileName = partHeader.fromFirstOccurrenceOf("filename=\"", false, false)
+                                .upToFirstOccurrenceOf("\"", false, false);
+    if (fileName.isEmpty())
+        fileName = "upload";
+
+    size_t contentStart = (size_t) partHeaderEnd + 4;
+    auto contents = std::make_shared<juce::MemoryBlock>(
+        static_cast<const char*>(request.body.getData()) + contentStart,
+        (size_t) contentEnd - contentStart);
+
+    juce::String path;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        path = "/tmp/gradio/mock/in" + juce::String(nextId++) + "/" + fileName;
+        files[path] = contents;
+    }
+
+    sendJson(socket, 200, R"([")" + path + R"("])");
+}
+
+void MockGradioServer::handleFile(juce::StreamingSocket& socket, const Request& request)
+{
+    juce::String path = request.target.fromFirstOccurrenceOf("/file=", false, false);
+
+    std::shared_ptr<juce::MemoryBlock> contents;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto it = files.find(path);
+        if (it != files.end())
+            contents = it->second;
+    }
+
+    if (contents == nullptr)
+    {
+        sendJson(socket, 404, R"({"detail": "File not found"})");
+        return;
+    }
+
+    juce::int64 total = (juce::int64) contents->getSize();
+    juce::int64 start = 0;
+    juce::int64 end = total - 1;
+    int statusCode = 200;
+    juce::String extraHeaders = "Accept-Ranges: bytes\r\nETag: \"" + juce::String(total) + "-"
+                                + juce::String::toHexString(path.hashCode64()) + "\"\r\n";
+
+    // e.g "bytes=100-199"
+    juce::String range = request.headers["range"];
+    if (range.startsWith("bytes="))
+    {
+        juce::String spec = range.fromFirstOccurrenceOf("bytes=", false, false);
+        start = spec.upToFirstOccurrenceOf("-", false, false).getLargeIntValue();
+        juce::String last = spec.fromFirstOccurrenceOf("-", false, false);
+        if (last.isNotEmpty())
+            end = juce::jmin(end, last.getLargeIntValue());
+
+        if (start > end)
+        {
+            sendResponse(socket, 416, "text/plain", nullptr, 0);
+            return;
+        }
+
+        statusCode = 206;
+        extraHeaders += "Content-Range: bytes " + juce::String(start) + "-" + juce::String(end)
+                        + "/" + juce::String(total) + "\r\n";
+    }
+
+    auto* data = static_cast<const char*>(contents->getData()) + start;
+    size_t numBytes = (size_t) (end - start + 1);
+
+    if (shouldFail(config.dropRate))
+    {
+        // Announce the full length but hang up half way through
+        juce::String header = "HTTP/1.1 " + juce::String(statusCode) + " "
+                              + getStatusText(statusCode) + "\r\nContent-Type: "
+                              + "application/octet-stream\r\nContent-Length: "
+                              + juce::String((juce::int64) numBytes) + "\r\n" + extraHeaders
+                              + "\r\n";
+        writeAll(socket, header.toRawUTF8(), header.getNumBytesAsUTF8());
+        writeAll(socket, data, numBytes / 2);
+        socket.close();
+        return;
+    }
+
+    sendResponse(socket, statusCode, "application/octet-stream", data, numBytes, extraHeaders);
+}
+
+void MockGradioServer::sendResponse(juce::StreamingSocket& socket,
+                                    int statusCode,
+                                    const juce::String& contentType,
+                                    const void* body,
+                                    size_t bodySize,
+                                    const juce::String& extraHeaders)
+{
+    juce::String header = "HTTP/1.1 " + juce::String(statusCode) + " " + getStatusText(statusCode)
+                          + "\r\nContent-Type: " + contentType + "\r\nContent-Length: "
+                          + juce::String((juce::int64) bodySize) + "\r\n" + extraHeaders
+                          + "\r\n";
+
+    if (writeAll(socket, header.toRawUTF8(), header.getNumBytesAsUTF8()) && bodySize > 0)
+        writeAll(socket, body, bodySize);
+}
+
+void MockGradioServer::sendJson(juce::StreamingSocket& socket,
+                                int statusCode,
+                                const juce::String& json)
+{
+    sendResponse(
+        socket, statusCode, "application/json", json.toRawUTF8(), json.getNumBytesAsUTF8());
+}
+
+bool MockGradioServer::writeAll(juce::StreamingSocket& socket, const void* data, size_t numBytes)
+{
+    auto* bytes = static_cast<const char*>(data);
+
+    while (numBytes > 0)
+    {
+        if (socket.waitUntilReady(false, 30000) != 1)
+            return false;
+
+        int numWritten = socket.write(bytes, (int) juce::jmin(numBytes, (size_t) 1 << 20));
+        if (numWritten <= 0)
+            return false;
+
+        bytes += numWritten;
+        numBytes -= (size_t) numWritten;
+    }
+
+    return true;
+}
+
+juce::String MockGradioServer::getControlsJson() const
+{
+    juce::String midi = config.midi ? "true" : "false";
+    juce::String input = config.midi ? R"({"ctrl_type": "midi_in", "label": "Input MIDI"})"
+                                     : R"({"ctrl_type": "audio_in", "label": "Input Audio"})";
+
+    return R"([{"card": {"name": "Mock", "description": "A local stand-in for a pyharp app",)"
+           R"( "author": "harp-bench", "tags": ["mock"], "midi_in": )"
+           + midi + R"(, "midi_out": )" + midi + R"(}, "ctrls": [)" + input
+           + R"(, {"ctrl_type": "slider", "label": "Gain", "minimum": 0, "maximum": 2,)"
+             R"( "step": 0.1, "value": 1}, {"ctrl_type": "text", "label": "Prompt",)"
+             R"( "value": "benchmark"}]}])";
+}
+
+juce::String MockGradioServer::getProcessResultJson(const juce::String& outputPath) const
+{
+    juce::String fileData = R"({"path": ")" + outputPath + R"(", "url": ")" + getURL()
+                            + "/c/file=" + outputPath
+                            + R"(", "meta": {"_type": "gradio.FileData"}})";
+
+    if (config.numLabels <= 0)
+        return "[" + fileData + "]";
+
+    juce::StringArray labels;
+    for (int i = 0; i < config.numLabels; ++i)
+    {
+        juce::String label =
+            config.midi ? R"({"label_type": "MidiLabel", "pitch": 60, )"
+                        : R"({"label_type": "AudioLabel", "amplitude": 0.5, )";
+        label += R"("t": )" + juce::String(i * 0.5) + R"(, "label": "mock )" + juce::String(i)
+                 + R"(", "duration": 0.25, "description": "Label from the mock server"})";
+        labels.add(label);
+    }
+
+    return "[" + fileData + R"(, {"labels": [)" + labels.joinIntoString(", ")
+           + R"(], "meta": {"_type": "pyharp.LabelList"}}])";
+}
+
+bool MockGradioServer::shouldFail(double rate)
+{
+    if (rate <= 0.0)
+        return false;
+
+    std::lock_guard<std::mutex> lock(mutex);
+    if (random.nextDouble() >= rate)
+        return false;
+
+    numInjectedFailures++;
+    return true;
+}
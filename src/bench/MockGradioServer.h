@@ -0,0 +1,111 @@
+/**
+ * @file
+ * @brief A local stand-in for a pyharp gradio app. It implements the subset of the
+ * gradio http api that GradioClient speaks (call/controls, upload, call/process,
+ * file=), with configurable latency, payload sizes and failure injection
+ */
+
+#pragma once
+
+#include <atomic>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "juce_core/juce_core.h"
+
+class MockGradioServer : private juce::Thread
+{
+public:
+    struct Config
+    {
+        // 0 picks a free port
+        int port = 0;
+        // Added before every response
+        int latencyMs = 0;
+        // Time between the process call and its complete event
+        int processingMs = 200;
+        // Progress events sent while "processing"
+        int numProgressEvents = 4;
+        // Size of the processed file. -1 echoes the uploaded file back
+        juce::int64 outputBytes = -1;
+        // Labels returned alongside the processed file. 0 returns no LabelList
+        int numLabels = 2;
+        bool midi = false;
+        // Probability (0-1) that a request fails with a 500 or an error event
+        double failureRate = 0.0;
+        // Probability (0-1) that a file download is cut off half way
+        double dropRate = 0.0;
+    };
+
+    explicit MockGradioServer(const Config& config);
+    ~MockGradioServer() override;
+
+    // Starts listening on 127.0.0.1. Returns false if the port couldn't be bound
+    bool start();
+    void stop();
+
+    int getPort() const { return port; }
+    juce::String getURL() const { return "http://127.0.0.1:" + juce::String(port); }
+
+    int getNumRequests() const { return numRequests; }
+    int getNumInjectedFailures() const { return numInjectedFailures; }
+
+private:
+    struct Request
+    {
+        juce::String method;
+        juce::String target;
+        juce::StringPairArray headers;
+        juce::MemoryBlock body;
+        bool keepAlive = true;
+    };
+
+    struct PendingCall
+    {
+        juce::String endpoint;
+        juce::String inputPath;
+    };
+
+    void run() override;
+    void serveConnection(juce::StreamingSocket* socket);
+
+    bool readRequest(juce::StreamingSocket& socket, Request& request);
+    void handleRequest(juce::StreamingSocket& socket, const Request& request);
+
+    void handleCall(juce::StreamingSocket& socket, const Request& request);
+    void handleEventStream(juce::StreamingSocket& socket, const Request& request);
+    void handleUpload(juce::StreamingSocket& socket, const Request& request);
+    void handleFile(juce::StreamingSocket& socket, const Request& request);
+
+    void sendResponse(juce::StreamingSocket& socket,
+                      int statusCode,
+                      const juce::String& contentType,
+                      const void* body,
+                      size_t bodySize,
+                      const juce::String& extraHeaders = {});
+    void sendJson(juce::StreamingSocket& socket, int statusCode, const juce::String& json);
+    static bool writeAll(juce::StreamingSocket& socket, const void* data, size_t numBytes);
+
+    juce::String getControlsJson() const;
+    juce::String getProcessResultJson(const juce::String& outputPath) const;
+    bool shouldFail(double rate);
+
+    Config config;
+    int port = 0;
+    juce::StreamingSocket listener;
+
+    std::mutex mutex;
+    std::vector<std::thread> connectionThreads;
+    std::vector<juce::StreamingSocket*> openSockets;
+    // Uploaded and processed files, by their server path
+    std::map<juce::String, std::shared_ptr<juce::MemoryBlock>> files;
+    std::map<juce::String, PendingCall> pendingCalls;
+    int nextId = 0;
+    juce::Random random;
+
+    std::atomic<int> numRequests { 0 };
+    std::atomic<int> numInjectedFailures { 0 };
+};
@@ -0,0 +1,306 @@
+/**
+ * @file
+ * @brief harp-cli, a headless runner that processes files with a gradio app
+ * through the same WebModel engine as the HARP GUI
+ */
+
+#include <iostream>
+#include <mutex>
+
+#include "../BatchProcessor.h"
+#include "../HarpLogger.h"
+#include "../Metrics.h"
+#include "../PipelineRunner.h"
+#include "../WebModel.h"
+#include "juce_core/juce_core.h"
+#include "juce_events/juce_events.h"
+
+namespace
+{
+void printUsage()
+{
+    std::cout
+        << "Usage: harp-cli --space <url> [options] <file or folder>...\n"
+           "\n"
+           "Options:\n"
+           "  --space <url>         Gradio app to use (e.g hugggof/harmonic_percussive).\n"
+           "                        Repeat it to chain apps, the output of each one is\n"
+           "                        processed by the next\n"
+           "  --output <folder>     Where outputs and labels are written (default: ./harp_output)\n"
+           "  --set <label>=<value> Overrides the value of a control of the preceding --space.\n"
+           "                        Can be repeated\n"
+           "  --jobs <n>            Number of files processed at the same time (default: 4).\n"
+           "                        Chained apps process one file at a time\n"
+           "  --list-controls       Prints the controls of the app and exits\n"
+           "  --metrics-port <n>    Serves the metrics on http://127.0.0.1:<n>/metrics while\n"
+           "                        running. They are also written to metrics.prom next to\n"
+           "                        the log\n"
+           "  --result-cache-mb <n> Disk space of the cached results (default: 2048)\n"
+           "  --help                Prints this message\n";
+}
+
+juce::String describeCtrl(const Ctrl& ctrl)
+{
+    if (auto slider = dynamic_cast<const SliderCtrl*>(&ctrl))
+        return "slider [" + juce::String(slider->minimum) + ", " + juce::String(slider->maximum)
+               + "] = " + juce::String(slider->value);
+    if (auto numberBox = dynamic_cast<const NumberBoxCtrl*>(&ctrl))
+        return "number [" + juce::String(numberBox->min) + ", " + juce::String(numberBox->max)
+               + "] = " + juce::String(numberBox->value);
+    if (auto toggle = dynamic_cast<const ToggleCtrl*>(&ctrl))
+        return "toggle = " + juce::String(toggle->value ? "true" : "false");
+    if (auto textBox = dynamic_cast<const TextBoxCtrl*>(&ctrl))
+        return "text = \"" + juce::String(textBox->value) + "\"";
+    if (auto comboBox = dynamic_cast<const ComboBoxCtrl*>(&ctrl))
+    {
+        juce::StringArray options;
+        for (const auto& option : comboBox->options)
+            options.add(option);
+        return "choice {" + options.joinIntoString(", ") + "} = " + juce::String(comboBox->value);
+    }
+    if (dynamic_cast<const AudioInCtrl*>(&ctrl) != nullptr)
+        return "audio input";
+    if (dynamic_cast<const MidiInCtrl*>(&ctrl) != nullptr)
+        return "midi input";
+    return "unknown";
+}
+
+void printControls(WebModel& model)
+{
+    for (const auto& ctrlPair : model.controls())
+        std::cout << "  " << ctrlPair.second->label << ": " << describeCtrl(*ctrlPair.second)
+                  << "\n";
+}
+
+// Expands folders to the files they contain that model can process.
+// Same extensions as the Audio/MidiDisplayComponent, which we can't use without juce_gui
+juce::Array<juce::File> findInputFiles(const juce::StringArray& inputs, WebModel& model)
+{
+    juce::StringArray extensions =
+        model.card().midi_in ? juce::StringArray { ".mid", ".midi" }
+                             : juce::StringArray { ".wav", ".bwf", ".aiff", ".aif", ".flac",
+                                                   ".ogg", ".mp3" };
+    juce::Array<juce::File> inputFiles;
+    for (const auto& input : inputs)
+    {
+        juce::File file = juce::File::getCurrentWorkingDirectory().getChildFile(input);
+        if (file.isDirectory())
+            inputFiles.addArray(BatchProcessor::findInputFiles(file, extensions));
+        else if (file.existsAsFile())
+            inputFiles.add(file);
+        else
+            std::cerr << "Skipping " << input << ", no such file or folder\n";
+    }
+    return inputFiles;
+}
+
+// Runs every input through the chain of apps, one file at a time
+int runPipeline(const std::vector<PipelineRunner::Step>& steps,
+                const juce::StringArray& inputs,
+                const juce::File& outputDirectory,
+                bool listControls)
+{
+    PipelineRunner pipeline(steps);
+
+    // All the apps load at the same time
+    for (const auto& step : steps)
+        std::cout << "Loading " << step.space << "..." << std::endl;
+    OpResult result = pipeline.waitUntilLoaded();
+    if (result.failed())
+    {
+        std::cerr << "Failed to load the pipeline: " << result.getError().devMessage << "\n";
+        return 1;
+    }
+
+    if (listControls)
+    {
+        for (int i = 0; i < pipeline.getNumSteps(); ++i)
+        {
+            std::cout << "Step " << (i + 1) << ", " << steps[(size_t) i].space << ":\n";
+            printControls(*pipeline.getModel(i));
+        }
+        return 0;
+    }
+
+    juce::Array<juce::File> inputFiles = findInputFiles(inputs, *pipeline.getModel(0));
+    if (inputFiles.isEmpty())
+    {
+        std::cerr << "Nothing to process.\n";
+        return 1;
+    }
+    outputDirectory.createDirectory();
+
+    int numFailed = 0;
+    for (const auto& input : inputFiles)
+    {
+        juce::File output = outputDirectory.getChildFile(input.getFileNameWithoutExtension()
+                                                         + "_harp" + input.getFileExtension());
+        PipelineRunner::Report report = pipeline.run(input, output);
+
+        // The labels of each step, e.g song_harp.2.labels.json
+        for (size_t i = 0; i < report.steps.size(); ++i)
+        {
+            if (report.steps[i].labelsJson.isNotEmpty())
+                output.withFileExtension("." + juce::String((int) i + 1) + ".labels.json")
+                    .replaceWithText(report.steps[i].labelsJson);
+        }
+
+        if (report.result.wasOk())
+        {
+            std::cout << "[ok]     " << input.getFileName() << " -> " << output.getFullPathName()
+                      << "\n         " << report.toString() << std::endl;
+        }
+        else
+        {
+            numFailed++;
+            std::cout << "[failed] " << input.getFileName() << ": "
+                      << report.result.getError().devMessage << std::endl;
+        }
+    }
+
+    return numFailed > 0 ? 1 : 0;
+}
+} // namespace
+
+int main(int argc, char* argv[])
+{
+    // Sets up the message manager and deletes the singletons (logger, caches) on exit
+    juce::ScopedJuceInitialiser_GUI juceInitialiser;
+    HarpLogger::getInstance()->initializeLogger();
+
+    // One step per --space, with the --set options that follow it
+    std::vector<PipelineRunner::Step> steps;
+    juce::File outputDirectory =
+        juce::File::getCurrentWorkingDirectory().getChildFile("harp_output");
+    juce::StringArray inputs;
+    int numJobs = 4;
+    int metricsPort = 0;
+    int resultCacheMB = 0;
+    bool listControls = false;
+
+    for (int i = 1; i < argc; ++i)
+    {
+        juce::String arg = juce::CharPointer_UTF8(argv[i]);
+        bool hasValue = i + 1 < argc;
+
+        if (arg == "--help" || arg == "-h")
+        {
+            printUsage();
+            return 0;
+        }
+        else if (arg == "--space" && hasValue)
+        {
+            PipelineRunner::Step step;
+            step.space = juce::CharPointer_UTF8(argv[++i]);
+            steps.push_back(step);
+        }
+        else if (arg == "--output" && hasValue)
+            outputDirectory =
+                juce::File::getCurrentWorkingDirectory().getChildFile(juce::String(argv[++i]));
+        else if (arg == "--set" && hasValue)
+        {
+            if (steps.empty())
+            {
+                std::cerr << "--set has to follow the --space it applies to\n\n";
+                printUsage();
+                return 2;
+            }
+            juce::String assignment = juce::CharPointer_UTF8(argv[++i]);
+            steps.back().ctrlValues.push_back(
+                { assignment.upToFirstOccurrenceOf("=", false, false).trim(),
+                  assignment.fromFirstOccurrenceOf("=", false, false).trim() });
+        }
+        else if (arg == "--jobs" && hasValue)
+            numJobs = juce::jmax(1, juce::String(argv[++i]).getIntValue());
+        else if (arg == "--list-controls")
+            listControls = true;
+        else if (arg == "--metrics-port" && hasValue)
+            metricsPort = juce::String(argv[++i]).getIntValue();
+        else if (arg == "--result-cache-mb" && hasValue)
+            resultCacheMB = juce::String(argv[++i]).getIntValue();
+        else if (arg.startsWith("--"))
+        {
+            std::cerr << "Unknown or incomplete option " << arg << "\n\n";
+            printUsage();
+            return 2;
+        }
+        else
+            inputs.add(arg);
+    }
+
+    if (steps.empty() || (inputs.isEmpty() && ! listControls))
+    {
+        printUsage();
+        return 2;
+    }
+
+    Metrics::getInstance()->startExporting(Metrics::getDefaultExportFile());
+    if (metricsPort > 0 && ! Metrics::getInstance()->startServer(metricsPort))
+        std::cerr << "Could not serve the metrics on port " << metricsPort << "\n";
+    if (resultCacheMB > 0)
+        ResultCache::getInstance()->setByteBudget((juce::int64) resultCacheMB * 1024 * 1024);
+
+    if (steps.size() > 1)
+        return runPipeline(steps, inputs, outputDirectory, listControls);
+
+    const juce::String& space = steps.front().space;
+    auto model = std::make_shared<WebModel>();
+
+    std::map<std::string, std::any> params = { { "url", space.toStdString() } };
+    std::cout << "Loading " << space << "..." << std::endl;
+    OpResult result = model->load(params);
+    if (result.failed())
+    {
+        std::cerr << "Failed to load " << space << ": " << result.getError().devMessage << "\n";
+        return 1;
+    }
+
+    if (listControls)
+    {
+        printControls(*model);
+        return 0;
+    }
+
+    for (const auto& [label, value] : steps.front().ctrlValues)
+    {
+        result = model->setCtrlValue(label, value);
+        if (result.failed())
+        {
+            std::cerr << result.getError().devMessage << "\n";
+            return 2;
+        }
+    }
+
+    juce::Array<juce::File> inputFiles = findInputFiles(inputs, *model);
+    if (inputFiles.isEmpty())
+    {
+        std::cerr << "Nothing to process.\n";
+        return 1;
+    }
+
+    BatchProcessor::Options options;
+    options.maxConcurrentJobs = numJobs;
+    options.outputDirectory = outputDirectory;
+    BatchProcessor batch(model, inputFiles, options);
+
+    std::mutex printMutex;
+    auto onItemChanged = [&printMutex](int, const BatchProcessor::Item& item)
+    {
+        if (! item.isDone())
+            return;
+
+        std::lock_guard<std::mutex> lock(printMutex);
+        if (item.status == ModelStatus::FINISHED)
+            std::cout << "[ok]     " << item.input.getFileName() << " -> "
+                      << item.output.getFullPathName() << " ("
+                      << juce::String(item.elapsedMs / 1000.0, 1) << " s)" << std::endl;
+        else
+            std::cout << "[failed] " << item.input.getFileName() << ": "
+                      << item.result.getError().devMessage << std::endl;
+    };
+
+    BatchProcessor::Report report = batch.run(onItemChanged);
+    std::cout << report.toString() << std::endl;
+
+    return report.numFailed > 0 ? 1 : 0;
+}
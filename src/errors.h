@@ -23,6 +23,7 @@ enum class ErrorType
     UnknownError,
     UnsupportedControlType,
     UnknownLabelType,
+    Cancelled,
 };
 
 struct Error
@@ -71,6 +72,10 @@ struct Error
             error.userMessage =
                 "Failed to upload the file to the gradio app. Please check you internet connection.";
         }
+        else if (error.type == ErrorType::Cancelled)
+        {
+            error.userMessage = "The processing was cancelled.";
+        }
     }
 
     // Function to check if all substrings are contained in the given string
@@ -113,6 +118,7 @@ public:
 
     // Get the Error object (contains developer and user messages)
     Error& getError() noexcept { return error; }
+    const Error& getError() const noexcept { return error; }
 
     operator bool() const noexcept
     {
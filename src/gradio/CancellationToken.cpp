@@ -0,0 +1,68 @@
+#include "CancellationToken.h"
+
+CancellationToken::ScopedAbortHandler::ScopedAbortHandler(CancellationToken* tokenToWatch,
+                                                          AbortHandler handler)
+    : token(tokenToWatch)
+{
+    if (token != nullptr)
+        handlerId = token->addHandler(std::move(handler));
+}
+
+CancellationToken::ScopedAbortHandler::~ScopedAbortHandler()
+{
+    if (token != nullptr && handlerId >= 0)
+        token->removeHandler(handlerId);
+}
+
+void CancellationToken::cancel()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+
+    if (cancelled.exchange(true))
+        return;
+
+    // The handlers run under the lock, so that ScopedAbortHandler can't
+    // be destroyed (along with what its handler aborts) halfway through
+    for (auto& [id, handler] : handlers)
+        handler();
+}
+
+int CancellationToken::addHandler(AbortHandler handler)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+
+    if (cancelled)
+    {
+        handler();
+        return -1;
+    }
+
+    int handlerId = nextHandlerId++;
+    handlers[handlerId] = std::move(handler);
+    return handlerId;
+}
+
+void CancellationToken::removeHandler(int handlerId)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    handlers.erase(handlerId);
+}
+
+bool CancellationToken::wait(CancellationToken* token, int timeoutMs)
+{
+    juce::WaitableEvent wakeUp;
+    {
+        ScopedAbortHandler abortWait(token, [&wakeUp] { wakeUp.signal(); });
+        wakeUp.wait(timeoutMs);
+    }
+    return ! isCancelled(token);
+}
+
+Error CancellationToken::makeError(const juce::String& what)
+{
+    Error error;
+    error.type = ErrorType::Cancelled;
+    error.devMessage = what + " was cancelled.";
+    error.userMessage = "The processing was cancelled.";
+    return error;
+}
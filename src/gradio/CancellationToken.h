@@ -0,0 +1,80 @@
+/**
+ * @file
+ * @brief A flag shared between a request and whoever wants to abort it. Cancelling
+ * also aborts the sockets and streams the request is currently blocked on
+ */
+
+#pragma once
+
+#include <atomic>
+#include <functional>
+#include <map>
+#include <mutex>
+
+#include "../errors.h"
+#include "juce_core/juce_core.h"
+
+class CancellationToken
+{
+public:
+    using AbortHandler = std::function<void()>;
+
+    /*
+    * Runs handler if the token gets cancelled while this object is alive,
+    * e.g to cancel a WebInputStream or close a socket that another thread
+    * is blocked on. If the token is already cancelled, handler runs straight away.
+    * The destructor waits for a running handler to return, so whatever it
+    * touches can be safely destroyed afterwards. token can be nullptr.
+    */
+    class ScopedAbortHandler
+    {
+    public:
+        ScopedAbortHandler(CancellationToken* token, AbortHandler handler);
+        ~ScopedAbortHandler();
+
+    private:
+        CancellationToken* token;
+        int handlerId = -1;
+
+        JUCE_DECLARE_NON_COPYABLE(ScopedAbortHandler)
+    };
+
+    CancellationToken() = default;
+
+    // Can be called from any thread, any number of times
+    void cancel();
+
+    bool isCancelled() const { return cancelled; }
+
+    // Same as above, for the optional tokens of GradioClient calls
+    static bool isCancelled(const CancellationToken* token)
+    {
+        return token != nullptr && token->isCancelled();
+    }
+
+    /*
+    * Waits for timeoutMs, returning early if token gets cancelled. Returns
+    * false if it was cancelled. token can be nullptr, then this just sleeps.
+    */
+    static bool wait(CancellationToken* token, int timeoutMs);
+
+    // The error returned by requests that were aborted through a token
+    static Error makeError(const juce::String& what);
+
+    static bool isCancellation(const OpResult& result)
+    {
+        return result.failed() && result.getError().type == ErrorType::Cancelled;
+    }
+
+private:
+    int addHandler(AbortHandler handler);
+    void removeHandler(int handlerId);
+
+    std::atomic<bool> cancelled { false };
+
+    std::mutex mutex;
+    std::map<int, AbortHandler> handlers;
+    int nextHandlerId = 0;
+
+    JUCE_DECLARE_NON_COPYABLE(CancellationToken)
+};
@@ -0,0 +1,851 @@
+#include "ConnectionPool.h"
+
+#include <algorithm>
+#include <type_traits>
+#include <vector>
+
+#include "../Metrics.h"
+
+#if JUCE_LINUX || JUCE_MAC
+#define HARP_CURL_POOL 1
+#include <curl/curl.h>
+#else
+#define HARP_CURL_POOL 0
+#endif
+
+JUCE_IMPLEMENT_SINGLETON(ConnectionPool)
+
+namespace
+{
+#if HARP_CURL_POOL
+// The libcurl functions the pool needs, looked up in the shared library
+// the first time they are needed, so that HARP doesn't link against libcurl
+struct CurlLibrary
+{
+    decltype(&curl_global_init) globalInit = nullptr;
+    decltype(&curl_easy_init) easyInit = nullptr;
+    decltype(&curl_easy_setopt) easySetopt = nullptr;
+    decltype(&curl_easy_getinfo) easyGetinfo = nullptr;
+    decltype(&curl_easy_pause) easyPause = nullptr;
+    decltype(&curl_easy_cleanup) easyCleanup = nullptr;
+    decltype(&curl_multi_init) multiInit = nullptr;
+    decltype(&curl_multi_setopt) multiSetopt = nullptr;
+    decltype(&curl_multi_add_handle) multiAddHandle = nullptr;
+    decltype(&curl_multi_remove_handle) multiRemoveHandle = nullptr;
+    decltype(&curl_multi_perform) multiPerform = nullptr;
+    decltype(&curl_multi_wait) multiWait = nullptr;
+    decltype(&curl_multi_info_read) multiInfoRead = nullptr;
+    decltype(&curl_multi_cleanup) multiCleanup = nullptr;
+    decltype(&curl_slist_append) slistAppend = nullptr;
+    decltype(&curl_slist_free_all) slistFreeAll = nullptr;
+
+    bool isLoaded() const { return easyInit != nullptr; }
+
+    static const CurlLibrary& get()
+    {
+        static const CurlLibrary functions = load();
+        return functions;
+    }
+
+private:
+    static CurlLibrary load()
+    {
+        static juce::DynamicLibrary library;
+        CurlLibrary functions;
+
+        if (! library.open("libcurl.so.4") && ! library.open("libcurl.so")
+            && ! library.open("libcurl.4.dylib"))
+            return functions;
+
+        auto find = [](auto& function, const char* name)
+        {
+            function = reinterpret_cast<std::remove_reference_t<decltype(function)>>(
+                library.getFunction(name));
+            return function != nullptr;
+        };
+
+        bool ok = find(functions.globalInit, "curl_global_init")
+                  && find(functions.easyInit, "curl_easy_init")
+                  && find(functions.easySetopt, "curl_easy_setopt")
+                  && find(functions.easyGetinfo, "curl_easy_getinfo")
+                  && find(functions.easyPause, "curl_easy_pause")
+                  && find(functions.easyCleanup, "curl_easy_cleanup")
+                  && find(functions.multiInit, "curl_multi_init")
+                  && find(functions.multiSetopt, "curl_multi_setopt")
+                  && find(functions.multiAddHandle, "curl_multi_add_handle")
+                  && find(functions.multiRemoveHandle, "curl_multi_remove_handle")
+                  && find(functions.multiPerform, "curl_multi_perform")
+                  && find(functions.multiWait, "curl_multi_wait")
+                  && find(functions.multiInfoRead, "curl_multi_info_read")
+                  && find(functions.multiCleanup, "curl_multi_cleanup")
+                  && find(functions.slistAppend, "curl_slist_append")
+                  && find(functions.slistFreeAll, "curl_slist_free_all");
+
+        if (! ok || functions.globalInit(CURL_GLOBAL_DEFAULT) != CURLE_OK)
+            functions = CurlLibrary();
+        return functions;
+    }
+};
+#endif
+} // namespace
+
+struct ConnectionPool::Host
+{
+    explicit Host(const juce::String& hostKey) : key(hostKey)
+    {
+#if HARP_CURL_POOL
+        const CurlLibrary& curl = CurlLibrary::get();
+        if (curl.isLoaded())
+            multi = curl.multiInit();
+
+        if (multi != nullptr)
+        {
+            // Idle connections are kept in the multi handle's cache until the next request
+            curl.multiSetopt(multi, CURLMOPT_MAX_HOST_CONNECTIONS, (long) maxConnectionsPerHost);
+            curl.multiSetopt(multi, CURLMOPT_MAXCONNECTS, (long) maxConnectionsPerHost);
+            curl.multiSetopt(multi, CURLMOPT_PIPELINING, (long) CURLPIPE_MULTIPLEX);
+        }
+#endif
+    }
+
+    ~Host()
+    {
+#if HARP_CURL_POOL
+        // All the streams hold on to their host, so none of them is left here
+        if (multi != nullptr)
+            CurlLibrary::get().multiCleanup(multi);
+#endif
+    }
+
+    const juce::String key;
+
+    // Guards everything below, and the buffers of the host's streams
+    std::mutex mutex;
+    std::condition_variable slotFreed;
+    int activeConnections = 0;
+    HostStats stats;
+
+#if HARP_CURL_POOL
+    /*
+    * libcurl handles can only be used by one thread at a time, so the thread
+    * that wants data runs the transfers of all the host's streams, and the
+    * others wait until it's done or their own data came in. Only the thread
+    * that set driving may touch the multi handle or the easy handles in it.
+    */
+    CURLM* multi = nullptr;
+    bool driving = false;
+    // Threads waiting in withMultiHandle, which go before the next driver
+    int numWaitingForMulti = 0;
+    std::condition_variable driven;
+    // Paused streams whose readers have caught up, resumed by the next driver
+    std::vector<CURL*> handlesToResume;
+#endif
+
+    JUCE_DECLARE_NON_COPYABLE(Host)
+};
+
+#if HARP_CURL_POOL
+/*
+* The response of a request running on its host's multi handle. The body is
+* received into a buffer while the host's transfers run, and the transfer is
+* paused while the reader is more than maxBufferedBytes behind.
+*/
+class ConnectionPool::CurlStream : public juce::InputStream
+{
+public:
+    CurlStream(std::shared_ptr<Host> hostToUse, const Request& request)
+        : host(std::move(hostToUse)), body(request.body)
+    {
+        const CurlLibrary& curl = CurlLibrary::get();
+        handle = curl.easyInit();
+        if (handle == nullptr)
+            return;
+
+        juce::String address = request.url.toString(! request.usePostData);
+        curl.easySetopt(handle, CURLOPT_URL, address.toRawUTF8());
+        curl.easySetopt(handle, CURLOPT_PRIVATE, this);
+        curl.easySetopt(handle, CURLOPT_NOSIGNAL, 1L);
+        curl.easySetopt(handle, CURLOPT_TCP_KEEPALIVE, 1L);
+        // Falls back to HTTP/1.1 if the server or libcurl doesn't speak HTTP/2
+        curl.easySetopt(handle, CURLOPT_HTTP_VERSION, (long) CURL_HTTP_VERSION_2TLS);
+        // Wait for a connection that can be multiplexed rather than open another one
+        curl.easySetopt(handle, CURLOPT_PIPEWAIT, 1L);
+
+        followsRedirects = request.numRedirectsToFollow > 0;
+        curl.easySetopt(handle, CURLOPT_FOLLOWLOCATION, followsRedirects ? 1L : 0L);
+        curl.easySetopt(handle, CURLOPT_MAXREDIRS, (long) request.numRedirectsToFollow);
+
+        if (request.timeoutMs > 0)
+        {
+            // Like WebInputStream, the timeout bounds the connect and any stall,
+            // rather than the whole transfer
+            curl.easySetopt(handle, CURLOPT_CONNECTTIMEOUT_MS, (long) request.timeoutMs);
+            curl.easySetopt(handle, CURLOPT_LOW_SPEED_LIMIT, 1L);
+            curl.easySetopt(
+                handle, CURLOPT_LOW_SPEED_TIME, (long) juce::jmax(1, request.timeoutMs / 1000));
+        }
+
+        for (const auto& line : juce::StringArray::fromLines(request.extraHeaders))
+        {
+            if (line.trim().isNotEmpty())
+                headers = curl.slistAppend(headers, line.trim().toRawUTF8());
+        }
+
+        bool isPost = body != nullptr || request.usePostData;
+
+        if (body != nullptr)
+        {
+            curl_read_callback readCallback = readBody;
+            curl_seek_callback seekCallback = seekBody;
+            curl.easySetopt(handle, CURLOPT_POST, 1L);
+            curl.easySetopt(
+                handle, CURLOPT_POSTFIELDSIZE_LARGE, (curl_off_t) body->getTotalLength());
+            curl.easySetopt(handle, CURLOPT_READFUNCTION, readCallback);
+            curl.easySetopt(handle, CURLOPT_READDATA, this);
+            curl.easySetopt(handle, CURLOPT_SEEKFUNCTION, seekCallback);
+            curl.easySetopt(handle, CURLOPT_SEEKDATA, this);
+            // Don't wait for a "100 Continue" before sending the body
+            headers = curl.slistAppend(headers, "Expect:");
+        }
+        else if (request.usePostData)
+        {
+            const juce::MemoryBlock& postData = request.url.getPostDataAsMemoryBlock();
+            curl.easySetopt(handle, CURLOPT_POSTFIELDSIZE_LARGE, (curl_off_t) postData.getSize());
+            curl.easySetopt(handle,
+                            CURLOPT_COPYPOSTFIELDS,
+                            postData.getSize() > 0 ? postData.getData() : (const void*) "");
+        }
+
+        if (request.command == "HEAD")
+            curl.easySetopt(handle, CURLOPT_NOBODY, 1L);
+        else if (request.command.isNotEmpty() && request.command != (isPost ? "POST" : "GET"))
+            curl.easySetopt(handle, CURLOPT_CUSTOMREQUEST, request.command.toRawUTF8());
+
+        if (headers != nullptr)
+            curl.easySetopt(handle, CURLOPT_HTTPHEADER, headers);
+
+        curl_write_callback writeCallback = writeBody;
+        curl_write_callback headerCallback = writeHeader;
+        curl.easySetopt(handle, CURLOPT_WRITEFUNCTION, writeCallback);
+        curl.easySetopt(handle, CURLOPT_WRITEDATA, this);
+        curl.easySetopt(handle, CURLOPT_HEADERFUNCTION, headerCallback);
+        curl.easySetopt(handle, CURLOPT_HEADERDATA, this);
+    }
+
+    ~CurlStream() override
+    {
+        if (handle == nullptr)
+            return;
+
+        const CurlLibrary& curl = CurlLibrary::get();
+        withMultiHandle(
+            [&]
+            {
+                // A transfer that ran to the end leaves its connection in the
+                // multi handle's cache, one that didn't closes it
+                if (added)
+                    curl.multiRemoveHandle(host->multi, handle);
+                curl.easyCleanup(handle);
+            });
+
+        {
+            std::lock_guard<std::mutex> lock(host->mutex);
+            auto& toResume = host->handlesToResume;
+            toResume.erase(std::remove(toResume.begin(), toResume.end(), handle), toResume.end());
+        }
+
+        if (headers != nullptr)
+            curl.slistFreeAll(headers);
+    }
+
+    // Sends the request and waits for the response headers
+    bool connect()
+    {
+        const CurlLibrary& curl = CurlLibrary::get();
+        if (handle == nullptr || host->multi == nullptr)
+            return false;
+
+        withMultiHandle([&] { added = curl.multiAddHandle(host->multi, handle) == CURLM_OK; });
+        if (! added)
+            return false;
+
+        runUntil([this] { return headersDone; });
+
+        withMultiHandle(
+            [&]
+            {
+                long numConnects = 0;
+                long httpVersion = 0;
+                curl_off_t connectUs = 0;
+                curl_off_t appConnectUs = 0;
+                curl_off_t preTransferUs = 0;
+                curl_off_t contentLength = -1;
+                curl.easyGetinfo(handle, CURLINFO_NUM_CONNECTS, &numConnects);
+                curl.easyGetinfo(handle, CURLINFO_HTTP_VERSION, &httpVersion);
+                curl.easyGetinfo(handle, CURLINFO_CONNECT_TIME_T, &connectUs);
+                curl.easyGetinfo(handle, CURLINFO_APPCONNECT_TIME_T, &appConnectUs);
+                curl.easyGetinfo(handle, CURLINFO_PRETRANSFER_TIME_T, &preTransferUs);
+                curl.easyGetinfo(handle, CURLINFO_CONTENT_LENGTH_DOWNLOAD_T, &contentLength);
+
+                reused = numConnects == 0;
+                usedHttp2 = httpVersion == CURL_HTTP_VERSION_2_0;
+                // The TLS handshake ends after the TCP one, for plain http there's none
+                handshakeMs = reused ? 0.0 : (double) juce::jmax(connectUs, appConnectUs) / 1000.0;
+                requestSent = preTransferUs > 0;
+                totalLength = (juce::int64) contentLength;
+            });
+
+        std::lock_guard<std::mutex> lock(host->mutex);
+        failed = ! headersDone || (finished && result != CURLE_OK);
+        // A request that never got a connection didn't reuse one either
+        reused = reused && ! failed;
+        return ! failed;
+    }
+
+    // Can be called from any thread, makes a blocked connect() or read() return
+    void cancel() { cancelled = true; }
+
+    bool isError() const { return failed; }
+    int getStatusCode() const { return statusCode; }
+    const juce::StringPairArray& getResponseHeaders() const { return responseHeaders; }
+    bool wasReused() const { return reused; }
+    bool wasHttp2() const { return usedHttp2; }
+    bool wasRequestSent() const { return requestSent || statusCode > 0; }
+    double getHandshakeMs() const { return handshakeMs; }
+
+    juce::int64 getTotalLength() override { return totalLength; }
+
+    bool isExhausted() override
+    {
+        std::lock_guard<std::mutex> lock(host->mutex);
+        return (finished || cancelled) && getNumBuffered() == 0;
+    }
+
+    int read(void* destBuffer, int maxBytesToRead) override
+    {
+        if (maxBytesToRead <= 0)
+            return 0;
+
+        runUntil([this] { return getNumBuffered() > 0; });
+
+        std::lock_guard<std::mutex> lock(host->mutex);
+        size_t numToCopy = juce::jmin((size_t) maxBytesToRead, getNumBuffered());
+        memcpy(destBuffer, received.data() + readOffset, numToCopy);
+        readOffset += numToCopy;
+
+        if (readOffset == received.size())
+        {
+            received.clear();
+            readOffset = 0;
+
+            if (paused)
+            {
+                paused = false;
+                host->handlesToResume.push_back(handle);
+            }
+        }
+
+        position += (juce::int64) numToCopy;
+        return (int) numToCopy;
+    }
+
+    juce::int64 getPosition() override { return position; }
+
+    bool setPosition(juce::int64 newPosition) override
+    {
+        // The response can only be skipped forward
+        char skipped[4096];
+        while (position < newPosition)
+        {
+            int numRead = read(skipped, (int) juce::jmin((juce::int64) sizeof(skipped),
+                                                          newPosition - position));
+            if (numRead <= 0)
+                return false;
+        }
+        return position == newPosition;
+    }
+
+private:
+    static constexpr size_t maxBufferedBytes = 1 << 20;
+
+    size_t getNumBuffered() const { return received.size() - readOffset; }
+
+    // Waits until no other thread uses the host's curl handles and runs fn
+    void withMultiHandle(const std::function<void()>& fn)
+    {
+        std::unique_lock<std::mutex> lock(host->mutex);
+        host->numWaitingForMulti++;
+        host->driven.wait(lock, [this] { return ! host->driving; });
+        host->numWaitingForMulti--;
+        host->driving = true;
+        lock.unlock();
+
+        fn();
+
+        lock.lock();
+        host->driving = false;
+        host->driven.notify_all();
+    }
+
+    // Runs the host's transfers until isReady returns true or this transfer is over
+    void runUntil(const std::function<bool()>& isReady)
+    {
+        const CurlLibrary& curl = CurlLibrary::get();
+        std::unique_lock<std::mutex> lock(host->mutex);
+
+        while (! isReady() && ! finished && ! cancelled)
+        {
+            if (host->driving || host->numWaitingForMulti > 0)
+            {
+                // Another thread is running the transfers, this one included
+                host->driven.wait_for(lock, std::chrono::milliseconds(50));
+                continue;
+            }
+
+            host->driving = true;
+            std::vector<CURL*> toResume;
+            toResume.swap(host->handlesToResume);
+            lock.unlock();
+
+            // Resuming delivers the data the transfer was paused on straight away
+            for (CURL* pausedHandle : toResume)
+                curl.easyPause(pausedHandle, CURLPAUSE_CONT);
+
+            int numRunning = 0;
+            curl.multiPerform(host->multi, &numRunning);
+
+            int numMessages = 0;
+            while (CURLMsg* message = curl.multiInfoRead(host->multi, &numMessages))
+            {
+                if (message->msg != CURLMSG_DONE)
+                    continue;
+
+                CurlStream* stream = nullptr;
+                curl.easyGetinfo(message->easy_handle, CURLINFO_PRIVATE, &stream);
+
+                std::lock_guard<std::mutex> doneLock(host->mutex);
+                stream->finished = true;
+                stream->result = message->data.result;
+                // e.g a response without a body
+                stream->headersDone = true;
+            }
+
+            lock.lock();
+            bool ready = isReady() || finished || cancelled;
+            lock.unlock();
+
+            if (! ready)
+                curl.multiWait(host->multi, nullptr, 0, 50, nullptr);
+
+            lock.lock();
+            host->driving = false;
+            host->driven.notify_all();
+        }
+    }
+
+    static bool isRedirect(int code)
+    {
+        return code == 301 || code == 302 || code == 303 || code == 307 || code == 308;
+    }
+
+    static size_t writeHeader(char* data, size_t size, size_t numItems, void* userData)
+    {
+        auto& stream = *static_cast<CurlStream*>(userData);
+        size_t numBytes = size * numItems;
+        juce::String line = juce::String::fromUTF8(data, (int) numBytes).trim();
+
+        std::lock_guard<std::mutex> lock(stream.host->mutex);
+
+        if (line.startsWith("HTTP/"))
+        {
+            // e.g "HTTP/2 200", a new response after a redirect or a "100 Continue"
+            stream.statusCode = line.fromFirstOccurrenceOf(" ", false, false).getIntValue();
+            stream.responseHeaders.clear();
+        }
+        else if (line.isEmpty())
+        {
+            bool followed = stream.followsRedirects && isRedirect(stream.statusCode)
+                            && stream.responseHeaders.getAllKeys().contains("Location", true);
+            if (stream.statusCode >= 200 && ! followed)
+                stream.headersDone = true;
+        }
+        else if (line.containsChar(':'))
+        {
+            juce::String name = line.upToFirstOccurrenceOf(":", false, false).trim();
+            juce::String value = line.fromFirstOccurrenceOf(":", false, false).trim();
+            juce::String previous = stream.responseHeaders.getValue(name, {});
+            stream.responseHeaders.set(name, previous.isEmpty() ? value : previous + "," + value);
+        }
+
+        return numBytes;
+    }
+
+    static size_t writeBody(char* data, size_t size, size_t numItems, void* userData)
+    {
+        auto& stream = *static_cast<CurlStream*>(userData);
+        size_t numBytes = size * numItems;
+
+        std::lock_guard<std::mutex> lock(stream.host->mutex);
+
+        // Keep the data with libcurl until the reader catches up
+        if (stream.getNumBuffered() >= maxBufferedBytes)
+        {
+            stream.paused = true;
+            return CURL_WRITEFUNC_PAUSE;
+        }
+
+        stream.headersDone = true;
+        stream.received.insert(stream.received.end(), data, data + numBytes);
+        return numBytes;
+    }
+
+    static size_t readBody(char* dest, size_t size, size_t numItems, void* userData)
+    {
+        auto& stream = *static_cast<CurlStream*>(userData);
+        if (stream.cancelled)
+            return CURL_READFUNC_ABORT;
+
+        int numRead = stream.body->read(dest, (int) juce::jmin(size * numItems, (size_t) 1 << 20));
+
+        // The body ended before its length, e.g the file it's read from got shorter
+        if (numRead <= 0 && ! stream.body->isExhausted())
+            return CURL_READFUNC_ABORT;
+
+        return (size_t) juce::jmax(0, numRead);
+    }
+
+    // Rewinds the body when libcurl sends the request again, e.g after a redirect,
+    // or when the kept-alive connection turned out to be closed by the server
+    static int seekBody(void* userData, curl_off_t offset, int origin)
+    {
+        auto& stream = *static_cast<CurlStream*>(userData);
+        if (origin != SEEK_SET || ! stream.body->setPosition((juce::int64) offset))
+            return CURL_SEEKFUNC_CANTSEEK;
+        return CURL_SEEKFUNC_OK;
+    }
+
+    std::shared_ptr<Host> host;
+    juce::InputStream* body = nullptr;
+    CURL* handle = nullptr;
+    curl_slist* headers = nullptr;
+    bool added = false;
+    bool followsRedirects = true;
+    std::atomic<bool> cancelled { false };
+
+    // Guarded by the host's mutex while the transfer runs
+    std::vector<char> received;
+    size_t readOffset = 0;
+    bool paused = false;
+    bool headersDone = false;
+    bool finished = false;
+    CURLcode result = CURLE_OK;
+    juce::StringPairArray responseHeaders;
+    int statusCode = 0;
+
+    // Set by connect()
+    bool failed = false;
+    bool reused = false;
+    bool usedHttp2 = false;
+    bool requestSent = false;
+    double handshakeMs = 0.0;
+    juce::int64 totalLength = -1;
+
+    juce::int64 position = 0;
+
+    JUCE_DECLARE_NON_COPYABLE(CurlStream)
+};
+#endif
+
+PooledConnection::PooledConnection(std::shared_ptr<ConnectionPool::Host> hostToUse)
+    : host(std::move(hostToUse))
+{
+}
+
+PooledConnection::~PooledConnection()
+{
+    abortHandler.reset();
+    stream.reset();
+    ConnectionPool::releaseSlot(*host);
+}
+
+ConnectionPool::~ConnectionPool() { clearSingletonInstance(); }
+
+bool ConnectionPool::isCurlAvailable()
+{
+#if HARP_CURL_POOL
+    return CurlLibrary::get().isLoaded();
+#else
+    return false;
+#endif
+}
+
+juce::String ConnectionPool::getHostKey(const juce::URL& url)
+{
+    // scheme + host + port, e.g "https://xribene-midi-pitch-shifter.hf.space"
+    juce::String address = url.toString(false);
+    juce::String scheme = address.upToFirstOccurrenceOf("://", true, false);
+    juce::String rest = address.fromFirstOccurrenceOf("://", false, false);
+    return scheme + rest.upToFirstOccurrenceOf("/", false, false);
+}
+
+juce::String ConnectionPool::getEndpointName(const juce::URL& url)
+{
+    // The path without the parts that change from request to request, e.g
+    // "gradio_api/call/process/{event_id}" or "gradio_api/file="
+    juce::String address = url.toString(false).fromFirstOccurrenceOf("://", false, false);
+    juce::StringArray parts;
+    parts.addTokens(address.fromFirstOccurrenceOf("/", false, false), "/", "");
+    parts.removeEmptyStrings();
+
+    juce::StringArray endpoint;
+    for (int i = 0; i < parts.size(); ++i)
+    {
+        if (parts[i].startsWith("file="))
+        {
+            endpoint.add("file=");
+            break;
+        }
+        if (i >= 2 && parts[i - 2] == "call")
+        {
+            endpoint.add("{event_id}");
+            break;
+        }
+        endpoint.add(parts[i]);
+    }
+    return endpoint.joinIntoString("/");
+}
+
+std::shared_ptr<ConnectionPool::Host> ConnectionPool::getHost(const juce::String& key)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    auto& host = hosts[key];
+    if (host == nullptr)
+        host = std::make_shared<Host>(key);
+    return host;
+}
+
+bool ConnectionPool::acquireSlot(Host& host, CancellationToken* cancellation)
+{
+    // Stop waiting as soon as the request gets cancelled
+    CancellationToken::ScopedAbortHandler abortWait(cancellation,
+                                                    [&host] { wakeUpWaiters(host); });
+
+    std::unique_lock<std::mutex> lock(host.mutex);
+
+    if (host.activeConnections >= maxConnectionsPerHost)
+    {
+        host.stats.numQueued++;
+        host.slotFreed.wait(lock,
+                            [&]
+                            {
+                                return host.activeConnections < maxConnectionsPerHost
+                                       || CancellationToken::isCancelled(cancellation);
+                            });
+    }
+
+    if (CancellationToken::isCancelled(cancellation))
+        return false;
+
+    host.activeConnections++;
+    return true;
+}
+
+void ConnectionPool::wakeUpWaiters(Host& host)
+{
+    // Taking the lock first means that a thread that is about to wait
+    // has either not checked its condition yet or is already waiting
+    {
+        std::lock_guard<std::mutex> lock(host.mutex);
+    }
+    host.slotFreed.notify_all();
+}
+
+void ConnectionPool::releaseSlot(Host& host)
+{
+    {
+        std::lock_guard<std::mutex> lock(host.mutex);
+        host.activeConnections--;
+    }
+    host.slotFreed.notify_all();
+}
+
+std::unique_ptr<PooledConnection>
+    ConnectionPool::open(const Request& request, int& statusCode, bool* requestSent)
+{
+    std::shared_ptr<Host> host = getHost(getHostKey(request.url));
+    statusCode = 0;
+    if (requestSent != nullptr)
+        *requestSent = false;
+
+    if (! acquireSlot(*host, request.cancellation))
+        return nullptr;
+
+    // From here on, the connection owns the slot and gives it back when destroyed
+    std::unique_ptr<PooledConnection> connection(new PooledConnection(host));
+
+    bool connected = false;
+    bool sent = false;
+    bool http2 = false;
+    double handshakeMs = 0.0;
+    double startMs = juce::Time::getMillisecondCounterHiRes();
+
+#if HARP_CURL_POOL
+    // juce::URL encodes files to upload (withFileToUpload) and parameters into the
+    // body itself without handing them out, so only WebInputStream can send those
+    bool urlEncodesBody = request.usePostData && request.url.getPostDataAsMemoryBlock().isEmpty();
+
+    if (host->multi != nullptr && ! urlEncodesBody)
+    {
+        auto stream = std::make_unique<CurlStream>(host, request);
+        CurlStream* curlStream = stream.get();
+        connection->abortHandler = std::make_unique<CancellationToken::ScopedAbortHandler>(
+            request.cancellation, [curlStream] { curlStream->cancel(); });
+
+        connected = stream->connect();
+        connection->statusCode = stream->getStatusCode();
+        connection->responseHeaders = stream->getResponseHeaders();
+        connection->reused = stream->wasReused();
+        sent = stream->wasRequestSent();
+        http2 = stream->wasHttp2();
+        handshakeMs = stream->getHandshakeMs();
+        connection->stream = std::move(stream);
+    }
+    else
+#endif
+    {
+        // A body stream can only be sent through libcurl
+        if (request.body != nullptr)
+            return nullptr;
+
+        auto stream = std::make_unique<juce::WebInputStream>(request.url, request.usePostData);
+        stream->withExtraHeaders(request.extraHeaders)
+            .withConnectionTimeout(request.timeoutMs)
+            .withNumRedirectsToFollow(request.numRedirectsToFollow);
+
+        if (request.command.isNotEmpty())
+            stream->withCustomRequestCommand(request.command);
+
+        // WebInputStream::cancel can be called from another thread,
+        // and makes a blocked connect() or read() return straight away
+        juce::WebInputStream* webStream = stream.get();
+        connection->abortHandler = std::make_unique<CancellationToken::ScopedAbortHandler>(
+            request.cancellation, [webStream] { webStream->cancel(); });
+
+        connected = stream->connect(nullptr) && ! stream->isError();
+        connection->statusCode = stream->getStatusCode();
+        connection->responseHeaders = stream->getResponseHeaders();
+
+        // WebInputStream doesn't say how far a failed connect() got. One that gave up
+        // well before the timeout was refused or couldn't resolve the host; one that
+        // ran into the timeout may have sent the request and waited for the response
+        double elapsedMs = juce::Time::getMillisecondCounterHiRes() - startMs;
+        bool gaveUpEarly = request.timeoutMs > 0 && elapsedMs < request.timeoutMs / 2;
+        sent = connection->statusCode > 0 || ! gaveUpEarly;
+        handshakeMs = elapsedMs;
+        connection->stream = std::move(stream);
+    }
+
+    connection->connectMs = juce::Time::getMillisecondCounterHiRes() - startMs;
+    statusCode = connection->statusCode;
+
+    if (requestSent != nullptr)
+        *requestSent = sent;
+
+    {
+        std::lock_guard<std::mutex> lock(host->mutex);
+        HostStats& hostStats = host->stats;
+        hostStats.numRequests++;
+        hostStats.totalConnectMs += connection->connectMs;
+        hostStats.maxConnectMs = juce::jmax(hostStats.maxConnectMs, connection->connectMs);
+
+        if (connection->reused)
+        {
+            hostStats.numReused++;
+        }
+        else
+        {
+            hostStats.totalHandshakeMs += handshakeMs;
+            hostStats.maxHandshakeMs = juce::jmax(hostStats.maxHandshakeMs, handshakeMs);
+        }
+
+        if (http2)
+            hostStats.numHttp2++;
+
+        if (! connected)
+            hostStats.numFailedConnects++;
+    }
+
+    juce::String endpoint = getEndpointName(request.url);
+    juce::String statusClass =
+        connected ? juce::String(statusCode / 100) + "xx" : juce::String("failed");
+    Metrics::Labels labels = { { "endpoint", endpoint }, { "status", statusClass } };
+    Metrics::getInstance()->counter("harp_http_requests_total", labels).increment();
+    Metrics::getInstance()
+        ->histogram("harp_http_connect_ms", { { "endpoint", endpoint } })
+        .observe(connection->connectMs);
+
+    if (! connected || CancellationToken::isCancelled(request.cancellation))
+        return nullptr;
+
+    return connection;
+}
+
+ConnectionPool::HostStats ConnectionPool::getStats(const juce::String& hostKey) const
+{
+    std::shared_ptr<Host> host;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto it = hosts.find(hostKey);
+        if (it == hosts.end())
+            return {};
+        host = it->second;
+    }
+
+    std::lock_guard<std::mutex> lock(host->mutex);
+    return host->stats;
+}
+
+std::map<juce::String, ConnectionPool::HostStats> ConnectionPool::getAllStats() const
+{
+    std::map<juce::String, std::shared_ptr<Host>> allHosts;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        allHosts = hosts;
+    }
+
+    std::map<juce::String, HostStats> allStats;
+    for (const auto& [hostKey, host] : allHosts)
+    {
+        std::lock_guard<std::mutex> lock(host->mutex);
+        allStats[hostKey] = host->stats;
+    }
+    return allStats;
+}
+
+void ConnectionPool::resetStats()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    for (auto& [hostKey, host] : hosts)
+    {
+        std::lock_guard<std::mutex> hostLock(host->mutex);
+        host->stats = HostStats();
+    }
+}
+
+juce::String ConnectionPool::statsToString() const
+{
+    juce::String str = "ConnectionPool: \n";
+    for (const auto& [host, hostStats] : getAllStats())
+    {
+        str += host + ": requests " + juce::String(hostStats.numRequests) + ", reused "
+               + juce::String(hostStats.numReused) + ", http/2 "
+               + juce::String(hostStats.numHttp2) + ", failed "
+               + juce::String(hostStats.numFailedConnects) + ", queued "
+               + juce::String(hostStats.numQueued) + ", handshake avg "
+               + juce::String(hostStats.getAverageHandshakeMs(), 1) + " ms / max "
+               + juce::String(hostStats.maxHandshakeMs, 1) + " ms, connect avg "
+               + juce::String(hostStats.getAverageConnectMs(), 1) + " ms / max "
+               + juce::String(hostStats.maxConnectMs, 1) + " ms\n";
+    }
+    return str;
+}
@@ -0,0 +1,174 @@
+/**
+ * @file
+ * @brief A process-wide pool of keep-alive HTTP connections, one per host, shared
+ * by all the GradioClient requests. Also caps the requests in flight to each host
+ * and keeps per-host stats on connection reuse and handshake time
+ */
+
+#pragma once
+
+#include <condition_variable>
+#include <map>
+#include <memory>
+#include <mutex>
+
+#include "CancellationToken.h"
+#include "juce_core/juce_core.h"
+
+class PooledConnection;
+
+/*
+* Requests go through libcurl, which is loaded at runtime the same way JUCE loads
+* it (JUCE_LOAD_CURL_SYMBOLS_LAZILY). All the requests to a host run on that host's
+* curl multi handle, so a connection that a request is done with stays open for
+* the next request to the same host (HTTP/1.1 keep-alive), and concurrent requests
+* share one connection where the server speaks HTTP/2. Where libcurl can't be
+* loaded, every request opens its own juce::WebInputStream and nothing is reused.
+*
+* The pool is shared by every GradioClient in the process, so all the models and
+* jobs that talk to the same space reuse the same connections.
+*/
+class ConnectionPool : private juce::DeletedAtShutdown
+{
+public:
+    JUCE_DECLARE_SINGLETON(ConnectionPool, false)
+
+    ~ConnectionPool();
+
+    ConnectionPool(const ConnectionPool&) = delete;
+    ConnectionPool& operator=(const ConnectionPool&) = delete;
+
+    struct HostStats
+    {
+        int numRequests = 0;
+        int numFailedConnects = 0;
+        // requests sent over a connection that an earlier request had opened
+        int numReused = 0;
+        // requests that were multiplexed over HTTP/2
+        int numHttp2 = 0;
+        // requests that had to wait for a free slot
+        int numQueued = 0;
+        // time to the response headers, for all requests
+        double totalConnectMs = 0.0;
+        double maxConnectMs = 0.0;
+        // TCP and TLS handshake time, for the requests that opened a connection
+        double totalHandshakeMs = 0.0;
+        double maxHandshakeMs = 0.0;
+
+        double getAverageConnectMs() const
+        {
+            return numRequests > 0 ? totalConnectMs / numRequests : 0.0;
+        }
+
+        double getAverageHandshakeMs() const
+        {
+            int numOpened = numRequests - numReused;
+            return numOpened > 0 ? totalHandshakeMs / numOpened : 0.0;
+        }
+    };
+
+    struct Request
+    {
+        juce::URL url;
+        // If true, the url's post data (or files to upload) are sent as the request body
+        bool usePostData = false;
+        // Sent as the request body instead of the url's post data, e.g a file
+        // upload, without ever being held in memory. Its total length is sent as
+        // the Content-Length, and it's rewound if the request has to be sent
+        // again. Only supported when isCurlAvailable() is true
+        juce::InputStream* body = nullptr;
+        juce::String command;
+        juce::String extraHeaders;
+        int timeoutMs = 10000;
+        int numRedirectsToFollow = 5;
+        // If given, cancelling it aborts the connection, including any
+        // read that is blocked on it, and stops waiting for a free slot
+        CancellationToken* cancellation = nullptr;
+    };
+
+    /*
+    * Opens a connection for the given request. Blocks while all the slots
+    * for the request's host are in use. Returns nullptr if the connection
+    * could not be established or the request was cancelled; statusCode is
+    * filled in either way. If given, requestSent is set to false when the
+    * request can't have reached the server, see RetryPolicy::Failure.
+    */
+    std::unique_ptr<PooledConnection>
+        open(const Request& request, int& statusCode, bool* requestSent = nullptr);
+
+    HostStats getStats(const juce::String& host) const;
+    std::map<juce::String, HostStats> getAllStats() const;
+    void resetStats();
+
+    juce::String statsToString() const;
+
+    // True if libcurl could be loaded, so connections are kept alive
+    // and Request::body can be used
+    static bool isCurlAvailable();
+
+    static juce::String getHostKey(const juce::URL& url);
+
+    // The path of url with the request specific parts (event ids, file paths)
+    // left out, so that the metrics of an endpoint add up
+    static juce::String getEndpointName(const juce::URL& url);
+
+private:
+    friend class PooledConnection;
+
+    struct Host;
+    class CurlStream;
+
+    ConnectionPool() = default;
+
+    std::shared_ptr<Host> getHost(const juce::String& key);
+
+    // Returns false if the request was cancelled while waiting for a slot
+    static bool acquireSlot(Host& host, CancellationToken* cancellation);
+    static void releaseSlot(Host& host);
+    static void wakeUpWaiters(Host& host);
+
+    static constexpr int maxConnectionsPerHost = 4;
+
+    mutable std::mutex mutex;
+    std::map<juce::String, std::shared_ptr<Host>> hosts;
+};
+
+/*
+* A request opened through the ConnectionPool. The response is read from
+* getStream(). Destroying the connection gives its slot back, and once the
+* response has been read to the end, leaves the socket open for the next
+* request to the same host.
+*/
+class PooledConnection
+{
+public:
+    ~PooledConnection();
+
+    juce::InputStream& getStream() { return *stream; }
+
+    int getStatusCode() const { return statusCode; }
+
+    const juce::StringPairArray& getResponseHeaders() const { return responseHeaders; }
+
+    // Time (ms) it took to establish the connection and receive the response headers
+    double getConnectMs() const { return connectMs; }
+
+    // True if the request went over a connection that an earlier request had opened
+    bool wasReused() const { return reused; }
+
+private:
+    friend class ConnectionPool;
+
+    explicit PooledConnection(std::shared_ptr<ConnectionPool::Host> host);
+
+    std::shared_ptr<ConnectionPool::Host> host;
+    std::unique_ptr<juce::InputStream> stream;
+    // Cancels the stream when the request's token is cancelled
+    std::unique_ptr<CancellationToken::ScopedAbortHandler> abortHandler;
+    juce::StringPairArray responseHeaders;
+    int statusCode = 0;
+    double connectMs = 0.0;
+    bool reused = false;
+
+    JUCE_DECLARE_NON_COPYABLE(PooledConnection)
+};
@@ -1,4 +1,5 @@
 #include "GradioClient.h"
+#include "../ContentHash.h"
 #include "../errors.h"
 
 OpResult GradioClient::extractKeyFromResponse(const juce::String& response,
@@ -176,48 +177,135 @@ OpResult GradioClient::setSpaceInfo(const juce::String userProvidedSpaceAddress)
 
 SpaceInfo GradioClient::getSpaceInfo() const { return spaceInfo; }
 
+juce::String GradioClient::getSchedulerKey(const juce::String& spaceAddress)
+{
+    SpaceInfo info;
+    if (parseSpaceAddress(spaceAddress, info).wasOk() && info.gradio.isNotEmpty())
+        return info.gradio;
+    return spaceAddress;
+}
+
+juce::String GradioClient::getHostKey() const
+{
+    return ConnectionPool::getHostKey(juce::URL(spaceInfo.gradio));
+}
+
+void GradioClient::setRetryPolicy(RequestType type, const RetryPolicy& policy)
+{
+    retryPolicies[(size_t) type] = policy;
+}
+
+const RetryPolicy& GradioClient::getRetryPolicy(RequestType type) const
+{
+    return retryPolicies[(size_t) type];
+}
+
 OpResult GradioClient::uploadFileRequest(const juce::File& fileToUpload,
                                          juce::String& uploadedFilePath,
-                                         const int timeoutMs) const
+                                         const int timeoutMs,
+                                         MultipartUpload::Stats* uploadStats,
+                                         CancellationToken* cancellation,
+                                         RetryPolicy::Stats* retryStats) const
+{
+    return getRetryPolicy(RequestType::Upload)
+        .run(getHostKey(),
+             "Upload of " + fileToUpload.getFileName(),
+             cancellation,
+             retryStats,
+             [&](RetryPolicy::Failure& failure)
+             {
+                 return uploadFileAttempt(fileToUpload,
+                                          uploadedFilePath,
+                                          timeoutMs,
+                                          uploadStats,
+                                          cancellation,
+                                          failure);
+             });
+}
+
+OpResult GradioClient::uploadFileAttempt(const juce::File& fileToUpload,
+                                         juce::String& uploadedFilePath,
+                                         const int timeoutMs,
+                                         MultipartUpload::Stats* uploadStats,
+                                         CancellationToken* cancellation,
+                                         RetryPolicy::Failure& failure) const
 {
     juce::URL gradioEndpoint = spaceInfo.gradio;
     juce::URL uploadEndpoint = gradioEndpoint.getChildURL("upload");
 
-    juce::StringPairArray responseHeaders;
     int statusCode = 0;
-    juce::String mimeType = "audio/midi";
+    juce::String mimeType = MultipartUpload::getMimeType(fileToUpload);
+    juce::String response;
+    MultipartUpload::Stats stats;
 
     // Create the error here, in case we need it
     // All the errors of this function are of type FileUploadError
     Error error;
     error.type = ErrorType::FileUploadError;
 
-    // Use withFileToUpload to handle the multipart/form-data construction
-    auto postEndpoint = uploadEndpoint.withFileToUpload("files", fileToUpload, mimeType);
+    ConnectionPool::Request request;
+    request.url = uploadEndpoint;
+    request.command = "POST";
+    request.timeoutMs = timeoutMs;
+    request.cancellation = cancellation;
+
+    // Stream the file from disk while sending, see MultipartUpload::canStream
+    std::unique_ptr<MultipartUpload::Body> body;
+    if (MultipartUpload::canStream())
+    {
+        body = std::make_unique<MultipartUpload::Body>("files", fileToUpload, mimeType);
+        request.body = body.get();
+        request.extraHeaders = "Content-Type: " + body->getContentType() + "\r\n";
+        stats.streamed = true;
+    }
+    else
+    {
+        // Use withFileToUpload to handle the multipart/form-data construction
+        request.url = uploadEndpoint.withFileToUpload("files", fileToUpload, mimeType);
+        request.usePostData = true;
+    }
 
-    auto options = juce::URL::InputStreamOptions(juce::URL::ParameterHandling::inPostData)
-                       // .withExtraHeaders("Accept: */*")
-                       .withConnectionTimeoutMs(timeoutMs)
-                       .withResponseHeaders(&responseHeaders)
-                       .withStatusCode(&statusCode)
-                       .withNumRedirectsToFollow(5)
-                       .withHttpRequestCmd("POST");
+    double startMs = juce::Time::getMillisecondCounterHiRes();
 
     // Create the input stream for the POST request
-    std::unique_ptr<juce::InputStream> stream(postEndpoint.createInputStream(options));
+    auto connection =
+        ConnectionPool::getInstance()->open(request, statusCode, &failure.requestSent);
+
+    if (CancellationToken::isCancelled(cancellation))
+    {
+        return OpResult::fail(
+            CancellationToken::makeError("Upload of " + fileToUpload.getFileName()));
+    }
 
-    if (stream == nullptr)
+    if (connection == nullptr)
     {
         error.code = statusCode;
         error.devMessage = "Failed to create input stream for file upload request.";
         return OpResult::fail(error);
     }
 
-    juce::String response = stream->readEntireStreamAsString();
+    response = connection->getStream().readEntireStreamAsString();
+    failure.retryAfter = connection->getResponseHeaders().getValue("Retry-After", {});
+
+    if (CancellationToken::isCancelled(cancellation))
+    {
+        return OpResult::fail(
+            CancellationToken::makeError("Upload of " + fileToUpload.getFileName()));
+    }
+
+    stats.bytesSent = body != nullptr ? body->getTotalLength() : fileToUpload.getSize();
+    stats.elapsedMs = juce::Time::getMillisecondCounterHiRes() - startMs;
+
+    LogAndDBG(stats.toString());
+    if (uploadStats != nullptr)
+    {
+        *uploadStats = stats;
+    }
 
     // Check the status code to ensure the request was successful
     if (statusCode != 200)
     {
+        error.code = statusCode;
         error.devMessage = "Request failed with status code: " + juce::String(statusCode);
         return OpResult::fail(error);
     }
@@ -249,10 +337,195 @@ OpResult GradioClient::uploadFileRequest(const juce::File& fileToUpload,
     return OpResult::ok();
 }
 
+OpResult GradioClient::uploadFileCached(const juce::File& fileToUpload,
+                                        juce::String& uploadedFilePath,
+                                        bool* wasCached,
+                                        const int timeoutMs,
+                                        CancellationToken* cancellation,
+                                        RetryPolicy::Stats* retryStats) const
+{
+    if (wasCached != nullptr)
+    {
+        *wasCached = false;
+    }
+
+    uint64_t contentHash = 0;
+    bool hashed = ContentHash::hashFile(fileToUpload, contentHash);
+
+    return uploadFileCached(fileToUpload,
+                            hashed ? std::optional<uint64_t>(contentHash) : std::nullopt,
+                            uploadedFilePath,
+                            wasCached,
+                            timeoutMs,
+                            cancellation,
+                            retryStats);
+}
+
+OpResult GradioClient::uploadFileCached(const juce::File& fileToUpload,
+                                        std::optional<uint64_t> contentHash,
+                                        juce::String& uploadedFilePath,
+                                        bool* wasCached,
+                                        const int timeoutMs,
+                                        CancellationToken* cancellation,
+                                        RetryPolicy::Stats* retryStats) const
+{
+    if (wasCached != nullptr)
+    {
+        *wasCached = false;
+    }
+
+    if (! contentHash.has_value())
+    {
+        // Let uploadFileRequest report the problem with the file
+        return uploadFileRequest(
+            fileToUpload, uploadedFilePath, timeoutMs, nullptr, cancellation, retryStats);
+    }
+
+    juce::String cachedPath;
+    if (uploadCache->lookup(spaceInfo.gradio, *contentHash, cachedPath))
+    {
+        bool exists = false;
+        if (checkUploadedFileExists(cachedPath, exists, cancellation).wasOk() && exists)
+        {
+            LogAndDBG("Skipping upload of " + fileToUpload.getFileName()
+                      + ", already uploaded as " + cachedPath);
+            uploadedFilePath = cachedPath;
+            if (wasCached != nullptr)
+            {
+                *wasCached = true;
+            }
+            return OpResult::ok();
+        }
+
+        // The space has dropped the file (e.g it restarted), so we upload it again
+        LogAndDBG("Uploaded file " + cachedPath + " has expired, uploading again.");
+        uploadCache->invalidate(spaceInfo.gradio, *contentHash);
+    }
+
+    OpResult result = uploadFileRequest(
+        fileToUpload, uploadedFilePath, timeoutMs, nullptr, cancellation, retryStats);
+    if (result.wasOk())
+    {
+        uploadCache->store(spaceInfo.gradio, *contentHash, uploadedFilePath);
+    }
+    return result;
+}
+
+OpResult GradioClient::checkUploadedFileExists(const juce::String& serverPath,
+                                               bool& exists,
+                                               CancellationToken* cancellation) const
+{
+    Error error;
+    error.type = ErrorType::HttpRequestError;
+
+    // Only ask for the first byte, we just want to know if it's still there
+    int statusCode = 0;
+    ConnectionPool::Request request;
+    request.url = juce::URL(spaceInfo.gradio.trimCharactersAtEnd("/") + "/file=" + serverPath);
+    request.extraHeaders = "Range: bytes=0-0";
+    request.cancellation = cancellation;
+
+    std::unique_ptr<PooledConnection> connection;
+    auto openConnection = [&](RetryPolicy::Failure& failure)
+    {
+        connection = ConnectionPool::getInstance()->open(request, statusCode);
+
+        if (CancellationToken::isCancelled(cancellation))
+        {
+            return OpResult::fail(
+                CancellationToken::makeError("GET request to file=" + serverPath));
+        }
+
+        if (connection == nullptr)
+        {
+            error.code = statusCode;
+            error.devMessage =
+                "Failed to create input stream for GET request to file=" + serverPath;
+            return OpResult::fail(error);
+        }
+
+        // A busy proxy doesn't tell us anything about the file
+        if (statusCode == 429 || statusCode >= 502)
+        {
+            failure.retryAfter = connection->getResponseHeaders().getValue("Retry-After", {});
+            error.code = statusCode;
+            error.devMessage = "GET request to file=" + serverPath
+                               + " failed with status code: " + juce::String(statusCode);
+            return OpResult::fail(error);
+        }
+        return OpResult::ok();
+    };
+
+    OpResult result = getRetryPolicy(RequestType::Get)
+                          .run(getHostKey(),
+                               "GET request to file=" + serverPath,
+                               cancellation,
+                               nullptr,
+                               openConnection);
+    if (result.failed())
+    {
+        return result;
+    }
+
+    exists = (statusCode == 200 || statusCode == 206);
+    return OpResult::ok();
+}
+
+OpResult GradioClient::getServerVersion(juce::String& version,
+                                        CancellationToken* cancellation) const
+{
+    Error error;
+    error.type = ErrorType::HttpRequestError;
+
+    int statusCode = 0;
+    ConnectionPool::Request request;
+    request.url = juce::URL(spaceInfo.gradio).getChildURL("config");
+    request.cancellation = cancellation;
+
+    auto connection = ConnectionPool::getInstance()->open(request, statusCode);
+
+    if (CancellationToken::isCancelled(cancellation))
+    {
+        return OpResult::fail(CancellationToken::makeError("GET request to config"));
+    }
+
+    if (connection == nullptr || statusCode != 200)
+    {
+        error.code = statusCode;
+        error.devMessage = "GET request to config failed with status code: "
+                           + juce::String(statusCode);
+        return OpResult::fail(error);
+    }
+
+    version = connection->getResponseHeaders().getValue("ETag", {});
+    return OpResult::ok();
+}
+
 OpResult GradioClient::makePostRequestForEventID(const juce::String endpoint,
                                                  juce::String& eventID,
                                                  const juce::String jsonBody,
-                                                 const int timeoutMs) const
+                                                 const int timeoutMs,
+                                                 CancellationToken* cancellation,
+                                                 RetryPolicy::Stats* retryStats) const
+{
+    return getRetryPolicy(RequestType::Call)
+        .run(getHostKey(),
+             "POST request to " + endpoint,
+             cancellation,
+             retryStats,
+             [&](RetryPolicy::Failure& failure)
+             {
+                 return postRequestForEventIDAttempt(
+                     endpoint, eventID, jsonBody, timeoutMs, cancellation, failure);
+             });
+}
+
+OpResult GradioClient::postRequestForEventIDAttempt(const juce::String& endpoint,
+                                                    juce::String& eventID,
+                                                    const juce::String& jsonBody,
+                                                    const int timeoutMs,
+                                                    CancellationToken* cancellation,
+                                                    RetryPolicy::Failure& failure) const
 {
     // Create the error here, in case we need it
     // All the errors of this function are of type FileUploadError
@@ -266,27 +539,39 @@ OpResult GradioClient::makePostRequestForEventID(const juce::String endpoint,
     // Prepare the POST request
     // juce::String jsonBody = R"({"data": []})";
     juce::URL postEndpoint = requestEndpoint.withPOSTData(jsonBody);
-    juce::StringPairArray responseHeaders;
     int statusCode = 0;
-    auto options = juce::URL::InputStreamOptions(juce::URL::ParameterHandling::inPostData)
-                       .withExtraHeaders("Content-Type: application/json\r\nAccept: */*")
-                       .withConnectionTimeoutMs(timeoutMs)
-                       .withResponseHeaders(&responseHeaders)
-                       .withStatusCode(&statusCode)
-                       .withNumRedirectsToFollow(5)
-                       .withHttpRequestCmd("POST");
+    ConnectionPool::Request request;
+    request.url = postEndpoint;
+    request.usePostData = true;
+    request.command = "POST";
+    request.extraHeaders = "Content-Type: application/json\r\nAccept: */*";
+    request.timeoutMs = timeoutMs;
+    request.cancellation = cancellation;
 
     // Create the input stream for the POST request
-    std::unique_ptr<juce::InputStream> stream(postEndpoint.createInputStream(options));
+    // Starting a job isn't idempotent, see RetryPolicy::idempotent
+    auto connection =
+        ConnectionPool::getInstance()->open(request, statusCode, &failure.requestSent);
+
+    if (CancellationToken::isCancelled(cancellation))
+    {
+        return OpResult::fail(CancellationToken::makeError("POST request to " + endpoint));
+    }
 
-    if (stream == nullptr)
+    if (connection == nullptr)
     {
         error.code = statusCode;
         error.devMessage = "Failed to create input stream for POST request to " + endpoint;
         return OpResult::fail(error);
     }
 
-    juce::String response = stream->readEntireStreamAsString();
+    juce::String response = connection->getStream().readEntireStreamAsString();
+    failure.retryAfter = connection->getResponseHeaders().getValue("Retry-After", {});
+
+    if (CancellationToken::isCancelled(cancellation))
+    {
+        return OpResult::fail(CancellationToken::makeError("POST request to " + endpoint));
+    }
 
     // Check the status code to ensure the request was successful
     if (statusCode != 200)
@@ -301,6 +586,7 @@ OpResult GradioClient::makePostRequestForEventID(const juce::String endpoint,
     juce::var parsedResponse = juce::JSON::parse(response);
     if (! parsedResponse.isObject())
     {
+        error.code = statusCode;
         error.devMessage = "Failed to parse JSON response from " + endpoint;
         return OpResult::fail(error);
     }
@@ -308,6 +594,7 @@ OpResult GradioClient::makePostRequestForEventID(const juce::String endpoint,
     juce::DynamicObject* obj = parsedResponse.getDynamicObject();
     if (obj == nullptr)
     {
+        error.code = statusCode;
         error.devMessage = "Parsed JSON is not an object from " + endpoint;
         return OpResult::fail(error);
     }
@@ -316,6 +603,7 @@ OpResult GradioClient::makePostRequestForEventID(const juce::String endpoint,
     if (eventID.isEmpty())
     {
         error.type = ErrorType::MissingJsonKey;
+        error.code = statusCode;
         error.devMessage = "event_id not found in the response from " + endpoint;
         return OpResult::fail(error);
     }
@@ -326,7 +614,10 @@ OpResult GradioClient::makePostRequestForEventID(const juce::String endpoint,
 OpResult GradioClient::getResponseFromEventID(const juce::String callID,
                                               const juce::String eventID,
                                               juce::String& response,
-                                              const int timeoutMs) const
+                                              const int timeoutMs,
+                                              const SSEParser::Callback& onEvent,
+                                              EventStreamTimings* timings,
+                                              CancellationToken* cancellation) const
 {
     // Create the error here, in case we need it
     Error error;
@@ -338,19 +629,25 @@ OpResult GradioClient::getResponseFromEventID(const juce::String callID,
     juce::URL gradioEndpoint = spaceInfo.gradio;
     juce::URL getEndpoint =
         gradioEndpoint.getChildURL("call").getChildURL(callID).getChildURL(eventID);
-    juce::StringPairArray responseHeaders;
     int statusCode = 0;
-    auto options = juce::URL::InputStreamOptions(juce::URL::ParameterHandling::inAddress)
-                       //    .withExtraHeaders("Content-Type: application/json\r\nAccept:
-                       //    */*")
-                       .withConnectionTimeoutMs(timeoutMs)
-                       .withResponseHeaders(&responseHeaders)
-                       .withStatusCode(&statusCode)
-                       .withNumRedirectsToFollow(5);
-    //  .withHttpRequestCmd ("POST");
-    std::unique_ptr<juce::InputStream> stream(getEndpoint.createInputStream(options));
-
-    if (stream == nullptr)
+    ConnectionPool::Request request;
+    request.url = getEndpoint;
+    request.timeoutMs = timeoutMs;
+    request.cancellation = cancellation;
+
+    double startMs = juce::Time::getMillisecondCounterHiRes();
+    auto connection = ConnectionPool::getInstance()->open(request, statusCode);
+    double connectedMs = juce::Time::getMillisecondCounterHiRes();
+    double firstByteMs = -1.0;
+    juce::int64 numBytes = 0;
+
+    if (CancellationToken::isCancelled(cancellation))
+    {
+        return OpResult::fail(
+            CancellationToken::makeError("GET request to " + callID + "/" + eventID));
+    }
+
+    if (connection == nullptr)
     {
         error.code = statusCode;
         error.devMessage =
@@ -358,13 +655,89 @@ OpResult GradioClient::getResponseFromEventID(const juce::String callID,
         return OpResult::fail(error);
     }
 
-    // Read the entire response from the stream
-    response = stream->readEntireStreamAsString();
+    // Parse the event stream as it arrives, instead of waiting for the server
+    // to close it. Only the last (complete/error) event is kept in memory.
+    auto& stream = connection->getStream();
+    SSEEvent finalEvent;
+    bool finished = false;
+
+    SSEParser parser(
+        [&](const SSEEvent& event)
+        {
+            if (onEvent)
+                onEvent(event);
+
+            if (event.isTerminal())
+            {
+                finalEvent = event;
+                finished = true;
+            }
+        });
+
+    // Small reads keep short events (heartbeats, progress) flowing as soon as
+    // they arrive. While inside a long data line, we read bigger chunks.
+    const int smallChunkSize = 64;
+    const int largeChunkSize = 16384;
+    juce::HeapBlock<char> buffer(largeChunkSize);
+
+    while (! finished && ! stream.isExhausted())
+    {
+        int chunkSize = parser.getPendingLineLength() > 4096 ? largeChunkSize : smallChunkSize;
+        int numRead = stream.read(buffer.getData(), chunkSize);
+        if (numRead <= 0)
+            break;
+        if (firstByteMs < 0.0)
+            firstByteMs = juce::Time::getMillisecondCounterHiRes();
+        numBytes += numRead;
+        parser.feed(buffer.getData(), (size_t) numRead);
+    }
+
+    if (timings != nullptr)
+    {
+        double endMs = juce::Time::getMillisecondCounterHiRes();
+        if (firstByteMs < 0.0)
+            firstByteMs = endMs;
+        timings->connectMs = connectedMs - startMs;
+        timings->firstByteMs = firstByteMs - connectedMs;
+        timings->streamMs = endMs - firstByteMs;
+        timings->bytes = numBytes;
+    }
+
+    // A cancelled stream just stops returning data, so this has to be checked
+    // before deciding that the app closed the stream early
+    if (CancellationToken::isCancelled(cancellation))
+    {
+        return OpResult::fail(
+            CancellationToken::makeError("GET request to " + callID + "/" + eventID));
+    }
+
+    if (! finished)
+        parser.finish();
+
+    if (finalEvent.type == SSEEvent::Type::Error)
+    {
+        error.devMessage = "The gradio app returned an error event for " + callID + "/" + eventID
+                           + ": " + finalEvent.data;
+        return OpResult::fail(error);
+    }
+
+    if (! finished)
+    {
+        error.code = statusCode;
+        error.devMessage = "The event stream for " + callID + "/" + eventID
+                           + " ended before a complete event was received.";
+        return OpResult::fail(error);
+    }
+
+    // Keep the "event: ... data: ..." layout, so that extractKeyFromResponse works as before
+    response = "event: " + finalEvent.name + "\ndata: " + finalEvent.data;
 
     return OpResult::ok();
 }
 
-OpResult GradioClient::getControls(juce::Array<juce::var>& ctrlList, juce::DynamicObject& cardDict)
+OpResult GradioClient::getControls(juce::Array<juce::var>& ctrlList,
+                                   juce::DynamicObject& cardDict,
+                                   CancellationToken* cancellation)
 {
     juce::String callID = "controls";
     juce::String eventID;
@@ -372,14 +745,15 @@ OpResult GradioClient::getControls(juce::Array<juce::var>& ctrlList, juce::Dynam
     // Initialize a positive result
     OpResult result = OpResult::ok();
 
-    result = makePostRequestForEventID(callID, eventID);
+    result = makePostRequestForEventID(callID, eventID, R"({"data": []})", 10000, cancellation);
     if (result.failed())
     {
         return result;
     }
 
     juce::String response;
-    result = getResponseFromEventID(callID, eventID, response);
+    result =
+        getResponseFromEventID(callID, eventID, response, 10000, nullptr, nullptr, cancellation);
     if (result.failed())
     {
         return result;
@@ -458,56 +832,44 @@ OpResult GradioClient::getControls(juce::Array<juce::var>& ctrlList, juce::Dynam
 
 OpResult GradioClient::downloadFileFromURL(const juce::URL& fileURL,
                                            juce::String& downloadedFilePath,
-                                           const int timeoutMs) const
+                                           const int timeoutMs,
+                                           const ProgressCallback& onProgress,
+                                           SegmentedDownload::Stats* downloadStats,
+                                           CancellationToken* cancellation) const
 {
-    // Create the error here, in case we need it
-    Error error;
-    error.type = ErrorType::FileDownloadError;
-
     // Determine the local temporary directory for storing the downloaded file
     juce::File tempDir = juce::File::getSpecialLocation(juce::File::tempDirectory);
     juce::String fileName = fileURL.getFileName();
-    juce::File downloadedFile = tempDir.getChildFile(fileName);
-
-    // Create input stream to download the file
-    juce::StringPairArray responseHeaders;
-    int statusCode = 0;
-    auto options = juce::URL::InputStreamOptions(juce::URL::ParameterHandling::inAddress)
-                       .withConnectionTimeoutMs(timeoutMs)
-                       .withResponseHeaders(&responseHeaders)
-                       .withStatusCode(&statusCode)
-                       .withNumRedirectsToFollow(5);
-
-    std::unique_ptr<juce::InputStream> stream(fileURL.createInputStream(options));
-
-    if (stream == nullptr)
-    {
-        error.devMessage = "Failed to create input stream for file download request.";
-        return OpResult::fail(error);
-    }
-
-    // Check if the request was successful
-    if (statusCode != 200)
+    // The jobs of a batch run at the same time, and the app can give their
+    // outputs the same name (e.g output.wav), so each download gets a name
+    // of its own. The file is moved over the input afterwards, so the name
+    // never reaches the user
+    juce::File downloadedFile = tempDir.getChildFile(juce::Uuid().toString() + "_" + fileName);
+
+    // Large files are downloaded in parallel Range segments. Segments that drop
+    // are resumed, and the final size is checked against the server's
+    SegmentedDownload::Options options;
+    options.timeoutMs = timeoutMs;
+    options.cancellation = cancellation;
+
+    SegmentedDownload download(*ConnectionPool::getInstance(), fileURL, downloadedFile, options);
+    SegmentedDownload::Stats stats;
+
+    OpResult result = download.run(onProgress, &stats);
+    if (result.failed())
     {
-        error.devMessage = "Request failed with status code: " + juce::String(statusCode);
-        return OpResult::fail(error);
+        // Don't leave a partial download behind
+        downloadedFile.deleteFile();
+        return result;
     }
-
-    // Create output stream to save the file locally
-    std::unique_ptr<juce::FileOutputStream> fileOutput(downloadedFile.createOutputStream());
-
-    if (fileOutput == nullptr || ! fileOutput->openedOk())
+    LogAndDBG(stats.toString());
+    if (downloadStats != nullptr)
     {
-        error.devMessage =
-            "Failed to create output stream for file: " + downloadedFile.getFullPathName();
-        return OpResult::fail(error);
+        *downloadStats = stats;
     }
 
-    // Copy data from the input stream to the output stream
-    fileOutput->writeFromInputStream(*stream, stream->getTotalLength());
-
     // Store the file path where the file was downloaded
     downloadedFilePath = downloadedFile.getFullPathName();
 
     return OpResult::ok();
-}
\ No newline at end of file
+}
@@ -7,47 +7,175 @@
 #pragma once
 
 #include <fstream>
+#include <optional>
 
 #include "../HarpLogger.h"
 #include "../errors.h"
 #include "../utils.h"
+#include "CancellationToken.h"
+#include "ConnectionPool.h"
+#include "MultipartUpload.h"
+#include "RetryPolicy.h"
+#include "SSEParser.h"
+#include "SegmentedDownload.h"
+#include "UploadCache.h"
 #include "juce_core/juce_core.h"
 class GradioClient
 
 {
 public:
+    using ProgressCallback = SegmentedDownload::ProgressCallback;
+
+    // Where the time of an event stream went, see getResponseFromEventID
+    struct EventStreamTimings
+    {
+        // Until the response headers arrived
+        double connectMs = 0.0;
+        // From the response headers until the first byte of the first event
+        double firstByteMs = 0.0;
+        // From the first byte until the final event
+        double streamMs = 0.0;
+        juce::int64 bytes = 0;
+    };
+
     // GradioClient(const juce::String& spaceUrl);
     GradioClient() = default;
 
+    /*
+    * All the requests below take an optional CancellationToken. Cancelling it
+    * from another thread aborts the request straight away, even if it is
+    * blocked on a read, and the request fails with ErrorType::Cancelled.
+    *
+    * Uploads, calls and file checks are retried on transient failures
+    * according to the RetryPolicy of their RequestType, and fail fast while
+    * the circuit breaker of the space is open. The optional retryStats
+    * count the retries and the time spent waiting for them.
+    */
+
+    enum class RequestType
+    {
+        Upload,
+        // POST requests that start a job (e.g process, controls)
+        Call,
+        Get,
+    };
+
+    // Not thread safe, set the policies before making any requests
+    void setRetryPolicy(RequestType type, const RetryPolicy& policy);
+    const RetryPolicy& getRetryPolicy(RequestType type) const;
+
     OpResult extractKeyFromResponse(const juce::String& response,
                                     juce::String& responseKey,
                                     const juce::String& key) const;
 
     OpResult uploadFileRequest(const juce::File& fileToUpload,
                                juce::String& uploadedFilePath,
-                               const int timeoutMs = 10000) const;
+                               const int timeoutMs = 10000,
+                               MultipartUpload::Stats* uploadStats = nullptr,
+                               CancellationToken* cancellation = nullptr,
+                               RetryPolicy::Stats* retryStats = nullptr) const;
+
+    /*
+    * Same as uploadFileRequest, but skips the upload if a file with the same
+    * contents was already uploaded to this space during this session.
+    * If the server has since dropped the file, it is uploaded again.
+    */
+    OpResult uploadFileCached(const juce::File& fileToUpload,
+                              juce::String& uploadedFilePath,
+                              bool* wasCached = nullptr,
+                              const int timeoutMs = 10000,
+                              CancellationToken* cancellation = nullptr,
+                              RetryPolicy::Stats* retryStats = nullptr) const;
+
+    /*
+    * Same as above, for callers that already hashed the file contents. Without
+    * a hash (the file couldn't be read) the upload bypasses the cache, so that
+    * files that failed to hash never share an entry.
+    */
+    OpResult uploadFileCached(const juce::File& fileToUpload,
+                              std::optional<uint64_t> contentHash,
+                              juce::String& uploadedFilePath,
+                              bool* wasCached = nullptr,
+                              const int timeoutMs = 10000,
+                              CancellationToken* cancellation = nullptr,
+                              RetryPolicy::Stats* retryStats = nullptr) const;
+
+    // Checks if a path returned by the /upload endpoint can still be served by the space
+    OpResult checkUploadedFileExists(const juce::String& serverPath,
+                                     bool& exists,
+                                     CancellationToken* cancellation = nullptr) const;
 
     OpResult makePostRequestForEventID(const juce::String endpoint,
                                        juce::String& eventId,
                                        const juce::String jsonBody = R"({"data": []})",
-                                       const int timeoutMs = 10000) const;
+                                       const int timeoutMs = 10000,
+                                       CancellationToken* cancellation = nullptr,
+                                       RetryPolicy::Stats* retryStats = nullptr) const;
 
+    /*
+    * Streams the server-sent events of callID/eventID. onEvent (if given) is
+    * called for every event as soon as it arrives. On success, response holds
+    * the final "complete" event.
+    */
     OpResult getResponseFromEventID(const juce::String callID,
                                     const juce::String eventID,
                                     juce::String& response,
-                                    const int timeoutMs = 10000) const;
+                                    const int timeoutMs = 10000,
+                                    const SSEParser::Callback& onEvent = nullptr,
+                                    EventStreamTimings* timings = nullptr,
+                                    CancellationToken* cancellation = nullptr) const;
+
+    OpResult getControls(juce::Array<juce::var>& ctrlList,
+                         juce::DynamicObject& cardDict,
+                         CancellationToken* cancellation = nullptr);
 
-    OpResult getControls(juce::Array<juce::var>& ctrlList, juce::DynamicObject& cardDict);
+    /*
+    * Identifies the deployment the space is running, so that cached schemas
+    * can be revalidated without fetching the controls again. This is the ETag
+    * of the /config endpoint, and empty if the server doesn't send one. The
+    * gradio version and app id in the config can't stand in for it: the first
+    * doesn't change when the app does, the second changes on every relaunch.
+    */
+    OpResult getServerVersion(juce::String& version,
+                              CancellationToken* cancellation = nullptr) const;
 
     OpResult setSpaceInfo(const juce::String url);
 
     SpaceInfo getSpaceInfo() const;
 
+    /*
+    * The gradio url of spaceAddress, whichever of the forms below it's given
+    * in, or spaceAddress itself if it can't be parsed. Jobs are submitted to
+    * the JobScheduler under this key, so that all the jobs of a space share
+    * its limit
+    */
+    static juce::String getSchedulerKey(const juce::String& spaceAddress);
+
     OpResult downloadFileFromURL(const juce::URL& fileURL,
                                  juce::String& downloadedFilePath,
-                                 const int timeoutMs = 10000) const;
+                                 const int timeoutMs = 10000,
+                                 const ProgressCallback& onProgress = nullptr,
+                                 SegmentedDownload::Stats* downloadStats = nullptr,
+                                 CancellationToken* cancellation = nullptr) const;
 
 private:
+    OpResult uploadFileAttempt(const juce::File& fileToUpload,
+                               juce::String& uploadedFilePath,
+                               const int timeoutMs,
+                               MultipartUpload::Stats* uploadStats,
+                               CancellationToken* cancellation,
+                               RetryPolicy::Failure& failure) const;
+
+    OpResult postRequestForEventIDAttempt(const juce::String& endpoint,
+                                          juce::String& eventID,
+                                          const juce::String& jsonBody,
+                                          const int timeoutMs,
+                                          CancellationToken* cancellation,
+                                          RetryPolicy::Failure& failure) const;
+
+    // Identifies the space for its circuit breaker
+    juce::String getHostKey() const;
+
     static OpResult parseSpaceAddress(juce::String spaceAddress, SpaceInfo& spaceInfo);
     /***
     We parse the space address given by the user
@@ -68,4 +196,11 @@ private:
     }
     ***/
     SpaceInfo spaceInfo;
+
+    std::shared_ptr<UploadCache> uploadCache { std::make_shared<UploadCache>() };
+
+    // One per RequestType
+    RetryPolicy retryPolicies[3] = { RetryPolicy::forUploads(),
+                                     RetryPolicy::forCalls(),
+                                     RetryPolicy::forGets() };
 };
\ No newline at end of file
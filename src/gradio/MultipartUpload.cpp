@@ -0,0 +1,114 @@
+#include "MultipartUpload.h"
+
+#include "ConnectionPool.h"
+
+juce::String MultipartUpload::getMimeType(const juce::File& file)
+{
+    juce::String extension = file.getFileExtension().toLowerCase();
+
+    if (extension == ".wav" || extension == ".bwf")
+        return "audio/wav";
+    if (extension == ".aif" || extension == ".aiff")
+        return "audio/aiff";
+    if (extension == ".flac")
+        return "audio/flac";
+    if (extension == ".ogg")
+        return "audio/ogg";
+    if (extension == ".mp3")
+        return "audio/mpeg";
+    if (extension == ".mid" || extension == ".midi")
+        return "audio/midi";
+
+    return "application/octet-stream";
+}
+
+MultipartUpload::Body::Body(const juce::String& fieldName,
+                            const juce::File& fileToSend,
+                            const juce::String& mimeType)
+    : file(fileToSend), mappedFile(fileToSend, juce::MemoryMappedFile::readOnly)
+{
+    boundary =
+        "------harp" + juce::String::toHexString(juce::Random::getSystemRandom().nextInt64());
+
+    partHeader = "--" + boundary + "\r\n" + "Content-Disposition: form-data; name=\"" + fieldName
+                 + "\"; filename=\"" + file.getFileName() + "\"\r\n" + "Content-Type: " + mimeType
+                 + "\r\n\r\n";
+    partFooter = "\r\n--" + boundary + "--\r\n";
+
+    if (mappedFile.getData() == nullptr)
+        input = std::make_unique<juce::FileInputStream>(file);
+
+    fileSize = mappedFile.getData() != nullptr ? (juce::int64) mappedFile.getSize()
+                                               : file.getSize();
+}
+
+juce::int64 MultipartUpload::Body::getTotalLength()
+{
+    return (juce::int64) partHeader.getNumBytesAsUTF8() + fileSize
+           + (juce::int64) partFooter.getNumBytesAsUTF8();
+}
+
+int MultipartUpload::Body::read(void* destBuffer, int maxBytesToRead)
+{
+    auto* dest = static_cast<char*>(destBuffer);
+    int numCopied = 0;
+
+    while (numCopied < maxBytesToRead)
+    {
+        juce::int64 headerSize = (juce::int64) partHeader.getNumBytesAsUTF8();
+        int numRead = 0;
+
+        if (position < headerSize)
+        {
+            numRead = (int) juce::jmin((juce::int64) (maxBytesToRead - numCopied),
+                                       headerSize - position);
+            memcpy(dest + numCopied, partHeader.toRawUTF8() + position, (size_t) numRead);
+        }
+        else if (position < headerSize + fileSize)
+        {
+            juce::int64 offset = position - headerSize;
+            numRead =
+                (int) juce::jmin((juce::int64) (maxBytesToRead - numCopied), fileSize - offset);
+
+            if (mappedFile.getData() != nullptr)
+            {
+                memcpy(dest + numCopied,
+                       static_cast<const char*>(mappedFile.getData()) + offset,
+                       (size_t) numRead);
+            }
+            else if (input == nullptr || ! input->openedOk()
+                     || (input->getPosition() != offset && ! input->setPosition(offset))
+                     || (numRead = input->read(dest + numCopied, numRead)) <= 0)
+            {
+                // The file got shorter, or can't be read anymore
+                break;
+            }
+        }
+        else
+        {
+            juce::int64 offset = position - headerSize - fileSize;
+            juce::int64 footerSize = (juce::int64) partFooter.getNumBytesAsUTF8();
+            numRead = (int) juce::jmin((juce::int64) (maxBytesToRead - numCopied),
+                                       footerSize - offset);
+            if (numRead <= 0)
+                break;
+            memcpy(dest + numCopied, partFooter.toRawUTF8() + offset, (size_t) numRead);
+        }
+
+        numCopied += numRead;
+        position += numRead;
+    }
+
+    return numCopied;
+}
+
+bool MultipartUpload::Body::setPosition(juce::int64 newPosition)
+{
+    if (newPosition < 0 || newPosition > getTotalLength())
+        return false;
+
+    position = newPosition;
+    return true;
+}
+
+bool MultipartUpload::canStream() { return ConnectionPool::isCurlAvailable(); }
@@ -0,0 +1,79 @@
+/**
+ * @file
+ * @brief Helpers for uploading files to the gradio /upload endpoint as multipart/form-data
+ */
+
+#pragma once
+
+#include "juce_core/juce_core.h"
+
+class MultipartUpload
+{
+public:
+    struct Stats
+    {
+        juce::int64 bytesSent = 0;
+        double elapsedMs = 0.0;
+        // true if the body was streamed from disk, false if it went through juce::URL
+        bool streamed = false;
+
+        double getThroughputMBps() const
+        {
+            return elapsedMs > 0.0 ? (bytesSent / (1024.0 * 1024.0)) / (elapsedMs / 1000.0) : 0.0;
+        }
+
+        juce::String toString() const
+        {
+            return "Upload: " + juce::String(bytesSent) + " bytes in "
+                   + juce::String(elapsedMs, 1) + " ms ("
+                   + juce::String(getThroughputMBps(), 2) + " MB/s, "
+                   + (streamed ? "streamed" : "buffered") + ")";
+        }
+    };
+
+    // Mime type of a media file, based on its extension
+    static juce::String getMimeType(const juce::File& file);
+
+    /*
+    * juce::URL can only send a body it holds in memory, so the body is streamed
+    * through the ConnectionPool's libcurl transport, sent as ConnectionPool::Request::body.
+    * Where libcurl isn't available, uploads go through juce::URL, which buffers the body.
+    */
+    static bool canStream();
+
+    /*
+    * A multipart/form-data body with a single file field: the part header, the
+    * file contents and the part footer, read in order. The file is memory-mapped
+    * when possible, and read in chunks otherwise, so memory usage is independent
+    * of the file size. Reading stops early (without isExhausted() becoming true)
+    * if the file can't be read anymore.
+    */
+    class Body : public juce::InputStream
+    {
+    public:
+        Body(const juce::String& fieldName, const juce::File& file, const juce::String& mimeType);
+
+        // The Content-Type header value, with the boundary
+        juce::String getContentType() const { return "multipart/form-data; boundary=" + boundary; }
+
+        const juce::File& getFile() const { return file; }
+
+        juce::int64 getTotalLength() override;
+        bool isExhausted() override { return position >= getTotalLength(); }
+        int read(void* destBuffer, int maxBytesToRead) override;
+        juce::int64 getPosition() override { return position; }
+        bool setPosition(juce::int64 newPosition) override;
+
+    private:
+        juce::File file;
+        juce::MemoryMappedFile mappedFile;
+        std::unique_ptr<juce::FileInputStream> input;
+        juce::String boundary;
+        juce::String partHeader;
+        juce::String partFooter;
+        juce::int64 fileSize = 0;
+        juce::int64 position = 0;
+
+        JUCE_DECLARE_NON_COPYABLE(Body)
+    };
+};
@@ -0,0 +1,232 @@
+#include "RetryPolicy.h"
+
+#include "../HarpLogger.h"
+
+std::shared_ptr<CircuitBreaker> CircuitBreaker::forHost(const juce::String& host)
+{
+    static std::mutex registryMutex;
+    static std::map<juce::String, std::shared_ptr<CircuitBreaker>> breakers;
+
+    std::lock_guard<std::mutex> lock(registryMutex);
+    auto& breaker = breakers[host];
+    if (breaker == nullptr)
+        breaker = std::make_shared<CircuitBreaker>();
+    return breaker;
+}
+
+bool CircuitBreaker::allowRequest()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+
+    if (state == State::Open
+        && juce::Time::getMillisecondCounterHiRes() - openedAtMs >= coolDownMs)
+    {
+        state = State::HalfOpen;
+        trialInFlight = false;
+    }
+
+    if (state == State::Open)
+        return false;
+
+    if (state == State::HalfOpen)
+    {
+        // Only one request finds out whether the space is back
+        if (trialInFlight)
+            return false;
+        trialInFlight = true;
+    }
+    return true;
+}
+
+void CircuitBreaker::recordSuccess()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    state = State::Closed;
+    consecutiveFailures = 0;
+    trialInFlight = false;
+}
+
+void CircuitBreaker::recordFailure()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    consecutiveFailures++;
+    trialInFlight = false;
+
+    if (state == State::HalfOpen || consecutiveFailures >= failureThreshold)
+    {
+        state = State::Open;
+        openedAtMs = juce::Time::getMillisecondCounterHiRes();
+    }
+}
+
+void CircuitBreaker::recordAbandoned()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    trialInFlight = false;
+}
+
+CircuitBreaker::State CircuitBreaker::getState() const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return state;
+}
+
+double CircuitBreaker::getMsUntilRetry() const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    if (state != State::Open)
+        return 0.0;
+    return juce::jmax(0.0, coolDownMs - (juce::Time::getMillisecondCounterHiRes() - openedAtMs));
+}
+
+RetryPolicy RetryPolicy::forUploads()
+{
+    RetryPolicy policy;
+    policy.maxAttempts = 3;
+    policy.baseDelayMs = 1000.0;
+    return policy;
+}
+
+RetryPolicy RetryPolicy::forCalls()
+{
+    RetryPolicy policy;
+    policy.maxAttempts = 4;
+    policy.idempotent = false;
+    return policy;
+}
+
+RetryPolicy RetryPolicy::forGets()
+{
+    RetryPolicy policy;
+    policy.maxAttempts = 3;
+    policy.baseDelayMs = 250.0;
+    return policy;
+}
+
+RetryPolicy RetryPolicy::none()
+{
+    RetryPolicy policy;
+    policy.maxAttempts = 1;
+    return policy;
+}
+
+bool RetryPolicy::isRetryable(int statusCode, bool requestSent) const
+{
+    // No response at all: the connection failed, or timed out before the headers
+    if (statusCode <= 0)
+        return idempotent || ! requestSent;
+
+    if (statusCode == 429 || statusCode == 502 || statusCode == 503 || statusCode == 504)
+        return true;
+
+    return idempotent && (statusCode == 408 || statusCode == 500);
+}
+
+double RetryPolicy::getBackoffMs(int attempt) const
+{
+    double backoff = juce::jmin(maxDelayMs, baseDelayMs * std::pow(2.0, (double) attempt));
+    return juce::Random::getSystemRandom().nextDouble() * backoff;
+}
+
+double RetryPolicy::parseRetryAfterMs(const juce::String& retryAfter)
+{
+    juce::String value = retryAfter.trim();
+    if (value.isEmpty())
+        return -1.0;
+
+    if (value.containsOnly("0123456789"))
+        return value.getDoubleValue() * 1000.0;
+
+    // e.g "Wed, 21 Oct 2015 07:28:00 GMT"
+    juce::StringArray tokens;
+    tokens.addTokens(value.fromFirstOccurrenceOf(",", false, false), " :", "");
+    tokens.removeEmptyStrings();
+    if (tokens.size() < 6)
+        return -1.0;
+
+    const juce::StringArray months { "Jan", "Feb", "Mar", "Apr", "May", "Jun",
+                                     "Jul", "Aug", "Sep", "Oct", "Nov", "Dec" };
+    int month = months.indexOf(tokens[1], true);
+    if (month < 0)
+        return -1.0;
+
+    juce::Time date(tokens[2].getIntValue(),
+                    month,
+                    tokens[0].getIntValue(),
+                    tokens[3].getIntValue(),
+                    tokens[4].getIntValue(),
+                    tokens[5].getIntValue(),
+                    0,
+                    false);
+    return juce::jmax(0.0, (double) (date - juce::Time::getCurrentTime()).inMilliseconds());
+}
+
+OpResult RetryPolicy::run(const juce::String& host,
+                          const juce::String& what,
+                          CancellationToken* cancellation,
+                          Stats* stats,
+                          const Attempt& attempt) const
+{
+    auto breaker = CircuitBreaker::forHost(host);
+
+    for (int attemptIndex = 0;; ++attemptIndex)
+    {
+        if (! breaker->allowRequest())
+        {
+            Error error;
+            error.type = ErrorType::HttpRequestError;
+            error.code = 503;
+            error.devMessage = what + " was not sent, " + host + " failed "
+                               + juce::String(breaker->failureThreshold)
+                               + " times in a row. Trying again in "
+                               + juce::String(breaker->getMsUntilRetry() / 1000.0, 0) + " s.";
+            return OpResult::fail(error);
+        }
+
+        Failure failure;
+        OpResult result = attempt(failure);
+        if (result.wasOk())
+        {
+            breaker->recordSuccess();
+            return result;
+        }
+        if (CancellationToken::isCancellation(result))
+        {
+            breaker->recordAbandoned();
+            return result;
+        }
+
+        // Client errors mean the space is up, so they don't count against it
+        int statusCode = result.getError().code;
+        if (statusCode <= 0 || statusCode >= 500 || statusCode == 429)
+            breaker->recordFailure();
+        else
+            breaker->recordSuccess();
+
+        if (attemptIndex + 1 >= maxAttempts || ! isRetryable(statusCode, failure.requestSent))
+            return result;
+
+        double delayMs = parseRetryAfterMs(failure.retryAfter);
+        if (delayMs > maxRetryAfterMs)
+            return result;
+        if (delayMs < 0.0)
+            delayMs = getBackoffMs(attemptIndex);
+
+        LogAndDBG("Retrying " + what + " in " + juce::String(juce::roundToInt(delayMs))
+                  + " ms (attempt " + juce::String(attemptIndex + 2) + " of "
+                  + juce::String(maxAttempts) + "): " + result.getError().devMessage,
+                  HarpLogger::Level::Warning);
+
+        // Stop waiting as soon as the request gets cancelled
+        double waitStartMs = juce::Time::getMillisecondCounterHiRes();
+        CancellationToken::wait(cancellation, (int) delayMs);
+        if (stats != nullptr)
+        {
+            stats->numRetries++;
+            stats->waitMs += juce::Time::getMillisecondCounterHiRes() - waitStartMs;
+        }
+
+        if (CancellationToken::isCancelled(cancellation))
+            return OpResult::fail(CancellationToken::makeError(what));
+    }
+}
@@ -0,0 +1,130 @@
+/**
+ * @file
+ * @brief Retries of failed GradioClient requests (jittered exponential backoff,
+ * Retry-After), and a per-space circuit breaker that fails requests fast
+ * while a space is known to be down
+ */
+
+#pragma once
+
+#include <cmath>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+
+#include "../errors.h"
+#include "CancellationToken.h"
+#include "juce_core/juce_core.h"
+
+/*
+* Counts consecutive failures of the requests to one space. After too many,
+* it opens and requests fail straight away, without touching the network.
+* Once the cool-down has passed, a single trial request is let through:
+* if it succeeds the breaker closes again, if it fails it stays open.
+*/
+class CircuitBreaker
+{
+public:
+    enum class State
+    {
+        Closed,
+        Open,
+        HalfOpen,
+    };
+
+    // The breaker of a space, shared by all the GradioClients that talk to it
+    static std::shared_ptr<CircuitBreaker> forHost(const juce::String& host);
+
+    CircuitBreaker() = default;
+
+    // False while the breaker is open, or while the trial request of a half open breaker runs
+    bool allowRequest();
+
+    void recordSuccess();
+    void recordFailure();
+    // The request ended without telling us anything about the space, e.g it was cancelled
+    void recordAbandoned();
+
+    State getState() const;
+
+    // How long until an open breaker lets a trial request through
+    double getMsUntilRetry() const;
+
+    int failureThreshold = 5;
+    double coolDownMs = 30000.0;
+
+private:
+    mutable std::mutex mutex;
+    State state = State::Closed;
+    int consecutiveFailures = 0;
+    double openedAtMs = 0.0;
+    bool trialInFlight = false;
+};
+
+struct RetryPolicy
+{
+    // Filled in by run(), e.g for the pipeline trace
+    struct Stats
+    {
+        int numRetries = 0;
+        // Time spent waiting between attempts
+        double waitMs = 0.0;
+    };
+
+    // What an attempt tells run() about its failure, besides the error
+    struct Failure
+    {
+        // The Retry-After header of the response, if there was one
+        juce::String retryAfter;
+        // False only if the request can't have reached the app, e.g the connection was refused
+        bool requestSent = true;
+    };
+
+    using Attempt = std::function<OpResult(Failure& failure)>;
+
+    // Including the first one
+    int maxAttempts = 3;
+    double baseDelayMs = 500.0;
+    double maxDelayMs = 8000.0;
+    // A Retry-After longer than this fails the request instead of waiting
+    double maxRetryAfterMs = 30000.0;
+
+    /*
+    * Idempotent requests (uploads, GETs) can be repeated safely, so they are
+    * also retried on timeouts and internal server errors. The others (e.g
+    * starting a job) only when the request can't have reached the app:
+    * connections that were never established (see Failure::requestSent), and
+    * busy or unavailable proxies (429, 502, 503, 504). A request that timed
+    * out after it was sent may have started a job, so it isn't repeated.
+    */
+    bool idempotent = true;
+
+    static RetryPolicy forUploads();
+    static RetryPolicy forCalls();
+    static RetryPolicy forGets();
+
+    // A policy that never retries
+    static RetryPolicy none();
+
+    /*
+    * Runs attempt until it succeeds, fails in a way that isn't worth
+    * retrying, or runs out of attempts. The status code of a failure is
+    * taken from its Error::code (0 or -1 when no response was received).
+    * Goes through the circuit breaker of host, see CircuitBreaker::forHost.
+    * Waiting between attempts stops as soon as cancellation is cancelled.
+    */
+    OpResult run(const juce::String& host,
+                 const juce::String& what,
+                 CancellationToken* cancellation,
+                 Stats* stats,
+                 const Attempt& attempt) const;
+
+    bool isRetryable(int statusCode, bool requestSent) const;
+
+    // Full jitter: a random delay between 0 and the exponential backoff of attempt (0 based)
+    double getBackoffMs(int attempt) const;
+
+    // The delay a Retry-After header asks for, in seconds or as an HTTP date. -1 if invalid
+    static double parseRetryAfterMs(const juce::String& retryAfter);
+};
@@ -0,0 +1,149 @@
+#include "SSEParser.h"
+
+SSEEvent::Type SSEEvent::typeFromName(const juce::String& name)
+{
+    if (name == "generating")
+        return Type::Generating;
+    if (name == "progress")
+        return Type::Progress;
+    if (name == "complete")
+        return Type::Complete;
+    if (name == "error")
+        return Type::Error;
+    if (name == "heartbeat")
+        return Type::Heartbeat;
+    return Type::Unknown;
+}
+
+float SSEEvent::getProgress() const
+{
+    if (type != Type::Progress && type != Type::Generating)
+        return -1.0f;
+
+    juce::var parsed = juce::JSON::parse(data);
+    // generating events wrap their payload in an array
+    if (parsed.isArray() && parsed.size() > 0)
+        parsed = parsed[0];
+
+    if (! parsed.isObject())
+        return -1.0f;
+
+    juce::var progressData = parsed["progress_data"];
+    if (progressData.isArray() && progressData.size() > 0)
+    {
+        juce::var unit = progressData[0];
+        if (unit["progress"].isDouble())
+            return juce::jlimit(0.0f, 1.0f, (float) (double) unit["progress"]);
+
+        double length = unit["length"];
+        if (length > 0.0)
+            return juce::jlimit(0.0f, 1.0f, (float) ((double) unit["index"] / length));
+    }
+
+    if (parsed["progress"].isDouble() || parsed["progress"].isInt())
+        return juce::jlimit(0.0f, 1.0f, (float) (double) parsed["progress"]);
+
+    return -1.0f;
+}
+
+SSEParser::SSEParser(Callback callback) : onEvent(std::move(callback)) {}
+
+void SSEParser::feed(const char* bytes, size_t numBytes)
+{
+    size_t lineStart = 0;
+
+    for (size_t i = 0; i < numBytes; ++i)
+    {
+        char c = bytes[i];
+
+        if (c != '\n' && c != '\r')
+        {
+            lastCharWasCR = false;
+            continue;
+        }
+
+        // "\r\n" is a single line ending
+        if (c == '\n' && lastCharWasCR && i == lineStart)
+        {
+            lastCharWasCR = false;
+            lineStart = i + 1;
+            continue;
+        }
+
+        lineBuffer.append(bytes + lineStart, i - lineStart);
+        processLine(lineBuffer);
+        lineBuffer.clear();
+
+        lastCharWasCR = (c == '\r');
+        lineStart = i + 1;
+    }
+
+    lineBuffer.append(bytes + lineStart, numBytes - lineStart);
+}
+
+void SSEParser::finish()
+{
+    if (! lineBuffer.empty())
+    {
+        processLine(lineBuffer);
+        lineBuffer.clear();
+    }
+    dispatch();
+}
+
+void SSEParser::processLine(const std::string& line)
+{
+    // An empty line dispatches the event
+    if (line.empty())
+    {
+        dispatch();
+        return;
+    }
+
+    // Lines starting with a colon are comments (sometimes used as keep-alives)
+    if (line[0] == ':')
+        return;
+
+    auto colon = line.find(':');
+    std::string field = line.substr(0, colon);
+    std::string value;
+
+    if (colon != std::string::npos)
+    {
+        value = line.substr(colon + 1);
+        if (! value.empty() && value[0] == ' ')
+            value.erase(0, 1);
+    }
+
+    if (field == "event")
+    {
+        eventName = juce::String::fromUTF8(value.data(), (int) value.size());
+    }
+    else if (field == "data")
+    {
+        if (hasData)
+            dataBuffer << "\n";
+        dataBuffer << juce::String::fromUTF8(value.data(), (int) value.size());
+        hasData = true;
+    }
+}
+
+void SSEParser::dispatch()
+{
+    if (eventName.isEmpty() && ! hasData)
+        return;
+
+    SSEEvent event;
+    event.name = eventName.isEmpty() ? juce::String("message") : eventName;
+    event.type = SSEEvent::typeFromName(event.name);
+    event.data = dataBuffer;
+    event.receivedMs = juce::Time::getMillisecondCounterHiRes();
+
+    eventName.clear();
+    dataBuffer.clear();
+    hasData = false;
+
+    numEventsDispatched++;
+    if (onEvent)
+        onEvent(event);
+}
@@ -0,0 +1,85 @@
+/**
+ * @file
+ * @brief An incremental parser for the server-sent events streamed by the Gradio API
+ */
+
+#pragma once
+
+#include <functional>
+#include <string>
+
+#include "juce_core/juce_core.h"
+
+/*
+* A single server-sent event. The Gradio /call/<endpoint>/<event_id>
+* stream looks like this:
+*
+*   event: generating
+*   data: [...]
+*
+*   event: complete
+*   data: [...]
+*/
+struct SSEEvent
+{
+    enum class Type
+    {
+        Generating,
+        Progress,
+        Complete,
+        Error,
+        Heartbeat,
+        Unknown
+    };
+
+    Type type = Type::Unknown;
+    juce::String name;
+    juce::String data;
+    // Time (Time::getMillisecondCounterHiRes) at which the event was fully received
+    double receivedMs = 0.0;
+
+    // complete and error are the last events of a stream
+    bool isTerminal() const { return type == Type::Complete || type == Type::Error; }
+
+    static Type typeFromName(const juce::String& name);
+
+    /*
+    * Returns the progress fraction (0-1) carried by the event, or -1 if there is none.
+    * Understands the gradio progress_data format
+    * ({"progress_data": [{"index": 3, "length": 10}]}) as well as a plain
+    * {"progress": 0.3} object.
+    */
+    float getProgress() const;
+};
+
+class SSEParser
+{
+public:
+    using Callback = std::function<void(const SSEEvent&)>;
+
+    explicit SSEParser(Callback onEvent);
+
+    // Feed the next chunk of bytes. Events are dispatched as soon as they are complete.
+    void feed(const char* bytes, size_t numBytes);
+
+    // Dispatch whatever is left once the stream has ended
+    void finish();
+
+    // Number of bytes of the line currently being received
+    size_t getPendingLineLength() const { return lineBuffer.size(); }
+
+    int getNumEventsDispatched() const { return numEventsDispatched; }
+
+private:
+    void processLine(const std::string& line);
+    void dispatch();
+
+    Callback onEvent;
+
+    std::string lineBuffer;
+    juce::String eventName;
+    juce::String dataBuffer;
+    bool hasData = false;
+    bool lastCharWasCR = false;
+    int numEventsDispatched = 0;
+};
@@ -0,0 +1,337 @@
+#include "SegmentedDownload.h"
+
+#include <thread>
+
+SegmentedDownload::SegmentedDownload(ConnectionPool& connectionPool,
+                                     const juce::URL& fileURL,
+                                     const juce::File& destinationFile,
+                                     const Options& downloadOptions)
+    : pool(connectionPool), url(fileURL), destination(destinationFile), options(downloadOptions)
+{
+}
+
+juce::int64 SegmentedDownload::parseTotalFromContentRange(const juce::String& contentRange)
+{
+    // e.g "bytes 0-0/1234567"
+    juce::String total = contentRange.fromLastOccurrenceOf("/", false, false).trim();
+    if (total.isEmpty() || total == "*")
+        return -1;
+    return total.getLargeIntValue();
+}
+
+ConnectionPool::Request SegmentedDownload::makeRequest(const juce::String& extraHeaders) const
+{
+    ConnectionPool::Request request;
+    request.url = url;
+    request.timeoutMs = options.timeoutMs;
+    request.extraHeaders = extraHeaders;
+    request.cancellation = options.cancellation;
+    return request;
+}
+
+OpResult SegmentedDownload::cancelledResult() const
+{
+    return OpResult::fail(CancellationToken::makeError("Download of " + url.toString(false)));
+}
+
+void SegmentedDownload::reportProgress(juce::int64 numBytes)
+{
+    juce::int64 downloaded = bytesDownloaded.fetch_add(numBytes) + numBytes;
+    if (progressCallback)
+        progressCallback(downloaded, totalBytes);
+}
+
+juce::int64 SegmentedDownload::copyStream(juce::InputStream& input, juce::OutputStream& output)
+{
+    const int bufferSize = 65536;
+    juce::HeapBlock<char> buffer(bufferSize);
+    juce::int64 numCopied = 0;
+
+    while (! input.isExhausted() && ! isCancelled())
+    {
+        int numRead = input.read(buffer.getData(), bufferSize);
+        if (numRead <= 0)
+            break;
+
+        if (! output.write(buffer.getData(), (size_t) numRead))
+            break;
+
+        numCopied += numRead;
+        reportProgress(numRead);
+    }
+
+    output.flush();
+    return numCopied;
+}
+
+OpResult SegmentedDownload::run(const ProgressCallback& onProgress, Stats* stats)
+{
+    Error error;
+    error.type = ErrorType::FileDownloadError;
+
+    double startMs = juce::Time::getMillisecondCounterHiRes();
+    progressCallback = onProgress;
+    bytesDownloaded = 0;
+    numRetries = 0;
+
+    // Ask for the first byte only. A 206 tells us that the server supports
+    // ranges, and the total size of the file (from Content-Range)
+    int statusCode = 0;
+    auto connection = pool.open(makeRequest("Range: bytes=0-0"), statusCode);
+
+    if (isCancelled())
+        return cancelledResult();
+
+    if (connection == nullptr)
+    {
+        error.devMessage = "Failed to create input stream for file download request.";
+        return OpResult::fail(error);
+    }
+
+    OpResult result = OpResult::ok();
+    int numSegments = 1;
+
+    if (statusCode == 206)
+    {
+        totalBytes = parseTotalFromContentRange(connection->getResponseHeaders()["Content-Range"]);
+        etag = connection->getResponseHeaders()["ETag"];
+        connection.reset();
+
+        if (totalBytes <= 0)
+        {
+            error.devMessage = "Could not read the size of " + url.toString(false)
+                               + " from the Content-Range header.";
+            return OpResult::fail(error);
+        }
+
+        if (totalBytes >= options.minSegmentedSize)
+        {
+            numSegments = options.numSegments;
+        }
+
+        std::vector<Segment> segments((size_t) numSegments);
+        juce::int64 segmentSize = totalBytes / numSegments;
+
+        for (int i = 0; i < numSegments; ++i)
+        {
+            Segment& segment = segments[(size_t) i];
+            segment.start = i * segmentSize;
+            segment.end = (i == numSegments - 1) ? totalBytes - 1 : (i + 1) * segmentSize - 1;
+            segment.partFile = destination.getSiblingFile(destination.getFileName() + ".part"
+                                                          + juce::String(i));
+            segment.partFile.deleteFile();
+        }
+
+        // The first segment runs on this thread, the others on their own
+        std::vector<std::thread> workers;
+        for (size_t i = 1; i < segments.size(); ++i)
+        {
+            workers.emplace_back([this, &segments, i]
+                                 { segments[i].result = downloadSegment(segments[i]); });
+        }
+        segments[0].result = downloadSegment(segments[0]);
+
+        for (auto& worker : workers)
+            worker.join();
+
+        result = mergeSegments(segments);
+    }
+    else if (statusCode == 200)
+    {
+        // The server ignored the Range header, so we download the whole file in one go
+        result = downloadSingle(std::move(connection));
+    }
+    else
+    {
+        error.code = statusCode;
+        error.devMessage = "Request failed with status code: " + juce::String(statusCode);
+        return OpResult::fail(error);
+    }
+
+    if (stats != nullptr)
+    {
+        stats->bytes = destination.getSize();
+        stats->elapsedMs = juce::Time::getMillisecondCounterHiRes() - startMs;
+        stats->numSegments = numSegments;
+        stats->numRetries = numRetries;
+        stats->ranged = (statusCode == 206);
+    }
+
+    // Don't leave half a file behind. The part files are already gone (see mergeSegments)
+    if (isCancelled())
+    {
+        destination.deleteFile();
+        return cancelledResult();
+    }
+
+    return result;
+}
+
+OpResult SegmentedDownload::downloadSegment(Segment& segment)
+{
+    Error error;
+    error.type = ErrorType::FileDownloadError;
+
+    for (int attempt = 0; attempt <= options.maxRetries; ++attempt)
+    {
+        // Resume from whatever the previous attempts already wrote to the part file
+        juce::int64 alreadyDownloaded = segment.partFile.getSize();
+        if (alreadyDownloaded >= segment.getLength())
+            return OpResult::ok();
+
+        if (isCancelled())
+            return cancelledResult();
+
+        if (attempt > 0)
+        {
+            numRetries++;
+            if (! CancellationToken::wait(options.cancellation, 200 * (1 << (attempt - 1))))
+                return cancelledResult();
+        }
+
+        int statusCode = 0;
+        juce::String range = "Range: bytes=" + juce::String(segment.start + alreadyDownloaded)
+                             + "-" + juce::String(segment.end);
+        auto connection = pool.open(makeRequest(range), statusCode);
+
+        if (connection == nullptr || statusCode != 206)
+        {
+            error.code = statusCode;
+            error.devMessage = "Ranged request for " + url.toString(false)
+                               + " failed with status code: " + juce::String(statusCode);
+            continue;
+        }
+
+        // If the file changed on the server, the segments can't be stitched together
+        juce::String segmentEtag = connection->getResponseHeaders()["ETag"];
+        if (etag.isNotEmpty() && segmentEtag.isNotEmpty() && segmentEtag != etag)
+        {
+            error.devMessage = "The file " + url.toString(false)
+                               + " changed on the server while it was being downloaded.";
+            return OpResult::fail(error);
+        }
+
+        // FileOutputStream appends to the existing part file
+        juce::FileOutputStream output(segment.partFile);
+        if (! output.openedOk())
+        {
+            error.devMessage =
+                "Failed to create output stream for file: " + segment.partFile.getFullPathName();
+            return OpResult::fail(error);
+        }
+
+        copyStream(connection->getStream(), output);
+    }
+
+    if (segment.partFile.getSize() >= segment.getLength())
+        return OpResult::ok();
+
+    if (error.devMessage.isEmpty())
+    {
+        error.devMessage = "Download of bytes " + juce::String(segment.start) + "-"
+                           + juce::String(segment.end) + " of " + url.toString(false)
+                           + " was interrupted too many times.";
+    }
+    return OpResult::fail(error);
+}
+
+OpResult SegmentedDownload::downloadSingle(std::unique_ptr<PooledConnection> connection)
+{
+    Error error;
+    error.type = ErrorType::FileDownloadError;
+
+    for (int attempt = 0; attempt <= options.maxRetries && ! isCancelled(); ++attempt)
+    {
+        if (attempt > 0)
+        {
+            numRetries++;
+            if (! CancellationToken::wait(options.cancellation, 200 * (1 << (attempt - 1))))
+                return cancelledResult();
+
+            // Without range support we can only start over
+            int statusCode = 0;
+            connection = pool.open(makeRequest(), statusCode);
+
+            if (connection == nullptr || statusCode != 200)
+            {
+                error.code = statusCode;
+                error.devMessage = "Request failed with status code: " + juce::String(statusCode);
+                continue;
+            }
+        }
+
+        auto& stream = connection->getStream();
+        totalBytes = stream.getTotalLength();
+
+        destination.deleteFile();
+        bytesDownloaded = 0;
+
+        juce::FileOutputStream output(destination);
+        if (! output.openedOk())
+        {
+            error.devMessage =
+                "Failed to create output stream for file: " + destination.getFullPathName();
+            return OpResult::fail(error);
+        }
+
+        juce::int64 numCopied = copyStream(stream, output);
+
+        // Without a known length we can't tell a dropped connection from the end of the file
+        if (totalBytes < 0 || numCopied == totalBytes)
+            return OpResult::ok();
+
+        error.devMessage = "Downloaded " + juce::String(numCopied) + " of "
+                           + juce::String(totalBytes) + " bytes of " + url.toString(false);
+    }
+
+    return OpResult::fail(error);
+}
+
+OpResult SegmentedDownload::mergeSegments(std::vector<Segment>& segments)
+{
+    Error error;
+    error.type = ErrorType::FileDownloadError;
+
+    for (auto& segment : segments)
+    {
+        if (segment.result.failed())
+        {
+            for (auto& s : segments)
+                s.partFile.deleteFile();
+            return segment.result;
+        }
+    }
+
+    destination.deleteFile();
+
+    {
+        juce::FileOutputStream output(destination);
+        if (! output.openedOk())
+        {
+            error.devMessage =
+                "Failed to create output stream for file: " + destination.getFullPathName();
+            return OpResult::fail(error);
+        }
+
+        for (auto& segment : segments)
+        {
+            juce::FileInputStream input(segment.partFile);
+            output.writeFromInputStream(input, segment.getLength());
+        }
+    }
+
+    for (auto& segment : segments)
+        segment.partFile.deleteFile();
+
+    // Verify that we got exactly the number of bytes announced by the server
+    if (destination.getSize() != totalBytes)
+    {
+        error.devMessage = "Downloaded file " + destination.getFullPathName() + " has "
+                           + juce::String(destination.getSize()) + " bytes, expected "
+                           + juce::String(totalBytes);
+        destination.deleteFile();
+        return OpResult::fail(error);
+    }
+
+    return OpResult::ok();
+}
@@ -0,0 +1,91 @@
+/**
+ * @file
+ * @brief Downloads a file in parallel HTTP Range segments, resuming segments that drop
+ */
+
+#pragma once
+
+#include <atomic>
+#include <functional>
+
+#include "../errors.h"
+#include "ConnectionPool.h"
+#include "juce_core/juce_core.h"
+
+class SegmentedDownload
+{
+public:
+    // Called from the download threads, so it has to be thread safe
+    using ProgressCallback =
+        std::function<void(juce::int64 bytesDownloaded, juce::int64 totalBytes)>;
+
+    struct Options
+    {
+        int numSegments = 4;
+        // Files smaller than this are downloaded in a single request
+        juce::int64 minSegmentedSize = 4 * 1024 * 1024;
+        // Number of times a dropped request is resumed before giving up
+        int maxRetries = 3;
+        int timeoutMs = 10000;
+        // If given, cancelling it aborts all the segments and deletes what was downloaded
+        CancellationToken* cancellation = nullptr;
+    };
+
+    struct Stats
+    {
+        juce::int64 bytes = 0;
+        double elapsedMs = 0.0;
+        int numSegments = 1;
+        int numRetries = 0;
+        bool ranged = false;
+
+        juce::String toString() const
+        {
+            return "Download: " + juce::String(bytes) + " bytes in " + juce::String(elapsedMs, 1)
+                   + " ms, " + juce::String(numSegments) + " segment(s), "
+                   + juce::String(numRetries) + " retries";
+        }
+    };
+
+    SegmentedDownload(ConnectionPool& pool,
+                      const juce::URL& url,
+                      const juce::File& destination,
+                      const Options& options);
+
+    OpResult run(const ProgressCallback& onProgress = nullptr, Stats* stats = nullptr);
+
+private:
+    struct Segment
+    {
+        juce::int64 start = 0;
+        juce::int64 end = 0; // inclusive
+        juce::File partFile;
+        OpResult result = OpResult::ok();
+
+        juce::int64 getLength() const { return end - start + 1; }
+    };
+
+    OpResult downloadSegment(Segment& segment);
+    OpResult downloadSingle(std::unique_ptr<PooledConnection> connection);
+    OpResult mergeSegments(std::vector<Segment>& segments);
+    ConnectionPool::Request makeRequest(const juce::String& extraHeaders = {}) const;
+    bool isCancelled() const { return CancellationToken::isCancelled(options.cancellation); }
+    OpResult cancelledResult() const;
+
+    juce::int64 copyStream(juce::InputStream& input, juce::OutputStream& output);
+    void reportProgress(juce::int64 numBytes);
+
+    static juce::int64 parseTotalFromContentRange(const juce::String& contentRange);
+
+    ConnectionPool& pool;
+    juce::URL url;
+    juce::File destination;
+    Options options;
+
+    juce::int64 totalBytes = -1;
+    juce::String etag;
+
+    ProgressCallback progressCallback;
+    std::atomic<juce::int64> bytesDownloaded { 0 };
+    std::atomic<int> numRetries { 0 };
+};
@@ -0,0 +1,44 @@
+#include "UploadCache.h"
+
+#include "../ContentHash.h"
+
+juce::String UploadCache::makeKey(const juce::String& space, uint64_t contentHash)
+{
+    return space + "#" + ContentHash::toString(contentHash);
+}
+
+bool UploadCache::lookup(const juce::String& space, uint64_t contentHash, juce::String& serverPath)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = entries.find(makeKey(space, contentHash));
+
+    if (it == entries.end())
+    {
+        numMisses++;
+        return false;
+    }
+
+    numHits++;
+    serverPath = it->second;
+    return true;
+}
+
+void UploadCache::store(const juce::String& space,
+                        uint64_t contentHash,
+                        const juce::String& serverPath)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    entries[makeKey(space, contentHash)] = serverPath;
+}
+
+void UploadCache::invalidate(const juce::String& space, uint64_t contentHash)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    entries.erase(makeKey(space, contentHash));
+}
+
+void UploadCache::clear()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    entries.clear();
+}
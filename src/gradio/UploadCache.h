@@ -0,0 +1,37 @@
+/**
+ * @file
+ * @brief Remembers which files were already uploaded to which space, keyed by content hash
+ */
+
+#pragma once
+
+#include <atomic>
+#include <map>
+#include <mutex>
+
+#include "juce_core/juce_core.h"
+
+/*
+* Maps (space, content hash) to the server-side path that the gradio
+* /upload endpoint returned for it. Entries only live for the current
+* session, as gradio apps clean up their uploads after a while anyway.
+*/
+class UploadCache
+{
+public:
+    bool lookup(const juce::String& space, uint64_t contentHash, juce::String& serverPath);
+    void store(const juce::String& space, uint64_t contentHash, const juce::String& serverPath);
+    void invalidate(const juce::String& space, uint64_t contentHash);
+    void clear();
+
+    int getNumHits() const { return numHits; }
+    int getNumMisses() const { return numMisses; }
+
+private:
+    static juce::String makeKey(const juce::String& space, uint64_t contentHash);
+
+    std::mutex mutex;
+    std::map<juce::String, juce::String> entries;
+    std::atomic<int> numHits { 0 };
+    std::atomic<int> numMisses { 0 };
+};
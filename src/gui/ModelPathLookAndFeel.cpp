@@ -0,0 +1,54 @@
+#include "ModelPathLookAndFeel.h"
+
+void ModelPathLookAndFeel::setReadiness(std::map<juce::String, juce::String> newReadiness)
+{
+    readiness = std::move(newReadiness);
+}
+
+juce::String ModelPathLookAndFeel::getReadiness(const juce::String& path) const
+{
+    auto found = readiness.find(path);
+    return found != readiness.end() ? found->second : juce::String();
+}
+
+void ModelPathLookAndFeel::drawPopupMenuItem(juce::Graphics& g,
+                                             const juce::Rectangle<int>& area,
+                                             bool isSeparator,
+                                             bool isActive,
+                                             bool isHighlighted,
+                                             bool isTicked,
+                                             bool hasSubMenu,
+                                             const juce::String& text,
+                                             const juce::String& shortcutKeyText,
+                                             const juce::Drawable* icon,
+                                             const juce::Colour* textColour)
+{
+    juce::String itemReadiness = getReadiness(text);
+    LookAndFeel_V4::drawPopupMenuItem(g,
+                                      area,
+                                      isSeparator,
+                                      isActive,
+                                      isHighlighted,
+                                      isTicked,
+                                      hasSubMenu,
+                                      text,
+                                      itemReadiness.isNotEmpty() ? itemReadiness : shortcutKeyText,
+                                      icon,
+                                      textColour);
+}
+
+void ModelPathLookAndFeel::getIdealPopupMenuItemSize(const juce::String& text,
+                                                     bool isSeparator,
+                                                     int standardMenuItemHeight,
+                                                     int& idealWidth,
+                                                     int& idealHeight)
+{
+    // Leave room for the readiness, the same way JUCE does for shortcuts
+    juce::String itemReadiness = getReadiness(text);
+    LookAndFeel_V4::getIdealPopupMenuItemSize(
+        itemReadiness.isNotEmpty() ? text + "   " + itemReadiness : text,
+        isSeparator,
+        standardMenuItemHeight,
+        idealWidth,
+        idealHeight);
+}
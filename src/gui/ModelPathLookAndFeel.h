@@ -0,0 +1,39 @@
+#pragma once
+
+#include "juce_gui_basics/juce_gui_basics.h"
+
+#include <map>
+
+/*
+* The look and feel of the model path combo box. Draws the readiness of each
+* saved model (see SpaceProber) on the right of its item in the drop-down menu,
+* where a menu shortcut would be, so the item text stays the bare model path.
+*/
+class ModelPathLookAndFeel : public juce::LookAndFeel_V4
+{
+public:
+    // Readiness text by model path. Items without one are drawn as usual
+    void setReadiness(std::map<juce::String, juce::String> newReadiness);
+    juce::String getReadiness(const juce::String& path) const;
+
+    void drawPopupMenuItem(juce::Graphics& g,
+                           const juce::Rectangle<int>& area,
+                           bool isSeparator,
+                           bool isActive,
+                           bool isHighlighted,
+                           bool isTicked,
+                           bool hasSubMenu,
+                           const juce::String& text,
+                           const juce::String& shortcutKeyText,
+                           const juce::Drawable* icon,
+                           const juce::Colour* textColour) override;
+
+    void getIdealPopupMenuItemSize(const juce::String& text,
+                                   bool isSeparator,
+                                   int standardMenuItemHeight,
+                                   int& idealWidth,
+                                   int& idealHeight) override;
+
+private:
+    std::map<juce::String, juce::String> readiness;
+};
@@ -2,12 +2,12 @@
 
 AudioDisplayComponent::AudioDisplayComponent()
 {
+    thread.addTimeSliceClient(&prefetcher);
     thread.startThread(Thread::Priority::normal);
 
-    thumbnailComponent.addMouseListener(this, true);
-    addAndMakeVisible(thumbnailComponent);
-
-    thumbnail.addChangeListener(this);
+    waveformComponent.addMouseListener(this, true);
+    waveformComponent.onCompleteDraw = [this] { setWaveformDrawn(); };
+    addAndMakeVisible(waveformComponent);
 
     mediaHandlerInstructions =
         "Audio waveform.\nClick and drag to start playback from any point in the waveform\nVertical scroll to zoom in/out.\nHorizontal scroll to move the waveform.";
@@ -15,9 +15,9 @@ AudioDisplayComponent::AudioDisplayComponent()
 
 AudioDisplayComponent::~AudioDisplayComponent()
 {
+    abortLoadJobs();
     resetTransport();
-
-    thumbnail.removeChangeListener(this);
+    thread.removeTimeSliceClient(&prefetcher);
 }
 
 StringArray AudioDisplayComponent::getSupportedExtensions()
@@ -37,54 +37,126 @@ StringArray AudioDisplayComponent::getSupportedExtensions()
 
 void AudioDisplayComponent::repositionContent()
 {
-    thumbnailComponent.setBounds(getContentBounds());
+    waveformComponent.setBounds(getContentBounds());
 }
 
-void AudioDisplayComponent::loadMediaFile(const URL& filePath)
+double AudioDisplayComponent::getTotalLengthInSecs()
 {
-    const auto source = std::make_unique<URLInputSource>(filePath);
+    if (audioFileSource == nullptr)
+        return 0.0;
 
+    auto* reader = audioFileSource->getAudioFormatReader();
+    return reader->sampleRate > 0.0 ? (double) reader->lengthInSamples / reader->sampleRate : 0.0;
+}
+
+void AudioDisplayComponent::loadMediaFile(const URL& filePath)
+{
     File audioFile = filePath.getLocalFile();
 
+    // Some readers scan the whole file when they are created (e.g mp3, to find
+    // its length), so even that happens on the loader thread
+    auto abort = std::make_shared<std::atomic<bool>>(false);
+    loadAbort = abort;
+    loadingReader = true;
+
+    AudioFormatManager* formats = &formatManager;
+    SafePointer<AudioDisplayComponent> safeThis(this);
+    loaderPool.addJob(
+        [safeThis, audioFile, formats, abort]
+        {
+            if (abort->load())
+                return;
+
+            std::shared_ptr<AudioFormatReaderSource> source;
+            if (auto reader = MappedAudioReader::create(*formats, audioFile))
+                source = std::make_shared<AudioFormatReaderSource>(reader.release(), true);
+            else
+                DBG("AudioDisplayComponent::loadMediaFile: Failed to read file "
+                    << audioFile.getFullPathName() << ".");
+
+            MessageManager::callAsync(
+                [safeThis, source, abort]
+                {
+                    if (safeThis != nullptr && ! abort->load())
+                        safeThis->readerLoaded(source);
+                });
+        });
+}
+
+void AudioDisplayComponent::readerLoaded(std::shared_ptr<AudioFormatReaderSource> source)
+{
+    loadingReader = false;
+
     if (source == nullptr)
     {
-        DBG("AudioDisplayComponent::loadMediaFile: File " << audioFile.getFullPathName()
-                                                          << " does not exist.");
-        // TODO - better error handing
-        jassertfalse;
+        startWhenLoaded = false;
+        setWaveformDrawn();
+        sendChangeMessage();
         return;
     }
 
-    auto stream = rawToUniquePtr(source->createInputStream());
+    audioFileSource = std::move(source);
+
+    auto* reader = audioFileSource->getAudioFormatReader();
 
-    if (stream == nullptr)
+    // ..and plug it into our transport source. Mapped files are read ahead
+    // too, as the page cache can't promise that a page is still there
+    transportSource.setSource(
+        audioFileSource.get(),
+        32768, // tells it to buffer this many samples ahead
+        &thread, // this is the background thread to use for reading-ahead
+        reader->sampleRate); // allows for sample rate correction
+
+    prefetchAt(getPlaybackPosition());
+
+    mediaLoaded();
+
+    if (startWhenLoaded)
     {
-        DBG("AudioDisplayComponent::loadMediaFile: Failed to load file "
-            << audioFile.getFullPathName() << ".");
-        // TODO - better error handing
-        jassertfalse;
-        return;
+        startWhenLoaded = false;
+        transportSource.start();
     }
+}
 
-    auto reader = rawToUniquePtr(formatManager.createReaderFor(std::move(stream)));
+void AudioDisplayComponent::setPlaybackPosition(double t)
+{
+    transportSource.setPosition(t);
 
-    if (reader == nullptr)
-    {
-        DBG("AudioDisplayComponent::loadMediaFile: Failed to read file "
-            << audioFile.getFullPathName() << ".");
-        // TODO - better error handing
-        jassertfalse;
+    prefetchAt(t);
+}
+
+void AudioDisplayComponent::prefetchAt(double t)
+{
+    if (audioFileSource == nullptr)
         return;
-    }
 
-    audioFileSource = std::make_unique<AudioFormatReaderSource>(reader.release(), true);
+    auto* reader = audioFileSource->getAudioFormatReader();
+    if (! MappedAudioReader::isMapped(reader))
+        return;
 
-    // ..and plug it into our transport source
-    transportSource.setSource(
-        audioFileSource.get(),
-        32768, // tells it to buffer this many samples ahead
-        &thread, // this is the background thread to use for reading-ahead
-        audioFileSource->getAudioFormatReader()->sampleRate); // allows for sample rate correction
+    // The read-ahead buffer refills from t as soon as the pages are in
+    prefetcher.request(audioFileSource,
+                       (int64) (t * reader->sampleRate),
+                       (int64) (prefetchSeconds * reader->sampleRate));
+    thread.moveToFrontOfQueue(&prefetcher);
+}
+
+void AudioDisplayComponent::startPlaying()
+{
+    if (loadingReader)
+    {
+        startWhenLoaded = true;
+    }
+    else
+    {
+        transportSource.start();
+    }
+}
+
+void AudioDisplayComponent::stopPlaying()
+{
+    startWhenLoaded = false;
+    transportSource.stop();
 }
 
 void AudioDisplayComponent::addLabels(LabelList& labels)
@@ -141,15 +213,64 @@ void AudioDisplayComponent::resetDisplay()
 {
     MediaDisplayComponent::resetTransport();
 
+    abortLoadJobs();
     audioFileSource.reset();
-    thumbnail.clear();
+    loadingReader = false;
+    startWhenLoaded = false;
+    waveformDrawn = false;
+    waveformComponent.setPyramid(nullptr, false);
+}
+
+void AudioDisplayComponent::setWaveformDrawn()
+{
+    waveformDrawn = true;
+    mediaDrawn();
+}
+
+void AudioDisplayComponent::abortLoadJobs()
+{
+    if (loadAbort != nullptr)
+        *loadAbort = true;
+    loadAbort.reset();
 }
 
 void AudioDisplayComponent::postLoadActions(const URL& filePath)
 {
-    if (auto inputSource = std::make_unique<URLInputSource>(filePath))
+    // Files seen before (e.g on undo and redo) come straight from the pyramid
+    // cache. New ones are summarised in parallel chunks, and drawn coarsely
+    // as the chunks are scanned. Either way the message thread doesn't wait
+    auto abort = loadAbort;
+    if (abort == nullptr)
+        return;
+
+    File audioFile = filePath.getLocalFile();
+    AudioFormatManager* formats = &formatManager;
+    SafePointer<AudioDisplayComponent> safeThis(this);
+    auto install = [safeThis, abort](std::shared_ptr<const WaveformPyramid> pyramid, bool complete)
     {
-        thumbnailCache.clear();
-        thumbnail.setSource(inputSource.release());
-    }
+        MessageManager::callAsync(
+            [safeThis, pyramid, complete, abort]
+            {
+                if (safeThis == nullptr || abort->load())
+                    return;
+
+                // A file that can't be summarised has nothing more to draw
+                if (complete && pyramid == nullptr)
+                    safeThis->setWaveformDrawn();
+                else
+                    safeThis->waveformComponent.setPyramid(pyramid, complete);
+            });
+    };
+
+    loaderPool.addJob(
+        [audioFile, formats, abort, install]
+        {
+            auto pyramid = WaveformPyramid::loadOrBuild(
+                audioFile,
+                *formats,
+                [abort] { return abort->load(); },
+                [install](std::shared_ptr<const WaveformPyramid> partial)
+                { install(partial, false); });
+            install(pyramid, true);
+        });
 }
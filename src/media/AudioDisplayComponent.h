@@ -2,26 +2,111 @@
 
 #include <juce_audio_utils/juce_audio_utils.h>
 
+#include <atomic>
+#include <memory>
+
+#include "../Metrics.h"
+#include "MappedAudioReader.h"
 #include "MediaDisplayComponent.h"
+#include "WaveformPyramid.h"
 
-class AudioThumbnailWrapper : public Component
+class WaveformComponent : public Component
 {
 public:
-    AudioThumbnailWrapper(AudioThumbnail& t, Range<double>& v) : thumbnail(t), visibleRange(v) {}
+    explicit WaveformComponent(Range<double>& v) : visibleRange(v) {}
 
-    void paint(Graphics& g) override
+    // A partial pyramid is one of those drawn while the file is being summarised
+    void setPyramid(std::shared_ptr<const WaveformPyramid> newPyramid, bool isComplete)
     {
-        g.setColour(Colours::lightblue);
+        pyramid = std::move(newPyramid);
+        complete = isComplete && pyramid != nullptr;
+        drawnComplete = false;
+        repaint();
+    }
+
+    // Called after the first paint of a complete pyramid
+    std::function<void()> onCompleteDraw;
 
-        thumbnail.drawChannels(
-            g, getLocalBounds(), visibleRange.getStart(), visibleRange.getEnd(), 1.0f);
+    void paint(Graphics& g) override
+    {
+        double startMs = Time::getMillisecondCounterHiRes();
+
+        if (pyramid != nullptr)
+        {
+            pyramid->draw(g,
+                          getLocalBounds(),
+                          visibleRange.getStart(),
+                          visibleRange.getEnd(),
+                          Colours::lightblue);
+        }
+
+        if (complete && ! drawnComplete)
+        {
+            drawnComplete = true;
+            if (onCompleteDraw)
+                onCompleteDraw();
+        }
+
+        // Redrawn on every playhead move, so it makes up most of a frame
+        paintMs.observe(Time::getMillisecondCounterHiRes() - startMs);
     }
 
 private:
-    AudioThumbnail& thumbnail;
+    // Looked up once, paint() runs too often to go through the registry
+    Metrics::Histogram& paintMs {
+        Metrics::getInstance()->histogram("harp_ui_paint_ms", { { "component", "waveform" } })
+    };
+    std::shared_ptr<const WaveformPyramid> pyramid;
+    bool complete = false;
+    bool drawnComplete = false;
     Range<double>& visibleRange;
 };
 
+/*
+* Pages in the audio after a seek on the transport's read-ahead thread, so
+* that neither the message thread nor the audio thread waits for the disk.
+* Only the latest request is kept.
+*/
+class AudioPrefetcher : public TimeSliceClient
+{
+public:
+    void request(std::shared_ptr<AudioFormatReaderSource> source,
+                 int64 startSample,
+                 int64 numSamples)
+    {
+        const ScopedLock lock(requestLock);
+        pendingSource = std::move(source);
+        pendingStart = startSample;
+        pendingNumSamples = numSamples;
+    }
+
+    int useTimeSlice() override
+    {
+        std::shared_ptr<AudioFormatReaderSource> source;
+        int64 startSample = 0;
+        int64 numSamples = 0;
+        {
+            const ScopedLock lock(requestLock);
+            source = std::move(pendingSource);
+            startSample = pendingStart;
+            numSamples = pendingNumSamples;
+        }
+
+        if (source == nullptr)
+            return 100;
+
+        MappedAudioReader::prefetch(source->getAudioFormatReader(), startSample, numSamples);
+        return 0;
+    }
+
+private:
+    CriticalSection requestLock;
+    // Keeps the reader alive until its pages are touched
+    std::shared_ptr<AudioFormatReaderSource> pendingSource;
+    int64 pendingStart = 0;
+    int64 pendingNumSamples = 0;
+};
+
 class AudioDisplayComponent : public MediaDisplayComponent
 {
 public:
@@ -33,26 +118,59 @@ public:
 
     void repositionContent() override;
 
-    Component* getMediaComponent() { return &thumbnailComponent; }
+    Component* getMediaComponent() { return &waveformComponent; }
 
+    // Creates the reader in the background, the transport is set up once it's ready
     void loadMediaFile(const URL& filePath) override;
 
-    double getTotalLengthInSecs() override { return thumbnail.getTotalLength(); }
+    // Play requested while the file is still loading starts once it's loaded
+    bool isPlaying() override { return startWhenLoaded || transportSource.isPlaying(); }
+    void setPlaybackPosition(double t) override;
+    void startPlaying() override;
+    void stopPlaying() override;
+
+    double getTotalLengthInSecs() override;
     double getTimeAtOrigin() override { return visibleRange.getStart(); }
 
     void addLabels(LabelList& labels) override;
 
+protected:
+    bool isMediaLoading() override { return loadingReader; }
+    bool isMediaDrawn() override { return waveformDrawn; }
+
 private:
     void resetDisplay() override;
 
     void postLoadActions(const URL& filePath) override;
 
+    void readerLoaded(std::shared_ptr<AudioFormatReaderSource> source);
+
+    // Pages in the audio after t in the background, if the file is mapped
+    void prefetchAt(double t);
+
+    static constexpr double prefetchSeconds = 1.0;
+
+    // Stops the load jobs of the previous file, if they are still running
+    void abortLoadJobs();
+
     TimeSliceThread thread { "Audio File Thread" };
+    AudioPrefetcher prefetcher;
+
+    std::shared_ptr<AudioFormatReaderSource> audioFileSource;
+
+    WaveformComponent waveformComponent { visibleRange };
 
-    std::unique_ptr<AudioFormatReaderSource> audioFileSource;
+    bool loadingReader = false;
+    bool startWhenLoaded = false;
+    // The complete waveform was painted, or there is none to paint
+    bool waveformDrawn = false;
 
-    AudioThumbnailCache thumbnailCache { 5 };
-    AudioThumbnail thumbnail = AudioThumbnail(512, formatManager, thumbnailCache);
+    void setWaveformDrawn();
 
-    AudioThumbnailWrapper thumbnailComponent { thumbnail, visibleRange };
+    // Set when the file being loaded is replaced
+    std::shared_ptr<std::atomic<bool>> loadAbort;
+    // Creates the reader, then loads or builds the pyramid of every file.
+    // Declared last, so that its destructor waits for the jobs before anything
+    // they use goes away
+    ThreadPool loaderPool { 1 };
 };
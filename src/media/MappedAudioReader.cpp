@@ -0,0 +1,45 @@
+#include "MappedAudioReader.h"
+
+namespace
+{
+// The usual size of a page
+const int pageSize = 4096;
+} // namespace
+
+std::unique_ptr<juce::AudioFormatReader>
+    MappedAudioReader::create(juce::AudioFormatManager& formatManager, const juce::File& file)
+{
+    // Formats that can't be mapped return nullptr
+    if (auto* format = formatManager.findFormatForFileExtension(file.getFileExtension()))
+    {
+        std::unique_ptr<juce::MemoryMappedAudioFormatReader> mapped(
+            format->createMemoryMappedReader(file));
+
+        if (mapped != nullptr && mapped->mapEntireFile())
+            return mapped;
+    }
+
+    return std::unique_ptr<juce::AudioFormatReader>(formatManager.createReaderFor(file));
+}
+
+bool MappedAudioReader::isMapped(juce::AudioFormatReader* reader)
+{
+    return dynamic_cast<juce::MemoryMappedAudioFormatReader*>(reader) != nullptr;
+}
+
+void MappedAudioReader::prefetch(juce::AudioFormatReader* reader,
+                                 juce::int64 startSample,
+                                 juce::int64 numSamples)
+{
+    auto* mapped = dynamic_cast<juce::MemoryMappedAudioFormatReader*>(reader);
+    if (mapped == nullptr)
+        return;
+
+    int bytesPerFrame = juce::jmax(1, (int) (mapped->bitsPerSample / 8 * mapped->numChannels));
+    juce::int64 samplesPerPage = juce::jmax(1, pageSize / bytesPerFrame);
+    juce::int64 endSample = juce::jmin(startSample + numSamples, mapped->lengthInSamples);
+
+    for (juce::int64 sample = juce::jmax((juce::int64) 0, startSample); sample < endSample;
+         sample += samplesPerPage)
+        mapped->touchSample(sample);
+}
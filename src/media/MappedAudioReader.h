@@ -0,0 +1,35 @@
+/**
+ * @file
+ * @brief Opens audio files through a memory map where the format allows it, so
+ * that playback and the waveform read the same pages of the OS page cache
+ */
+
+#pragma once
+
+#include <memory>
+
+#include <juce_audio_formats/juce_audio_formats.h>
+
+/*
+* Uncompressed formats (WAV, AIFF) are read straight from a map of the whole
+* file: a seek costs nothing, the OS does the read-ahead, and every reader of
+* the same file shares its pages. The other formats get a regular reader.
+*/
+class MappedAudioReader
+{
+public:
+    // nullptr if no registered format can read file
+    static std::unique_ptr<juce::AudioFormatReader>
+        create(juce::AudioFormatManager& formatManager, const juce::File& file);
+
+    static bool isMapped(juce::AudioFormatReader* reader);
+
+    /*
+    * Touches the pages of the samples [startSample, startSample + numSamples)
+    * of a mapped reader, so that the audio thread doesn't wait for them to be
+    * paged in. Does nothing for other readers.
+    */
+    static void prefetch(juce::AudioFormatReader* reader,
+                         juce::int64 startSample,
+                         juce::int64 numSamples);
+};
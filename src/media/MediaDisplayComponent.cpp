@@ -140,14 +140,17 @@ void MediaDisplayComponent::setupDisplay(const URL& filePath)
     resetMedia();
 
     setNewTarget(filePath);
-    updateDisplay(filePath);
 
     horizontalScrollBar.setVisible(true);
-    updateVisibleRange({ 0.0, getTotalLengthInSecs() });
+    resetVisibleRangeOnLoad = true;
+    updateDisplay(filePath);
 }
 
 void MediaDisplayComponent::updateDisplay(const URL& filePath)
 {
+    // Whoever waits for the previous media won't see it drawn anymore
+    mediaDrawn();
+
     resetDisplay();
 
     loadMediaFile(filePath);
@@ -155,9 +158,44 @@ void MediaDisplayComponent::updateDisplay(const URL& filePath)
 
     currentPositionMarker.toFront(true);
 
+    // Displays that load in the background call it once they are done
+    if (! isMediaLoading())
+    {
+        mediaLoaded();
+    }
+}
+
+void MediaDisplayComponent::mediaLoaded()
+{
     Range<double> range(0.0, getTotalLengthInSecs());
 
     horizontalScrollBar.setRangeLimits(range);
+
+    if (resetVisibleRangeOnLoad)
+    {
+        resetVisibleRangeOnLoad = false;
+        updateVisibleRange(range);
+    }
+
+    repositionLabels();
+    repaint();
+}
+
+void MediaDisplayComponent::whenMediaDrawn(std::function<void()> callback)
+{
+    drawnCallbacks.push_back(std::move(callback));
+
+    // Displays that draw in one go are drawn by the next paint
+    if (isMediaDrawn())
+        mediaDrawn();
+}
+
+void MediaDisplayComponent::mediaDrawn()
+{
+    // Called from paint, so the callbacks run after it
+    for (auto& callback : drawnCallbacks)
+        MessageManager::callAsync(std::move(callback));
+    drawnCallbacks.clear();
 }
 
 void MediaDisplayComponent::addNewTempFile()
@@ -168,47 +206,209 @@ void MediaDisplayComponent::addNewTempFile()
 
     File originalFile = targetFilePath.getLocalFile();
 
-    File targetFile;
+    VersionStore* store = VersionStore::getInstance();
 
     if (! numTempFiles)
     {
-        targetFile = originalFile;
+        // The first version is the original file, until a copy of it is stored.
+        // Opening the same file again finds that copy instead of making another
+        URL originalPath = URL(originalFile);
+
+        tempFilePaths.add(originalPath);
+        currentTempFileIdx++;
+        historyHasOriginal = true;
+
+        addFileJob(originalPath,
+                   [store, originalFile]
+                   {
+                       File stored = store->store(originalFile, false);
+                       return stored == File() ? std::optional<File>() : stored;
+                   });
+        return;
     }
-    else
+
+    // A clone of the current version, for processing to replace. Where the
+    // filesystem allows, it shares its data with the stored version
+    File currentFile = getTempFilePath().getLocalFile();
+
+    File workingFile = store->createWorkingFile(
+        originalFile.getFileNameWithoutExtension() + "_" + String(numTempFiles),
+        originalFile.getFileExtension());
+
+    URL tempFilePath = URL(workingFile);
+
+    tempFilePaths.add(tempFilePath);
+    currentTempFileIdx++;
+
+    addFileJob(tempFilePath,
+               [store, currentFile, workingFile]
+               {
+                   return store->checkOut(currentFile, workingFile)
+                              ? std::optional<File>(workingFile)
+                              : std::optional<File>();
+               });
+}
+
+void MediaDisplayComponent::commitTempFile()
+{
+    URL tempFilePath = getTempFilePath();
+    File workingFile = tempFilePath.getLocalFile();
+
+    VersionStore* store = VersionStore::getInstance();
+
+    if (! store->isWorkingFile(workingFile))
     {
-        targetFile = getTempFilePath().getLocalFile();
+        return;
     }
 
-    String docsDirectory =
-        File::getSpecialLocation(File::SpecialLocationType::userDocumentsDirectory)
-            .getFullPathName();
+    // Processing that changed nothing finds the version it started from
+    addFileJob(tempFilePath,
+               [store, workingFile]
+               {
+                   File stored = store->store(workingFile, true);
+                   return stored == File() ? std::optional<File>() : stored;
+               });
+}
 
-    String targetFileName = originalFile.getFileNameWithoutExtension();
-    String targetFileExtension = originalFile.getFileExtension();
+void MediaDisplayComponent::addFileJob(const URL& tempFilePath,
+                                       std::function<std::optional<File>()> job)
+{
+    // The file work of a long file takes seconds, so it doesn't happen on the message thread
+    auto pendingJob = std::make_shared<PendingFileJob>();
+    lastFileJob = pendingJob;
 
-    URL tempFilePath = URL(File(docsDirectory + "/HARP/" + targetFileName + "_"
-                                + String(numTempFiles) + targetFileExtension));
+    SafePointer<MediaDisplayComponent> safeThis(this);
+    fileJobPool.addJob(
+        [safeThis, pendingJob, tempFilePath, job]
+        {
+            std::optional<File> result = job();
 
-    File tempFile = tempFilePath.getLocalFile();
+            MessageManager::callAsync(
+                [safeThis, pendingJob, tempFilePath, result]
+                {
+                    if (safeThis != nullptr)
+                        safeThis->fileJobFinished(*pendingJob, tempFilePath, result);
+                });
+        });
+}
 
-    tempFile.getParentDirectory().createDirectory();
+void MediaDisplayComponent::fileJobFinished(PendingFileJob& pendingJob,
+                                            const URL& tempFilePath,
+                                            std::optional<File> result)
+{
+    bool succeeded = result.has_value();
 
-    if (! targetFile.copyFileTo(tempFile))
+    if (! succeeded)
     {
-        DBG("MediaDisplayComponent::generateTempFile: Failed to copy file "
-            << targetFile.getFullPathName() << " to " << tempFile.getFullPathName() << ".");
+        DBG("MediaDisplayComponent::fileJobFinished: Failed to create the version at "
+            << tempFilePath.getLocalFile().getFullPathName() << ".");
 
-        AlertWindow(
-            "Error", "Failed to create temporary file for processing.", AlertWindow::WarningIcon);
+        AlertWindow::showMessageBoxAsync(AlertWindow::WarningIcon,
+                                         "Error",
+                                         "Failed to create a version of the file.");
     }
     else
     {
-        DBG("MediaDisplayComponent::generateTempFile: Copied file "
-            << targetFile.getFullPathName() << " to " << tempFile.getFullPathName() << ".");
+        DBG("MediaDisplayComponent::fileJobFinished: Version "
+            << tempFilePath.getLocalFile().getFullPathName() << " is at "
+            << result->getFullPathName() << ".");
+
+        // The version moved into the store
+        int index = tempFilePaths.indexOf(tempFilePath);
+
+        if (index >= 0 && *result != tempFilePath.getLocalFile())
+        {
+            tempFilePaths.set(index, URL(*result));
+
+            enforceVersionBudget();
+        }
+    }
+
+    pendingJob.finished = true;
+    pendingJob.succeeded = succeeded;
+
+    auto waiting = std::move(pendingJob.waiting);
+    pendingJob.waiting.clear();
+
+    for (auto& callback : waiting)
+    {
+        callback(succeeded);
     }
+}
 
-    tempFilePaths.add(tempFilePath);
-    currentTempFileIdx++;
+void MediaDisplayComponent::enforceVersionBudget()
+{
+    VersionStore* store = VersionStore::getInstance();
+
+    // The data the history keeps on disk. Every stored version is one file per
+    // content, counted once however often it appears. Working files aren't
+    // counted: they are clones that share their data with a stored version
+    // until processing replaces them, and then get stored themselves
+    auto getHistoryBytes = [this, store]
+    {
+        int64 total = 0;
+        Array<File> counted;
+
+        for (const auto& path : tempFilePaths)
+        {
+            File file = path.getLocalFile();
+
+            if (store->isStored(file) && counted.addIfNotAlreadyThere(file))
+            {
+                total += file.getSize();
+            }
+        }
+
+        return total;
+    };
+
+    bool droppedOriginal = false;
+
+    // The oldest versions go first, the current one always stays
+    while (currentTempFileIdx > 0 && getHistoryBytes() > store->getByteBudget())
+    {
+        DBG("MediaDisplayComponent::enforceVersionBudget: Dropping the oldest version "
+            << tempFilePaths.getReference(0).getLocalFile().getFullPathName() << ".");
+
+        tempFilePaths.remove(0);
+        currentTempFileIdx--;
+
+        droppedOriginal = droppedOriginal || historyHasOriginal;
+        historyHasOriginal = false;
+    }
+
+    if (droppedOriginal)
+    {
+        // Undo can't get back to the file as it was loaded anymore
+        AlertWindow::showMessageBoxAsync(
+            AlertWindow::InfoIcon,
+            "Undo history",
+            "The original version of " + targetFilePath.getLocalFile().getFileName()
+                + " was removed from the undo history, which is limited to "
+                + String(store->getByteBudget() / (1024 * 1024))
+                + " MB (see HARP_VERSIONS_BUDGET_MB).");
+    }
+
+    Array<File> inUse;
+
+    for (const auto& path : tempFilePaths)
+    {
+        inUse.add(path.getLocalFile());
+    }
+
+    fileJobPool.addJob([store, inUse] { store->evictIfNeeded(inUse); });
+}
+
+void MediaDisplayComponent::whenTempFileReady(std::function<void(bool)> callback)
+{
+    if (lastFileJob == nullptr || lastFileJob->finished)
+    {
+        callback(lastFileJob == nullptr || lastFileJob->succeeded);
+    }
+    else
+    {
+        lastFileJob->waiting.push_back(std::move(callback));
+    }
 }
 
 bool MediaDisplayComponent::iteratePreviousTempFile()
@@ -247,6 +447,20 @@ void MediaDisplayComponent::clearFutureTempFiles()
 {
     int n = tempFilePaths.size() - (currentTempFileIdx + 1);
 
+    VersionStore* store = VersionStore::getInstance();
+
+    for (int i = currentTempFileIdx + 1; i < tempFilePaths.size(); i++)
+    {
+        File file = tempFilePaths.getReference(i).getLocalFile();
+
+        // Stored versions stay, to be found again or evicted. Deleted after
+        // any job that is still filling them in
+        if (store->isWorkingFile(file))
+        {
+            fileJobPool.addJob([file] { file.deleteFile(); });
+        }
+    }
+
     tempFilePaths.removeLast(n);
 }
 
@@ -573,6 +787,9 @@ void MediaDisplayComponent::resetPaths()
 
     tempFilePaths.clear();
     currentTempFileIdx = -1;
+    historyHasOriginal = false;
+
+    lastFileJob.reset();
 }
 
 // TODO - may be able to simplify some of this logic by embedding cursor in media component
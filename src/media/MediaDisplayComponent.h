@@ -4,8 +4,14 @@
 #include "juce_gui_basics/juce_gui_basics.h"
 #include <juce_audio_utils/juce_audio_utils.h>
 
+#include <functional>
+#include <memory>
+#include <optional>
+#include <vector>
+
 #include "../utils.h"
 #include "OutputLabelComponent.h"
+#include "VersionStore.h"
 
 using namespace juce;
 
@@ -46,14 +52,36 @@ public:
     void setupDisplay(const URL& filePath);
     void updateDisplay(const URL& filePath);
 
+    /*
+    * Calls callback on the message thread once the media of the last
+    * updateDisplay is completely drawn, e.g the whole waveform of an audio
+    * file rather than the coarse one drawn while it's being summarised.
+    * If another file is displayed first, callback is called then
+    */
+    void whenMediaDrawn(std::function<void()> callback);
+
     URL getTargetFilePath() { return targetFilePath; }
 
     bool isFileLoaded() { return ! tempFilePaths.isEmpty(); }
 
+    /*
+    * Adds a version after the current one, a clone of it to be processed in
+    * place. The clone is made in the background, see whenTempFileReady
+    */
     void addNewTempFile();
 
+    // Moves the processed current version into the VersionStore, in the background
+    void commitTempFile();
+
     URL getTempFilePath() { return tempFilePaths.getReference(currentTempFileIdx); }
 
+    /*
+    * Calls callback on the message thread once the file work of the last
+    * addNewTempFile or commitTempFile is complete, right away if it already
+    * is, with whether it succeeded
+    */
+    void whenTempFileReady(std::function<void(bool)> callback);
+
     bool iteratePreviousTempFile();
     bool iterateNextTempFile();
 
@@ -104,6 +132,18 @@ public:
 protected:
     void setNewTarget(URL filePath);
 
+    // True while loadMediaFile is still loading in the background
+    virtual bool isMediaLoading() { return false; }
+
+    // Updates the scroll range, to be called once the length of the media is known
+    void mediaLoaded();
+
+    // Displays that draw progressively return false until their first complete paint
+    virtual bool isMediaDrawn() { return ! isMediaLoading(); }
+
+    // To be called by those displays after that paint, see whenMediaDrawn
+    void mediaDrawn();
+
     double mediaXToTime(const float x);
     float timeToMediaX(const double t);
     float mediaXToDisplayX(const float mX);
@@ -140,6 +180,26 @@ private:
 
     void timerCallback() override;
 
+    struct PendingFileJob
+    {
+        bool finished = false;
+        bool succeeded = false;
+        std::vector<std::function<void(bool)>> waiting;
+    };
+
+    /*
+    * Runs job on fileJobPool. It returns where the version at tempFilePath
+    * ended up, or nothing if it failed
+    */
+    void addFileJob(const URL& tempFilePath, std::function<std::optional<File>()> job);
+
+    void fileJobFinished(PendingFileJob& pendingJob,
+                         const URL& tempFilePath,
+                         std::optional<File> result);
+
+    // Drops the oldest versions while the history is over the budget of the VersionStore
+    void enforceVersionBudget();
+
     void scrollBarMoved(ScrollBar* scrollBarThatHasMoved, double scrollBarRangeStart) override;
 
     void mouseWheelMove(const MouseEvent&, const MouseWheelDetails& wheel) override;
@@ -147,8 +207,21 @@ private:
     URL targetFilePath;
     URL droppedFilePath;
 
+    // The versions, oldest first. Stored ones are in the VersionStore, the
+    // one being processed is a working file. Undo and redo only move the index
     int currentTempFileIdx;
     Array<URL> tempFilePaths;
+    // Whether the first version is still the file as it was loaded, see enforceVersionBudget
+    bool historyHasOriginal = false;
+
+    // The file work of the last addNewTempFile or commitTempFile
+    std::shared_ptr<PendingFileJob> lastFileJob;
+
+    // Set by setupDisplay, so that the whole of a new file is shown once loaded
+    bool resetVisibleRangeOnLoad = false;
+
+    // Waiting for the media to be completely drawn, see whenMediaDrawn
+    std::vector<std::function<void()>> drawnCallbacks;
 
     const float cursorWidth = 1.5f;
     DrawableRectangle currentPositionMarker;
@@ -161,4 +234,8 @@ private:
 
     Array<LabelOverlayComponent*> labelOverlays;
     Array<OverheadLabelComponent*> oveheadLabels;
+
+    // Does the file work of the versions, one job at a time and in order, so
+    // that each job starts from a complete file
+    ThreadPool fileJobPool { 1 };
 };
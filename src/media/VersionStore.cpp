@@ -0,0 +1,322 @@
+#include "VersionStore.h"
+
+#include <algorithm>
+#include <vector>
+
+#if JUCE_LINUX || JUCE_MAC || JUCE_BSD
+#include <fcntl.h>
+#include <sys/ioctl.h>
+#include <unistd.h>
+#endif
+
+#if JUCE_LINUX
+#include <linux/fs.h>
+#endif
+
+#if JUCE_MAC
+#include <sys/clonefile.h>
+#endif
+
+#include "../ContentHash.h"
+#include "../Metrics.h"
+#include "../external/magic_enum.hpp"
+
+JUCE_IMPLEMENT_SINGLETON(VersionStore)
+
+namespace
+{
+const juce::String objectsDirectoryName = "objects";
+const juce::String workingDirectoryName = "work";
+
+// Older working files can't belong to a history of this or another instance anymore
+const juce::RelativeTime maxWorkingFileAge = juce::RelativeTime::days(1);
+
+bool reflinkFile(const juce::File& source, const juce::File& target)
+{
+#if JUCE_MAC
+    return clonefile(source.getFullPathName().toRawUTF8(),
+                     target.getFullPathName().toRawUTF8(),
+                     0)
+           == 0;
+#elif JUCE_LINUX && defined(FICLONE)
+    int sourceFd = open(source.getFullPathName().toRawUTF8(), O_RDONLY);
+    if (sourceFd < 0)
+        return false;
+
+    bool cloned = false;
+    int targetFd = open(target.getFullPathName().toRawUTF8(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (targetFd >= 0)
+    {
+        cloned = ioctl(targetFd, FICLONE, sourceFd) == 0;
+        close(targetFd);
+    }
+    close(sourceFd);
+
+    // e.g ext4, or source and target on different filesystems
+    if (! cloned)
+        target.deleteFile();
+    return cloned;
+#else
+    juce::ignoreUnused(source, target);
+    return false;
+#endif
+}
+
+bool hardLinkFile(const juce::File& source, const juce::File& target)
+{
+#if JUCE_LINUX || JUCE_MAC || JUCE_BSD
+    return link(source.getFullPathName().toRawUTF8(), target.getFullPathName().toRawUTF8()) == 0;
+#else
+    juce::ignoreUnused(source, target);
+    return false;
+#endif
+}
+} // namespace
+
+VersionStore::VersionStore()
+{
+    // Next to the temp files that used to hold every version
+    storeDirectory = juce::File::getSpecialLocation(juce::File::userDocumentsDirectory)
+                         .getChildFile("HARP")
+                         .getChildFile(".versions");
+
+    // Nothing is in use yet, other instances keep theirs alive, see evictIfNeeded
+    removeStaleWorkingFiles({});
+}
+
+VersionStore::~VersionStore() { clearSingletonInstance(); }
+
+void VersionStore::setDirectory(const juce::File& directory)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    storeDirectory = directory;
+}
+
+juce::File VersionStore::getDirectory() const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return storeDirectory;
+}
+
+juce::File VersionStore::getObjectsDirectory() const
+{
+    return getDirectory().getChildFile(objectsDirectoryName);
+}
+
+juce::File VersionStore::getWorkingDirectory() const
+{
+    return getDirectory().getChildFile(workingDirectoryName);
+}
+
+bool VersionStore::isStored(const juce::File& file) const
+{
+    return file.getParentDirectory().getParentDirectory() == getObjectsDirectory();
+}
+
+bool VersionStore::isWorkingFile(const juce::File& file) const
+{
+    return file.getParentDirectory() == getWorkingDirectory();
+}
+
+bool VersionStore::cloneFile(const juce::File& source,
+                             const juce::File& target,
+                             bool allowHardLink,
+                             CloneMethod* methodUsed)
+{
+    if (! target.deleteFile())
+        return false;
+
+    CloneMethod method = CloneMethod::Copy;
+    bool cloned = false;
+    if (reflinkFile(source, target))
+    {
+        method = CloneMethod::Reflink;
+        cloned = true;
+    }
+    else if (allowHardLink && hardLinkFile(source, target))
+    {
+        method = CloneMethod::HardLink;
+        cloned = true;
+    }
+    else
+    {
+        cloned = source.copyFileTo(target);
+    }
+
+    if (! cloned)
+        return false;
+
+    if (methodUsed != nullptr)
+        *methodUsed = method;
+    juce::String methodName = std::string(magic_enum::enum_name(method)).c_str();
+    Metrics::getInstance()
+        ->counter("harp_version_clones_total", { { "method", methodName.toLowerCase() } })
+        .increment();
+    return true;
+}
+
+juce::File VersionStore::store(const juce::File& file, bool moveFile)
+{
+    uint64_t hash = 0;
+    if (! ContentHash::hashFile(file, hash))
+        return {};
+
+    std::lock_guard<std::mutex> lock(mutex);
+    juce::File entryDir =
+        storeDirectory.getChildFile(objectsDirectoryName).getChildFile(ContentHash::toString(hash));
+
+    // The same contents were stored before, e.g processing that left the file as it was
+    auto existing = entryDir.findChildFiles(juce::File::findFiles, false);
+    Metrics::getInstance()->countCacheLookup("versions", ! existing.isEmpty());
+    if (! existing.isEmpty())
+    {
+        juce::File stored = existing.getFirst();
+        stored.setLastModificationTime(juce::Time::getCurrentTime());
+        if (moveFile)
+            file.deleteFile();
+        return stored;
+    }
+
+    if (! entryDir.createDirectory())
+    {
+        DBG("VersionStore::store: Failed to create " << entryDir.getFullPathName());
+        return {};
+    }
+
+    juce::File stored = entryDir.getChildFile(file.getFileName());
+    bool ok = false;
+    if (moveFile)
+    {
+        ok = file.moveFileTo(stored);
+    }
+    else
+    {
+        // Cloned next to the store and then moved in, so that a stored file is
+        // always complete. Never hard linked, as the caller may still change file
+        juce::File workingDir = storeDirectory.getChildFile(workingDirectoryName);
+        workingDir.createDirectory();
+        juce::File partial = workingDir.getNonexistentChildFile(
+            file.getFileNameWithoutExtension(), file.getFileExtension(), false);
+        ok = cloneFile(file, partial, false) && partial.moveFileTo(stored);
+        partial.deleteFile();
+    }
+
+    if (! ok)
+    {
+        DBG("VersionStore::store: Failed to store " << file.getFullPathName());
+        entryDir.deleteRecursively();
+        return {};
+    }
+    return stored;
+}
+
+juce::File VersionStore::createWorkingFile(const juce::String& name, const juce::String& extension)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    juce::File workingDir = storeDirectory.getChildFile(workingDirectoryName);
+    workingDir.createDirectory();
+
+    juce::File workingFile = workingDir.getNonexistentChildFile(name, extension, false);
+    // Reserves the name until checkOut fills it in
+    workingFile.create();
+    return workingFile;
+}
+
+bool VersionStore::checkOut(const juce::File& file, const juce::File& workingFile)
+{
+    // Processing replaces its input file as a whole, so a stored file can be
+    // shared with it
+    if (! cloneFile(file, workingFile, isStored(file)))
+        return false;
+
+    // Clones can keep the time of their source, which would make them look stale
+    workingFile.setLastModificationTime(juce::Time::getCurrentTime());
+    return true;
+}
+
+juce::int64 VersionStore::getEntrySize(const juce::File& entryDir)
+{
+    juce::int64 size = 0;
+    for (const auto& file : entryDir.findChildFiles(juce::File::findFiles, false))
+        size += file.getSize();
+    return size;
+}
+
+juce::int64 VersionStore::getTotalBytes()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    juce::int64 total = 0;
+    for (const auto& entryDir : storeDirectory.getChildFile(objectsDirectoryName)
+                                    .findChildFiles(juce::File::findDirectories, false))
+        total += getEntrySize(entryDir);
+    return total;
+}
+
+void VersionStore::evictIfNeeded(const juce::Array<juce::File>& inUse)
+{
+    for (const auto& file : inUse)
+    {
+        if (isWorkingFile(file))
+            file.setLastModificationTime(juce::Time::getCurrentTime());
+    }
+    removeStaleWorkingFiles(inUse);
+
+    std::lock_guard<std::mutex> lock(mutex);
+
+    struct EntryInfo
+    {
+        juce::File dir;
+        juce::Time lastUsed;
+        juce::int64 size;
+    };
+
+    std::vector<EntryInfo> entries;
+    juce::int64 total = 0;
+
+    for (const auto& entryDir : storeDirectory.getChildFile(objectsDirectoryName)
+                                    .findChildFiles(juce::File::findDirectories, false))
+    {
+        juce::Time lastUsed;
+        for (const auto& file : entryDir.findChildFiles(juce::File::findFiles, false))
+            lastUsed = juce::jmax(lastUsed, file.getLastModificationTime());
+
+        juce::int64 size = getEntrySize(entryDir);
+        entries.push_back({ entryDir, lastUsed, size });
+        total += size;
+    }
+
+    if (total <= byteBudget)
+        return;
+
+    // Least recently used first
+    std::sort(entries.begin(),
+              entries.end(),
+              [](const EntryInfo& a, const EntryInfo& b) { return a.lastUsed < b.lastUsed; });
+
+    for (const auto& entry : entries)
+    {
+        if (total <= byteBudget)
+            break;
+
+        bool used = std::any_of(inUse.begin(),
+                                inUse.end(),
+                                [&entry](const juce::File& file)
+                                { return file.getParentDirectory() == entry.dir; });
+        if (used)
+            continue;
+
+        DBG("VersionStore: evicting " << entry.dir.getFileName());
+        entry.dir.deleteRecursively();
+        total -= entry.size;
+    }
+}
+
+void VersionStore::removeStaleWorkingFiles(const juce::Array<juce::File>& inUse)
+{
+    juce::Time oldest = juce::Time::getCurrentTime() - maxWorkingFileAge;
+    for (const auto& file : getWorkingDirectory().findChildFiles(juce::File::findFiles, false))
+    {
+        if (file.getLastModificationTime() < oldest && ! inUse.contains(file))
+            file.deleteFile();
+    }
+}
@@ -0,0 +1,110 @@
+/**
+ * @file
+ * @brief A content-addressed, size-bounded store of the versions of the edited
+ * files, which keeps the undo history without a full copy of every version
+ */
+
+#pragma once
+
+#include <atomic>
+#include <mutex>
+
+#include <juce_core/juce_core.h>
+#include <juce_events/juce_events.h>
+
+/*
+* Every stored version is kept once, in objects/<content hash>/, however many
+* times it appears in a history. Files handed out for processing are clones
+* of a stored version: a reflink where the filesystem supports it, so they
+* take no space until they are changed, a hard link otherwise, and a copy only
+* as a last resort.
+*/
+class VersionStore : private juce::DeletedAtShutdown
+{
+public:
+    JUCE_DECLARE_SINGLETON(VersionStore, false)
+
+    ~VersionStore();
+
+    VersionStore(const VersionStore&) = delete;
+    VersionStore& operator=(const VersionStore&) = delete;
+
+    enum class CloneMethod
+    {
+        Reflink,
+        HardLink,
+        Copy
+    };
+
+    /*
+    * Stores the contents of file and returns the stored file, which is the
+    * file stored before with the same contents, if there is one. With
+    * moveFile, file itself is moved into the store, or deleted if its
+    * contents were already there; otherwise it's cloned and left alone.
+    * Returns File() on failure. Any thread.
+    */
+    juce::File store(const juce::File& file, bool moveFile);
+
+    /*
+    * A new, empty file in the working directory, for checkOut to fill in.
+    * Cheap, so it can be called on the message thread to know the path
+    * before the (possibly slow) checkOut.
+    */
+    juce::File createWorkingFile(const juce::String& name, const juce::String& extension);
+
+    /*
+    * Fills workingFile with the contents of file, to be processed. When file
+    * is stored, the two may share their data, so workingFile must only be
+    * replaced (e.g by File::moveFileTo or File::copyFileTo, which delete the
+    * target first), never written in place. Any thread.
+    */
+    bool checkOut(const juce::File& file, const juce::File& workingFile);
+
+    bool isStored(const juce::File& file) const;
+    bool isWorkingFile(const juce::File& file) const;
+
+    // Least recently used stored files are evicted once the store grows over this size
+    void setByteBudget(juce::int64 numBytes) { byteBudget = numBytes; }
+    juce::int64 getByteBudget() const { return byteBudget; }
+
+    /*
+    * Evicts stored files until the store fits the budget, apart from those in
+    * inUse, and removes stale working files that aren't in inUse. The working
+    * files in inUse are marked as alive, for other instances of HARP.
+    */
+    void evictIfNeeded(const juce::Array<juce::File>& inUse);
+
+    juce::int64 getTotalBytes();
+
+    void setDirectory(const juce::File& directory);
+    juce::File getDirectory() const;
+
+    /*
+    * Clones source to target (replacing it), with the cheapest method the
+    * filesystem supports. Hard links are only made with allowHardLink, as
+    * writing either file in place changes the other one too.
+    */
+    static bool cloneFile(const juce::File& source,
+                          const juce::File& target,
+                          bool allowHardLink,
+                          CloneMethod* methodUsed = nullptr);
+
+private:
+    VersionStore();
+
+    juce::File getObjectsDirectory() const;
+    juce::File getWorkingDirectory() const;
+
+    /*
+    * Working files left behind by a crash, or by processing that was
+    * cancelled. Those in inUse stay, however old: a version whose commit
+    * failed stays a working file in its history.
+    */
+    void removeStaleWorkingFiles(const juce::Array<juce::File>& inUse);
+
+    static juce::int64 getEntrySize(const juce::File& entryDir);
+
+    mutable std::mutex mutex;
+    juce::File storeDirectory;
+    std::atomic<juce::int64> byteBudget { (juce::int64) 2 * 1024 * 1024 * 1024 };
+};
@@ -0,0 +1,529 @@
+#include "WaveformPyramid.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstring>
+
+#include "../ContentHash.h"
+#include "MappedAudioReader.h"
+
+namespace
+{
+const char* const cacheMagic = "HARPPEAK";
+const int cacheVersion = 1;
+const int maxCachedPyramids = 200;
+
+// More than any audio file has, anything above is a damaged cache file
+const int maxCachedChannels = 1024;
+
+// Below this, splitting the file between threads costs more than it saves
+const juce::int64 minBlocksPerChunk = 4096;
+
+// Enough for a full screen of waveform, small enough to rebuild 4 times a second
+const juce::int64 maxPartialBlocks = 16384;
+
+// Summarises blocks [startBlock, endBlock) of level 0 with its own reader
+bool summariseChunk(const juce::File& file,
+                    juce::AudioFormatManager& formatManager,
+                    juce::int64 startBlock,
+                    juce::int64 endBlock,
+                    juce::int64 lengthInSamples,
+                    int numChannels,
+                    std::vector<WaveformPyramid::Peak>& peaks,
+                    std::atomic<juce::int64>& numScanned,
+                    const std::function<bool()>& shouldAbort)
+{
+    // Mapped readers of the same file share its pages with each other and with playback
+    auto reader = MappedAudioReader::create(formatManager, file);
+    if (reader == nullptr)
+        return false;
+
+    const int blocksPerRead = 1024;
+    juce::AudioBuffer<float> buffer(numChannels, blocksPerRead * WaveformPyramid::baseBlockSize);
+
+    for (juce::int64 block = startBlock; block < endBlock; block += blocksPerRead)
+    {
+        if (shouldAbort())
+            return false;
+
+        juce::int64 numBlocks = juce::jmin((juce::int64) blocksPerRead, endBlock - block);
+        juce::int64 startSample = block * WaveformPyramid::baseBlockSize;
+        int numSamples = (int) juce::jmin(numBlocks * WaveformPyramid::baseBlockSize,
+                                          lengthInSamples - startSample);
+        reader->read(&buffer, 0, numSamples, startSample, true, true);
+
+        for (int channel = 0; channel < numChannels; ++channel)
+        {
+            const float* samples = buffer.getReadPointer(channel);
+            for (juce::int64 i = 0; i < numBlocks; ++i)
+            {
+                int offset = (int) i * WaveformPyramid::baseBlockSize;
+                int length = juce::jmin(WaveformPyramid::baseBlockSize, numSamples - offset);
+
+                WaveformPyramid::Peak peak;
+                if (length > 0)
+                {
+                    auto range = juce::FloatVectorOperations::findMinAndMax(samples + offset,
+                                                                            length);
+                    double sumOfSquares = 0.0;
+                    for (int s = 0; s < length; ++s)
+                        sumOfSquares += (double) samples[offset + s] * samples[offset + s];
+
+                    peak.min = range.getStart();
+                    peak.max = range.getEnd();
+                    peak.rms = (float) std::sqrt(sumOfSquares / length);
+                }
+                peaks[(size_t) ((block + i) * numChannels + channel)] = peak;
+            }
+        }
+        // Publishes the peaks above to makePartial
+        numScanned.store(block + numBlocks - startBlock, std::memory_order_release);
+    }
+    return true;
+}
+} // namespace
+
+std::shared_ptr<const WaveformPyramid>
+    WaveformPyramid::loadOrBuild(const juce::File& file,
+                                 juce::AudioFormatManager& formatManager,
+                                 const std::function<bool()>& shouldAbort,
+                                 const PartialCallback& onPartial)
+{
+    // Reopening a file, or loading a version that was shown before, doesn't
+    // have to hash or decode it at all
+    juce::File indexFile = getIndexFile(file);
+    uint64_t indexedHash = 0;
+    if (readIndex(indexFile, indexedHash))
+    {
+        juce::File cacheFile = getCacheFile(indexedHash);
+        if (auto cached = readFrom(cacheFile, indexedHash))
+        {
+            cacheFile.setLastModificationTime(juce::Time::getCurrentTime());
+            indexFile.setLastModificationTime(juce::Time::getCurrentTime());
+            return std::shared_ptr<const WaveformPyramid>(std::move(cached));
+        }
+    }
+
+    uint64_t hash = 0;
+    bool hashed = false;
+    juce::File cacheFile;
+    std::unique_ptr<WaveformPyramid> cached;
+    std::atomic<bool> cacheHit { false };
+    juce::WaitableEvent hasherDone;
+
+    // Hashing a long file takes about as long as reading it, so the build
+    // starts right away and is abandoned if the pyramid turns out to be cached.
+    // Queued ahead of the build's chunks, so that it starts first
+    getWorkerPool().addJob(
+        [&]
+        {
+            hashed = ContentHash::hashFile(file, hash);
+            if (hashed)
+            {
+                cacheFile = getCacheFile(hash);
+                cached = readFrom(cacheFile, hash);
+                cacheHit = cached != nullptr;
+            }
+            hasherDone.signal();
+        });
+
+    auto pyramid =
+        build(file, formatManager, [&] { return cacheHit || shouldAbort(); }, onPartial);
+    hasherDone.wait();
+
+    if (cached != nullptr)
+    {
+        cacheFile.setLastModificationTime(juce::Time::getCurrentTime());
+        writeIndex(indexFile, hash);
+        return std::shared_ptr<const WaveformPyramid>(std::move(cached));
+    }
+
+    if (pyramid == nullptr || ! hashed)
+        return nullptr;
+
+    pyramid->contentHash = hash;
+    if (pyramid->writeTo(cacheFile))
+    {
+        writeIndex(indexFile, hash);
+        pruneCache(maxCachedPyramids);
+    }
+    return std::shared_ptr<const WaveformPyramid>(std::move(pyramid));
+}
+
+juce::ThreadPool& WaveformPyramid::getWorkerPool()
+{
+    static juce::ThreadPool pool(juce::jmax(1, juce::SystemStats::getNumCpus() - 1));
+    return pool;
+}
+
+std::unique_ptr<WaveformPyramid> WaveformPyramid::build(const juce::File& file,
+                                                        juce::AudioFormatManager& formatManager,
+                                                        const std::function<bool()>& shouldAbort,
+                                                        const PartialCallback& onPartial)
+{
+    auto reader = MappedAudioReader::create(formatManager, file);
+    if (reader == nullptr || reader->lengthInSamples <= 0)
+        return nullptr;
+
+    auto pyramid = std::make_unique<WaveformPyramid>();
+    pyramid->sampleRate = reader->sampleRate;
+    pyramid->numChannels = (int) reader->numChannels;
+    pyramid->lengthInSamples = reader->lengthInSamples;
+    reader.reset();
+
+    Level base;
+    base.blockSize = baseBlockSize;
+    base.numBlocks = (pyramid->lengthInSamples + baseBlockSize - 1) / baseBlockSize;
+    base.peaks.resize((size_t) (base.numBlocks * pyramid->numChannels));
+
+    // Every chunk writes its own range of the base level
+    juce::int64 numChunks = juce::jlimit((juce::int64) 1,
+                                         (juce::int64) getWorkerPool().getNumThreads(),
+                                         base.numBlocks / minBlocksPerChunk);
+    juce::int64 blocksPerChunk = (base.numBlocks + numChunks - 1) / numChunks;
+
+    std::vector<juce::int64> chunkStarts;
+    std::vector<std::atomic<juce::int64>> numScanned((size_t) numChunks);
+    std::atomic<juce::int64> numRunning { numChunks };
+    juce::WaitableEvent allScanned;
+
+    std::atomic<bool> failed { false };
+    auto abortOrFailed = [&] { return failed.load() || shouldAbort(); };
+    for (juce::int64 chunk = 0; chunk < numChunks; ++chunk)
+    {
+        juce::int64 startBlock = chunk * blocksPerChunk;
+        juce::int64 endBlock = juce::jmin(base.numBlocks, startBlock + blocksPerChunk);
+        chunkStarts.push_back(startBlock);
+        // Refers to the locals of this function, which waits for every chunk below
+        getWorkerPool().addJob(
+            [&, chunk, startBlock, endBlock]
+            {
+                if (! summariseChunk(file,
+                                     formatManager,
+                                     startBlock,
+                                     endBlock,
+                                     pyramid->lengthInSamples,
+                                     pyramid->numChannels,
+                                     base.peaks,
+                                     numScanned[(size_t) chunk],
+                                     abortOrFailed))
+                    failed = true;
+                if (--numRunning == 0)
+                    allScanned.signal();
+            });
+    }
+
+    while (! allScanned.wait(partialIntervalMs))
+    {
+        if (onPartial == nullptr || abortOrFailed())
+            continue;
+
+        std::vector<juce::int64> scannedSoFar;
+        for (const auto& count : numScanned)
+            scannedSoFar.push_back(count.load(std::memory_order_acquire));
+        onPartial(pyramid->makePartial(base, chunkStarts, scannedSoFar));
+    }
+
+    if (failed)
+        return nullptr;
+
+    pyramid->levels.push_back(std::move(base));
+    pyramid->buildCoarserLevels();
+    return pyramid;
+}
+
+std::shared_ptr<const WaveformPyramid>
+    WaveformPyramid::makePartial(const Level& base,
+                                 const std::vector<juce::int64>& chunkStarts,
+                                 const std::vector<juce::int64>& numScanned) const
+{
+    auto partial = std::make_shared<WaveformPyramid>();
+    partial->sampleRate = sampleRate;
+    partial->numChannels = numChannels;
+    partial->lengthInSamples = lengthInSamples;
+
+    juce::int64 factor = 1;
+    while ((base.numBlocks + factor - 1) / factor > maxPartialBlocks)
+        factor *= levelFactor;
+
+    Level coarse;
+    coarse.blockSize = base.blockSize * factor;
+    coarse.numBlocks = (base.numBlocks + factor - 1) / factor;
+    coarse.peaks.resize((size_t) (coarse.numBlocks * numChannels));
+    std::vector<double> sumsOfSquares(coarse.peaks.size(), 0.0);
+    std::vector<bool> hasPeaks(coarse.peaks.size(), false);
+
+    for (size_t chunk = 0; chunk < chunkStarts.size(); ++chunk)
+    {
+        juce::int64 endBlock = chunkStarts[chunk] + numScanned[chunk];
+        for (juce::int64 block = chunkStarts[chunk]; block < endBlock; ++block)
+        {
+            for (int channel = 0; channel < numChannels; ++channel)
+            {
+                size_t index = (size_t) ((block / factor) * numChannels + channel);
+                const Peak& peak = base.peaks[(size_t) (block * numChannels + channel)];
+                Peak& merged = coarse.peaks[index];
+                merged.min = hasPeaks[index] ? juce::jmin(merged.min, peak.min) : peak.min;
+                merged.max = hasPeaks[index] ? juce::jmax(merged.max, peak.max) : peak.max;
+                hasPeaks[index] = true;
+                sumsOfSquares[index] += (double) peak.rms * peak.rms;
+            }
+        }
+    }
+
+    // The blocks that weren't scanned yet count as silence
+    for (juce::int64 block = 0; block < coarse.numBlocks; ++block)
+    {
+        juce::int64 numBaseBlocks = juce::jmin(factor, base.numBlocks - block * factor);
+        for (int channel = 0; channel < numChannels; ++channel)
+        {
+            size_t index = (size_t) (block * numChannels + channel);
+            coarse.peaks[index].rms =
+                (float) std::sqrt(sumsOfSquares[index] / (double) numBaseBlocks);
+        }
+    }
+
+    partial->levels.push_back(std::move(coarse));
+    partial->buildCoarserLevels();
+    return partial;
+}
+
+void WaveformPyramid::buildCoarserLevels()
+{
+    while (levels.back().numBlocks > 1)
+    {
+        const Level& finer = levels.back();
+        Level coarser;
+        coarser.blockSize = finer.blockSize * levelFactor;
+        coarser.numBlocks = (finer.numBlocks + levelFactor - 1) / levelFactor;
+        coarser.peaks.resize((size_t) (coarser.numBlocks * numChannels));
+
+        for (juce::int64 block = 0; block < coarser.numBlocks; ++block)
+        {
+            juce::int64 start = block * levelFactor;
+            juce::int64 end = juce::jmin(finer.numBlocks, start + levelFactor);
+            for (int channel = 0; channel < numChannels; ++channel)
+                coarser.peaks[(size_t) (block * numChannels + channel)] =
+                    getPeak(finer, channel, start, end);
+        }
+        levels.push_back(std::move(coarser));
+    }
+}
+
+WaveformPyramid::Peak WaveformPyramid::getPeak(const Level& level,
+                                               int channel,
+                                               juce::int64 startBlock,
+                                               juce::int64 endBlock) const
+{
+    Peak merged = level.peaks[(size_t) (startBlock * numChannels + channel)];
+    double sumOfSquares = (double) merged.rms * merged.rms;
+    for (juce::int64 block = startBlock + 1; block < endBlock; ++block)
+    {
+        const Peak& peak = level.peaks[(size_t) (block * numChannels + channel)];
+        merged.min = juce::jmin(merged.min, peak.min);
+        merged.max = juce::jmax(merged.max, peak.max);
+        sumOfSquares += (double) peak.rms * peak.rms;
+    }
+    // The blocks have the same length, apart from the very last one
+    merged.rms = (float) std::sqrt(sumOfSquares / (double) (endBlock - startBlock));
+    return merged;
+}
+
+double WaveformPyramid::getLengthInSeconds() const
+{
+    return sampleRate > 0.0 ? (double) lengthInSamples / sampleRate : 0.0;
+}
+
+void WaveformPyramid::draw(juce::Graphics& g,
+                           juce::Rectangle<int> area,
+                           double startTime,
+                           double endTime,
+                           juce::Colour colour) const
+{
+    if (levels.empty() || area.isEmpty() || endTime <= startTime)
+        return;
+
+    double samplesPerPixel = (endTime - startTime) * sampleRate / area.getWidth();
+
+    // The coarsest level with at least one block per pixel
+    size_t levelIndex = 0;
+    while (levelIndex + 1 < levels.size() && levels[levelIndex + 1].blockSize <= samplesPerPixel)
+        levelIndex++;
+    const Level& level = levels[levelIndex];
+
+    float channelHeight = (float) area.getHeight() / (float) numChannels;
+    for (int channel = 0; channel < numChannels; ++channel)
+    {
+        float top = (float) area.getY() + channel * channelHeight;
+        float centreY = top + channelHeight * 0.5f;
+        float halfHeight = channelHeight * 0.5f;
+
+        for (int x = 0; x < area.getWidth(); ++x)
+        {
+            double startSample = startTime * sampleRate + x * samplesPerPixel;
+            juce::int64 startBlock = (juce::int64) std::floor(startSample / level.blockSize);
+            juce::int64 endBlock =
+                (juce::int64) std::ceil((startSample + samplesPerPixel) / level.blockSize);
+            startBlock = juce::jmax((juce::int64) 0, startBlock);
+            endBlock = juce::jmin(level.numBlocks, juce::jmax(startBlock + 1, endBlock));
+            if (startBlock >= level.numBlocks)
+                break;
+
+            Peak peak = getPeak(level, channel, startBlock, endBlock);
+            float maxY = centreY - juce::jlimit(-1.0f, 1.0f, peak.max) * halfHeight;
+            float minY = centreY - juce::jlimit(-1.0f, 1.0f, peak.min) * halfHeight;
+            float rms = juce::jmin(1.0f, peak.rms) * halfHeight;
+            float px = (float) (area.getX() + x);
+
+            g.setColour(colour.withMultipliedAlpha(0.6f));
+            g.fillRect(px, maxY, 1.0f, juce::jmax(1.0f, minY - maxY));
+            g.setColour(colour);
+            g.fillRect(px,
+                       juce::jmax(maxY, centreY - rms),
+                       1.0f,
+                       juce::jmin(minY, centreY + rms) - juce::jmax(maxY, centreY - rms));
+        }
+    }
+}
+
+juce::File WaveformPyramid::getCacheDirectory()
+{
+    return juce::File::getSpecialLocation(juce::File::userDocumentsDirectory)
+        .getChildFile("HARP")
+        .getChildFile(".peaks");
+}
+
+juce::File WaveformPyramid::getCacheFile(uint64_t hash)
+{
+    return getCacheDirectory().getChildFile(ContentHash::toString(hash) + ".peaks");
+}
+
+juce::File WaveformPyramid::getIndexFile(const juce::File& file)
+{
+    juce::String key = file.getFullPathName() + "|" + juce::String(file.getSize()) + "|"
+                       + juce::String(file.getLastModificationTime().toMilliseconds());
+    return getCacheDirectory().getChildFile(ContentHash::toString(ContentHash::hashString(key))
+                                            + ".key");
+}
+
+bool WaveformPyramid::readIndex(const juce::File& indexFile, uint64_t& hash)
+{
+    juce::FileInputStream in(indexFile);
+    if (! in.openedOk() || in.getTotalLength() != (juce::int64) sizeof(juce::int64))
+        return false;
+
+    hash = (uint64_t) in.readInt64();
+    return true;
+}
+
+void WaveformPyramid::writeIndex(const juce::File& indexFile, uint64_t hash)
+{
+    if (! indexFile.getParentDirectory().createDirectory())
+        return;
+
+    juce::TemporaryFile tempFile(indexFile);
+    {
+        juce::FileOutputStream out(tempFile.getFile());
+        if (! out.openedOk() || ! out.writeInt64((juce::int64) hash))
+            return;
+    }
+    tempFile.overwriteTargetFileWithTemporary();
+}
+
+bool WaveformPyramid::writeTo(const juce::File& cacheFile) const
+{
+    if (! cacheFile.getParentDirectory().createDirectory())
+        return false;
+
+    // Readers never see a half written pyramid
+    juce::TemporaryFile tempFile(cacheFile);
+    {
+        juce::FileOutputStream out(tempFile.getFile());
+        if (! out.openedOk())
+            return false;
+
+        out.write(cacheMagic, 8);
+        out.writeInt(cacheVersion);
+        out.writeInt64((juce::int64) contentHash);
+        out.writeDouble(sampleRate);
+        out.writeInt(numChannels);
+        out.writeInt64(lengthInSamples);
+        out.writeInt((int) levels.size());
+        for (const auto& level : levels)
+        {
+            out.writeInt64(level.blockSize);
+            out.writeInt64(level.numBlocks);
+            out.write(level.peaks.data(), level.peaks.size() * sizeof(Peak));
+        }
+        out.flush();
+        if (out.getStatus().failed())
+            return false;
+    }
+    return tempFile.overwriteTargetFileWithTemporary();
+}
+
+std::unique_ptr<WaveformPyramid> WaveformPyramid::readFrom(const juce::File& cacheFile,
+                                                           uint64_t expectedHash)
+{
+    juce::FileInputStream in(cacheFile);
+    if (! in.openedOk())
+        return nullptr;
+
+    char magic[8] = {};
+    if (in.read(magic, 8) != 8 || std::memcmp(magic, cacheMagic, 8) != 0
+        || in.readInt() != cacheVersion || (uint64_t) in.readInt64() != expectedHash)
+        return nullptr;
+
+    auto pyramid = std::make_unique<WaveformPyramid>();
+    pyramid->contentHash = expectedHash;
+    pyramid->sampleRate = in.readDouble();
+    pyramid->numChannels = in.readInt();
+    pyramid->lengthInSamples = in.readInt64();
+    int numLevels = in.readInt();
+    if (! (pyramid->sampleRate > 0.0) || pyramid->numChannels <= 0
+        || pyramid->numChannels > maxCachedChannels || pyramid->lengthInSamples <= 0
+        || numLevels <= 0 || numLevels > 64)
+        return nullptr;
+
+    const juce::int64 bytesPerBlock = pyramid->numChannels * (juce::int64) sizeof(Peak);
+    for (int i = 0; i < numLevels; ++i)
+    {
+        Level level;
+        level.blockSize = in.readInt64();
+        level.numBlocks = in.readInt64();
+
+        // Damaged, or cut short. Checked before allocating anything, and
+        // without multiplying numBlocks, which could overflow
+        juce::int64 maxBlocks =
+            juce::jmin(in.getNumBytesRemaining(), (juce::int64) INT_MAX) / bytesPerBlock;
+        if (level.blockSize <= 0 || level.numBlocks <= 0 || level.numBlocks > maxBlocks
+            || level.numBlocks != (pyramid->lengthInSamples - 1) / level.blockSize + 1)
+            return nullptr;
+
+        int numBytes = (int) (level.numBlocks * bytesPerBlock);
+        level.peaks.resize((size_t) (level.numBlocks * pyramid->numChannels));
+        if (in.read(level.peaks.data(), numBytes) != numBytes)
+            return nullptr;
+        pyramid->levels.push_back(std::move(level));
+    }
+    return pyramid;
+}
+
+void WaveformPyramid::pruneCache(int maxFiles)
+{
+    // An index entry whose pyramid was pruned is just a miss
+    for (const char* pattern : { "*.peaks", "*.key" })
+    {
+        auto files = getCacheDirectory().findChildFiles(juce::File::findFiles, false, pattern);
+        if (files.size() <= maxFiles)
+            continue;
+
+        std::sort(files.begin(),
+                  files.end(),
+                  [](const juce::File& a, const juce::File& b)
+                  { return a.getLastModificationTime() < b.getLastModificationTime(); });
+        for (int i = 0; i < files.size() - maxFiles; ++i)
+            files.getReference(i).deleteFile();
+    }
+}
@@ -0,0 +1,130 @@
+/**
+ * @file
+ * @brief A multi-resolution min/max/RMS summary of an audio file, cached on
+ * disk by content hash, so that the waveform of a file that was seen before
+ * is drawn without decoding it again
+ */
+
+#pragma once
+
+#include <functional>
+#include <memory>
+#include <vector>
+
+#include <juce_audio_formats/juce_audio_formats.h>
+#include <juce_gui_basics/juce_gui_basics.h>
+
+/*
+* Level 0 holds the min, max and RMS of every block of baseBlockSize samples
+* of every channel; each next level summarises levelFactor blocks of the one
+* before. Drawing picks the coarsest level that still has at least one block
+* per pixel, so it costs O(visible pixels) at any zoom.
+*/
+class WaveformPyramid
+{
+public:
+    static constexpr int baseBlockSize = 256;
+    static constexpr int levelFactor = 4;
+
+    struct Peak
+    {
+        float min = 0.0f;
+        float max = 0.0f;
+        float rms = 0.0f;
+    };
+
+    /*
+    * Called from the building thread every partialIntervalMs while a pyramid
+    * is being built, with a coarse pyramid of the blocks scanned so far. The
+    * blocks that weren't scanned yet are silent.
+    */
+    using PartialCallback = std::function<void(std::shared_ptr<const WaveformPyramid>)>;
+    static constexpr int partialIntervalMs = 250;
+
+    /*
+    * The pyramid of file, read from the cache if a file with the same content
+    * was summarised before, or built (in parallel chunks, see getWorkerPool)
+    * and cached.
+    * A file seen before at the same path, size and modification time is found
+    * without reading it, see getIndexFile. Any other file is hashed while it's
+    * being built, so that its partial pyramids don't wait for the hash.
+    * Returns nullptr if the file can't be read or shouldAbort returned true.
+    * Call from a background thread.
+    */
+    static std::shared_ptr<const WaveformPyramid>
+        loadOrBuild(const juce::File& file,
+                    juce::AudioFormatManager& formatManager,
+                    const std::function<bool()>& shouldAbort,
+                    const PartialCallback& onPartial = nullptr);
+
+    static std::unique_ptr<WaveformPyramid> build(const juce::File& file,
+                                                  juce::AudioFormatManager& formatManager,
+                                                  const std::function<bool()>& shouldAbort,
+                                                  const PartialCallback& onPartial = nullptr);
+
+    // Draws the channels stacked on top of each other, like AudioThumbnail::drawChannels
+    void draw(juce::Graphics& g,
+              juce::Rectangle<int> area,
+              double startTime,
+              double endTime,
+              juce::Colour colour) const;
+
+    double getLengthInSeconds() const;
+    int getNumChannels() const { return numChannels; }
+
+    // Documents/HARP/.peaks, next to the temp files of MediaDisplayComponent
+    static juce::File getCacheDirectory();
+
+private:
+    /*
+    * The threads that hash files and summarise chunks, shared by all the
+    * pyramids being built, so that loading several files at once doesn't
+    * start a set of threads for each of them
+    */
+    static juce::ThreadPool& getWorkerPool();
+
+    struct Level
+    {
+        juce::int64 blockSize = 0;
+        juce::int64 numBlocks = 0;
+        // numBlocks * numChannels, block by block
+        std::vector<Peak> peaks;
+    };
+
+    void buildCoarserLevels();
+
+    /*
+    * A pyramid of at most maxPartialBlocks blocks per channel, from the first
+    * numScanned[i] blocks after chunkStarts[i] of the base level
+    */
+    std::shared_ptr<const WaveformPyramid>
+        makePartial(const Level& base,
+                    const std::vector<juce::int64>& chunkStarts,
+                    const std::vector<juce::int64>& numScanned) const;
+
+    // Merges the peaks of blocks [startBlock, endBlock) of a channel
+    Peak getPeak(const Level& level,
+                 int channel,
+                 juce::int64 startBlock,
+                 juce::int64 endBlock) const;
+
+    bool writeTo(const juce::File& cacheFile) const;
+    static std::unique_ptr<WaveformPyramid> readFrom(const juce::File& cacheFile,
+                                                     uint64_t expectedHash);
+
+    static juce::File getCacheFile(uint64_t contentHash);
+
+    // Holds the content hash of file, keyed by its path, size and modification time
+    static juce::File getIndexFile(const juce::File& file);
+    static bool readIndex(const juce::File& indexFile, uint64_t& contentHash);
+    static void writeIndex(const juce::File& indexFile, uint64_t contentHash);
+
+    // Keeps the cache from growing forever, the least recently used go first
+    static void pruneCache(int maxFiles);
+
+    uint64_t contentHash = 0;
+    double sampleRate = 0.0;
+    int numChannels = 0;
+    juce::int64 lengthInSamples = 0;
+    std::vector<Level> levels;
+};
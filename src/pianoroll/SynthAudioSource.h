@@ -1,5 +1,10 @@
 #include <juce_audio_basics/juce_audio_basics.h>
 
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <vector>
+
 struct SineWaveSound : public juce::SynthesiserSound
 {
     SineWaveSound() {}
@@ -22,14 +27,18 @@ struct SineWaveVoice : public juce::SynthesiserVoice
                    juce::SynthesiserSound*,
                    int /*currentPitchWheelPosition*/) override
     {
-        currentAngle = 0.0;
+        phase = 0.0;
         level = velocity * 0.15;
         tailOff = 0.0;
 
         auto cyclesPerSecond = juce::MidiMessage::getMidiNoteInHertz(midiNoteNumber);
-        auto cyclesPerSample = cyclesPerSecond / getSampleRate();
+        auto cyclesPerSample =
+            getSampleRate() > 0.0 ? cyclesPerSecond / getSampleRate() : 0.0;
 
-        angleDelta = cyclesPerSample * 2.0 * juce::MathConstants<double>::pi;
+        // Notes above Nyquist can't be played anyway. Below it, phaseDelta is
+        // less than half the table, so a single wrap in renderNextBlock keeps
+        // phase inside the table
+        phaseDelta = juce::jmin(cyclesPerSample, 0.49) * tableSize;
     }
 
     void stopNote(float /*velocity*/, bool allowTailOff) override
@@ -42,7 +51,7 @@ struct SineWaveVoice : public juce::SynthesiserVoice
         else
         {
             clearCurrentNote();
-            angleDelta = 0.0;
+            phaseDelta = 0.0;
         }
     }
 
@@ -53,49 +62,90 @@ struct SineWaveVoice : public juce::SynthesiserVoice
                          int startSample,
                          int numSamples) override
     {
-        if (angleDelta != 0.0)
+        if (phaseDelta == 0.0)
+            return;
+
+        const float* table = getSineTable().data();
+
+        // Rendered into chunk first, then mixed into every channel at once
+        while (numSamples > 0)
         {
-            if (tailOff > 0.0) // [7]
+            int numToRender = juce::jmin(numSamples, chunkSize);
+            bool finished = false;
+
+            for (int i = 0; i < numToRender; ++i)
             {
-                while (--numSamples >= 0)
-                {
-                    auto currentSample = (float) (std::sin(currentAngle) * level * tailOff);
+                int index = (int) phase;
+                float fraction = (float) (phase - index);
+                chunk[i] = table[index] + fraction * (table[index + 1] - table[index]);
 
-                    for (auto i = outputBuffer.getNumChannels(); --i >= 0;)
-                        outputBuffer.addSample(i, startSample, currentSample);
+                phase += phaseDelta;
+                if (phase >= tableSize) // phaseDelta < tableSize, see startNote
+                    phase -= tableSize;
+            }
 
-                    currentAngle += angleDelta;
-                    ++startSample;
+            if (tailOff > 0.0) // [7]
+            {
+                for (int i = 0; i < numToRender; ++i)
+                {
+                    chunk[i] *= (float) (level * tailOff);
 
                     tailOff *= 0.99; // [8]
 
                     if (tailOff <= 0.005)
                     {
-                        clearCurrentNote(); // [9]
-
-                        angleDelta = 0.0;
+                        numToRender = i + 1;
+                        finished = true;
                         break;
                     }
                 }
             }
             else
             {
-                while (--numSamples >= 0) // [6]
-                {
-                    auto currentSample = (float) (std::sin(currentAngle) * level);
+                juce::FloatVectorOperations::multiply(chunk, (float) level, numToRender); // [6]
+            }
 
-                    for (auto i = outputBuffer.getNumChannels(); --i >= 0;)
-                        outputBuffer.addSample(i, startSample, currentSample);
+            for (auto i = outputBuffer.getNumChannels(); --i >= 0;)
+                juce::FloatVectorOperations::add(
+                    outputBuffer.getWritePointer(i, startSample), chunk, numToRender);
 
-                    currentAngle += angleDelta;
-                    ++startSample;
-                }
+            if (finished)
+            {
+                clearCurrentNote(); // [9]
+
+                phaseDelta = 0.0;
+                return;
             }
+
+            startSample += numToRender;
+            numSamples -= numToRender;
         }
     }
 
 private:
-    double currentAngle = 0.0, angleDelta = 0.0, level = 0.0, tailOff = 0.0;
+    static constexpr int tableSize = 2048;
+    static constexpr int chunkSize = 64;
+
+    // One cycle of a sine, shared by all voices, with the first sample
+    // repeated at the end so that interpolation never wraps
+    static const std::array<float, tableSize + 1>& getSineTable()
+    {
+        static const auto table = []
+        {
+            std::array<float, tableSize + 1> t;
+            for (int i = 0; i <= tableSize; ++i)
+                t[(size_t) i] =
+                    (float) std::sin(juce::MathConstants<double>::twoPi * i / tableSize);
+            return t;
+        }();
+        return table;
+    }
+
+    // In table samples
+    double phase = 0.0, phaseDelta = 0.0;
+    double level = 0.0, tailOff = 0.0;
+
+    float chunk[chunkSize];
 };
 
 class SynthAudioSource : public juce::PositionableAudioSource
@@ -113,8 +163,13 @@ public:
         DBG("Sample rate being set to " << sampleRate);
         DBG("Samples per block being set to " << samplesPerBlockExpected);
         synth.setCurrentPlaybackSampleRate(sampleRate); // [3]
-        mySampleRate = sampleRate;
         samplesPerBlock = samplesPerBlockExpected;
+
+        if (sampleRate != mySampleRate)
+        {
+            mySampleRate = sampleRate;
+            rebuildSchedule();
+        }
     }
 
     void releaseResources() override {}
@@ -155,31 +210,44 @@ public:
 
         synth.clearVoices();
 
+        // Dense files can ask for hundreds. Past this the oldest notes are
+        // stolen, which a preview can afford
+        maxVoices = juce::jmin(maxVoices, maxNumVoices);
+
         for (auto i = 0; i < maxVoices; ++i) // [1]
             synth.addVoice(new SineWaveVoice());
+
+        rebuildSchedule();
     }
 
     void getNextAudioBlock(const juce::AudioSourceChannelInfo& bufferToFill) override
     {
         bufferToFill.clearActiveBufferRegion();
 
-        juce::MidiBuffer incomingMidi;
-
-        int lastSample = readPosition + samplesPerBlock;
+        int64 blockEnd = readPosition + bufferToFill.numSamples;
 
-        for (int eventIdx = 0; eventIdx < sequence.getNumEvents(); ++eventIdx)
+        // The schedule is being replaced, this block stays silent
+        const juce::SpinLock::ScopedTryLockType lock(scheduleLock);
+        if (! lock.isLocked())
         {
-            const auto midiEvent = sequence.getEventPointer(eventIdx);
-            const auto& midiMessage = midiEvent->message;
+            readPosition = blockEnd;
+            return;
+        }
 
-            int startTimeSamples = secondsToSamples(midiEvent->message.getTimeStamp());
+        juce::MidiBuffer incomingMidi;
 
-            if (startTimeSamples >= readPosition && startTimeSamples <= lastSample)
-            {
-                incomingMidi.addEvent(midiMessage, startTimeSamples - readPosition);
+        // Only the events of this block are visited
+        while (nextEvent < schedule.size() && schedule[nextEvent].sample < blockEnd)
+        {
+            const auto& event = schedule[nextEvent];
 
-                // DBG("Event " << eventIdx << " at " << startTimeSamples << ": " << midiMessage.getDescription());
-            }
+            // Synthesiser reads the positions in the coordinates of the buffer
+            if (event.sample >= readPosition)
+                incomingMidi.addEvent(event.message,
+                                      bufferToFill.startSample
+                                          + (int) (event.sample - readPosition));
+
+            ++nextEvent;
         }
 
         synth.renderNextBlock(*bufferToFill.buffer,
@@ -187,10 +255,16 @@ public:
                               bufferToFill.startSample,
                               bufferToFill.numSamples); // [5]
 
-        readPosition += samplesPerBlock;
+        readPosition = blockEnd;
     }
 
-    void setNextReadPosition(int64 newPosition) override { readPosition = newPosition; }
+    void setNextReadPosition(int64 newPosition) override
+    {
+        const juce::SpinLock::ScopedLockType lock(scheduleLock);
+
+        readPosition = newPosition;
+        nextEvent = findFirstEventAtOrAfter(newPosition);
+    }
 
     int64 getNextReadPosition() const override { return readPosition; }
 
@@ -214,15 +288,68 @@ public:
     void resetNotes() { synth.allNotesOff(0, false); }
 
 private:
+    struct ScheduledEvent
+    {
+        int64 sample;
+        juce::MidiMessage message;
+    };
+
+    // Converts the timestamps of the sequence to samples once, instead of on every block
+    void rebuildSchedule()
+    {
+        std::vector<ScheduledEvent> newSchedule;
+        newSchedule.reserve((size_t) sequence.getNumEvents());
+
+        for (int eventIdx = 0; eventIdx < sequence.getNumEvents(); ++eventIdx)
+        {
+            const auto& midiMessage = sequence.getEventPointer(eventIdx)->message;
+            newSchedule.push_back({ secondsToSamples(midiMessage.getTimeStamp()), midiMessage });
+        }
+
+        // The sequence is sorted already, but the cursor relies on it
+        std::stable_sort(newSchedule.begin(),
+                         newSchedule.end(),
+                         [](const ScheduledEvent& a, const ScheduledEvent& b)
+                         { return a.sample < b.sample; });
+
+        const juce::SpinLock::ScopedLockType lock(scheduleLock);
+
+        schedule.swap(newSchedule);
+        nextEvent = findFirstEventAtOrAfter(readPosition);
+    }
+
+    size_t findFirstEventAtOrAfter(int64 position) const
+    {
+        auto it = std::lower_bound(schedule.begin(),
+                                   schedule.end(),
+                                   position,
+                                   [](const ScheduledEvent& event, int64 p)
+                                   { return event.sample < p; });
+
+        return (size_t) (it - schedule.begin());
+    }
+
+    static constexpr int maxNumVoices = 128;
+
     juce::Synthesiser synth;
     juce::MidiMessageSequence sequence;
 
-    double mySampleRate;
-    int samplesPerBlock;
+    // The events of sequence in samples, in order, and the next one to play
+    std::vector<ScheduledEvent> schedule;
+    size_t nextEvent = 0;
+
+    // Guards schedule and nextEvent. The audio thread only tries it
+    juce::SpinLock scheduleLock;
 
-    double lastStartTime;
+    double mySampleRate = 44100.0;
+    int samplesPerBlock = 0;
 
-    int64 readPosition;
+    double lastStartTime = 0.0;
 
-    int secondsToSamples(double secondsTime) const { return (int) (secondsTime * mySampleRate); }
+    int64 readPosition = 0;
+
+    int64 secondsToSamples(double secondsTime) const
+    {
+        return (int64) (secondsTime * mySampleRate);
+    }
 };
@@ -23,7 +23,10 @@ enum ModelStatus
     CANCELLED,
     CANCELLING,
 
-    ERROR
+    ERROR,
+
+    // After ERROR, so that the values of the statuses above stay the same
+    DOWNLOADING
 };
 
 struct Ctrl